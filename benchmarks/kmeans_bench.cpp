@@ -0,0 +1,518 @@
+// kmeans_bench
+//
+// Standalone benchmark of kernels of src/ and of the Lloyd driver, without Python.
+// Every kernel is run over the cartesian product of the requested problem sizes,
+// data types and window parameters, and timed with SYCL event profiling.
+// The driver is timed with the host clock, since it synchronizes by design.
+//
+// Unless --roofline off is given, peak bandwidth and throughput of the device are
+// measured first, and kernels with an analytic model (src/performance_model.hpp)
+// are reported along with the lowest time the roofline allows for them.
+//
+// Usage:
+//   kmeans_bench [--device cpu|gpu|default] [--n-samples 100000,1000000]
+//                [--n-features 14] [--n-clusters 127] [--dtype float,double]
+//                [--window-height 8,16] [--work-group-size 128]
+//                [--repetitions 20] [--warmup 3] [--driver-max-iter 20]
+//                [--roofline on|off] [--format csv|json] [--output FILE]
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "util_kernels.hpp"
+#include "compute_euclidean_distance.hpp"
+#include "assignment.hpp"
+#include "compute_inertia.hpp"
+#include "lloyd_single_step.hpp"
+#include "kmeans_lloyd_driver.hpp"
+#include "profiling.hpp"
+#include "performance_model.hpp"
+
+constexpr size_t preferred_work_group_size_multiple = 8;
+constexpr size_t centroids_window_width_multiplier = 4;
+
+constexpr double centroids_private_copies_max_cache_occupancy = 0.7;
+
+struct bench_options {
+    std::string device = "default";
+    std::vector<size_t> n_samples = {100000, 1000000};
+    std::vector<size_t> n_features = {14};
+    std::vector<size_t> n_clusters = {127};
+    std::vector<std::string> dtypes = {"float"};
+    std::vector<size_t> window_heights = {8};
+    std::vector<size_t> work_group_sizes = {128};
+    size_t repetitions = 20;
+    size_t warmup = 3;
+    size_t driver_max_iter = 20;
+    bool roofline = true;
+    std::string format = "csv";
+    std::string output = "";
+};
+
+struct bench_config {
+    std::string dtype;
+    size_t n_samples;
+    size_t n_features;
+    size_t n_clusters;
+    size_t window_height;
+    size_t work_group_size;
+};
+
+struct bench_result {
+    std::string kernel;
+    bench_config config;
+    double median_ns;
+    double p95_ns;
+    kernel_cost cost;
+    double attainable_ns = 0.0;   // 0 when the kernel has no roofline model
+};
+
+static std::vector<size_t> parse_size_list(const std::string &arg) {
+    std::vector<size_t> res;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        res.push_back(std::stoull(item));
+    }
+    return res;
+}
+
+static std::vector<std::string> parse_string_list(const std::string &arg) {
+    std::vector<std::string> res;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        res.push_back(item);
+    }
+    return res;
+}
+
+static bench_options parse_options(int argc, char *argv[]) {
+    bench_options opts;
+    for(int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key == "--help" || key == "-h") {
+            std::cout <<
+                "kmeans_bench [--device cpu|gpu|default] [--n-samples N1,N2,...]\n"
+                "             [--n-features F1,...] [--n-clusters K1,...] [--dtype float,double]\n"
+                "             [--window-height H1,...] [--work-group-size W1,...]\n"
+                "             [--repetitions R] [--warmup W] [--driver-max-iter I]\n"
+                "             [--roofline on|off] [--format csv|json] [--output FILE]\n";
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + key);
+        }
+        std::string value = argv[++i];
+
+        if (key == "--device") { opts.device = value; }
+        else if (key == "--n-samples") { opts.n_samples = parse_size_list(value); }
+        else if (key == "--n-features") { opts.n_features = parse_size_list(value); }
+        else if (key == "--n-clusters") { opts.n_clusters = parse_size_list(value); }
+        else if (key == "--dtype") { opts.dtypes = parse_string_list(value); }
+        else if (key == "--window-height") { opts.window_heights = parse_size_list(value); }
+        else if (key == "--work-group-size") { opts.work_group_sizes = parse_size_list(value); }
+        else if (key == "--repetitions") { opts.repetitions = std::stoull(value); }
+        else if (key == "--warmup") { opts.warmup = std::stoull(value); }
+        else if (key == "--driver-max-iter") { opts.driver_max_iter = std::stoull(value); }
+        else if (key == "--roofline") { opts.roofline = (value != "off"); }
+        else if (key == "--format") { opts.format = value; }
+        else if (key == "--output") { opts.output = value; }
+        else {
+            throw std::invalid_argument("Unknown option " + key);
+        }
+    }
+
+    if (opts.format != "csv" && opts.format != "json") {
+        throw std::invalid_argument("Format must be csv or json");
+    }
+    opts.repetitions = std::max<size_t>(opts.repetitions, 1);
+
+    return opts;
+}
+
+static sycl::queue make_queue(const std::string &device) {
+    sycl::property_list props{sycl::property::queue::in_order(), sycl::property::queue::enable_profiling()};
+    if (device == "cpu") {
+        return sycl::queue(sycl::cpu_selector_v, props);
+    } else if (device == "gpu") {
+        return sycl::queue(sycl::gpu_selector_v, props);
+    }
+    return sycl::queue(sycl::default_selector_v, props);
+}
+
+static double percentile(std::vector<double> sorted_values, double q) {
+    std::sort(sorted_values.begin(), sorted_values.end());
+    size_t idx = static_cast<size_t>(q * (sorted_values.size() - 1) + 0.5);
+    return sorted_values[std::min(idx, sorted_values.size() - 1)];
+}
+
+static std::uint64_t event_duration_ns(const sycl::event &ev) {
+    return ev.get_profiling_info<sycl::info::event_profiling::command_end>() -
+           ev.get_profiling_info<sycl::info::event_profiling::command_start>();
+}
+
+/* Runs `submit` warmup + repetitions times, timing the returned event */
+static bench_result time_kernel(
+    const std::string &name,
+    const bench_config &config,
+    const bench_options &opts,
+    kernel_cost cost,
+    const std::function<sycl::event()> &submit
+) {
+    std::vector<double> times_ns;
+    for(size_t rep = 0; rep < opts.warmup + opts.repetitions; ++rep) {
+        sycl::event ev = submit();
+        ev.wait();
+        if (rep >= opts.warmup) {
+            times_ns.push_back(static_cast<double>(event_duration_ns(ev)));
+        }
+    }
+    return {name, config, percentile(times_ns, 0.5), percentile(times_ns, 0.95), cost};
+}
+
+/* As time_kernel, for a sequence of kernels: `submit` sets its argument to
+   the event of the first one and returns the event of the last one, and
+   runs are timed from the start of the first to the end of the last. */
+static bench_result time_kernel_span(
+    const std::string &name,
+    const bench_config &config,
+    const bench_options &opts,
+    kernel_cost cost,
+    const std::function<sycl::event(sycl::event *)> &submit
+) {
+    std::vector<double> times_ns;
+    for(size_t rep = 0; rep < opts.warmup + opts.repetitions; ++rep) {
+        sycl::event first_ev;
+        sycl::event last_ev = submit(&first_ev);
+        last_ev.wait();
+        if (rep >= opts.warmup) {
+            times_ns.push_back(static_cast<double>(
+                last_ev.get_profiling_info<sycl::info::event_profiling::command_end>() -
+                first_ev.get_profiling_info<sycl::info::event_profiling::command_start>()));
+        }
+    }
+    return {name, config, percentile(times_ns, 0.5), percentile(times_ns, 0.95), cost};
+}
+
+/* As time_kernel, for kernels with a roofline model */
+static bench_result time_modeled_kernel(
+    const std::string &name,
+    const bench_config &config,
+    const bench_options &opts,
+    const kernel_model &model,
+    const device_peaks *peaks,
+    const std::function<sycl::event()> &submit
+) {
+    bench_result res = time_kernel(name, config, opts, model.cost(), submit);
+    if (peaks) {
+        res.attainable_ns = attainable_ns(model, *peaks);
+    }
+    return res;
+}
+
+template <typename dataT>
+void run_config(sycl::queue q, const bench_config &config, const bench_options &opts, const device_peaks *peaks, std::vector<bench_result> &results) {
+    using indT = std::int32_t;
+    constexpr size_t window_n_centroids = preferred_work_group_size_multiple * centroids_window_width_multiplier;
+
+    size_t n_samples = config.n_samples;
+    size_t n_features = config.n_features;
+    size_t n_clusters = config.n_clusters;
+    size_t h = config.window_height;
+    size_t wgs = config.work_group_size;
+
+    std::vector<dataT> host_X_t(n_features * n_samples);
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<dataT> dist(dataT(0), dataT(1));
+    for(auto &v : host_X_t) {
+        v = dist(gen);
+    }
+
+    // first samples are initial centroids
+    std::vector<dataT> host_centroids_t(n_features * n_clusters);
+    for(size_t f = 0; f < n_features; ++f) {
+        for(size_t k = 0; k < n_clusters; ++k) {
+            host_centroids_t[f * n_clusters + k] = host_X_t[f * n_samples + (k % n_samples)];
+        }
+    }
+
+    dataT *X_t = sycl::malloc_device<dataT>(n_features * n_samples, q);
+    dataT *sample_weight = sycl::malloc_device<dataT>(n_samples, q);
+    dataT *centroids_t = sycl::malloc_device<dataT>(n_features * n_clusters, q);
+    dataT *res_centroids_t = sycl::malloc_device<dataT>(n_features * n_clusters, q);
+    dataT *half_l2_norm = sycl::malloc_device<dataT>(n_clusters, q);
+    dataT *cluster_sizes = sycl::malloc_device<dataT>(n_clusters, q);
+    dataT *centroid_shifts = sycl::malloc_device<dataT>(n_clusters, q);
+    dataT *per_sample_inertia = sycl::malloc_device<dataT>(n_samples, q);
+    indT *assignment_id = sycl::malloc_device<indT>(n_samples, q);
+    indT *empty_clusters_list = sycl::malloc_device<indT>(n_clusters + 1, q);
+
+    size_t n_copies =
+        compute_number_of_private_copies<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+            q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, wgs);
+    dataT *centroids_t_private_copies = sycl::malloc_device<dataT>(n_copies * n_features * n_clusters, q);
+    dataT *cluster_sizes_private_copies = sycl::malloc_device<dataT>(n_copies * n_clusters, q);
+
+    // the distance matrix is only benchmarked when it fits in a single allocation
+    size_t max_alloc = q.get_device().get_info<sycl::info::device::max_mem_alloc_size>();
+    bool with_distances = (n_clusters * n_samples * sizeof(dataT) <= max_alloc / 2);
+    dataT *distances_t = (with_distances) ? sycl::malloc_device<dataT>(n_clusters * n_samples, q) : nullptr;
+
+    q.copy<dataT>(host_X_t.data(), X_t, host_X_t.size());
+    q.copy<dataT>(host_centroids_t.data(), centroids_t, host_centroids_t.size());
+    q.fill<dataT>(sample_weight, dataT(1), n_samples);
+    q.fill<dataT>(cluster_sizes, dataT(1), n_clusters);
+    q.wait();
+
+    results.push_back(time_kernel(
+        "half_l2_norm", config, opts, lloyd_kernel_costs::half_l2_norm<dataT>(n_features, n_clusters),
+        [&]() { return half_l2_norm_kernel<dataT>(q, n_features, n_clusters, wgs, centroids_t, half_l2_norm); }));
+
+    results.push_back(time_kernel(
+        "fill_private_copies", config, opts, lloyd_kernel_costs::fill<dataT>(n_copies * n_features * n_clusters),
+        [&]() { return q.fill<dataT>(centroids_t_private_copies, dataT(0), n_copies * n_features * n_clusters); }));
+
+    results.push_back(time_modeled_kernel(
+        "assignment", config, opts,
+        lloyd_kernel_models::assignment<dataT, indT>(n_samples, n_features, n_clusters, h, wgs, window_n_centroids), peaks,
+        [&]() {
+            return assignment<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+                q, n_samples, n_features, n_clusters, h, wgs,
+                X_t, centroids_t, half_l2_norm, assignment_id);
+        }));
+
+    results.push_back(time_modeled_kernel(
+        "lloyd_single_step", config, opts,
+        lloyd_kernel_models::lloyd_single_step<dataT, indT>(n_samples, n_features, n_clusters, h, wgs, window_n_centroids, n_copies), peaks,
+        [&]() {
+            return lloyd_single_step<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+                q, n_samples, n_features, n_clusters, h, n_copies, wgs,
+                X_t, sample_weight, centroids_t, half_l2_norm,
+                assignment_id, centroids_t_private_copies, cluster_sizes_private_copies);
+        }));
+
+    // the reduction, then the compaction of empty clusters
+    results.push_back(time_kernel_span(
+        "reduce_centroid_data", config, opts, lloyd_kernel_costs::reduce_centroid_data<dataT>(n_copies, n_features, n_clusters),
+        [&](sycl::event *first_ev) {
+            return reduce_centroid_data_kernel<dataT, indT>(
+                q, n_copies, n_features, n_clusters, wgs,
+                cluster_sizes_private_copies, centroids_t_private_copies,
+                cluster_sizes, res_centroids_t, empty_clusters_list, empty_clusters_list + n_clusters,
+                {}, false, first_ev);
+        }));
+
+    results.push_back(time_kernel(
+        "broadcast_division", config, opts, lloyd_kernel_costs::broadcast_division<dataT>(n_features, n_clusters),
+        [&]() { return broadcast_division_kernel<dataT>(q, n_features, n_clusters, wgs, res_centroids_t, cluster_sizes); }));
+
+    results.push_back(time_kernel(
+        "compute_centroid_shifts", config, opts, lloyd_kernel_costs::centroid_shifts<dataT>(n_features, n_clusters),
+        [&]() {
+            return compute_centroid_shifts_squared_kernel<dataT>(
+                q, n_features, n_clusters, wgs, centroids_t, res_centroids_t, centroid_shifts);
+        }));
+
+    results.push_back(time_modeled_kernel(
+        "compute_inertia", config, opts,
+        lloyd_kernel_models::compute_inertia<dataT, indT>(n_samples, n_features, n_clusters), peaks,
+        [&]() {
+            return compute_inertia_kernel<dataT, indT>(
+                q, n_samples, n_features, n_clusters, wgs,
+                X_t, sample_weight, centroids_t, assignment_id, per_sample_inertia);
+        }));
+
+    if (with_distances) {
+        results.push_back(time_modeled_kernel(
+            "compute_distances", config, opts,
+            lloyd_kernel_models::compute_distances<dataT>(n_samples, n_features, n_clusters, h, wgs, window_n_centroids), peaks,
+            [&]() {
+                return compute_distances<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+                    q, n_samples, n_features, n_clusters, h, wgs,
+                    X_t, centroids_t, distances_t);
+            }));
+    }
+
+    // full driver, timed on host, with tol=0 so that all iterations run
+    {
+        dataT *init_centroids_t = sycl::malloc_device<dataT>(n_features * n_clusters, q);
+        auto silent = [](const std::stringstream &) {};
+
+        std::vector<double> times_ns;
+        size_t n_iters = 0;
+        for(size_t rep = 0; rep < opts.warmup + opts.repetitions; ++rep) {
+            q.copy<dataT>(host_centroids_t.data(), init_centroids_t, host_centroids_t.size()).wait();
+
+            dataT total_inertia;
+            auto t0 = std::chrono::steady_clock::now();
+            n_iters = driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(silent)>(
+                q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, h, wgs,
+                X_t, sample_weight, init_centroids_t, opts.driver_max_iter, false, dataT(0),
+                assignment_id, res_centroids_t, total_inertia, silent);
+            auto t1 = std::chrono::steady_clock::now();
+
+            if (rep >= opts.warmup) {
+                times_ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+            }
+        }
+
+        kernel_cost step = lloyd_kernel_costs::lloyd_single_step<dataT, indT>(n_samples, n_features, n_clusters);
+        kernel_cost final_assignment = lloyd_kernel_costs::assignment<dataT, indT>(n_samples, n_features, n_clusters);
+        kernel_cost final_inertia = lloyd_kernel_costs::compute_inertia<dataT, indT>(n_samples, n_features);
+        kernel_cost cost = {
+            n_iters * step.n_bytes + final_assignment.n_bytes + final_inertia.n_bytes,
+            n_iters * step.n_flops + final_assignment.n_flops + final_inertia.n_flops
+        };
+
+        results.push_back({"driver_lloyd", config, percentile(times_ns, 0.5), percentile(times_ns, 0.95), cost});
+
+        sycl::free(init_centroids_t, q);
+    }
+
+    for(void *ptr : std::vector<void *>{
+            X_t, sample_weight, centroids_t, res_centroids_t, half_l2_norm, cluster_sizes,
+            centroid_shifts, per_sample_inertia, assignment_id, empty_clusters_list,
+            centroids_t_private_copies, cluster_sizes_private_copies, distances_t}) {
+        if (ptr) {
+            sycl::free(ptr, q);
+        }
+    }
+}
+
+static void write_csv(std::ostream &os, const std::vector<bench_result> &results) {
+    os << "kernel,dtype,n_samples,n_features,n_clusters,window_height,work_group_size,"
+          "median_ns,p95_ns,bytes,flops,gb_per_s,gflop_per_s,attainable_ns,fraction_of_attainable\n";
+    for(const auto &r : results) {
+        os << r.kernel << "," << r.config.dtype << ","
+           << r.config.n_samples << "," << r.config.n_features << "," << r.config.n_clusters << ","
+           << r.config.window_height << "," << r.config.work_group_size << ","
+           << r.median_ns << "," << r.p95_ns << ","
+           << r.cost.n_bytes << "," << r.cost.n_flops << ","
+           << r.cost.n_bytes / r.median_ns << "," << r.cost.n_flops / r.median_ns << ",";
+        if (r.attainable_ns > 0) {
+            os << r.attainable_ns << "," << r.attainable_ns / r.median_ns;
+        } else {
+            os << ",";
+        }
+        os << "\n";
+    }
+}
+
+static void write_json(std::ostream &os, const std::vector<bench_result> &results) {
+    os << "[\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        os << "  {\"kernel\": \"" << r.kernel << "\", \"dtype\": \"" << r.config.dtype << "\", "
+           << "\"n_samples\": " << r.config.n_samples << ", \"n_features\": " << r.config.n_features << ", "
+           << "\"n_clusters\": " << r.config.n_clusters << ", \"window_height\": " << r.config.window_height << ", "
+           << "\"work_group_size\": " << r.config.work_group_size << ", "
+           << "\"median_ns\": " << r.median_ns << ", \"p95_ns\": " << r.p95_ns << ", "
+           << "\"bytes\": " << r.cost.n_bytes << ", \"flops\": " << r.cost.n_flops << ", "
+           << "\"gb_per_s\": " << r.cost.n_bytes / r.median_ns << ", "
+           << "\"gflop_per_s\": " << r.cost.n_flops / r.median_ns;
+        if (r.attainable_ns > 0) {
+            os << ", \"attainable_ns\": " << r.attainable_ns
+               << ", \"fraction_of_attainable\": " << r.attainable_ns / r.median_ns;
+        }
+        os << "}"
+           << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
+
+/* Human readable report of achieved vs attainable performance */
+static void write_roofline_report(std::ostream &os, const std::vector<bench_result> &results) {
+    for(const auto &r : results) {
+        if (r.attainable_ns <= 0) {
+            continue;
+        }
+        os << r.kernel << " [" << r.config.dtype << " N=" << r.config.n_samples
+           << " F=" << r.config.n_features << " K=" << r.config.n_clusters
+           << " h=" << r.config.window_height << " wgs=" << r.config.work_group_size << "]: "
+           << "achieved " << r.cost.n_flops / r.median_ns << " GFLOP/s, "
+           << r.cost.n_bytes / r.median_ns << " GB/s; "
+           << "attainable " << r.cost.n_flops / r.attainable_ns << " GFLOP/s; "
+           << 100.0 * r.attainable_ns / r.median_ns << "% of roofline"
+           << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_options opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    sycl::queue q = make_queue(opts.device);
+    std::cerr << "Running on " << q.get_device().get_info<sycl::info::device::name>() << std::endl;
+
+    std::vector<bench_result> results;
+
+    for(const auto &dtype : opts.dtypes) {
+        if (dtype == "double" && !q.get_device().has(sycl::aspect::fp64)) {
+            std::cerr << "Skipping double, device does not support fp64" << std::endl;
+            continue;
+        }
+
+        device_peaks peaks{0.0, 0.0};
+        if (opts.roofline) {
+            peaks = (dtype == "double") ? measure_device_peaks<double>(q) : measure_device_peaks<float>(q);
+            std::cerr << "Device peaks (" << dtype << "): "
+                      << peaks.gb_per_s << " GB/s (STREAM triad), "
+                      << peaks.gflop_per_s << " GFLOP/s (FMA)" << std::endl;
+        }
+        const device_peaks *peaks_ptr = (opts.roofline) ? &peaks : nullptr;
+        for(size_t n_samples : opts.n_samples) {
+            for(size_t n_features : opts.n_features) {
+                for(size_t n_clusters : opts.n_clusters) {
+                    for(size_t h : opts.window_heights) {
+                        for(size_t wgs : opts.work_group_sizes) {
+                            bench_config config{dtype, n_samples, n_features, n_clusters, h, wgs};
+                            if (dtype == "float") {
+                                run_config<float>(q, config, opts, peaks_ptr, results);
+                            } else if (dtype == "double") {
+                                run_config<double>(q, config, opts, peaks_ptr, results);
+                            } else {
+                                std::cerr << "Unsupported dtype " << dtype << std::endl;
+                                return 2;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::ofstream ofs;
+    if (!opts.output.empty()) {
+        ofs.open(opts.output);
+    }
+    std::ostream &os = (opts.output.empty()) ? std::cout : ofs;
+
+    if (opts.roofline) {
+        write_roofline_report(std::cerr, results);
+    }
+
+    if (opts.format == "csv") {
+        write_csv(os, results);
+    } else {
+        write_json(os, results);
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@ from ._kmeans_dpcpp import (
     half_l2_norm_squared,
     reduce_centroids_data,
     compute_threshold,
+    radix_sort,
     select_samples_far_from_centroid,
     relocate_empty_clusters,
     compute_centroid_shifts_squared,
@@ -13,13 +14,30 @@ from ._kmeans_dpcpp import (
     fused_lloyd_single_step,
     compute_number_of_private_copies,
     kmeans_lloyd_driver,
+    assignment_csr,
+    kmeans_lloyd_driver_csr,
+    kmeans_lloyd_driver_streaming,
+    npy_header,
+    read_X_t_from_file,
+    OnlineKMeans,
+    build_coreset,
+    kmeans_bisecting_driver,
+    kmeans_lloyd_driver_sub_devices,
+    numa_sub_devices_count,
+    Communicator,
+    TcpCommunicator,
+    make_in_process_communicators,
+    kmeans_lloyd_driver_distributed,
 )
+from ._io import load_X_t
+from ._refit import kmeans_lloyd_refit
 
 __all__ = [
     "broadcast_divide",
     "half_l2_norm_squared",
     "reduce_centroids_data",
     "compute_threshold",
+    "radix_sort",
     "select_samples_far_from_centroid",
     "relocate_empty_clusters",
     "compute_centroid_shifts_squared",
@@ -29,7 +47,23 @@ __all__ = [
     "reduce_vector_blocking",
     "fused_lloyd_single_step",
     "compute_number_of_private_copies",
-    "kmeans_lloyd_driver"
+    "kmeans_lloyd_driver",
+    "assignment_csr",
+    "kmeans_lloyd_driver_csr",
+    "kmeans_lloyd_driver_streaming",
+    "npy_header",
+    "read_X_t_from_file",
+    "OnlineKMeans",
+    "build_coreset",
+    "kmeans_bisecting_driver",
+    "kmeans_lloyd_driver_sub_devices",
+    "numa_sub_devices_count",
+    "Communicator",
+    "TcpCommunicator",
+    "make_in_process_communicators",
+    "kmeans_lloyd_driver_distributed",
+    "load_X_t",
+    "kmeans_lloyd_refit",
 ]
 
 __doc__ = """
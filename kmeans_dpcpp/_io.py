@@ -0,0 +1,56 @@
+import numpy as np
+import dpctl
+import dpctl.tensor as dpt
+
+from ._kmeans_dpcpp import npy_header, read_X_t_from_file
+
+
+def load_X_t(
+    path,
+    dtype=None,
+    shape=None,
+    raw_dtype=np.float32,
+    offset=0,
+    fortran_order=False,
+    chunk_size=2**16,
+    n_threads=0,
+    sycl_queue=None,
+):
+    """Load samples from .npy file, or raw binary file if `shape` is given,
+    directly into a usm_ndarray X_t with shape (n_features, n_samples).
+
+    The file is memory-mapped and transposed in chunks of `chunk_size`
+    samples by `n_threads` host threads (all cores if 0), without
+    materializing X in a NumPy array.
+
+    For raw files, `shape` is (n_samples, n_features), elements have type
+    `raw_dtype` and start at byte `offset`, in C order unless
+    `fortran_order`. Samples are converted to `dtype`, which defaults to the
+    type stored in the file.
+    """
+    path = str(path)
+
+    if shape is None:
+        descr, fortran_order, shape, offset = npy_header(path)
+        src_dtype = np.dtype(descr)
+    else:
+        src_dtype = np.dtype(raw_dtype)
+
+    if len(shape) != 2:
+        raise ValueError(f"Expected samples with shape (n_samples, n_features), got {shape}")
+
+    if sycl_queue is None:
+        sycl_queue = dpctl.SyclQueue()
+
+    n_samples, n_features = shape
+    X_t = dpt.empty(
+        (n_features, n_samples),
+        dtype=src_dtype.newbyteorder("=") if dtype is None else dtype,
+        sycl_queue=sycl_queue,
+    )
+
+    read_X_t_from_file(
+        path, offset, src_dtype, fortran_order, X_t, chunk_size, n_threads, sycl_queue
+    )
+
+    return X_t
@@ -0,0 +1,53 @@
+import dpctl.tensor as dpt
+
+from ._kmeans_dpcpp import kmeans_lloyd_driver
+
+
+def kmeans_lloyd_refit(
+    X_t,
+    sample_weight,
+    centroids_t,
+    labels,
+    tol=0.0,
+    max_iter=300,
+    centroids_window_height=8,
+    work_group_size=128,
+    centroids_private_copies_max_cache_occupancy=0.7,
+    label_change_tol=0.0,
+    verbose=False,
+    **driver_kwargs,
+):
+    """Refit a model with centroids `centroids_t` (n_features, n_clusters) and
+    labels `labels` (n_labeled_samples,) on samples X_t (n_features, n_samples).
+
+    The first n_labeled_samples samples of X_t must be those the model was fit
+    on, possibly updated, the others being appended samples. Lloyd iterations
+    resume from the previous centroids, and label changes are counted against
+    the previous labels, so that a refit on data that barely changed stops
+    after a couple of iterations.
+
+    Returns (n_iter, total_inertia, assignment_id, res_centroids_t). Arrays
+    `centroids_t` and `labels` are left untouched.
+    """
+    n_features, n_samples = X_t.shape
+    n_labeled_samples = labels.shape[0]
+    if n_labeled_samples > n_samples:
+        raise ValueError("More labels than samples")
+
+    q = X_t.sycl_queue
+    init_centroids_t = dpt.copy(centroids_t)
+    res_centroids_t = dpt.empty_like(centroids_t)
+    assignment_id = dpt.empty(n_samples, dtype=labels.dtype, sycl_queue=q)
+    assignment_id[:n_labeled_samples] = labels
+
+    n_iter, total_inertia = kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_id, res_centroids_t,
+        tol, verbose, max_iter, centroids_window_height, work_group_size,
+        centroids_private_copies_max_cache_occupancy,
+        q,
+        label_change_tol=label_change_tol,
+        n_labeled_samples=n_labeled_samples,
+        **driver_kwargs,
+    )
+
+    return n_iter, total_inertia, assignment_id, res_centroids_t
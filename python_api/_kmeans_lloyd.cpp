@@ -1,7 +1,14 @@
 #include <cstdint>
+#include <limits>
+#include <string>
 #include <vector>
 #include <utility>
 #include <sstream>
+#include <functional>
+#include <optional>
+#include <memory>
+#include <variant>
+#include <type_traits>
 #include <CL/sycl.hpp>
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
@@ -14,6 +21,18 @@
 #include "compute_inertia.hpp"
 #include "lloyd_single_step.hpp"
 #include "kmeans_lloyd_driver.hpp"
+#include "csr_kernels.hpp"
+#include "kmeans_lloyd_csr_driver.hpp"
+#include "kmeans_lloyd_streaming_driver.hpp"
+#include "dataset_reader.hpp"
+#include "profiling.hpp"
+#include "telemetry.hpp"
+#include "online_kmeans.hpp"
+#include "coreset.hpp"
+#include "kmeans_bisecting_driver.hpp"
+#include "kmeans_lloyd_sub_devices_driver.hpp"
+#include "communicator.hpp"
+#include "kmeans_lloyd_distributed_driver.hpp"
 
 namespace py = pybind11;
 
@@ -144,7 +163,8 @@ py_reduce_centroids_data(
   dpctl::tensor::usm_ndarray out_n_empty_clusters,         // OUT (1,)                                 indT
   size_t work_group_size,
   sycl::queue q,
-  const std::vector<sycl::event> &depends={}
+  const std::vector<sycl::event> &depends={},
+  bool reset_private_copies = false
 ) {
   if (!is_2d(cluster_sizes_private_copies) ||
       !is_3d(centroids_t_private_copies) ||
@@ -170,10 +190,12 @@ py_reduce_centroids_data(
     throw py::value_error("Dimensions mismatch");
   }
 
-  int dataT_typenum = cluster_sizes_private_copies.get_typenum();
+  int accT_typenum = cluster_sizes_private_copies.get_typenum();
+  int dataT_typenum = out_cluster_sizes.get_typenum();
   int indT_typenum = out_n_empty_clusters.get_typenum();
 
-  if (!same_typenum_as(dataT_typenum, {centroids_t_private_copies, out_cluster_sizes, out_centroids_t}) ||
+  if (!same_typenum_as(accT_typenum, {centroids_t_private_copies}) ||
+      !same_typenum_as(dataT_typenum, {out_centroids_t}) ||
       !same_typenum_as(indT_typenum, {out_empty_clusters_list}))
   {
     throw py::value_error("Array element data types must be consisten");
@@ -203,7 +225,7 @@ py_reduce_centroids_data(
 
   sycl::event comp_ev;
 
-  if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+  if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
     using dataT = float;
     using indT = std::int32_t;
     comp_ev = reduce_centroid_data_kernel<dataT, indT>(
@@ -214,8 +236,9 @@ py_reduce_centroids_data(
             out_centroids_t.get_data<dataT>(),
             out_empty_clusters_list.get_data<indT>(),
             out_n_empty_clusters.get_data<indT>(),
-            depends);
-  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+            depends,
+            reset_private_copies);
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
     using dataT = float;
     using indT = std::int64_t;
     comp_ev = reduce_centroid_data_kernel<dataT, indT>(
@@ -226,8 +249,9 @@ py_reduce_centroids_data(
             out_centroids_t.get_data<dataT>(),
             out_empty_clusters_list.get_data<indT>(),
             out_n_empty_clusters.get_data<indT>(),
-            depends);
-  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+            depends,
+            reset_private_copies);
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
     using dataT = double;
     using indT = std::int32_t;
     comp_ev = reduce_centroid_data_kernel<dataT, indT>(
@@ -238,8 +262,9 @@ py_reduce_centroids_data(
             out_centroids_t.get_data<dataT>(),
             out_empty_clusters_list.get_data<indT>(),
             out_n_empty_clusters.get_data<indT>(),
-            depends);
-  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+            depends,
+            reset_private_copies);
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
     using dataT = double;
     using indT = std::int64_t;
     comp_ev = reduce_centroid_data_kernel<dataT, indT>(
@@ -250,7 +275,36 @@ py_reduce_centroids_data(
             out_centroids_t.get_data<dataT>(),
             out_empty_clusters_list.get_data<indT>(),
             out_n_empty_clusters.get_data<indT>(),
-            depends);
+            depends,
+            reset_private_copies);
+  } else if (accT_typenum == api.UAR_DOUBLE_ && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = float;
+    using accT = double;
+    using indT = std::int32_t;
+    comp_ev = reduce_centroid_data_kernel<dataT, indT, accT>(
+            q, n_copies, n_features, n_clusters, work_group_size,
+            cluster_sizes_private_copies.get_data<accT>(),
+            centroids_t_private_copies.get_data<accT>(),
+            out_cluster_sizes.get_data<dataT>(),
+            out_centroids_t.get_data<dataT>(),
+            out_empty_clusters_list.get_data<indT>(),
+            out_n_empty_clusters.get_data<indT>(),
+            depends,
+            reset_private_copies);
+  } else if (accT_typenum == api.UAR_DOUBLE_ && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = float;
+    using accT = double;
+    using indT = std::int64_t;
+    comp_ev = reduce_centroid_data_kernel<dataT, indT, accT>(
+            q, n_copies, n_features, n_clusters, work_group_size,
+            cluster_sizes_private_copies.get_data<accT>(),
+            centroids_t_private_copies.get_data<accT>(),
+            out_cluster_sizes.get_data<dataT>(),
+            out_centroids_t.get_data<dataT>(),
+            out_empty_clusters_list.get_data<indT>(),
+            out_n_empty_clusters.get_data<indT>(),
+            depends,
+            reset_private_copies);
   } else {
     throw py::value_error("Unsupported data types");
   }
@@ -304,7 +358,7 @@ py_compute_threshold(
       n_samples, data.get_data<dataT>(), topk,
       threshold.get_data<dataT>(), depends);
   } else if (data_typenum == api.UAR_DOUBLE_) {
-    using dataT = float;
+    using dataT = double;
     comp_ev = compute_threshold_kernel<dataT>(q,
       n_samples, data.get_data<dataT>(), topk,
       threshold.get_data<dataT>(), depends);
@@ -318,6 +372,150 @@ py_compute_threshold(
   return std::make_pair(ht_ev, comp_ev);
 }
 
+template <typename dataT, typename valueT>
+sycl::event
+_radix_sort_with_scratch(
+  sycl::queue q,
+  size_t n_keys,
+  size_t work_group_size,
+  dataT const *keys,
+  dataT *sorted_keys,
+  valueT *sorted_idx,
+  bool descending,
+  const std::vector<sycl::event> &depends
+) {
+  char *scratch = sycl::malloc_device<char>(
+    radix_sort_scratch_size<dataT, valueT>(n_keys, work_group_size), q);
+
+  sycl::event sort_ev = radix_sort_pairs<dataT, valueT>(
+    q, n_keys, work_group_size,
+    keys, nullptr, sorted_keys, sorted_idx, scratch,
+    descending, depends);
+
+  sycl::event free_ev = q.submit([&](sycl::handler &cgh) {
+    cgh.depends_on(sort_ev);
+    auto ctx = q.get_context();
+    cgh.host_task([ctx, scratch] { sycl::free(scratch, ctx); });
+  });
+
+  return free_ev;
+}
+
+std::pair<sycl::event, sycl::event>
+py_radix_sort(
+  dpctl::tensor::usm_ndarray keys,          // IN  (n_keys,)  dataT
+  dpctl::tensor::usm_ndarray sorted_keys,   // OUT (n_keys,)  dataT
+  dpctl::tensor::usm_ndarray sorted_idx,    // OUT (n_keys,)  indT
+  size_t work_group_size,
+  sycl::queue q,
+  bool descending = false,
+  const std::vector<sycl::event> &depends = {}
+) {
+  if (!is_1d(keys) || !is_1d(sorted_keys) || !is_1d(sorted_idx)) {
+    throw py::value_error("Arguments keys, sorted_keys and sorted_idx must be vectors");
+  }
+
+  if (!all_c_contiguous({keys, sorted_keys, sorted_idx})) {
+    throw py::value_error("All array arguments must be C-contiguous");
+  }
+
+  py::ssize_t n_keys = keys.get_shape(0);
+  if (sorted_keys.get_shape(0) != n_keys || sorted_idx.get_shape(0) != n_keys) {
+    throw py::value_error("Arguments keys, sorted_keys and sorted_idx must have the same length");
+  }
+
+  if (static_cast<size_t>(n_keys) > std::numeric_limits<std::uint32_t>::max()) {
+    throw py::value_error("Number of keys must fit in 32 bits");
+  }
+
+  int dataT_typenum = keys.get_typenum();
+  if (!same_typenum_as(dataT_typenum, {sorted_keys})) {
+    throw py::value_error("Arguments keys and sorted_keys must have the same data type");
+  }
+
+  if (! ::dpctl::utils::queues_are_compatible(q, {keys.get_queue(), sorted_keys.get_queue(), sorted_idx.get_queue()})) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  auto &api = ::dpctl::detail::dpctl_capi::get();
+  int indT_typenum = sorted_idx.get_typenum();
+
+  // indices are non-negative, sorted as unsigned payloads of the same width
+  sycl::event comp_ev;
+  if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = float;
+    comp_ev = _radix_sort_with_scratch<dataT, std::uint32_t>(
+      q, n_keys, work_group_size,
+      keys.get_data<dataT>(), sorted_keys.get_data<dataT>(),
+      reinterpret_cast<std::uint32_t *>(sorted_idx.get_data<std::int32_t>()),
+      descending, depends);
+  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = float;
+    comp_ev = _radix_sort_with_scratch<dataT, std::uint64_t>(
+      q, n_keys, work_group_size,
+      keys.get_data<dataT>(), sorted_keys.get_data<dataT>(),
+      reinterpret_cast<std::uint64_t *>(sorted_idx.get_data<std::int64_t>()),
+      descending, depends);
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = double;
+    comp_ev = _radix_sort_with_scratch<dataT, std::uint32_t>(
+      q, n_keys, work_group_size,
+      keys.get_data<dataT>(), sorted_keys.get_data<dataT>(),
+      reinterpret_cast<std::uint32_t *>(sorted_idx.get_data<std::int32_t>()),
+      descending, depends);
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = double;
+    comp_ev = _radix_sort_with_scratch<dataT, std::uint64_t>(
+      q, n_keys, work_group_size,
+      keys.get_data<dataT>(), sorted_keys.get_data<dataT>(),
+      reinterpret_cast<std::uint64_t *>(sorted_idx.get_data<std::int64_t>()),
+      descending, depends);
+  } else {
+    throw py::value_error("Unsupported data types. Expect single- or double- floating-point keys, and 32- or 64-bit integer indices.");
+  }
+
+  sycl::event ht_ev = ::dpctl::utils::keep_args_alive(
+       q, {keys, sorted_keys, sorted_idx}, {comp_ev});
+
+  return std::make_pair(ht_ev, comp_ev);
+}
+
+template <typename dataT, typename indT>
+sycl::event
+_select_samples_far_from_centroid_with_scratch(
+  sycl::queue q,
+  size_t n_selected,
+  size_t n_samples,
+  size_t work_group_size,
+  dataT const *distance_to_centroid,
+  dataT const *threshold,
+  indT *selected_samples_idx,
+  indT *n_selected_gt_threshold,
+  indT *n_selected_eq_threshold,
+  const std::vector<sycl::event> &depends
+) {
+  size_t scratch_size = select_samples_far_from_centroid_scratch_size<indT>(n_samples, work_group_size);
+  char *scratch = (scratch_size > 0) ? sycl::malloc_device<char>(scratch_size, q) : nullptr;
+
+  sycl::event select_ev = select_samples_far_from_centroid_kernel<dataT, indT>(
+    q, n_selected, n_samples, work_group_size,
+    distance_to_centroid, threshold,
+    selected_samples_idx, n_selected_gt_threshold, n_selected_eq_threshold,
+    scratch, depends);
+
+  if (scratch == nullptr) {
+    return select_ev;
+  }
+
+  sycl::event free_ev = q.submit([&](sycl::handler &cgh) {
+    cgh.depends_on(select_ev);
+    auto ctx = q.get_context();
+    cgh.host_task([ctx, scratch] { sycl::free(scratch, ctx); });
+  });
+
+  return free_ev;
+}
+
 std::pair<sycl::event, sycl::event>
 py_select_samples_far_from_centroid(
   size_t n_selected,
@@ -378,7 +576,7 @@ py_select_samples_far_from_centroid(
   if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
     using dataT = float;
     using indT = std::int32_t;
-    comp_ev = select_samples_far_from_centroid_kernel<dataT, indT>(
+    comp_ev = _select_samples_far_from_centroid_with_scratch<dataT, indT>(
       q, n_selected, static_cast<size_t>(n_samples), work_group_size,
       distance_to_centroid.get_data<dataT>(), threshold.get_data<dataT>(),
       selected_samples_idx.get_data<indT>(), n_selected_gt_threshold.get_data<indT>(),
@@ -387,7 +585,7 @@ py_select_samples_far_from_centroid(
   } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
     using dataT = double;
     using indT = std::int32_t;
-    comp_ev = select_samples_far_from_centroid_kernel<dataT, indT>(
+    comp_ev = _select_samples_far_from_centroid_with_scratch<dataT, indT>(
       q, n_selected, static_cast<size_t>(n_samples), work_group_size,
       distance_to_centroid.get_data<dataT>(), threshold.get_data<dataT>(),
       selected_samples_idx.get_data<indT>(), n_selected_gt_threshold.get_data<indT>(),
@@ -396,7 +594,7 @@ py_select_samples_far_from_centroid(
   } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
     using dataT = float;
     using indT = std::int64_t;
-    comp_ev = select_samples_far_from_centroid_kernel<dataT, indT>(
+    comp_ev = _select_samples_far_from_centroid_with_scratch<dataT, indT>(
       q, n_selected, static_cast<size_t>(n_samples), work_group_size,
       distance_to_centroid.get_data<dataT>(), threshold.get_data<dataT>(),
       selected_samples_idx.get_data<indT>(), n_selected_gt_threshold.get_data<indT>(),
@@ -405,7 +603,7 @@ py_select_samples_far_from_centroid(
   } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
     using dataT = double;
     using indT = std::int64_t;
-    comp_ev = select_samples_far_from_centroid_kernel<dataT, indT>(
+    comp_ev = _select_samples_far_from_centroid_with_scratch<dataT, indT>(
       q, n_selected, static_cast<size_t>(n_samples), work_group_size,
       distance_to_centroid.get_data<dataT>(), threshold.get_data<dataT>(),
       selected_samples_idx.get_data<indT>(), n_selected_gt_threshold.get_data<indT>(),
@@ -1010,18 +1208,23 @@ py_fused_lloyd_single_step(
 
   int dataT_typenum = X_t.get_typenum();
   int indT_typenum = assignments_idx.get_typenum();
+  int accT_typenum = new_centroids_t_private_copies.get_typenum();
 
-  if (!same_typenum_as(dataT_typenum, {sample_weight, centroids_t, centroids_half_l2_norm,
-    new_centroids_t_private_copies, cluster_sizes_private_copies}))
+  if (!same_typenum_as(dataT_typenum, {sample_weight, centroids_t, centroids_half_l2_norm}) ||
+      !same_typenum_as(accT_typenum, {cluster_sizes_private_copies}))
   {
     throw py::value_error("Array arguments have different elemental data types");
   }
 
   const auto &api = dpctl::detail::dpctl_capi::get();
 
+  if (accT_typenum != dataT_typenum && !(dataT_typenum == api.UAR_FLOAT_ && accT_typenum == api.UAR_DOUBLE_)) {
+    throw py::value_error("Private copies must have the data type of X_t, or double precision if X_t is single precision");
+  }
+
   sycl::event comp_ev;
 
-  if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+  if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
     using dataT = float;
     using indT = std::int32_t;
 
@@ -1035,7 +1238,7 @@ py_fused_lloyd_single_step(
       cluster_sizes_private_copies.get_data<dataT>(),
       depends
     );
-  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
     using dataT = float;
     using indT = std::int64_t;
 
@@ -1049,8 +1252,8 @@ py_fused_lloyd_single_step(
       cluster_sizes_private_copies.get_data<dataT>(),
       depends
     );
-  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
-    using dataT = float;
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = double;
     using indT = std::int32_t;
 
     comp_ev = lloyd_single_step<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
@@ -1063,8 +1266,8 @@ py_fused_lloyd_single_step(
       cluster_sizes_private_copies.get_data<dataT>(),
       depends
     );
-  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
-    using dataT = float;
+  } else if (accT_typenum == dataT_typenum && dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = double;
     using indT = std::int64_t;
 
     comp_ev = lloyd_single_step<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
@@ -1077,6 +1280,36 @@ py_fused_lloyd_single_step(
       cluster_sizes_private_copies.get_data<dataT>(),
       depends
     );
+  } else if (accT_typenum == api.UAR_DOUBLE_ && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = float;
+    using accT = double;
+    using indT = std::int32_t;
+
+    comp_ev = lloyd_single_step<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, accT>(
+      q,
+      n_samples, n_features, n_clusters,
+      centroids_window_height, n_copies, work_group_size,
+      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), centroids_t.get_data<dataT>(),
+      centroids_half_l2_norm.get_data<dataT>(), assignments_idx.get_data<indT>(),
+      new_centroids_t_private_copies.get_data<accT>(),
+      cluster_sizes_private_copies.get_data<accT>(),
+      depends
+    );
+  } else if (accT_typenum == api.UAR_DOUBLE_ && dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = float;
+    using accT = double;
+    using indT = std::int64_t;
+
+    comp_ev = lloyd_single_step<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, accT>(
+      q,
+      n_samples, n_features, n_clusters,
+      centroids_window_height, n_copies, work_group_size,
+      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), centroids_t.get_data<dataT>(),
+      centroids_half_l2_norm.get_data<dataT>(), assignments_idx.get_data<indT>(),
+      new_centroids_t_private_copies.get_data<accT>(),
+      cluster_sizes_private_copies.get_data<accT>(),
+      depends
+    );
   } else {
     throw py::value_error("Unsupported array elemental data types.");
   }
@@ -1127,6 +1360,102 @@ size_t py_compute_number_of_private_copies(
   }
 }
 
+template <typename dataT, typename indT, typename accT = dataT, bool X_row_major = false>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_impl(
+  sycl::queue q,
+  size_t n_samples,
+  size_t n_features,
+  size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  dpctl::tensor::usm_ndarray X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray init_centroids_t,
+  size_t max_iter,
+  bool verbose,
+  double tol,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray res_centroids_t,
+  py::object profile,
+  py::object callback,
+  lloyd_driver_options options
+) {
+  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  kernel_profiler profiler;
+  kernel_profiler *profiler_ptr = nullptr;
+  sycl::queue exec_q = q;
+
+  if (!profile.is_none()) {
+    profiler_ptr = &profiler;
+    // same context and device, so that USM allocations remain accessible
+    if (!q.has_property<sycl::property::queue::enable_profiling>()) {
+      sycl::property_list props = (q.is_in_order()) ?
+        sycl::property_list{sycl::property::queue::enable_profiling(), sycl::property::queue::in_order()} :
+        sycl::property_list{sycl::property::queue::enable_profiling()};
+      exec_q = sycl::queue(q.get_context(), q.get_device(), props);
+    }
+  }
+
+  std::function<void(const lloyd_iteration_metrics &)> iteration_callback;
+  if (!callback.is_none()) {
+    iteration_callback = [&callback](const lloyd_iteration_metrics &m) {
+      py::dict d;
+      d["iteration"] = m.iteration;
+      d["centroid_shifts_sum"] = m.centroid_shifts_sum;
+      d["n_empty_clusters"] = m.n_empty_clusters;
+      d["n_changed_labels"] = m.n_changed_labels;
+      d["lloyd_step_ns"] = m.lloyd_step_ns;
+      d["inertia_ns"] = m.inertia_ns;
+      d["update_ns"] = m.update_ns;
+      callback(d);
+    };
+  }
+
+  size_t n_iters_ = driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn), accT, X_row_major, decltype(iteration_callback)>(
+    exec_q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+    X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(),
+    max_iter, verbose, static_cast<dataT>(tol),
+    assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn,
+    profiler_ptr, iteration_callback, options
+  );
+
+  if (profiler_ptr) {
+    py::list records = profile.cast<py::list>();
+    for(const auto &r : profiler.collect()) {
+      py::dict d;
+      d["name"] = r.name;
+      d["iteration"] = r.iteration;
+      d["start_ns"] = r.start_ns;
+      d["end_ns"] = r.end_ns;
+      d["duration_ns"] = r.duration_ns();
+      d["bytes"] = r.n_bytes;
+      d["flops"] = r.n_flops;
+      d["gb_per_s"] = r.gb_per_s();
+      d["gflop_per_s"] = r.gflop_per_s();
+      records.append(d);
+    }
+  }
+
+  return std::make_pair(n_iters_, py_total_inertia);
+}
+
+template <typename dataT, typename indT, typename accT = dataT, typename... ArgsT>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_dispatch_layout(bool X_row_major, ArgsT&&... args) {
+  if (X_row_major) {
+    return _kmeans_lloyd_driver_impl<dataT, indT, accT, true>(std::forward<ArgsT>(args)...);
+  } else {
+    return _kmeans_lloyd_driver_impl<dataT, indT, accT, false>(std::forward<ArgsT>(args)...);
+  }
+}
+
 std::pair<size_t, py::array>
 py_kmeans_lloyd_driver(
   dpctl::tensor::usm_ndarray X_t,
@@ -1141,7 +1470,19 @@ py_kmeans_lloyd_driver(
   size_t work_group_size,
   double centroids_private_copies_max_cache_occupancy,
   sycl::queue q,
-  const std::vector<sycl::event> &depends = {}
+  const std::vector<sycl::event> &depends = {},
+  bool accumulate_in_double = false,
+  bool X_row_major = false,
+  py::object profile = py::none(),
+  py::object callback = py::none(),
+  std::optional<double> label_change_tol = std::nullopt,
+  size_t n_labeled_samples = 0,
+  bool spherical = false,
+  bool double_buffer_private_copies = false,
+  bool use_command_graph = false,
+  bool reset_private_copies_in_reduction = false,
+  bool adaptive_private_copies = false,
+  const std::string &update_strategy = "private_copies"
 ) {
 
   if (!is_2d(X_t) || !is_1d(sample_weight) || !is_2d(init_centroids_t) || !is_2d(res_centroids_t) || !is_1d(assignment_id)) {
@@ -1159,8 +1500,9 @@ py_kmeans_lloyd_driver(
     throw py::value_error("Execution queue is not compatible with allocation queues");
   }
 
-  py::ssize_t n_features = X_t.get_shape(0);
-  py::ssize_t n_samples = X_t.get_shape(1);
+  // when X_row_major, X_t is X with shape (n_samples, n_features)
+  py::ssize_t n_features = X_t.get_shape((X_row_major) ? 1 : 0);
+  py::ssize_t n_samples = X_t.get_shape((X_row_major) ? 0 : 1);
   py::ssize_t n_clusters = init_centroids_t.get_shape(1);
 
   if ( n_features != init_centroids_t.get_shape(0) || n_features != res_centroids_t.get_shape(0) || 
@@ -1179,156 +1521,1330 @@ py_kmeans_lloyd_driver(
 
   if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
     throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
-  } 
+  }
+
+  if (X_row_major && (work_group_size * centroids_window_height * X_t.get_elemsize() > q.get_device().get_info<sycl::info::device::local_mem_size>())) {
+    throw py::value_error("Window of samples of row-major X does not fit in local memory, decrease `centroids_window_height`");
+  }
 
   if (tol < 0.0) {
     throw py::value_error("Tolerance must be non-negative");
   }
 
+  if (!profile.is_none() && !py::isinstance<py::list>(profile)) {
+    throw py::value_error("`profile` must be a list, to be populated with records of profiled commands");
+  }
 
-  const auto &api = dpctl::detail::dpctl_capi::get();
-  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+  if (!callback.is_none() && !PyCallable_Check(callback.ptr())) {
+    throw py::value_error("`callback` must be callable");
+  }
 
-  size_t n_iters_;
-  py::array py_total_inertia;
+  lloyd_driver_options options;
+  if (label_change_tol) {
+    if (*label_change_tol < 0.0 || *label_change_tol >= 1.0) {
+      throw py::value_error("Fraction `label_change_tol` is out of bounds");
+    }
+    options.label_change_tol = *label_change_tol;
+  }
 
-  if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
-    using dataT = float;
-    using indT = std::int32_t;
+  if (n_labeled_samples > static_cast<size_t>(n_samples)) {
+    throw py::value_error("`n_labeled_samples` exceeds the number of samples");
+  }
+  options.n_labeled_samples = n_labeled_samples;
+  options.spherical = spherical;
+  options.double_buffer_private_copies = double_buffer_private_copies;
+  options.use_command_graph = use_command_graph;
+  options.reset_private_copies_in_reduction = reset_private_copies_in_reduction;
+  options.adaptive_private_copies = adaptive_private_copies;
+  if (update_strategy == "private_copies") {
+    options.update_strategy = centroid_update_strategy::private_copies;
+  } else if (update_strategy == "sort_by_label") {
+    if (static_cast<size_t>(n_samples) > std::numeric_limits<std::uint32_t>::max()) {
+      throw py::value_error("Too many samples for the sort_by_label update strategy");
+    }
+    options.update_strategy = centroid_update_strategy::sort_by_label;
+  } else {
+    throw py::value_error("`update_strategy` must be either 'private_copies' or 'sort_by_label'");
+  }
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
 
-    auto tmp = py::array_t<dataT>(1);
-    dataT *total_inertia_ptr = tmp.mutable_data(0);
-    py_total_inertia = py::cast<py::array>(tmp);
+  // accumulation in double precision only makes a difference for single precision inputs
+  bool mixed_precision = accumulate_in_double && (dataT_typenum == api.UAR_FLOAT_);
+  if (mixed_precision) {
+    const auto &dev = q.get_device();
+    if (!dev.has(sycl::aspect::fp64) || !dev.has(sycl::aspect::atomic64)) {
+      throw py::value_error("Accumulation in double precision requires a device supporting fp64 atomics");
+    }
+  }
 
-    n_iters_ =  driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+  if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_ && mixed_precision) {
+    return _kmeans_lloyd_driver_dispatch_layout<float, std::int32_t, double>(
+      X_row_major,
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
+    );
+  } else if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_ && mixed_precision) {
+    return _kmeans_lloyd_driver_dispatch_layout<float, std::int64_t, double>(
+      X_row_major,
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
+    );
+  } else if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    return _kmeans_lloyd_driver_dispatch_layout<float, std::int32_t>(
+      X_row_major,
       q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
-      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(), 
-      max_iter, verbose, static_cast<dataT>(tol), 
-      assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
     );
   } else if( dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
-    using dataT = double;
-    using indT = std::int32_t;
-
-    auto tmp = py::array_t<dataT>(1);
-    dataT *total_inertia_ptr = tmp.mutable_data(0);
-    py_total_inertia = py::cast<py::array>(tmp);
-
-    n_iters_ =  driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    return _kmeans_lloyd_driver_dispatch_layout<double, std::int32_t>(
+      X_row_major,
       q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
-      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(), 
-      max_iter, verbose, static_cast<dataT>(tol), 
-      assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
     );
   } else if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
-    using dataT = float;
-    using indT = std::int64_t;
-
-    auto tmp = py::array_t<dataT>(1);
-    dataT *total_inertia_ptr = tmp.mutable_data(0);
-    py_total_inertia = py::cast<py::array>(tmp);
-
-    n_iters_ =  driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    return _kmeans_lloyd_driver_dispatch_layout<float, std::int64_t>(
+      X_row_major,
       q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
-      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(), 
-      max_iter, verbose, static_cast<dataT>(tol), 
-      assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
     );
   } else if( dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
-    using dataT = double;
-    using indT = std::int64_t;
-
-    auto tmp = py::array_t<dataT>(1);
-    dataT *total_inertia_ptr = tmp.mutable_data(0);
-    py_total_inertia = py::cast<py::array>(tmp);
-
-    n_iters_ =  driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    return _kmeans_lloyd_driver_dispatch_layout<double, std::int64_t>(
+      X_row_major,
       q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
-      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(), 
-      max_iter, verbose, static_cast<dataT>(tol), 
-      assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+      X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t, profile, callback, options
     );
   } else {
     throw py::value_error("Unsupport elemental data type");
   }
-
-  return std::make_pair(n_iters_, py_total_inertia);
 }
 
-PYBIND11_MODULE(_kmeans_dpcpp, m) {
-  m.def(
-    "broadcast_divide", &py_broadcast_divide,
-          "broadcast_divide(divident=src, divisor=dst, sycl_queue=q, depends=[]) evaluates "
-    "`src /= dst` for matrix src and vector dst",
-          py::arg("divident"), py::arg("divisor"),
-          py::arg("sycl_queue"), py::arg("depends")=py::list()
-  );
-  m.def(
-    "half_l2_norm_squared", &py_half_l2_norm_squared,
-          "half_l2_norm_squared(centroids=X, centroids_half_l2_norm_squared=y, sycl_queue=q, depends=[]) "
-    "computes row-wise half of norm squared of X and places it in y",
-          py::arg("centroids"), py::arg("centroids_half_l2_norm_squared"),
-          py::arg("sycl_queue"), py::arg("depends") = py::list()
-  );
+void
+_validate_csr_arrays(
+  dpctl::tensor::usm_ndarray data,     // (nnz,)
+  dpctl::tensor::usm_ndarray indices,  // (nnz,)
+  dpctl::tensor::usm_ndarray indptr    // (n_samples + 1,)
+) {
+  if (!is_1d(data) || !is_1d(indices) || !is_1d(indptr)) {
+    throw py::value_error("CSR arrays data, indices and indptr must be vectors");
+  }
 
-  m.def(
-    "reduce_centroids_data", &py_reduce_centroids_data,
-    "reduce_centroids_data(cluster_sizes_private_copies, centroids_t_private_copies, out_cluster_sizes, "
-    " out_centroids_t, out_empty_clusters_list, out_n_empty_clusters, sycl_queue=q, depends=[])",
-    py::arg("cluster_sizes_private_copies"),  // IN (n_copies, n_clusters)                dataT
-    py::arg("centroids_t_private_copies"),    // IN (n_copies, n_features, n_clusters,)   dataT
-    py::arg("out_cluster_sizes"),             // OUT (n_clusters,)                        dataT
-    py::arg("out_centroids_t"),               // OUT (n_features, n_clusters,)            dataT
-    py::arg("out_empty_clusters_list"),       // OUT (n_clusters,)                        indT
-    py::arg("out_n_empty_clusters"),          // OUT (1,)                                 indT
-    py::arg("work_group_size"),
-    py::arg("sycl_queue"),
-    py::arg("depends") = py::list()
-  );
+  if (!all_c_contiguous({data, indices, indptr})) {
+    throw py::value_error("CSR arrays data, indices and indptr must be C-contiguous");
+  }
 
-  m.def("compute_threshold", &py_compute_threshold,
-    "compute_threshold(data, topk, threshold, sycl_queue=q, depends=[]) finds "
-    "topk-th largest element in data and puts in threshold",
-    py::arg("data"), py::arg("topk"), py::arg("threshold"),
-    py::arg("sycl_queue"), py::arg("depends") = py::list()
-  );
+  if (data.get_shape(0) != indices.get_shape(0) || indptr.get_shape(0) < 1) {
+    throw py::value_error("CSR arrays have inconsistent dimensions");
+  }
 
-  m.def(
-    "select_samples_far_from_centroid", &py_select_samples_far_from_centroid,
-    "select_samples_far_from_centroid(n_selected, distance_to_centroid, threshold, selected_samples_idx, n_selected_gt_threshold, n_selected_eq_threshold, work_group_size, sycl_queue=q, depends=[]) "
-    " populates `selected_samples_idx` with ids of observations whose distance to nearest centroid is greater than `threshold`. The last element of `selected_samples_idx` is "
-    " populated with id of the observation whose distance to centroid centroid equals to `threshold`. `n_selected_gt_threshold` and `n_selected_eq_threshold` are temporary scalars.",
-    py::arg("n_selected"), py::arg("distance_to_centroid"), py::arg("threshold"),
-    py::arg("selected_samples_idx"), py::arg("n_selected_gt_threshold"),
-    py::arg("n_selected_eq_threshold"), py::arg("work_group_size"),
-    py::arg("sycl_queue"), py::arg("depends") = py::list()
-  );
+  if (!same_typenum_as(indices.get_typenum(), {indptr})) {
+    throw py::value_error("CSR arrays indices and indptr must have the same elemental data type");
+  }
+}
 
-  m.def(
-    "relocate_empty_clusters", &py_relocate_empty_clusters,
-    "Relocates empty clustsers, modifies centroid_t, cluster_sizes, per_sample_inertia",
-    py::arg("n_empty_clusters"),    // int
-    py::arg("X_t"),                 // IN (n_features, n_samples,)      dataT
-    py::arg("sample_weights"),      // IN (n_samples, )                 dataT
-    py::arg("assignment_id"),       // IN (n_samples, )                 indT
-    py::arg("empty_clusters_list"), // IN (n_clusters, )                indT
-    py::arg("sq_dist_to_nearest_centroid"), // IN (n_samples, )         dataT
-    py::arg("centroid_t"),          // INTOUT (n_features, n_clusters,) dataT
-    py::arg("cluster_sizes"),       // INOUT  (n_clusters, )            dataT
-    py::arg("per_sample_inertia"),  // INOUT  (n_samples,)              dataT
-    py::arg("work_group_size"),
-    py::arg("sycl_queue"),
-    py::arg("depends") = py::list()
-  );
+std::pair<sycl::event, sycl::event>
+py_assignment_csr(
+  dpctl::tensor::usm_ndarray data,       // IN (nnz,)
+  dpctl::tensor::usm_ndarray indices,    // IN (nnz,)
+  dpctl::tensor::usm_ndarray indptr,     // IN (n_samples + 1,)
+  dpctl::tensor::usm_ndarray centroid_t, // IN (n_features, n_clusters)
+  dpctl::tensor::usm_ndarray centroids_half_l2_norm, // (n_clusters,)
+  dpctl::tensor::usm_ndarray assignment_id,  // OUT (n_samples, )
+  size_t work_group_size,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends={}
+) {
+  _validate_csr_arrays(data, indices, indptr);
 
-  m.def(
-    "compute_centroid_shifts_squared", &py_compute_centroid_shifts_squared_kernel,
-    "Computes equivalent of `np.sum(np.square(old_centroid_t - new_centroid_t), axis=0)",
-    py::arg("centroid_t"),          // IN (n_features, n_clusters, )
-    py::arg("new_centroid_t"),      // IN (n_features, n_clusters, )
-    py::arg("out_centroid_shifts"), // OUT (n_clusters)
-    py::arg("sycl_queue"),
-    py::arg("depends") = py::list()
+  if (!is_2d(centroid_t) || !is_1d(centroids_half_l2_norm) || !is_1d(assignment_id)) {
+    throw py::value_error("Inputs have unexpected dimensionality.");
+  }
+
+  if (!all_c_contiguous({centroid_t, centroids_half_l2_norm, assignment_id})) {
+    throw py::value_error("Inputs must be C-contiguous arrays.");
+  }
+
+  py::ssize_t n_samples = indptr.get_shape(0) - 1;
+  py::ssize_t n_clusters = centroids_half_l2_norm.get_shape(0);
+
+  if (n_clusters != centroid_t.get_shape(1) || n_samples != assignment_id.get_shape(0)) {
+    throw py::value_error("Inputs have inconsistent dimensions.");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {
+    data.get_queue(), indices.get_queue(), indptr.get_queue(),
+    centroid_t.get_queue(), centroids_half_l2_norm.get_queue(), assignment_id.get_queue()
+  })) {
+    throw py::value_error("Execution queue is not compatible with allocation queues.");
+  }
+
+  int dataT_typenum = data.get_typenum();
+  int indT_typenum = assignment_id.get_typenum();
+
+  if (!same_typenum_as(dataT_typenum, {centroid_t, centroids_half_l2_norm}) ||
+      !same_typenum_as(indT_typenum, {indices, indptr}))
+  {
+    throw py::value_error("Inconsistent array elemental data types");
+  }
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+
+  sycl::event comp_ev;
+  if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = float;
+    using indT = std::int32_t;
+
+    comp_ev = csr_assignment<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+      q, n_samples, n_clusters, work_group_size,
+      data.get_data<dataT>(), indices.get_data<indT>(), indptr.get_data<indT>(),
+      centroid_t.get_data<dataT>(), centroids_half_l2_norm.get_data<dataT>(),
+      assignment_id.get_data<indT>(), depends
+    );
+  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = float;
+    using indT = std::int64_t;
+
+    comp_ev = csr_assignment<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+      q, n_samples, n_clusters, work_group_size,
+      data.get_data<dataT>(), indices.get_data<indT>(), indptr.get_data<indT>(),
+      centroid_t.get_data<dataT>(), centroids_half_l2_norm.get_data<dataT>(),
+      assignment_id.get_data<indT>(), depends
+    );
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+    using dataT = double;
+    using indT = std::int32_t;
+
+    comp_ev = csr_assignment<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+      q, n_samples, n_clusters, work_group_size,
+      data.get_data<dataT>(), indices.get_data<indT>(), indptr.get_data<indT>(),
+      centroid_t.get_data<dataT>(), centroids_half_l2_norm.get_data<dataT>(),
+      assignment_id.get_data<indT>(), depends
+    );
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+    using dataT = double;
+    using indT = std::int64_t;
+
+    comp_ev = csr_assignment<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+      q, n_samples, n_clusters, work_group_size,
+      data.get_data<dataT>(), indices.get_data<indT>(), indptr.get_data<indT>(),
+      centroid_t.get_data<dataT>(), centroids_half_l2_norm.get_data<dataT>(),
+      assignment_id.get_data<indT>(), depends
+    );
+  } else {
+    throw py::value_error("Unsupported array elemental data types.");
+  }
+
+  sycl::event ht_ev = dpctl::utils::keep_args_alive(q,
+    {data, indices, indptr, centroid_t, centroids_half_l2_norm, assignment_id}, {comp_ev});
+
+  return std::make_pair(ht_ev, comp_ev);
+}
+
+template <typename dataT, typename indT>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_csr_impl(
+  sycl::queue q,
+  size_t n_samples,
+  size_t n_features,
+  size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t work_group_size,
+  dpctl::tensor::usm_ndarray data,
+  dpctl::tensor::usm_ndarray indices,
+  dpctl::tensor::usm_ndarray indptr,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray init_centroids_t,
+  size_t max_iter,
+  bool verbose,
+  double tol,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray res_centroids_t
+) {
+  // out of range indices would address private copies and centroids out of bounds
+  size_t nnz = static_cast<size_t>(indices.get_shape(0));
+  if (csr_count_invalid_indices<indT>(q, nnz, n_features, indices.get_data<indT>()) > 0) {
+    throw py::value_error("Column indices must be non-negative and smaller than the number of features");
+  }
+
+  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  size_t n_iters_ = driver_lloyd_csr<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size,
+    data.get_data<dataT>(), indices.get_data<indT>(), indptr.get_data<indT>(),
+    sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(),
+    max_iter, verbose, static_cast<dataT>(tol),
+    assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+  );
+
+  return std::make_pair(n_iters_, py_total_inertia);
+}
+
+std::pair<size_t, py::array>
+py_kmeans_lloyd_driver_csr(
+  dpctl::tensor::usm_ndarray data,
+  dpctl::tensor::usm_ndarray indices,
+  dpctl::tensor::usm_ndarray indptr,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray init_centroids_t,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray res_centroids_t,
+  double tol,
+  bool verbose,
+  size_t max_iter,
+  size_t work_group_size,
+  double centroids_private_copies_max_cache_occupancy,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends = {}
+) {
+  _validate_csr_arrays(data, indices, indptr);
+
+  if (!is_1d(sample_weight) || !is_2d(init_centroids_t) || !is_2d(res_centroids_t) || !is_1d(assignment_id)) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  if (!all_c_contiguous({sample_weight, init_centroids_t, assignment_id, res_centroids_t})) {
+    throw py::value_error("All input arrays must be C-contiguous");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {
+    data.get_queue(), indices.get_queue(), indptr.get_queue(),
+    sample_weight.get_queue(), init_centroids_t.get_queue(),
+    assignment_id.get_queue(), res_centroids_t.get_queue()
+  })) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  py::ssize_t n_features = init_centroids_t.get_shape(0);
+  py::ssize_t n_samples = indptr.get_shape(0) - 1;
+  py::ssize_t n_clusters = init_centroids_t.get_shape(1);
+
+  if ( n_features != res_centroids_t.get_shape(0) ||
+       n_clusters != res_centroids_t.get_shape(1) || n_samples != sample_weight.get_shape(0) ||
+       n_samples != assignment_id.get_shape(0)
+  ) {
+    throw py::value_error("Array dimensions are not consistent");
+  }
+
+  int dataT_typenum = data.get_typenum();
+  int indT_typenum = assignment_id.get_typenum();
+
+  if (!same_typenum_as(dataT_typenum, {sample_weight, init_centroids_t, res_centroids_t}) ||
+      !same_typenum_as(indT_typenum, {indices, indptr})) {
+    throw py::value_error("Sample coordinates, weights and centroids must have the same elemental data types, "
+                          "and so must indices, indptr and assignment_id");
+  }
+
+  if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
+    throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
+  }
+
+  if (tol < 0.0) {
+    throw py::value_error("Tolerance must be non-negative");
+  }
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+
+  if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    return _kmeans_lloyd_driver_csr_impl<float, std::int32_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size,
+      data, indices, indptr, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+    );
+  } else if( dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+    return _kmeans_lloyd_driver_csr_impl<double, std::int32_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size,
+      data, indices, indptr, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+    );
+  } else if( dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    return _kmeans_lloyd_driver_csr_impl<float, std::int64_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size,
+      data, indices, indptr, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+    );
+  } else if( dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+    return _kmeans_lloyd_driver_csr_impl<double, std::int64_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size,
+      data, indices, indptr, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+    );
+  } else {
+    throw py::value_error("Unsupport elemental data type");
+  }
+}
+
+template <typename dataT, typename indT>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_streaming_impl(
+  sycl::queue q,
+  size_t n_samples,
+  size_t n_features,
+  size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  size_t chunk_size,
+  py::array X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray init_centroids_t,
+  size_t max_iter,
+  bool verbose,
+  double tol,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray res_centroids_t
+) {
+  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  size_t n_iters_ = driver_lloyd_streaming<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+    centroids_window_height, work_group_size, chunk_size,
+    static_cast<dataT const *>(X_t.data()),
+    sample_weight.get_data<dataT>(), init_centroids_t.get_data<dataT>(),
+    max_iter, verbose, static_cast<dataT>(tol),
+    assignment_id.get_data<indT>(), res_centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+  );
+
+  return std::make_pair(n_iters_, py_total_inertia);
+}
+
+std::pair<size_t, py::array>
+py_kmeans_lloyd_driver_streaming(
+  py::array X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray init_centroids_t,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray res_centroids_t,
+  double tol,
+  bool verbose,
+  size_t max_iter,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t chunk_size,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends = {}
+) {
+  if (X_t.ndim() != 2 || !is_1d(sample_weight) || !is_2d(init_centroids_t) || !is_2d(res_centroids_t) || !is_1d(assignment_id)) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  if (!(X_t.flags() & py::array::c_style) ||
+      !all_c_contiguous({sample_weight, init_centroids_t, assignment_id, res_centroids_t})) {
+    throw py::value_error("All input arrays must be C-contiguous");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {
+    sample_weight.get_queue(), init_centroids_t.get_queue(),
+    assignment_id.get_queue(), res_centroids_t.get_queue()
+  })) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  py::ssize_t n_features = X_t.shape(0);
+  py::ssize_t n_samples = X_t.shape(1);
+  py::ssize_t n_clusters = init_centroids_t.get_shape(1);
+
+  if ( n_features != init_centroids_t.get_shape(0) || n_features != res_centroids_t.get_shape(0) ||
+       n_clusters != res_centroids_t.get_shape(1) || n_samples != sample_weight.get_shape(0) ||
+       n_samples != assignment_id.get_shape(0)
+  ) {
+    throw py::value_error("Array dimensions are not consistent");
+  }
+
+  if (chunk_size == 0) {
+    throw py::value_error("Chunk size must be positive");
+  }
+
+  int dataT_typenum = sample_weight.get_typenum();
+  int indT_typenum = assignment_id.get_typenum();
+
+  if (!same_typenum_as(dataT_typenum, {init_centroids_t, res_centroids_t})) {
+    throw py::value_error("Sample weights and centroids must have the same elemental data types");
+  }
+
+  if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
+    throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
+  }
+
+  if (tol < 0.0) {
+    throw py::value_error("Tolerance must be non-negative");
+  }
+
+  // the streaming driver synchronizes on its first pass on data
+  sycl::event::wait(depends);
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+
+  if( dataT_typenum == api.UAR_FLOAT_ && X_t.dtype().is(py::dtype::of<float>()) ) {
+    if (indT_typenum == api.UAR_INT32_) {
+      return _kmeans_lloyd_driver_streaming_impl<float, std::int32_t>(
+        q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, chunk_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else if (indT_typenum == api.UAR_INT64_) {
+      return _kmeans_lloyd_driver_streaming_impl<float, std::int64_t>(
+        q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, chunk_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  } else if( dataT_typenum == api.UAR_DOUBLE_ && X_t.dtype().is(py::dtype::of<double>()) ) {
+    if (indT_typenum == api.UAR_INT32_) {
+      return _kmeans_lloyd_driver_streaming_impl<double, std::int32_t>(
+        q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, chunk_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else if (indT_typenum == api.UAR_INT64_) {
+      return _kmeans_lloyd_driver_streaming_impl<double, std::int64_t>(
+        q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, chunk_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  }
+
+  throw py::value_error("Unsupport elemental data type");
+}
+
+template <typename dataT, typename indT>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_sub_devices_impl(
+  const std::vector<sycl::queue> &queues,
+  size_t n_samples,
+  size_t n_features,
+  size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  py::array X_t,
+  py::array sample_weight,
+  py::array init_centroids_t,
+  size_t max_iter,
+  bool verbose,
+  double tol,
+  py::array assignment_id,
+  py::array res_centroids_t
+) {
+  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  size_t n_iters_ = driver_lloyd_sub_devices<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+    queues, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+    centroids_window_height, work_group_size,
+    static_cast<dataT const *>(X_t.data()),
+    static_cast<dataT const *>(sample_weight.data()),
+    static_cast<dataT const *>(init_centroids_t.data()),
+    max_iter, verbose, static_cast<dataT>(tol),
+    static_cast<indT *>(assignment_id.mutable_data()),
+    static_cast<dataT *>(res_centroids_t.mutable_data()),
+    *total_inertia_ptr, py_print_fn
+  );
+
+  return std::make_pair(n_iters_, py_total_inertia);
+}
+
+// Validates arguments of drivers taking all arrays in host memory, returns
+// (is_float, is_int32) describing their elemental data types
+std::pair<bool, bool>
+_check_host_lloyd_driver_args(
+  const py::array &X_t,
+  const py::array &sample_weight,
+  const py::array &init_centroids_t,
+  const py::array &assignment_id,
+  const py::array &res_centroids_t,
+  double tol,
+  double centroids_private_copies_max_cache_occupancy
+) {
+  if (X_t.ndim() != 2 || sample_weight.ndim() != 1 || init_centroids_t.ndim() != 2 ||
+      res_centroids_t.ndim() != 2 || assignment_id.ndim() != 1) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  for (const py::array &arr : {X_t, sample_weight, init_centroids_t, assignment_id, res_centroids_t}) {
+    if (!(arr.flags() & py::array::c_style)) {
+      throw py::value_error("All input arrays must be C-contiguous");
+    }
+  }
+
+  if (!assignment_id.writeable() || !res_centroids_t.writeable()) {
+    throw py::value_error("Output arrays must be writeable");
+  }
+
+  py::ssize_t n_features = X_t.shape(0);
+  py::ssize_t n_samples = X_t.shape(1);
+  py::ssize_t n_clusters = init_centroids_t.shape(1);
+
+  if ( n_features != init_centroids_t.shape(0) || n_features != res_centroids_t.shape(0) ||
+       n_clusters != res_centroids_t.shape(1) || n_samples != sample_weight.shape(0) ||
+       n_samples != assignment_id.shape(0)
+  ) {
+    throw py::value_error("Array dimensions are not consistent");
+  }
+
+  if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
+    throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
+  }
+
+  if (tol < 0.0) {
+    throw py::value_error("Tolerance must be non-negative");
+  }
+
+  auto same_dtype = [](const py::dtype &dt, std::initializer_list<py::array> arrs) {
+    for (const py::array &arr : arrs) {
+      if (!arr.dtype().is(dt)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  bool is_float = same_dtype(py::dtype::of<float>(), {X_t, sample_weight, init_centroids_t, res_centroids_t});
+  bool is_double = same_dtype(py::dtype::of<double>(), {X_t, sample_weight, init_centroids_t, res_centroids_t});
+  bool is_int32 = assignment_id.dtype().is(py::dtype::of<std::int32_t>());
+  bool is_int64 = assignment_id.dtype().is(py::dtype::of<std::int64_t>());
+
+  if (!(is_float || is_double) || !(is_int32 || is_int64)) {
+    throw py::value_error("Unsupport elemental data type");
+  }
+
+  return std::make_pair(is_float, is_int32);
+}
+
+std::pair<size_t, py::array>
+py_kmeans_lloyd_driver_sub_devices(
+  py::array X_t,
+  py::array sample_weight,
+  py::array init_centroids_t,
+  py::array assignment_id,
+  py::array res_centroids_t,
+  double tol,
+  bool verbose,
+  size_t max_iter,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  double centroids_private_copies_max_cache_occupancy,
+  sycl::queue q
+) {
+  auto [is_float, is_int32] = _check_host_lloyd_driver_args(
+    X_t, sample_weight, init_centroids_t, assignment_id, res_centroids_t,
+    tol, centroids_private_copies_max_cache_occupancy);
+
+  size_t n_features = X_t.shape(0);
+  size_t n_samples = X_t.shape(1);
+  size_t n_clusters = init_centroids_t.shape(1);
+
+  std::vector<sycl::queue> queues = make_numa_sub_device_queues(q.get_device());
+
+  if (is_float) {
+    if (is_int32) {
+      return _kmeans_lloyd_driver_sub_devices_impl<float, std::int32_t>(
+        queues, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else {
+      return _kmeans_lloyd_driver_sub_devices_impl<float, std::int64_t>(
+        queues, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  } else {
+    if (is_int32) {
+      return _kmeans_lloyd_driver_sub_devices_impl<double, std::int32_t>(
+        queues, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else {
+      return _kmeans_lloyd_driver_sub_devices_impl<double, std::int64_t>(
+        queues, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  }
+}
+
+size_t
+py_numa_sub_devices_count(sycl::queue q) {
+  return make_numa_sub_device_queues(q.get_device()).size();
+}
+
+template <typename dataT, typename indT>
+std::pair<size_t, py::array>
+_kmeans_lloyd_driver_distributed_impl(
+  communicator &comm,
+  const std::vector<sycl::queue> &queues,
+  size_t n_local_samples,
+  size_t n_features,
+  size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  py::array X_t,
+  py::array sample_weight,
+  py::array init_centroids_t,
+  size_t max_iter,
+  bool verbose,
+  double tol,
+  py::array assignment_id,
+  py::array res_centroids_t
+) {
+  // the GIL is released while ranks wait on each other, possibly in threads
+  // of this very process
+  auto py_print_fn = [](const std::stringstream &ss) -> void {
+    py::gil_scoped_acquire acquire;
+    py::print( ss.str() );
+  };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  dataT const *X_t_ptr = static_cast<dataT const *>(X_t.data());
+  dataT const *sample_weight_ptr = static_cast<dataT const *>(sample_weight.data());
+  dataT const *init_centroids_t_ptr = static_cast<dataT const *>(init_centroids_t.data());
+  indT *assignment_id_ptr = static_cast<indT *>(assignment_id.mutable_data());
+  dataT *res_centroids_t_ptr = static_cast<dataT *>(res_centroids_t.mutable_data());
+
+  size_t n_iters_;
+  {
+    py::gil_scoped_release release;
+
+    n_iters_ = driver_lloyd_distributed<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+      comm, queues, n_local_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+      centroids_window_height, work_group_size,
+      X_t_ptr, sample_weight_ptr, init_centroids_t_ptr,
+      max_iter, verbose, static_cast<dataT>(tol),
+      assignment_id_ptr, res_centroids_t_ptr, *total_inertia_ptr, py_print_fn
+    );
+  }
+
+  return std::make_pair(n_iters_, py_total_inertia);
+}
+
+std::pair<size_t, py::array>
+py_kmeans_lloyd_driver_distributed(
+  std::shared_ptr<communicator> comm,
+  py::array X_t,
+  py::array sample_weight,
+  py::array init_centroids_t,
+  py::array assignment_id,
+  py::array res_centroids_t,
+  double tol,
+  bool verbose,
+  size_t max_iter,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  double centroids_private_copies_max_cache_occupancy,
+  sycl::queue q,
+  bool use_sub_devices
+) {
+  if (!comm) {
+    throw py::value_error("A communicator is required");
+  }
+
+  auto [is_float, is_int32] = _check_host_lloyd_driver_args(
+    X_t, sample_weight, init_centroids_t, assignment_id, res_centroids_t,
+    tol, centroids_private_copies_max_cache_occupancy);
+
+  size_t n_features = X_t.shape(0);
+  size_t n_local_samples = X_t.shape(1);
+  size_t n_clusters = init_centroids_t.shape(1);
+
+  std::vector<sycl::queue> queues =
+    (use_sub_devices) ? make_numa_sub_device_queues(q.get_device()) : std::vector<sycl::queue>{q};
+
+  if (is_float) {
+    if (is_int32) {
+      return _kmeans_lloyd_driver_distributed_impl<float, std::int32_t>(
+        *comm, queues, n_local_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else {
+      return _kmeans_lloyd_driver_distributed_impl<float, std::int64_t>(
+        *comm, queues, n_local_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  } else {
+    if (is_int32) {
+      return _kmeans_lloyd_driver_distributed_impl<double, std::int32_t>(
+        *comm, queues, n_local_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    } else {
+      return _kmeans_lloyd_driver_distributed_impl<double, std::int64_t>(
+        *comm, queues, n_local_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size,
+        X_t, sample_weight, init_centroids_t, max_iter, verbose, tol, assignment_id, res_centroids_t
+      );
+    }
+  }
+}
+
+py::tuple
+py_npy_header(const std::string &path) {
+  npy_header_info info = read_npy_header(path);
+
+  py::tuple shape(info.shape.size());
+  for(size_t i = 0; i < info.shape.size(); ++i) {
+    shape[i] = py::int_(info.shape[i]);
+  }
+
+  return py::make_tuple(info.descr, info.fortran_order, shape, info.data_offset);
+}
+
+void
+py_read_X_t_from_file(
+  const std::string &path,
+  size_t data_offset,
+  py::dtype src_dtype,
+  bool fortran_order,
+  dpctl::tensor::usm_ndarray X_t,
+  size_t chunk_size,
+  size_t n_threads,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends = {}
+) {
+  if (!is_2d(X_t)) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  if (!X_t.is_c_contiguous()) {
+    throw py::value_error("All input arrays must be C-contiguous");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {X_t.get_queue()})) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  if (src_dtype.attr("byteorder").cast<std::string>() == ">") {
+    throw py::value_error("Big-endian files are not supported");
+  }
+
+  size_t n_features = X_t.get_shape(0);
+  size_t n_samples = X_t.get_shape(1);
+
+  sycl::event::wait(depends);
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+  int dataT_typenum = X_t.get_typenum();
+  bool src_is_float = (src_dtype.kind() == 'f' && src_dtype.itemsize() == 4);
+  bool src_is_double = (src_dtype.kind() == 'f' && src_dtype.itemsize() == 8);
+
+  if (dataT_typenum == api.UAR_FLOAT_ && src_is_float) {
+    read_X_t_from_file<float, float>(
+      q, path, data_offset, fortran_order, n_samples, n_features, chunk_size, n_threads, X_t.get_data<float>());
+  } else if (dataT_typenum == api.UAR_FLOAT_ && src_is_double) {
+    read_X_t_from_file<float, double>(
+      q, path, data_offset, fortran_order, n_samples, n_features, chunk_size, n_threads, X_t.get_data<float>());
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && src_is_float) {
+    read_X_t_from_file<double, float>(
+      q, path, data_offset, fortran_order, n_samples, n_features, chunk_size, n_threads, X_t.get_data<double>());
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && src_is_double) {
+    read_X_t_from_file<double, double>(
+      q, path, data_offset, fortran_order, n_samples, n_features, chunk_size, n_threads, X_t.get_data<double>());
+  } else {
+    throw py::value_error("Unsupport elemental data type");
+  }
+}
+
+template <typename dataT>
+py::tuple
+_build_coreset_impl(
+  sycl::queue q,
+  size_t n_samples, size_t n_features, size_t n_clusters,
+  size_t centroids_window_height, size_t work_group_size,
+  size_t coreset_size, std::uint64_t seed,
+  dpctl::tensor::usm_ndarray X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray rough_centroids_t,
+  const std::vector<sycl::event> &depends
+) {
+  py::object dpt_empty = py::module_::import("dpctl.tensor").attr("empty");
+  py::object dtype = X_t.attr("dtype");
+  py::object coreset_X_t, coreset_weight;
+
+  auto alloc_fn = [&](size_t n_coreset_samples) {
+    coreset_X_t = dpt_empty(py::make_tuple(n_features, n_coreset_samples), py::arg("dtype") = dtype, py::arg("sycl_queue") = q);
+    coreset_weight = dpt_empty(py::make_tuple(n_coreset_samples), py::arg("dtype") = dtype, py::arg("sycl_queue") = q);
+    return std::make_pair(
+      coreset_X_t.cast<dpctl::tensor::usm_ndarray>().get_data<dataT>(),
+      coreset_weight.cast<dpctl::tensor::usm_ndarray>().get_data<dataT>()
+    );
+  };
+
+  build_coreset<dataT, std::int32_t, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+    q, n_samples, n_features, n_clusters, centroids_window_height, work_group_size, coreset_size, seed,
+    X_t.get_data<dataT>(), sample_weight.get_data<dataT>(), rough_centroids_t.get_data<dataT>(),
+    alloc_fn, depends
+  );
+
+  return py::make_tuple(coreset_X_t, coreset_weight);
+}
+
+template <typename dataT, typename indT>
+py::tuple
+_kmeans_bisecting_driver_impl(
+  sycl::queue q,
+  size_t n_samples, size_t n_features, size_t n_clusters,
+  double centroids_private_copies_max_cache_occupancy, size_t centroids_window_height, size_t work_group_size,
+  dpctl::tensor::usm_ndarray X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  size_t max_iter, double tol, std::uint64_t seed,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray centroids_t
+) {
+  auto py_print_fn = [](const std::stringstream &ss) -> void { py::print( ss.str() ); };
+
+  auto tmp = py::array_t<dataT>(1);
+  dataT *total_inertia_ptr = tmp.mutable_data(0);
+  py::array py_total_inertia = py::cast<py::array>(tmp);
+
+  std::vector<size_t> split_parents =
+    driver_bisecting<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, decltype(py_print_fn)>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t.get_data<dataT>(), sample_weight.get_data<dataT>(),
+      max_iter, static_cast<dataT>(tol), seed,
+      assignment_id.get_data<indT>(), centroids_t.get_data<dataT>(), *total_inertia_ptr, py_print_fn
+    );
+
+  py::array_t<std::uint64_t> py_split_parents(split_parents.size());
+  std::copy(split_parents.begin(), split_parents.end(), py_split_parents.mutable_data());
+
+  return py::make_tuple(py_total_inertia, py_split_parents);
+}
+
+/*! @brief Bisecting k-means. Returns (total_inertia, split_parents), cluster
+    split_parents[s] having been split at step s into itself and cluster s + 1. */
+py::tuple
+py_kmeans_bisecting_driver(
+  dpctl::tensor::usm_ndarray X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray assignment_id,
+  dpctl::tensor::usm_ndarray centroids_t,
+  double tol,
+  size_t max_iter,
+  std::uint64_t seed,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  double centroids_private_copies_max_cache_occupancy,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends = {}
+) {
+  if (!is_2d(X_t) || !is_1d(sample_weight) || !is_1d(assignment_id) || !is_2d(centroids_t)) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  if (!all_c_contiguous({X_t, sample_weight, assignment_id, centroids_t})) {
+    throw py::value_error("All input arrays must be C-contiguous");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {
+    X_t.get_queue(), sample_weight.get_queue(), assignment_id.get_queue(), centroids_t.get_queue()
+  })) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  py::ssize_t n_features = X_t.get_shape(0);
+  py::ssize_t n_samples = X_t.get_shape(1);
+  py::ssize_t n_clusters = centroids_t.get_shape(1);
+
+  if (n_features != centroids_t.get_shape(0) || n_samples != sample_weight.get_shape(0) ||
+      n_samples != assignment_id.get_shape(0)) {
+    throw py::value_error("Array dimensions are not consistent");
+  }
+
+  if (n_clusters == 0 || n_clusters > n_samples) {
+    throw py::value_error("Number of clusters must be positive and at most the number of samples");
+  }
+
+  int dataT_typenum = X_t.get_typenum();
+  int indT_typenum = assignment_id.get_typenum();
+
+  if (!same_typenum_as(dataT_typenum, {sample_weight, centroids_t})) {
+    throw py::value_error("Sample coordinates, weights and centroids must have the same elemental data types");
+  }
+
+  if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
+    throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
+  }
+
+  if (tol < 0.0) {
+    throw py::value_error("Tolerance must be non-negative");
+  }
+
+  sycl::event::wait(depends);
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+
+  if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT32_) {
+    return _kmeans_bisecting_driver_impl<float, std::int32_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, max_iter, tol, seed, assignment_id, centroids_t);
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT32_) {
+    return _kmeans_bisecting_driver_impl<double, std::int32_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, max_iter, tol, seed, assignment_id, centroids_t);
+  } else if (dataT_typenum == api.UAR_FLOAT_ && indT_typenum == api.UAR_INT64_) {
+    return _kmeans_bisecting_driver_impl<float, std::int64_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, max_iter, tol, seed, assignment_id, centroids_t);
+  } else if (dataT_typenum == api.UAR_DOUBLE_ && indT_typenum == api.UAR_INT64_) {
+    return _kmeans_bisecting_driver_impl<double, std::int64_t>(
+      q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+      X_t, sample_weight, max_iter, tol, seed, assignment_id, centroids_t);
+  } else {
+    throw py::value_error("Unsupported elemental data types");
+  }
+}
+
+/*! @brief Builds an importance-sampled coreset of about `coreset_size` weighted samples
+    from rough centroids. Returns (coreset_X_t, coreset_weight). */
+py::tuple
+py_build_coreset(
+  dpctl::tensor::usm_ndarray X_t,
+  dpctl::tensor::usm_ndarray sample_weight,
+  dpctl::tensor::usm_ndarray rough_centroids_t,
+  size_t coreset_size,
+  std::uint64_t seed,
+  size_t centroids_window_height,
+  size_t work_group_size,
+  sycl::queue q,
+  const std::vector<sycl::event> &depends = {}
+) {
+  if (!is_2d(X_t) || !is_1d(sample_weight) || !is_2d(rough_centroids_t)) {
+    throw py::value_error("Unsupported array dimensionalities");
+  }
+
+  if (!all_c_contiguous({X_t, sample_weight, rough_centroids_t})) {
+    throw py::value_error("All input arrays must be C-contiguous");
+  }
+
+  if (!dpctl::utils::queues_are_compatible(q, {X_t.get_queue(), sample_weight.get_queue(), rough_centroids_t.get_queue()})) {
+    throw py::value_error("Execution queue is not compatible with allocation queues");
+  }
+
+  py::ssize_t n_features = X_t.get_shape(0);
+  py::ssize_t n_samples = X_t.get_shape(1);
+  py::ssize_t n_clusters = rough_centroids_t.get_shape(1);
+
+  if (n_features != rough_centroids_t.get_shape(0) || n_samples != sample_weight.get_shape(0)) {
+    throw py::value_error("Array dimensions are not consistent");
+  }
+
+  if (coreset_size == 0) {
+    throw py::value_error("`coreset_size` must be positive");
+  }
+
+  int dataT_typenum = X_t.get_typenum();
+  if (!same_typenum_as(dataT_typenum, {sample_weight, rough_centroids_t})) {
+    throw py::value_error("Sample coordinates, weights and centroids must have the same elemental data types");
+  }
+
+  const auto &api = dpctl::detail::dpctl_capi::get();
+
+  if (dataT_typenum == api.UAR_FLOAT_) {
+    return _build_coreset_impl<float>(
+      q, n_samples, n_features, n_clusters, centroids_window_height, work_group_size, coreset_size, seed,
+      X_t, sample_weight, rough_centroids_t, depends);
+  } else if (dataT_typenum == api.UAR_DOUBLE_) {
+    return _build_coreset_impl<double>(
+      q, n_samples, n_features, n_clusters, centroids_window_height, work_group_size, coreset_size, seed,
+      X_t, sample_weight, rough_centroids_t, depends);
+  } else {
+    throw py::value_error("Unsupported elemental data type. Expecting single or double precision floating point numbers");
+  }
+}
+
+/*! @brief Online k-means state over an append-only stream of samples.
+    Centroids are of the type of `init_centroids_t`, running sums are kept in
+    double precision for single precision data if `accumulate_in_double`. */
+class py_online_kmeans {
+  template <typename dataT, typename accT>
+  using state_t = online_kmeans_state<
+    dataT, std::int32_t, preferred_work_group_size_multiple, centroids_window_width_multiplier, accT>;
+
+public:
+  py_online_kmeans(
+    dpctl::tensor::usm_ndarray init_centroids_t,
+    size_t max_chunk_size,
+    double decay,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    double centroids_private_copies_max_cache_occupancy,
+    bool accumulate_in_double,
+    const std::vector<sycl::event> &depends
+  ) : q_(init_centroids_t.get_queue()) {
+    if (!is_2d(init_centroids_t) || !init_centroids_t.is_c_contiguous()) {
+      throw py::value_error("Initial centroids must be a C-contiguous matrix");
+    }
+
+    if (max_chunk_size == 0) {
+      throw py::value_error("`max_chunk_size` must be positive");
+    }
+
+    if (decay <= 0.0 || decay > 1.0) {
+      throw py::value_error("`decay` must be in (0, 1]");
+    }
+
+    if (centroids_private_copies_max_cache_occupancy <= 0.0 || centroids_private_copies_max_cache_occupancy >= 1.0) {
+      throw py::value_error("Fraction `centroids_private_copies_max_cache_occupancy` is out of bounds");
+    }
+
+    size_t n_features = init_centroids_t.get_shape(0);
+    size_t n_clusters = init_centroids_t.get_shape(1);
+
+    const auto &api = dpctl::detail::dpctl_capi::get();
+    dataT_typenum_ = init_centroids_t.get_typenum();
+
+    bool mixed_precision = accumulate_in_double && (dataT_typenum_ == api.UAR_FLOAT_);
+    if (mixed_precision) {
+      const auto &dev = q_.get_device();
+      if (!dev.has(sycl::aspect::fp64) || !dev.has(sycl::aspect::atomic64)) {
+        throw py::value_error("Accumulation in double precision requires a device supporting fp64 atomics");
+      }
+    }
+
+    if (dataT_typenum_ == api.UAR_FLOAT_ && mixed_precision) {
+      accT_typenum_ = api.UAR_DOUBLE_;
+      state_ = std::make_unique<state_t<float, double>>(
+        q_, n_features, n_clusters, max_chunk_size, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, decay, init_centroids_t.get_data<float>(), depends);
+    } else if (dataT_typenum_ == api.UAR_FLOAT_) {
+      accT_typenum_ = api.UAR_FLOAT_;
+      state_ = std::make_unique<state_t<float, float>>(
+        q_, n_features, n_clusters, max_chunk_size, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, static_cast<float>(decay), init_centroids_t.get_data<float>(), depends);
+    } else if (dataT_typenum_ == api.UAR_DOUBLE_) {
+      accT_typenum_ = api.UAR_DOUBLE_;
+      state_ = std::make_unique<state_t<double, double>>(
+        q_, n_features, n_clusters, max_chunk_size, centroids_private_copies_max_cache_occupancy,
+        centroids_window_height, work_group_size, decay, init_centroids_t.get_data<double>(), depends);
+    } else {
+      throw py::value_error("Unsupported elemental data type. Expecting single or double precision floating point numbers");
+    }
+
+    // initial centroids are copied, the array is released once they are
+    keep_alive_ev_ = ::dpctl::utils::keep_args_alive(q_, {init_centroids_t}, {last_event()});
+  }
+
+  std::pair<sycl::event, sycl::event>
+  partial_fit(
+    dpctl::tensor::usm_ndarray X_chunk_t,
+    dpctl::tensor::usm_ndarray sample_weight,
+    std::optional<dpctl::tensor::usm_ndarray> assignment_id,
+    const std::vector<sycl::event> &depends
+  ) {
+    if (!is_2d(X_chunk_t) || !is_1d(sample_weight) || !all_c_contiguous({X_chunk_t, sample_weight})) {
+      throw py::value_error("Samples must be a C-contiguous matrix and weights a C-contiguous vector");
+    }
+
+    size_t n_chunk_samples = X_chunk_t.get_shape(1);
+    if (static_cast<size_t>(X_chunk_t.get_shape(0)) != n_features() || static_cast<size_t>(sample_weight.get_shape(0)) != n_chunk_samples) {
+      throw py::value_error("Array dimensions are not consistent");
+    }
+
+    if (n_chunk_samples > max_chunk_size()) {
+      throw py::value_error("Chunk of samples exceeds `max_chunk_size`");
+    }
+
+    if (!same_typenum_as(dataT_typenum_, {X_chunk_t, sample_weight})) {
+      throw py::value_error("Samples and weights must have the elemental data type of centroids");
+    }
+
+    if (!dpctl::utils::queues_are_compatible(q_, {X_chunk_t.get_queue(), sample_weight.get_queue()})) {
+      throw py::value_error("Execution queue is not compatible with allocation queues");
+    }
+
+    std::int32_t *assignment_id_ptr = nullptr;
+    if (assignment_id) {
+      const auto &api = dpctl::detail::dpctl_capi::get();
+      if (!is_1d(*assignment_id) || !assignment_id->is_c_contiguous() ||
+          static_cast<size_t>(assignment_id->get_shape(0)) != n_chunk_samples ||
+          assignment_id->get_typenum() != api.UAR_INT32_) {
+        throw py::value_error("Labels must be a C-contiguous vector of int32 with an element per sample");
+      }
+      if (!dpctl::utils::queues_are_compatible(q_, {assignment_id->get_queue()})) {
+        throw py::value_error("Execution queue is not compatible with allocation queues");
+      }
+      assignment_id_ptr = assignment_id->get_data<std::int32_t>();
+    }
+
+    sycl::event comp_ev = std::visit(
+      [&](auto &state) {
+        using dataT = typename std::remove_reference_t<decltype(*state)>::data_type;
+        return state->partial_fit(
+          n_chunk_samples, X_chunk_t.get_data<dataT>(), sample_weight.get_data<dataT>(), assignment_id_ptr, depends);
+      }, state_);
+
+    sycl::event ht_ev = (assignment_id) ?
+      ::dpctl::utils::keep_args_alive(q_, {X_chunk_t, sample_weight, *assignment_id}, {comp_ev}) :
+      ::dpctl::utils::keep_args_alive(q_, {X_chunk_t, sample_weight}, {comp_ev});
+    return std::make_pair(ht_ev, comp_ev);
+  }
+
+  std::pair<sycl::event, sycl::event>
+  copy_centroids_t(dpctl::tensor::usm_ndarray out, const std::vector<sycl::event> &depends) {
+    if (!is_2d(out) || !out.is_c_contiguous() ||
+        static_cast<size_t>(out.get_shape(0)) != n_features() || static_cast<size_t>(out.get_shape(1)) != n_clusters() ||
+        out.get_typenum() != dataT_typenum_) {
+      throw py::value_error("Expecting a C-contiguous (n_features, n_clusters) matrix of the elemental type of centroids");
+    }
+
+    if (!dpctl::utils::queues_are_compatible(q_, {out.get_queue()})) {
+      throw py::value_error("Execution queue is not compatible with allocation queues");
+    }
+
+    sycl::event comp_ev = std::visit(
+      [&](auto &state) {
+        using dataT = typename std::remove_reference_t<decltype(*state)>::data_type;
+        return state->copy_centroids_t(out.get_data<dataT>(), depends);
+      }, state_);
+
+    sycl::event ht_ev = ::dpctl::utils::keep_args_alive(q_, {out}, {comp_ev});
+    return std::make_pair(ht_ev, comp_ev);
+  }
+
+  std::pair<sycl::event, sycl::event>
+  copy_cluster_weights(dpctl::tensor::usm_ndarray out, const std::vector<sycl::event> &depends) {
+    if (!is_1d(out) || !out.is_c_contiguous() || static_cast<size_t>(out.get_shape(0)) != n_clusters() ||
+        out.get_typenum() != accT_typenum_) {
+      throw py::value_error("Expecting a C-contiguous (n_clusters,) vector of the elemental type of running sums");
+    }
+
+    if (!dpctl::utils::queues_are_compatible(q_, {out.get_queue()})) {
+      throw py::value_error("Execution queue is not compatible with allocation queues");
+    }
+
+    sycl::event comp_ev = std::visit(
+      [&](auto &state) {
+        using accT = typename std::remove_reference_t<decltype(*state)>::acc_type;
+        return state->copy_cluster_weights(out.get_data<accT>(), depends);
+      }, state_);
+
+    sycl::event ht_ev = ::dpctl::utils::keep_args_alive(q_, {out}, {comp_ev});
+    return std::make_pair(ht_ev, comp_ev);
+  }
+
+  size_t n_features() const { return std::visit([](auto &state) { return state->n_features(); }, state_); }
+  size_t n_clusters() const { return std::visit([](auto &state) { return state->n_clusters(); }, state_); }
+  size_t max_chunk_size() const { return std::visit([](auto &state) { return state->max_chunk_size(); }, state_); }
+  size_t n_seen_samples() const { return std::visit([](auto &state) { return state->n_seen_samples(); }, state_); }
+  sycl::queue queue() const { return q_; }
+
+private:
+  sycl::event last_event() const { return std::visit([](auto &state) { return state->last_event(); }, state_); }
+
+  sycl::queue q_;
+  int dataT_typenum_;
+  int accT_typenum_;
+  std::variant<
+    std::unique_ptr<state_t<float, float>>,
+    std::unique_ptr<state_t<float, double>>,
+    std::unique_ptr<state_t<double, double>>
+  > state_;
+  sycl::event keep_alive_ev_;
+};
+
+PYBIND11_MODULE(_kmeans_dpcpp, m) {
+  m.def(
+    "broadcast_divide", &py_broadcast_divide,
+          "broadcast_divide(divident=src, divisor=dst, sycl_queue=q, depends=[]) evaluates "
+    "`src /= dst` for matrix src and vector dst",
+          py::arg("divident"), py::arg("divisor"),
+          py::arg("sycl_queue"), py::arg("depends")=py::list()
+  );
+  m.def(
+    "half_l2_norm_squared", &py_half_l2_norm_squared,
+          "half_l2_norm_squared(centroids=X, centroids_half_l2_norm_squared=y, sycl_queue=q, depends=[]) "
+    "computes row-wise half of norm squared of X and places it in y",
+          py::arg("centroids"), py::arg("centroids_half_l2_norm_squared"),
+          py::arg("sycl_queue"), py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "reduce_centroids_data", &py_reduce_centroids_data,
+    "reduce_centroids_data(cluster_sizes_private_copies, centroids_t_private_copies, out_cluster_sizes, "
+    " out_centroids_t, out_empty_clusters_list, out_n_empty_clusters, sycl_queue=q, depends=[], reset_private_copies=False)",
+    py::arg("cluster_sizes_private_copies"),  // IN (n_copies, n_clusters)                dataT
+    py::arg("centroids_t_private_copies"),    // IN (n_copies, n_features, n_clusters,)   dataT
+    py::arg("out_cluster_sizes"),             // OUT (n_clusters,)                        dataT
+    py::arg("out_centroids_t"),               // OUT (n_features, n_clusters,)            dataT
+    py::arg("out_empty_clusters_list"),       // OUT (n_clusters,)                        indT
+    py::arg("out_n_empty_clusters"),          // OUT (1,)                                 indT
+    py::arg("work_group_size"),
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list(),
+    py::arg("reset_private_copies") = false   // bool, zero private copies once read
+  );
+
+  m.def("compute_threshold", &py_compute_threshold,
+    "compute_threshold(data, topk, threshold, sycl_queue=q, depends=[]) finds "
+    "topk-th largest element in data and puts in threshold",
+    py::arg("data"), py::arg("topk"), py::arg("threshold"),
+    py::arg("sycl_queue"), py::arg("depends") = py::list()
+  );
+
+  m.def("radix_sort", &py_radix_sort,
+    "radix_sort(keys, sorted_keys, sorted_idx, work_group_size, sycl_queue=q, descending=False, depends=[]) "
+    "stably sorts keys into sorted_keys, and the indices of keys into sorted_idx, "
+    "with a LSD radix sort",
+    py::arg("keys"), py::arg("sorted_keys"), py::arg("sorted_idx"),
+    py::arg("work_group_size"), py::arg("sycl_queue"),
+    py::arg("descending") = false, py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "select_samples_far_from_centroid", &py_select_samples_far_from_centroid,
+    "select_samples_far_from_centroid(n_selected, distance_to_centroid, threshold, selected_samples_idx, n_selected_gt_threshold, n_selected_eq_threshold, work_group_size, sycl_queue=q, depends=[]) "
+    " populates `selected_samples_idx` with ids of observations whose distance to nearest centroid is greater than `threshold`. The last element of `selected_samples_idx` is "
+    " populated with id of the observation whose distance to centroid centroid equals to `threshold`. `n_selected_gt_threshold` and `n_selected_eq_threshold` are temporary scalars.",
+    py::arg("n_selected"), py::arg("distance_to_centroid"), py::arg("threshold"),
+    py::arg("selected_samples_idx"), py::arg("n_selected_gt_threshold"),
+    py::arg("n_selected_eq_threshold"), py::arg("work_group_size"),
+    py::arg("sycl_queue"), py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "relocate_empty_clusters", &py_relocate_empty_clusters,
+    "Relocates empty clustsers, modifies centroid_t, cluster_sizes, per_sample_inertia",
+    py::arg("n_empty_clusters"),    // int
+    py::arg("X_t"),                 // IN (n_features, n_samples,)      dataT
+    py::arg("sample_weights"),      // IN (n_samples, )                 dataT
+    py::arg("assignment_id"),       // IN (n_samples, )                 indT
+    py::arg("empty_clusters_list"), // IN (n_clusters, )                indT
+    py::arg("sq_dist_to_nearest_centroid"), // IN (n_samples, )         dataT
+    py::arg("centroid_t"),          // INTOUT (n_features, n_clusters,) dataT
+    py::arg("cluster_sizes"),       // INOUT  (n_clusters, )            dataT
+    py::arg("per_sample_inertia"),  // INOUT  (n_samples,)              dataT
+    py::arg("work_group_size"),
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "compute_centroid_shifts_squared", &py_compute_centroid_shifts_squared_kernel,
+    "Computes equivalent of `np.sum(np.square(old_centroid_t - new_centroid_t), axis=0)",
+    py::arg("centroid_t"),          // IN (n_features, n_clusters, )
+    py::arg("new_centroid_t"),      // IN (n_features, n_clusters, )
+    py::arg("out_centroid_shifts"), // OUT (n_clusters)
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
   );
 
   m.def(
@@ -1424,6 +2940,271 @@ PYBIND11_MODULE(_kmeans_dpcpp, m) {
     py::arg("work_group_size"),
     py::arg("centroids_private_copies_max_cache_occupancy"), // double, fraction in (0, 1)
     py::arg("sycl_queue"), 
+    py::arg("depends") = py::list(),
+    py::arg("accumulate_in_double") = false, // bool, accumulate centroids of single precision data in double precision
+    py::arg("X_row_major") = false,          // bool, X_t is given as X with shape (n_samples, n_features)
+    py::arg("profile") = py::none(),         // list, if given, populated with a dict per profiled command
+    py::arg("callback") = py::none(),        // callable, if given, called with a dict of metrics after each iteration
+    py::arg("label_change_tol") = py::none(), // float in [0, 1), if given, also stop once at most this fraction of labels changed
+    py::arg("n_labeled_samples") = 0,         // size_t, warm start, leading labels of assignments_id are kept as initial labels
+    py::arg("spherical") = false,             // bool, cosine k-means of normalized samples, centroids are kept normalized
+    py::arg("double_buffer_private_copies") = false, // bool, zero private copies of the next iteration during the reduction of this one
+    py::arg("use_command_graph") = false,     // bool, record commands of a lloyd step once and replay them at every iteration, as a command graph where supported
+    py::arg("reset_private_copies_in_reduction") = false, // bool, private copies are zeroed by their reduction instead of fills
+    py::arg("adaptive_private_copies") = false, // bool, tune the number of private copies and their mapping at first iterations
+    py::arg("update_strategy") = "private_copies" // str, 'private_copies' (atomics) or 'sort_by_label' (sort and segmented reduction)
+  );
+
+  m.def(
+    "assignment_csr", &py_assignment_csr,
+    "Compute assignment of samples given as CSR matrix (data, indices, indptr) to nearest centroids.",
+    py::arg("data"),                    // IN (nnz,)
+    py::arg("indices"),                 // IN (nnz,)
+    py::arg("indptr"),                  // IN (n_samples + 1,)
+    py::arg("centroids_t"),             // IN (n_features, n_clusters, )
+    py::arg("centroids_half_l2_norm"),  // IN (n_clusters, )
+    py::arg("assignment_id"),           // OUT (n_samples,)
+    py::arg("work_group_size"),
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "kmeans_lloyd_driver_csr",
+    &py_kmeans_lloyd_driver_csr,
+    "Implement Lloyd's refinement algorithm for samples given as CSR matrix (data, indices, indptr). "
+    "Returns 2-tuple, number of iterations performed and 0d numpy array with total_inertia "
+    "of the returned configuration. "
+    ""
+    "Array init_centroid_t is overwritten.",
+    py::arg("data"),            // IN        (nnz, )
+    py::arg("indices"),         // IN        (nnz, )
+    py::arg("indptr"),          // IN        (n_samples + 1, )
+    py::arg("sample_weight"),   // IN        (n_sample, )
+    py::arg("init_centroid_t"), // IN-OUT    (n_features, n_clusters,)
+    py::arg("assignments_id"),  // OUT       (n_samples, )
+    py::arg("res_centroids_t"), // OUT       (n_features, n_clusters,)
+    py::arg("tol"),             // double
+    py::arg("verbose"),         // bool
+    py::arg("max_iter"),        // size_t
+    py::arg("work_group_size"),
+    py::arg("centroids_private_copies_max_cache_occupancy"), // double, fraction in (0, 1)
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "kmeans_lloyd_driver_streaming",
+    &py_kmeans_lloyd_driver_streaming,
+    "Implement Lloyd's refinement algorithm for X_t residing in host memory, e.g. a numpy.memmap, "
+    "streamed to the device in chunks of `chunk_size` samples at every pass on data. "
+    "Returns 2-tuple, number of iterations performed and 0d numpy array with total_inertia "
+    "of the returned configuration. "
+    ""
+    "Array init_centroid_t is overwritten.",
+    py::arg("X_t"),             // IN HOST   (n_features, n_samples, )
+    py::arg("sample_weight"),   // IN        (n_sample, )
+    py::arg("init_centroid_t"), // IN-OUT    (n_features, n_clusters,)
+    py::arg("assignments_id"),  // OUT       (n_samples, )
+    py::arg("res_centroids_t"), // OUT       (n_features, n_clusters,)
+    py::arg("tol"),             // double
+    py::arg("verbose"),         // bool
+    py::arg("max_iter"),        // size_t
+    py::arg("centroids_window_height"),  // size_t
+    py::arg("work_group_size"),
+    py::arg("centroids_private_copies_max_cache_occupancy"), // double, fraction in (0, 1)
+    py::arg("chunk_size"),      // size_t, number of samples resident on device per buffer
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "kmeans_lloyd_driver_sub_devices", &py_kmeans_lloyd_driver_sub_devices,
+    "Implement Lloyd's refinement algorithm for X_t residing in host memory, with samples "
+    "split across sub-devices of the device of `sycl_queue` partitioned by NUMA domain, "
+    "or processed by the device itself if it can not be partitioned so. Partial sums of "
+    "centroids are combined on the host. All arrays are numpy arrays. Returns 2-tuple, "
+    "number of iterations performed and 0d numpy array with total_inertia of the returned "
+    "configuration.",
+    py::arg("X_t"),             // IN HOST  (n_features, n_samples, )
+    py::arg("sample_weight"),   // IN HOST  (n_sample, )
+    py::arg("init_centroid_t"), // IN HOST  (n_features, n_clusters,)
+    py::arg("assignments_id"),  // OUT HOST (n_samples, )
+    py::arg("res_centroids_t"), // OUT HOST (n_features, n_clusters,)
+    py::arg("tol"),             // double
+    py::arg("verbose"),         // bool
+    py::arg("max_iter"),        // size_t
+    py::arg("centroids_window_height"),  // size_t
+    py::arg("work_group_size"),
+    py::arg("centroids_private_copies_max_cache_occupancy"), // double, fraction in (0, 1)
+    py::arg("sycl_queue")
+  );
+
+  m.def(
+    "numa_sub_devices_count", &py_numa_sub_devices_count,
+    "Number of devices kmeans_lloyd_driver_sub_devices splits samples across for the "
+    "device of `sycl_queue`.",
+    py::arg("sycl_queue")
+  );
+
+  py::class_<communicator, std::shared_ptr<communicator>>(
+    m, "Communicator",
+    "Collective operations between the ranks of a distributed fit."
+  )
+    .def_property_readonly("rank", &communicator::rank)
+    .def_property_readonly("size", &communicator::size);
+
+  py::class_<tcp_communicator, communicator, std::shared_ptr<tcp_communicator>>(
+    m, "TcpCommunicator",
+    "Communicator between processes, on one host or several ones, connected by TCP. "
+    "Rank 0 listens on `address`:`port`, where other ranks connect within `timeout` seconds. "
+    "All ranks must construct it collectively."
+  )
+    .def(
+      py::init<size_t, size_t, const std::string &, int, double>(),
+      py::arg("rank"),
+      py::arg("size"),
+      py::arg("address") = "127.0.0.1",  // numeric IPv4 address of rank 0
+      py::arg("port") = 29500,
+      py::arg("timeout") = 60.0,
+      py::call_guard<py::gil_scoped_release>()
+    );
+
+  m.def(
+    "make_in_process_communicators", &make_in_process_communicators,
+    "List of `size` communicators between threads of this process, one per rank.",
+    py::arg("size")
+  );
+
+  m.def(
+    "kmeans_lloyd_driver_distributed", &py_kmeans_lloyd_driver_distributed,
+    "Implement Lloyd's refinement algorithm for samples distributed over the ranks of `comm`, "
+    "each rank passing its own X_t with shape (n_features, n_local_samples) in host memory. "
+    "Only partial sums of centroids and candidates for relocation of empty clusters are "
+    "exchanged between ranks. Must be called collectively, with the same init_centroids_t. "
+    "All arrays are numpy arrays. Returns 2-tuple, number of iterations performed and 0d "
+    "numpy array with total_inertia of the returned configuration, same on all ranks.",
+    py::arg("comm"),
+    py::arg("X_t"),             // IN HOST  (n_features, n_local_samples, )
+    py::arg("sample_weight"),   // IN HOST  (n_local_samples, )
+    py::arg("init_centroid_t"), // IN HOST  (n_features, n_clusters,)
+    py::arg("assignments_id"),  // OUT HOST (n_local_samples, )
+    py::arg("res_centroids_t"), // OUT HOST (n_features, n_clusters,)
+    py::arg("tol"),             // double
+    py::arg("verbose"),         // bool
+    py::arg("max_iter"),        // size_t
+    py::arg("centroids_window_height"),  // size_t
+    py::arg("work_group_size"),
+    py::arg("centroids_private_copies_max_cache_occupancy"), // double, fraction in (0, 1)
+    py::arg("sycl_queue"),
+    py::arg("use_sub_devices") = true  // split local samples across NUMA sub-devices
+  );
+
+  m.def(
+    "npy_header", &py_npy_header,
+    "npy_header(path) returns 4-tuple (descr, fortran_order, shape, data_offset) "
+    "read from the header of .npy file",
+    py::arg("path")
+  );
+
+  m.def(
+    "read_X_t_from_file", &py_read_X_t_from_file,
+    "Synchronously populates X_t with shape (n_features, n_samples) from samples stored "
+    "in memory-mapped file `path` at `data_offset`, with elemental type `src_dtype`, as X "
+    "with shape (n_samples, n_features) in C order, or in Fortran order if `fortran_order`. "
+    "Chunks of `chunk_size` samples are transposed by `n_threads` host threads (0 for all cores).",
+    py::arg("path"),
+    py::arg("data_offset"),
+    py::arg("src_dtype"),
+    py::arg("fortran_order"),
+    py::arg("X_t"),                  // OUT (n_features, n_samples)
+    py::arg("chunk_size"),
+    py::arg("n_threads"),
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "kmeans_bisecting_driver", &py_kmeans_bisecting_driver,
+    "Bisecting k-means, repeatedly splitting the cluster of largest inertia with 2-means Lloyd "
+    "iterations on its samples only. Returns 2-tuple, 0d numpy array with total_inertia and "
+    "numpy array split_parents, cluster split_parents[s] being split at step s into itself "
+    "and cluster s + 1.",
+    py::arg("X_t"),             // IN  (n_features, n_samples, )
+    py::arg("sample_weight"),   // IN  (n_samples, )
+    py::arg("assignments_id"),  // OUT (n_samples, )
+    py::arg("centroids_t"),     // OUT (n_features, n_clusters,)
+    py::arg("tol"),             // double, tolerance of 2-means runs
+    py::arg("max_iter"),        // size_t, iterations of 2-means runs
+    py::arg("seed"),            // uint64, drawing initial centroids of 2-means runs
+    py::arg("centroids_window_height"),
+    py::arg("work_group_size"),
+    py::arg("centroids_private_copies_max_cache_occupancy"),
+    py::arg("sycl_queue"),
+    py::arg("depends") = py::list()
+  );
+
+  m.def(
+    "build_coreset", &py_build_coreset,
+    "Builds an importance-sampled coreset of about `coreset_size` samples of X_t with shape "
+    "(n_features, n_samples), with sensitivities derived from the clustering by `rough_centroids_t`. "
+    "Returns (coreset_X_t, coreset_weight), to be fit as X_t and sample_weight. Synchronous.",
+    py::arg("X_t"),                  // IN (n_features, n_samples)
+    py::arg("sample_weight"),        // IN (n_samples,)
+    py::arg("rough_centroids_t"),    // IN (n_features, n_clusters)
+    py::arg("coreset_size"),         // size_t, expected number of samples of the coreset
+    py::arg("seed"),                 // uint64
+    py::arg("centroids_window_height"),
+    py::arg("work_group_size"),
+    py::arg("sycl_queue"),
     py::arg("depends") = py::list()
   );
+
+  py::class_<py_online_kmeans>(
+    m, "OnlineKMeans",
+    "Online k-means state over an append-only stream of samples. Running sums of samples "
+    "and weights of clusters are kept on the device, and updated by `partial_fit` with "
+    "chunks of samples, after being decayed by `decay` in (0, 1]."
+  )
+    .def(
+      py::init<
+        dpctl::tensor::usm_ndarray, size_t, double, size_t, size_t, double, bool, const std::vector<sycl::event> &
+      >(),
+      py::arg("init_centroids_t"),       // IN (n_features, n_clusters), copied
+      py::arg("max_chunk_size"),         // size_t, maximal number of samples per call to partial_fit
+      py::arg("decay") = 1.0,            // double in (0, 1], 1 keeps means of all samples seen
+      py::arg("centroids_window_height") = 8,
+      py::arg("work_group_size") = 128,
+      py::arg("centroids_private_copies_max_cache_occupancy") = 0.7,
+      py::arg("accumulate_in_double") = false,
+      py::arg("depends") = py::list()
+    )
+    .def(
+      "partial_fit", &py_online_kmeans::partial_fit,
+      "Asynchronously updates centroids with samples X_chunk_t with shape (n_features, n_chunk_samples). "
+      "Labels of samples with respect to centroids prior to the update are written to `assignment_id` "
+      "if given. Returns (ht_ev, comp_ev).",
+      py::arg("X_chunk_t"),
+      py::arg("sample_weight"),
+      py::arg("assignment_id") = py::none(),
+      py::arg("depends") = py::list()
+    )
+    .def(
+      "copy_centroids_t", &py_online_kmeans::copy_centroids_t,
+      "Copies current centroids into `out` with shape (n_features, n_clusters). Returns (ht_ev, comp_ev).",
+      py::arg("out"),
+      py::arg("depends") = py::list()
+    )
+    .def(
+      "copy_cluster_weights", &py_online_kmeans::copy_cluster_weights,
+      "Copies decayed sums of weights of samples assigned to clusters into `out` with shape (n_clusters,). "
+      "Returns (ht_ev, comp_ev).",
+      py::arg("out"),
+      py::arg("depends") = py::list()
+    )
+    .def_property_readonly("n_features", &py_online_kmeans::n_features)
+    .def_property_readonly("n_clusters", &py_online_kmeans::n_clusters)
+    .def_property_readonly("max_chunk_size", &py_online_kmeans::max_chunk_size)
+    .def_property_readonly("n_seen_samples", &py_online_kmeans::n_seen_samples)
+    .def_property_readonly("sycl_queue", &py_online_kmeans::queue);
 }
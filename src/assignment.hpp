@@ -4,11 +4,18 @@
 #include <CL/sycl.hpp>
 #include <vector>
 #include "quotients_utils.hpp"
+#include "device_functions.hpp"
 
-template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, bool X_row_major>
 class assignment_krn;
 
-template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+/* @brief Assigns samples to the nearest centroid.
+
+   When `X_row_major` is true, X_t is instead expected to be X with shape
+   (n_samples, n_features). Tiles of samples are then transposed through SLM
+   so that global memory reads stay coalesced.
+ */
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, bool X_row_major = false>
 sycl::event
 assignment(
     sycl::queue q,
@@ -18,7 +25,7 @@ assignment(
     size_t centroids_window_height,
     size_t work_group_size,
     // ===============================
-    const T* X_t,                    // IN READ-ONLY   (n_features, n_samples, )
+    const T* X_t,                    // IN READ-ONLY   (n_features, n_samples, ) or (n_samples, n_features) if X_row_major
     const T* centroids_t,            // IN READ-ONLY   (n_features, n_clusters, )
     const T *centroids_half_l2_norm, // IN             (n_clusters, )
     indT *assignment_idx,          // OUT            (n_samples, )
@@ -47,11 +54,18 @@ assignment(
             using slm_l2hnT = sycl::accessor<T, 1, sycl::access::mode::read_write, sycl::access::target::local>;
             slm_l2hnT window_of_centroids_half_l2_norms(sycl::range<1>(window_n_centroids), cgh);
 
-            cgh.parallel_for<class assignment_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>>(
+            // only used when X is row-major
+            using slm_swT = sycl::accessor<T, 2, sycl::access::mode::read_write, sycl::access::target::local>;
+            slm_swT samples_window(
+                (X_row_major) ? sycl::range<2>(centroids_window_height, (work_group_size + 1)) : sycl::range<2>(1, 1),
+                cgh);
+
+            cgh.parallel_for<class assignment_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, X_row_major>>(
                 sycl::nd_range<1>(G, L),
                 [=](sycl::nd_item<1> it) {
                     size_t sample_idx = it.get_global_id(0);
                     size_t local_work_id = it.get_local_id(0);
+                    size_t first_sample_idx = sample_idx - local_work_id;
 
                     std::array<T, window_n_centroids> dot_products;
 
@@ -81,7 +95,7 @@ assignment(
 
                         size_t first_feature_idx = 0;
 
-                        for(size_t i1 = 0; i1 < n_windows_for_centroid; ++i1) {
+                        for(size_t i1 = 0; i1 < n_windows_for_feature; ++i1) {
                             _load_window_of_centroids_and_features(
                                 n_clusters,
                                 n_features,
@@ -97,21 +111,48 @@ assignment(
                                 centroids_window
                             );
 
+                            if constexpr (X_row_major) {
+                                _load_window_of_samples_row_major<T>(
+                                    n_samples,
+                                    n_features,
+                                    work_group_size,
+                                    centroids_window_height,
+                                    // =====
+                                    local_work_id,
+                                    first_sample_idx,
+                                    first_feature_idx,
+                                    X_t,
+                                    samples_window
+                                );
+                            }
+
                             it.barrier(sycl::access::fence_space::local_space);
 
                             constexpr bool acummulate_dot_product = true;
-                            _acummulate_sum_of_ops<T, decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
-                                n_samples, 
-                                n_features,
-                                centroids_window_height,
-                                window_n_centroids,
-                                // ==============
-                                sample_idx,
-                                first_feature_idx,
-                                X_t,
-                                centroids_window,
-                                dot_products
-                            );
+                            if constexpr (X_row_major) {
+                                _acummulate_sum_of_ops_from_window<T, decltype(samples_window), decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
+                                    centroids_window_height,
+                                    window_n_centroids,
+                                    // ==============
+                                    local_work_id,
+                                    samples_window,
+                                    centroids_window,
+                                    dot_products
+                                );
+                            } else {
+                                _acummulate_sum_of_ops<T, decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
+                                    n_samples,
+                                    n_features,
+                                    centroids_window_height,
+                                    window_n_centroids,
+                                    // ==============
+                                    sample_idx,
+                                    first_feature_idx,
+                                    X_t,
+                                    centroids_window,
+                                    dot_products
+                                );
+                            }
 
                             it.barrier(sycl::access::fence_space::local_space);
 
@@ -132,6 +173,8 @@ assignment(
 
                         min_idx = closest.first;
                         min_sample_pseudo_inertia = closest.second;
+
+                        first_centroid_idx += window_n_centroids;
                     }
 
                     if (sample_idx < n_samples) {
@@ -0,0 +1,316 @@
+// communicator.hpp
+//
+// Collective operations between the ranks of a distributed fit. Drivers only
+// exchange (n_clusters, n_features + 1) partial sums and a few relocation
+// candidates per iteration, so a single primitive, an all-gather of byte
+// blobs, suffices: reductions are performed by every rank over the gathered
+// contributions in rank order, which keeps results bitwise identical across
+// ranks, and thereby the stopping decisions of their iterations.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class communicator {
+public:
+    virtual ~communicator() = default;
+
+    virtual size_t rank() const = 0;
+    virtual size_t size() const = 0;
+
+    /* @brief Blobs of all ranks, in rank order. Blobs may have different sizes. */
+    virtual std::vector<std::vector<char>> allgather(const char *data, size_t n_bytes) = 0;
+
+    /* @brief Replaces data (n,) with its element-wise sum over ranks */
+    template <typename T>
+    void allreduce_sum(T *data, size_t n) {
+        std::vector<std::vector<char>> blobs = allgather(reinterpret_cast<const char *>(data), n * sizeof(T));
+
+        std::fill(data, data + n, T(0));
+        for(const auto &blob : blobs) {
+            if (blob.size() != n * sizeof(T)) {
+                throw std::runtime_error("Ranks contributed reductions of different sizes");
+            }
+            const T *contribution = reinterpret_cast<const T *>(blob.data());
+            for(size_t i = 0; i < n; ++i) {
+                data[i] += contribution[i];
+            }
+        }
+    }
+
+    /* @brief Sum of `value` over ranks */
+    template <typename T>
+    T allreduce_sum(T value) {
+        allreduce_sum<T>(&value, 1);
+        return value;
+    }
+};
+
+/* @brief State shared by the ranks of an in_process_communicator group */
+class in_process_group {
+public:
+    explicit in_process_group(size_t n_ranks) : n_ranks_(n_ranks), slots_(n_ranks) {}
+
+    std::vector<std::vector<char>> allgather(size_t rank, const char *data, size_t n_bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        slots_[rank].assign(data, data + n_bytes);
+        size_t generation = generation_;
+
+        if (++n_arrived_ == n_ranks_) {
+            result_ = slots_;
+            n_arrived_ = 0;
+            ++generation_;
+            cv_.notify_all();
+        } else {
+            cv_.wait(lock, [&]() { return generation_ != generation; });
+        }
+
+        // the next round can not complete before this rank joins it
+        return result_;
+    }
+
+    size_t n_ranks() const { return n_ranks_; }
+
+private:
+    size_t n_ranks_;
+    size_t n_arrived_ = 0;
+    size_t generation_ = 0;
+    std::vector<std::vector<char>> slots_;
+    std::vector<std::vector<char>> result_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+/* @brief Ranks are threads of one process, e.g. to test distributed drivers */
+class in_process_communicator : public communicator {
+public:
+    in_process_communicator(std::shared_ptr<in_process_group> group, size_t rank)
+        : group_(std::move(group)), rank_(rank) {}
+
+    size_t rank() const override { return rank_; }
+    size_t size() const override { return group_->n_ranks(); }
+
+    std::vector<std::vector<char>> allgather(const char *data, size_t n_bytes) override {
+        return group_->allgather(rank_, data, n_bytes);
+    }
+
+private:
+    std::shared_ptr<in_process_group> group_;
+    size_t rank_;
+};
+
+/* @brief One communicator per rank of a new in-process group of `n_ranks` */
+inline std::vector<std::shared_ptr<communicator>>
+make_in_process_communicators(size_t n_ranks) {
+    auto group = std::make_shared<in_process_group>(n_ranks);
+
+    std::vector<std::shared_ptr<communicator>> comms;
+    comms.reserve(n_ranks);
+    for(size_t rank = 0; rank < n_ranks; ++rank) {
+        comms.push_back(std::make_shared<in_process_communicator>(group, rank));
+    }
+
+    return comms;
+}
+
+/* @brief Ranks are processes connected by TCP, on one host or several ones.
+
+   Rank 0 listens on `address`:`port` (numeric IPv4 address), the other ranks
+   connect to it. Gathers go through rank 0, which is adequate for the small
+   messages of Lloyd iterations: samples never leave their rank.
+ */
+class tcp_communicator : public communicator {
+public:
+    tcp_communicator(
+        size_t rank,
+        size_t n_ranks,
+        const std::string &address,
+        int port,
+        double timeout_seconds = 60.0
+    ) : rank_(rank), n_ranks_(n_ranks), peers_(n_ranks, -1)
+    {
+        if (rank_ >= n_ranks_) {
+            throw std::invalid_argument("Rank must be smaller than the number of ranks");
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+            throw std::invalid_argument("Address must be a numeric IPv4 address");
+        }
+
+        if (rank_ == 0) {
+            accept_peers(addr);
+        } else {
+            connect_to_root(addr, timeout_seconds);
+        }
+    }
+
+    tcp_communicator(const tcp_communicator &) = delete;
+    tcp_communicator &operator=(const tcp_communicator &) = delete;
+
+    ~tcp_communicator() override {
+        for(int fd : peers_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    size_t rank() const override { return rank_; }
+    size_t size() const override { return n_ranks_; }
+
+    std::vector<std::vector<char>> allgather(const char *data, size_t n_bytes) override {
+        std::vector<std::vector<char>> blobs(n_ranks_);
+        blobs[rank_].assign(data, data + n_bytes);
+
+        if (rank_ == 0) {
+            for(size_t peer = 1; peer < n_ranks_; ++peer) {
+                blobs[peer] = recv_blob(peers_[peer]);
+            }
+            for(size_t peer = 1; peer < n_ranks_; ++peer) {
+                for(const auto &blob : blobs) {
+                    send_blob(peers_[peer], blob.data(), blob.size());
+                }
+            }
+        } else {
+            send_blob(peers_[0], data, n_bytes);
+            for(size_t src = 0; src < n_ranks_; ++src) {
+                blobs[src] = recv_blob(peers_[0]);
+            }
+        }
+
+        return blobs;
+    }
+
+private:
+    size_t rank_;
+    size_t n_ranks_;
+    // socket connected to each rank: all ranks for rank 0, rank 0 otherwise
+    std::vector<int> peers_;
+
+    static void set_no_delay(int fd) {
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    void accept_peers(const sockaddr_in &addr) {
+        int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw std::runtime_error("Could not create socket");
+        }
+
+        int one = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (::bind(listen_fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd, static_cast<int>(n_ranks_)) != 0) {
+            ::close(listen_fd);
+            throw std::runtime_error("Could not listen on the address of rank 0");
+        }
+
+        try {
+            for(size_t n_accepted = 1; n_accepted < n_ranks_; ++n_accepted) {
+                int fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd < 0) {
+                    throw std::runtime_error("Could not accept connection of a rank");
+                }
+
+                std::uint64_t peer_rank;
+                recv_all(fd, reinterpret_cast<char *>(&peer_rank), sizeof(peer_rank));
+                if (peer_rank == 0 || peer_rank >= n_ranks_ || peers_[peer_rank] >= 0) {
+                    ::close(fd);
+                    throw std::runtime_error("Connected rank is invalid or duplicated");
+                }
+
+                set_no_delay(fd);
+                peers_[peer_rank] = fd;
+            }
+        } catch (...) {
+            ::close(listen_fd);
+            throw;
+        }
+
+        ::close(listen_fd);
+    }
+
+    void connect_to_root(const sockaddr_in &addr, double timeout_seconds) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_seconds);
+
+        // rank 0 may not be listening yet
+        while (true) {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0) {
+                throw std::runtime_error("Could not create socket");
+            }
+            if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0) {
+                set_no_delay(fd);
+                peers_[0] = fd;
+                break;
+            }
+            ::close(fd);
+
+            if (std::chrono::steady_clock::now() > deadline) {
+                throw std::runtime_error("Timed out connecting to rank 0");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+
+        std::uint64_t this_rank = rank_;
+        send_all(peers_[0], reinterpret_cast<const char *>(&this_rank), sizeof(this_rank));
+    }
+
+    static void send_all(int fd, const char *data, size_t n_bytes) {
+        while (n_bytes > 0) {
+            ssize_t n_sent = ::send(fd, data, n_bytes, MSG_NOSIGNAL);
+            if (n_sent <= 0) {
+                throw std::runtime_error("Connection to a rank was lost");
+            }
+            data += n_sent;
+            n_bytes -= static_cast<size_t>(n_sent);
+        }
+    }
+
+    static void recv_all(int fd, char *data, size_t n_bytes) {
+        while (n_bytes > 0) {
+            ssize_t n_received = ::recv(fd, data, n_bytes, 0);
+            if (n_received <= 0) {
+                throw std::runtime_error("Connection to a rank was lost");
+            }
+            data += n_received;
+            n_bytes -= static_cast<size_t>(n_received);
+        }
+    }
+
+    static void send_blob(int fd, const char *data, size_t n_bytes) {
+        std::uint64_t size = n_bytes;
+        send_all(fd, reinterpret_cast<const char *>(&size), sizeof(size));
+        send_all(fd, data, n_bytes);
+    }
+
+    static std::vector<char> recv_blob(int fd) {
+        std::uint64_t size;
+        recv_all(fd, reinterpret_cast<char *>(&size), sizeof(size));
+        std::vector<char> blob(size);
+        recv_all(fd, blob.data(), blob.size());
+        return blob;
+    }
+};
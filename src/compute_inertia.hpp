@@ -4,11 +4,12 @@
 #include <CL/sycl.hpp>
 #include <vector>
 #include "quotients_utils.hpp"
+#include "device_functions.hpp"
 
-template <typename T, typename indT>
+template <typename T, typename indT, bool X_row_major>
 class compute_interia_krn;
 
-template <typename T, typename indT>
+template <typename T, typename indT, bool X_row_major = false>
 sycl::event
 compute_inertia_kernel(
     sycl::queue q,
@@ -17,7 +18,7 @@ compute_inertia_kernel(
     size_t n_clusters,
     size_t work_group_size,
     // ======================
-    const T *X_t,                    // (n_features, n_samples)
+    const T *X_t,                    // (n_features, n_samples) or (n_samples, n_features) if X_row_major
     const T *sample_weights,         // (n_features, )
     const T *centroids_t,            // (n_features, n_clusters)
     const indT *assignments_idx,     // (n_samples, )
@@ -31,7 +32,7 @@ compute_inertia_kernel(
             auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
             auto L = sycl::range<1>(work_group_size);
 
-            cgh.parallel_for<class compute_interia_krn<T, indT>>(
+            cgh.parallel_for<class compute_interia_krn<T, indT, X_row_major>>(
                 sycl::nd_range<1>(G, L),
                 [=](sycl::nd_item<1> it) {
                     size_t sample_idx = it.get_global_id(0);
@@ -39,7 +40,7 @@ compute_inertia_kernel(
                         T inertia(0);
                         size_t centroid_idx = centroid_idx = assignments_idx[sample_idx];
                         for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
-                            T diff = X_t[feature_idx * n_samples + sample_idx] - 
+                            T diff = X_t[_X_index<X_row_major>(n_samples, n_features, sample_idx, feature_idx)] -
                                         centroids_t[feature_idx * n_clusters + centroid_idx];
                             inertia += diff * diff;
                         }
@@ -52,10 +53,10 @@ compute_inertia_kernel(
     return e;
 }
 
-template <typename T, typename indT>
+template <typename T, typename indT, bool X_row_major>
 class compute_uniform_weight_interia_krn;
 
-template <typename T, typename indT>
+template <typename T, typename indT, bool X_row_major = false>
 sycl::event
 compute_uniform_weight_inertia_kernel(
     sycl::queue q,
@@ -64,7 +65,7 @@ compute_uniform_weight_inertia_kernel(
     size_t n_clusters,
     size_t work_group_size,
     // ======================
-    T const *X_t,                      // (n_features, n_samples)
+    T const *X_t,                      // (n_features, n_samples) or (n_samples, n_features) if X_row_major
     T const *centroids_t,              // (n_features, n_clusters)
     indT const *assignments_idx,       // (n_samples, )
     T *per_sample_inertia,             // (n_samples, )
@@ -77,7 +78,7 @@ compute_uniform_weight_inertia_kernel(
             auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
             auto L = sycl::range<1>(work_group_size);
 
-            cgh.parallel_for<class compute_uniform_weight_interia_krn<T, indT>>(
+            cgh.parallel_for<class compute_uniform_weight_interia_krn<T, indT, X_row_major>>(
                 sycl::nd_range<1>(G, L),
                 [=](sycl::nd_item<1> it) {
                     size_t sample_idx = it.get_global_id(0);
@@ -85,7 +86,7 @@ compute_uniform_weight_inertia_kernel(
                         T inertia(0);
                         size_t centroid_idx = centroid_idx = assignments_idx[sample_idx];
                         for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
-                            T diff = X_t[feature_idx * n_samples + sample_idx] - 
+                            T diff = X_t[_X_index<X_row_major>(n_samples, n_features, sample_idx, feature_idx)] -
                                         centroids_t[feature_idx * n_clusters + centroid_idx];
                             inertia += diff * diff;
                         }
@@ -106,7 +107,8 @@ T reduce_vector_kernel_blocking(
     sycl::queue q,
     size_t n_samples,
     T *data,
-    const std::vector<sycl::event> &depends = {}
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *reduction_ev = nullptr     // OUT, optional, event of the reduction kernel
 ) {
     T *dev_total = sycl::malloc_device<T>(1, q);
 
@@ -131,5 +133,9 @@ T reduce_vector_kernel_blocking(
     copy_ev.wait();
     sycl::free(dev_total, q);
 
+    if (reduction_ev) {
+        *reduction_ev = red_ev;
+    }
+
     return host_total;
 }
\ No newline at end of file
@@ -0,0 +1,315 @@
+// coreset.hpp
+//
+// Importance-sampled coreset of weighted samples, built on the device from a
+// rough clustering (Bachem et al., "Scalable k-Means Clustering via Lightweight
+// Coresets", 2018, with the rough centroids in place of the mean of the data).
+//
+// Sample i, assigned to rough centroid b_i, has sensitivity
+//     s_i = w_i d(x_i, b_i)^2 / cost + w_i / W_{b_i}
+// where cost is the weighted inertia of the rough clustering and W_k the total
+// weight of cluster k. Samples are kept independently with probability
+// p_i = min(1, m s_i / S), S being the sum of sensitivities, so that the coreset
+// holds m samples in expectation, and are given weights w_i / p_i, which keeps
+// costs of any set of centroids unbiased.
+//
+// Draws come from a counter-based generator keyed by the seed and the index of
+// the sample, so that counting and gathering passes make the same decisions
+// without storing them.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "assignment.hpp"
+#include "compute_inertia.hpp"
+#include "util_kernels.hpp"
+
+/* @brief Uniform draw in [0, 1) of the counter-based generator, splitmix64
+   of the seed and counter */
+template <typename T>
+inline T _counter_based_uniform(std::uint64_t seed, std::uint64_t counter) {
+    std::uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z = z ^ (z >> 31);
+    // 53 (resp. 24) most significant bits, so that the result is below 1
+    constexpr int n_bits = (sizeof(T) == sizeof(double)) ? 53 : 24;
+    return static_cast<T>(z >> (64 - n_bits)) * (T(1) / static_cast<T>(std::uint64_t(1) << n_bits));
+}
+
+template <typename dataT, typename indT>
+class cluster_weights_krn;
+
+/* @brief cluster_weights[k] = sum of weights of samples assigned to k */
+template <typename dataT, typename indT>
+sycl::event
+cluster_weights_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t work_group_size,
+    //
+    dataT const *sample_weight,    // IN  (n_samples,)
+    indT const *assignment_id,     // IN  (n_samples,)
+    dataT *cluster_weights,        // INOUT (n_clusters,), zero-initialized
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            size_t global_size = quotient_ceil(n_samples, work_group_size) * work_group_size;
+            cgh.parallel_for<class cluster_weights_krn<dataT, indT>>(
+                sycl::nd_range<1>(global_size, work_group_size),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx < n_samples) {
+                        sycl::atomic_ref<
+                            dataT,
+                            sycl::memory_order::relaxed,
+                            sycl::memory_scope::device,
+                            sycl::access::address_space::global_space> w(cluster_weights[assignment_id[sample_idx]]);
+                        w += sample_weight[sample_idx];
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+template <typename dataT, typename indT>
+class coreset_sensitivity_krn;
+
+/* @brief Overwrites per_sample_inertia with sensitivities of samples */
+template <typename dataT, typename indT>
+sycl::event
+coreset_sensitivity_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t work_group_size,
+    dataT total_cost,
+    //
+    dataT const *sample_weight,      // IN    (n_samples,)
+    indT const *assignment_id,       // IN    (n_samples,)
+    dataT const *cluster_weights,    // IN    (n_clusters,)
+    dataT *per_sample_inertia,       // INOUT (n_samples,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    // all samples lie on rough centroids, the distance term vanishes
+    dataT inv_total_cost = (total_cost > dataT(0)) ? dataT(1) / total_cost : dataT(0);
+
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            size_t global_size = quotient_ceil(n_samples, work_group_size) * work_group_size;
+            cgh.parallel_for<class coreset_sensitivity_krn<dataT, indT>>(
+                sycl::nd_range<1>(global_size, work_group_size),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx < n_samples) {
+                        dataT w = sample_weight[sample_idx];
+                        dataT cluster_w = cluster_weights[assignment_id[sample_idx]];
+                        per_sample_inertia[sample_idx] =
+                            per_sample_inertia[sample_idx] * inv_total_cost +
+                            ((cluster_w > dataT(0)) ? w / cluster_w : dataT(0));
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+template <typename dataT, typename indT, bool gather>
+class coreset_sampling_krn;
+
+/* @brief Keeps sample i with probability min(1, scale * sensitivity[i]).
+
+   Without `gather`, only counts kept samples in n_selected. With `gather`,
+   also copies kept samples to columns of coreset_X_t, in unspecified order,
+   with weights w_i / p_i.
+ */
+template <typename dataT, typename indT, bool gather>
+sycl::event
+coreset_sampling_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_coreset_samples,        // columns of coreset_X_t, unused without gather
+    size_t work_group_size,
+    dataT scale,
+    std::uint64_t seed,
+    //
+    dataT const *X_t,                // IN  (n_features, n_samples)
+    dataT const *sample_weight,      // IN  (n_samples,)
+    dataT const *sensitivity,        // IN  (n_samples,)
+    dataT *coreset_X_t,              // OUT (n_features, n_coreset_samples)
+    dataT *coreset_weight,           // OUT (n_coreset_samples,)
+    indT *n_selected,                // INOUT (1,), zero-initialized
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            size_t global_size = quotient_ceil(n_samples, work_group_size) * work_group_size;
+            cgh.parallel_for<class coreset_sampling_krn<dataT, indT, gather>>(
+                sycl::nd_range<1>(global_size, work_group_size),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+
+                    dataT p(0);
+                    bool keep = false;
+                    if (sample_idx < n_samples) {
+                        p = sycl::min(dataT(1), scale * sensitivity[sample_idx]);
+                        keep = _counter_based_uniform<dataT>(seed, sample_idx) < p;
+                    }
+
+                    sycl::atomic_ref<
+                        indT,
+                        sycl::memory_order::relaxed,
+                        sycl::memory_scope::device,
+                        sycl::access::address_space::global_space> n_selected_ref(n_selected[0]);
+
+                    if constexpr (gather) {
+                        if (keep) {
+                            indT pos = n_selected_ref.fetch_add(indT(1));
+                            for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+                                coreset_X_t[feature_idx * n_coreset_samples + pos] =
+                                    X_t[feature_idx * n_samples + sample_idx];
+                            }
+                            coreset_weight[pos] = sample_weight[sample_idx] / p;
+                        }
+                    } else {
+                        indT n_kept = sycl::reduce_over_group(it.get_group(), indT(keep), sycl::plus<indT>());
+                        if (it.get_local_linear_id() == 0 && n_kept > 0) {
+                            n_selected_ref += n_kept;
+                        }
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+/* @brief Builds a coreset of X_t (n_features, n_samples) of about
+   `coreset_size` weighted samples, from rough centroids.
+
+   `alloc_fn(n_coreset_samples)` is called once the size is known, and returns
+   a pair of USM pointers (coreset_X_t, coreset_weight) with shapes
+   (n_features, n_coreset_samples) and (n_coreset_samples,).
+   Blocks until the coreset is populated. Returns n_coreset_samples.
+ */
+template <typename dataT, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename AllocFnT>
+size_t build_coreset(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    size_t coreset_size,
+    std::uint64_t seed,
+    //
+    dataT const *X_t,                // IN (n_features, n_samples)
+    dataT const *sample_weight,      // IN (n_samples,)
+    dataT const *rough_centroids_t,  // IN (n_features, n_clusters)
+    AllocFnT alloc_fn,
+    const std::vector<sycl::event> &depends = {}
+) {
+    const auto &ctx = q.get_context();
+    const auto &dev = q.get_device();
+
+    dataT *centroids_half_l2_norm = sycl::malloc_device<dataT>(n_clusters, dev, ctx);
+    dataT *cluster_weights = sycl::malloc_device<dataT>(n_clusters, dev, ctx);
+    indT *assignment_id = sycl::malloc_device<indT>(n_samples, dev, ctx);
+    indT *n_selected = sycl::malloc_device<indT>(1, dev, ctx);
+    // per sample inertia, then sensitivities
+    dataT *sensitivity = sycl::malloc_device<dataT>(n_samples, dev, ctx);
+
+    sycl::event half_l2_norm_ev =
+        half_l2_norm_kernel<dataT>(
+            q, n_features, n_clusters, work_group_size,
+            rough_centroids_t, centroids_half_l2_norm, depends);
+
+    sycl::event assignment_ev =
+        assignment<
+            dataT, indT,
+            preferred_work_group_size_multiple,
+            centroids_window_width_multiplier
+        >(
+            q,
+            n_samples, n_features, n_clusters,
+            centroids_window_height, work_group_size,
+            //
+            X_t, rough_centroids_t, centroids_half_l2_norm,
+            assignment_id,
+            {half_l2_norm_ev}
+        );
+
+    sycl::event inertia_ev =
+        compute_inertia_kernel<dataT, indT>(
+            q,
+            n_samples, n_features, n_clusters, work_group_size,
+            //
+            X_t, sample_weight, rough_centroids_t, assignment_id,
+            sensitivity,
+            {assignment_ev}
+        );
+
+    sycl::event fill_ev = q.fill<dataT>(cluster_weights, dataT(0), n_clusters);
+    sycl::event cluster_weights_ev =
+        cluster_weights_kernel<dataT, indT>(
+            q, n_samples, work_group_size,
+            sample_weight, assignment_id, cluster_weights,
+            {assignment_ev, fill_ev}
+        );
+
+    dataT total_cost = reduce_vector_kernel_blocking<dataT>(q, n_samples, sensitivity, {inertia_ev});
+
+    sycl::event sensitivity_ev =
+        coreset_sensitivity_kernel<dataT, indT>(
+            q, n_samples, work_group_size, total_cost,
+            sample_weight, assignment_id, cluster_weights, sensitivity,
+            {cluster_weights_ev}
+        );
+
+    dataT total_sensitivity = reduce_vector_kernel_blocking<dataT>(q, n_samples, sensitivity, {sensitivity_ev});
+    dataT scale = (total_sensitivity > dataT(0)) ?
+        static_cast<dataT>(coreset_size) / total_sensitivity : dataT(0);
+
+    sycl::event reset_count_ev = q.fill<indT>(n_selected, indT(0), 1);
+    sycl::event count_ev =
+        coreset_sampling_kernel<dataT, indT, false>(
+            q, n_samples, n_features, 0, work_group_size, scale, seed,
+            X_t, sample_weight, sensitivity, nullptr, nullptr, n_selected,
+            {reset_count_ev}
+        );
+
+    indT host_n_selected;
+    q.copy<indT>(n_selected, &host_n_selected, 1, {count_ev}).wait();
+    size_t n_coreset_samples = static_cast<size_t>(host_n_selected);
+
+    std::pair<dataT *, dataT *> out = alloc_fn(n_coreset_samples);
+
+    if (n_coreset_samples > 0) {
+        sycl::event reset_pos_ev = q.fill<indT>(n_selected, indT(0), 1);
+        coreset_sampling_kernel<dataT, indT, true>(
+            q, n_samples, n_features, n_coreset_samples, work_group_size, scale, seed,
+            X_t, sample_weight, sensitivity, out.first, out.second, n_selected,
+            {reset_pos_ev}
+        ).wait();
+    }
+
+    sycl::free(centroids_half_l2_norm, ctx);
+    sycl::free(cluster_weights, ctx);
+    sycl::free(assignment_id, ctx);
+    sycl::free(n_selected, ctx);
+    sycl::free(sensitivity, ctx);
+
+    return n_coreset_samples;
+}
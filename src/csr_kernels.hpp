@@ -0,0 +1,563 @@
+// csr_kernels.hpp
+//
+// Kernels for samples given as a CSR matrix (data, indices, indptr) with shape
+// (n_samples, n_features). Centroids remain dense, with shape
+// (n_features, n_clusters), so that for every stored element of a sample the
+// coordinates of a window of consecutive centroids are contiguous in memory.
+
+#pragma once
+#include <CL/sycl.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include "quotients_utils.hpp"
+#include "device_functions.hpp"
+#include "util_kernels.hpp"
+
+template <typename indT>
+class csr_count_invalid_indices_krn;
+
+/* @brief Number of column indices of a CSR matrix out of [0, n_features).
+   Waits for the count. */
+template <typename indT>
+size_t csr_count_invalid_indices(
+    sycl::queue q,
+    size_t nnz,
+    size_t n_features,
+    indT const *indices,  // IN (nnz,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    std::uint64_t *n_invalid = sycl::malloc_device<std::uint64_t>(1, q);
+
+    sycl::event count_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            sycl::property_list prop( {sycl::property::reduction::initialize_to_identity{}} );
+            auto sumReduction = sycl::reduction(n_invalid, sycl::plus<std::uint64_t>(), prop);
+            cgh.parallel_for<class csr_count_invalid_indices_krn<indT>>(
+                sycl::range<1>(nnz),
+                sumReduction,
+                [=](sycl::id<1> wid, auto &sum) {
+                    indT feature_idx = indices[wid];
+                    bool is_valid = (feature_idx >= indT(0)) && (static_cast<size_t>(feature_idx) < n_features);
+                    sum.combine((is_valid) ? 0 : 1);
+                }
+            );
+        });
+
+    std::uint64_t host_n_invalid = 0;
+    q.copy<std::uint64_t>(n_invalid, &host_n_invalid, 1, {count_ev}).wait();
+    sycl::free(n_invalid, q);
+
+    return static_cast<size_t>(host_n_invalid);
+}
+
+/* Accumulates dot products of the CSR sample stored in positions
+   [row_start, row_end) of (data, indices) with a window of `window_n_centroids`
+   centroids starting at `first_centroid_idx`. */
+template <typename T, typename indT, typename resT>
+void _csr_accumulate_dot_products(
+    size_t n_clusters,
+    size_t window_n_centroids,
+    // ===========================
+    size_t first_centroid_idx,
+    size_t row_start,
+    size_t row_end,
+    T const *data,
+    indT const *indices,
+    T const *centroids_t,
+    resT &result
+) {
+    constexpr T zero(0);
+    for(size_t i = 0; i < window_n_centroids; ++i) {
+        result[i] = zero;
+    }
+
+    for(size_t k = row_start; k < row_end; ++k) {
+        T X_value = data[k];
+        size_t offset = static_cast<size_t>(indices[k]) * n_clusters;
+        for(size_t window_centroid_idx = 0; window_centroid_idx < window_n_centroids; ++window_centroid_idx) {
+            size_t centroid_idx = first_centroid_idx + window_centroid_idx;
+            T centroid_value = (centroid_idx < n_clusters) ? centroids_t[offset + centroid_idx] : zero;
+            result[window_centroid_idx] += centroid_value * X_value;
+        }
+    }
+}
+
+/* Finds the closest centroid of the CSR sample stored in positions
+   [row_start, row_end), returns its index. */
+template <typename T, typename indT, size_t window_n_centroids>
+size_t _csr_closest_centroid(
+    size_t n_clusters,
+    // ===========================
+    size_t row_start,
+    size_t row_end,
+    T const *data,
+    indT const *indices,
+    T const *centroids_t,
+    T const *centroids_half_l2_norm
+) {
+    constexpr T inf = std::numeric_limits<T>::infinity();
+
+    std::array<T, window_n_centroids> dot_products;
+    std::array<T, window_n_centroids> window_of_centroids_half_l2_norms;
+
+    size_t n_windows_for_centroid = quotient_ceil(n_clusters, window_n_centroids);
+
+    size_t first_centroid_idx = 0;
+    size_t min_idx = 0;
+    T min_sample_pseudo_inertia(inf);
+
+    for(size_t i0 = 0; i0 < n_windows_for_centroid; ++i0) {
+        for(size_t i = 0; i < window_n_centroids; ++i) {
+            size_t centroid_idx = first_centroid_idx + i;
+            window_of_centroids_half_l2_norms[i] =
+                (centroid_idx < n_clusters) ? centroids_half_l2_norm[centroid_idx] : inf;
+        }
+
+        _csr_accumulate_dot_products<T, indT>(
+            n_clusters, window_n_centroids,
+            first_centroid_idx, row_start, row_end,
+            data, indices, centroids_t,
+            dot_products
+        );
+
+        auto closest = _update_closest_centroid<T>(
+            window_n_centroids,
+            // =================
+            first_centroid_idx,
+            min_idx,
+            min_sample_pseudo_inertia,
+            window_of_centroids_half_l2_norms,
+            dot_products.data()
+        );
+
+        min_idx = closest.first;
+        min_sample_pseudo_inertia = closest.second;
+
+        first_centroid_idx += window_n_centroids;
+    }
+
+    return min_idx;
+}
+
+template <typename T, typename indT>
+class csr_row_sq_norms_krn;
+
+// sample_sq_norms = np.square(X).sum(axis=1)
+template <typename T, typename indT>
+sycl::event
+csr_row_sq_norms_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t work_group_size,
+    // ======================
+    T const *data,           // IN  (nnz,)
+    indT const *indptr,      // IN  (n_samples + 1,)
+    T *sample_sq_norms,      // OUT (n_samples,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event e =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
+            auto L = sycl::range<1>(work_group_size);
+
+            cgh.parallel_for<class csr_row_sq_norms_krn<T, indT>>(
+                sycl::nd_range<1>(G, L),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx < n_samples) {
+                        T sq_norm(0);
+                        for(size_t k = indptr[sample_idx]; k < static_cast<size_t>(indptr[sample_idx + 1]); ++k) {
+                            T v = data[k];
+                            sq_norm += v * v;
+                        }
+                        sample_sq_norms[sample_idx] = sq_norm;
+                    }
+                }
+            );
+        });
+
+    return e;
+}
+
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+class csr_assignment_krn;
+
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+sycl::event
+csr_assignment(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_clusters,
+    size_t work_group_size,
+    // ===============================
+    T const *data,                   // IN READ-ONLY   (nnz,)
+    indT const *indices,             // IN READ-ONLY   (nnz,)
+    indT const *indptr,              // IN READ-ONLY   (n_samples + 1,)
+    T const *centroids_t,            // IN READ-ONLY   (n_features, n_clusters, )
+    T const *centroids_half_l2_norm, // IN             (n_clusters, )
+    indT *assignment_idx,            // OUT            (n_samples, )
+    const std::vector<sycl::event> &depends={}
+) {
+    constexpr size_t window_n_centroids = (
+        preferred_work_group_size_multiple * centroids_window_width_multiplier
+    );
+
+    sycl::event e =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
+            auto L = sycl::range<1>(work_group_size);
+
+            cgh.parallel_for<class csr_assignment_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>>(
+                sycl::nd_range<1>(G, L),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx < n_samples) {
+                        size_t min_idx = _csr_closest_centroid<T, indT, window_n_centroids>(
+                            n_clusters,
+                            indptr[sample_idx], indptr[sample_idx + 1],
+                            data, indices,
+                            centroids_t, centroids_half_l2_norm
+                        );
+                        assignment_idx[sample_idx] = min_idx;
+                    }
+                }
+            );
+        });
+
+    return e;
+}
+
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+class csr_lloyd_single_step_krn;
+
+/* @brief Fused assignment and accumulation of new centroid data for CSR samples.
+
+   Each work item scatters the stored elements of its sample into the private
+   copy of new centroids selected by its sub-group, see `lloyd_single_step`.
+ */
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+sycl::event
+csr_lloyd_single_step(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    size_t n_centroids_private_copies,
+    size_t work_group_size,
+    // ===================
+    T const *data,                     // IN READ-ONLY  (nnz,)
+    indT const *indices,               // IN READ-ONLY  (nnz,)
+    indT const *indptr,                // IN READ-ONLY  (n_samples + 1,)
+    T const *sample_weights,           // IN READ-ONLY  (n_samples, )
+    T const *current_centroids_t,      // IN            (n_features, n_clusters)
+    T const *centroids_half_l2_norm,   // IN            (n_clusters, )
+    indT *assignments_idx,             // OUT           (n_samples, )
+    T *new_centroids_t_private_copies, // OUT           (n_private_copies, n_features, n_clusters)
+    T *cluster_sizes_private_copies,   // OUT           (n_private_copies, n_clusters)
+    const std::vector<sycl::event> &depends = {}
+) {
+    constexpr size_t window_n_centroids = (
+        preferred_work_group_size_multiple * centroids_window_width_multiplier
+    );
+
+    sycl::event e =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
+            auto L = sycl::range<1>(work_group_size);
+
+            cgh.parallel_for<class csr_lloyd_single_step_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>>(
+                sycl::nd_range<1>(G, L),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx >= n_samples) return;
+
+                    size_t row_start = indptr[sample_idx];
+                    size_t row_end = indptr[sample_idx + 1];
+
+                    size_t min_idx = _csr_closest_centroid<T, indT, window_n_centroids>(
+                        n_clusters,
+                        row_start, row_end,
+                        data, indices,
+                        current_centroids_t, centroids_half_l2_norm
+                    );
+
+                    assignments_idx[sample_idx] = min_idx;
+
+                    T weight = sample_weights[sample_idx];
+
+                    size_t privatization_idx = (
+                        sample_idx / preferred_work_group_size_multiple
+                    ) % n_centroids_private_copies;
+
+                    auto atomic_cluster_size =
+                    sycl::atomic_ref<
+                        T,
+                        sycl::memory_order::relaxed,
+                        sycl::memory_scope::device,
+                        sycl::access::address_space::global_space>(
+                            cluster_sizes_private_copies[privatization_idx * n_clusters + min_idx]
+                        );
+
+                    atomic_cluster_size += weight;
+
+                    // new_centroids_t_private_copies  (n_copies, n_features, n_clusters)
+                    size_t _offset = privatization_idx * n_features * n_clusters + min_idx;
+                    for(size_t k = row_start; k < row_end; ++k) {
+                        auto atomic_coord =
+                        sycl::atomic_ref<
+                            T,
+                            sycl::memory_order::relaxed,
+                            sycl::memory_scope::device,
+                            sycl::access::address_space::global_space>(
+                                new_centroids_t_private_copies[_offset + static_cast<size_t>(indices[k]) * n_clusters]
+                            );
+
+                        atomic_coord += data[k] * weight;
+                    }
+                }
+            );
+        });
+
+    return e;
+}
+
+template <typename T, typename indT>
+class csr_compute_inertia_krn;
+
+/* @brief Computes per-sample inertia of CSR samples.
+
+   Uses the expansion |x - c|^2 = |x|^2 + 2 * (|c|^2 / 2 - <x, c>), so that only
+   the stored elements of samples are visited. When `sample_weights` is a null
+   pointer, uniform weights are used.
+ */
+template <typename T, typename indT>
+sycl::event
+csr_compute_inertia_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_clusters,
+    size_t work_group_size,
+    // ======================
+    T const *data,                    // (nnz,)
+    indT const *indices,              // (nnz,)
+    indT const *indptr,               // (n_samples + 1,)
+    T const *sample_sq_norms,         // (n_samples,)
+    T const *sample_weights,          // (n_samples,) or nullptr
+    T const *centroids_t,             // (n_features, n_clusters)
+    T const *centroids_half_l2_norm,  // (n_clusters,)
+    indT const *assignments_idx,      // (n_samples, )
+    T *per_sample_inertia,            // (n_samples, )
+    const std::vector<sycl::event> &depends={}
+) {
+    sycl::event e =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            auto G = sycl::range<1>(quotient_ceil(n_samples, work_group_size) * work_group_size);
+            auto L = sycl::range<1>(work_group_size);
+
+            cgh.parallel_for<class csr_compute_inertia_krn<T, indT>>(
+                sycl::nd_range<1>(G, L),
+                [=](sycl::nd_item<1> it) {
+                    size_t sample_idx = it.get_global_id(0);
+                    if (sample_idx < n_samples) {
+                        size_t centroid_idx = assignments_idx[sample_idx];
+                        T dot_product(0);
+                        for(size_t k = indptr[sample_idx]; k < static_cast<size_t>(indptr[sample_idx + 1]); ++k) {
+                            dot_product += data[k] * centroids_t[static_cast<size_t>(indices[k]) * n_clusters + centroid_idx];
+                        }
+                        T inertia = sample_sq_norms[sample_idx] + T(2) * (centroids_half_l2_norm[centroid_idx] - dot_product);
+                        // guard against negative values due to cancellation
+                        inertia = sycl::fmax(inertia, T(0));
+                        T weight = (sample_weights) ? sample_weights[sample_idx] : T(1);
+                        per_sample_inertia[sample_idx] = inertia * weight;
+                    }
+                }
+            );
+        });
+
+    return e;
+}
+
+template <typename dataT, typename indT>
+class csr_relocate_empty_clusters_krn;
+
+/* @brief Same as `relocate_empty_clusters_kernel` for CSR samples.
+
+   Columns of empty clusters in `centroids_t` are zero, since no sample
+   contributed to them, so only the stored elements of relocated samples need
+   to be scattered.
+ */
+template <typename dataT, typename indT>
+sycl::event
+csr_relocate_empty_clusters_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_clusters,
+    size_t n_empty_clusters,
+    indT const *n_selected_gt_threshold,   // USM pointer
+    size_t work_group_size,
+    //
+    dataT const *data,                 // IN, READ ONLY (nnz,)
+    indT const *indices,               // IN, READ ONLY (nnz,)
+    indT const *indptr,                // IN, READ ONLY (n_samples + 1,)
+    dataT const *sample_weight,        // IN, READ ONLY (n_samples,)
+    indT const *assignment_id,            // IN  (n_samples,)
+    indT const *samples_far_from_center,  // IN  (n_samples, )
+    indT const *empty_clusters_list,   // IN  (n_clusters, )
+    dataT *per_sample_inertia,         // INOUT (n_samples,)
+    dataT *centroids_t,                // INOUT (n_features, n_clusters,)
+    dataT *cluster_sizes,              // INOUT (n_clusters,)
+    const std::vector<sycl::event> &depends = {}
+)
+{
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            size_t global_size = work_group_size * n_empty_clusters;
+
+            cgh.parallel_for<class csr_relocate_empty_clusters_krn<dataT, indT>>(
+                sycl::nd_range<1>({global_size}, {work_group_size}),
+                [=](sycl::nd_item<1> wit) {
+                    size_t relocated_idx = wit.get_group(0);
+                    size_t item_idx = wit.get_local_id(0);
+
+                    indT relocated_cluster_idx = empty_clusters_list[relocated_idx];
+                    indT n_selected_gt_threshold_ = n_selected_gt_threshold[0];
+
+                    size_t index = selected_sample_position(relocated_idx, n_selected_gt_threshold_, n_samples);
+                    indT new_location_X_idx = samples_far_from_center[index];
+                    indT new_location_previous_assignment = assignment_id[new_location_X_idx];
+
+                    dataT new_location_weight = sample_weight[new_location_X_idx];
+
+                    size_t row_start = indptr[new_location_X_idx];
+                    size_t row_end = indptr[new_location_X_idx + 1];
+
+                    for(size_t k = row_start + item_idx; k < row_end; k += work_group_size) {
+                        size_t feature_idx = indices[k];
+                        dataT X_centroid_addend = data[k] * new_location_weight;
+
+                        auto atomic_centroid_component_ref =
+                        sycl::atomic_ref<
+                                dataT,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(centroids_t[feature_idx * n_clusters + new_location_previous_assignment]);
+
+                        atomic_centroid_component_ref -= X_centroid_addend;
+                        centroids_t[feature_idx * n_clusters + relocated_cluster_idx] = X_centroid_addend;
+                    }
+
+                    if (item_idx == 0) {
+                        per_sample_inertia[new_location_X_idx] = dataT(0);
+                        auto atomic_cluster_size_ref =
+                        sycl::atomic_ref<
+                                dataT,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(cluster_sizes[new_location_previous_assignment]);
+                        atomic_cluster_size_ref -= new_location_weight;
+                        cluster_sizes[relocated_cluster_idx] = new_location_weight;
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+template <typename dataT, typename indT>
+sycl::event
+csr_relocate_empty_clusters(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_clusters,
+    size_t work_group_size,
+    //
+    size_t n_empty_clusters,
+    dataT const *data,                         // IN (nnz,)
+    indT const *indices,                       // IN (nnz,)
+    indT const *indptr,                        // IN (n_samples + 1,)
+    dataT const *sample_weight,                // IN (n_samples, )
+    indT const *assignment_id,                 // IN (n_samples, )
+    indT const *empty_clusters_list,           // IN (n_clusters, )
+    dataT const *sq_dist_to_nearest_centroid,  // IN (n_samples, )
+    dataT *centroids_t,                        // INOUT (n_features, n_clusters)
+    dataT *cluster_sizes,                      // INOUT (n_clusters,)
+    dataT *per_sample_inertia,                 // INOUT (n_sample, )
+    const std::vector<sycl::event> &depends = {}
+) {
+    // compute threshold = kth largest element in sq_dist_to_nearest_centroid
+    dataT *threshold = sycl::malloc_device<dataT>(1, q);
+
+    sycl::event compute_threshold_ev =
+        compute_threshold_kernel(q, n_samples, sq_dist_to_nearest_centroid, n_empty_clusters, threshold, depends);
+
+    // scratch of the selection, in multiples of indT, follows the counters
+    size_t n_select_scratch = quotient_ceil<size_t>(
+        select_samples_far_from_centroid_scratch_size<indT>(n_samples, work_group_size), sizeof(indT));
+    indT *samples_far_from_center = sycl::malloc_device<indT>(n_samples + 2 + n_select_scratch, q);
+    indT *n_selected = samples_far_from_center + n_samples;
+
+    indT *n_selected_gt_threshold = n_selected;
+    indT *n_selected_eq_threshold = n_selected + 1;
+    indT *select_scratch = n_selected + 2;
+
+    sycl::event select_samples_far_from_centroid_ev =
+        select_samples_far_from_centroid_kernel<dataT, indT>(
+            q,
+            n_empty_clusters, n_samples, work_group_size,
+            //
+            sq_dist_to_nearest_centroid, // IN (n_samples,)
+            threshold,                   // IN (1, )
+            samples_far_from_center,     // OUT (n_samples,)
+            n_selected_gt_threshold,     // OUT (1,)
+            n_selected_eq_threshold,     // OUT (1,)
+            select_scratch,              // SCRATCH
+            {compute_threshold_ev}
+        );
+
+    sycl::event relocate_empty_cluster_ev =
+        csr_relocate_empty_clusters_kernel<dataT, indT>(
+            q,
+            n_samples,
+            n_clusters,
+            n_empty_clusters,
+            n_selected_gt_threshold,   // USM pointer
+            work_group_size,
+            //
+            data, indices, indptr,               // IN, READ ONLY
+            sample_weight,                       // IN, READ ONLY (n_samples,)
+            assignment_id,                       // IN  (n_samples,)
+            samples_far_from_center,             // IN  (n_samples, )
+            empty_clusters_list,                 // IN  (n_clusters, )
+            per_sample_inertia,                  // INOUT (n_samples,)
+            centroids_t,                         // INOUT (n_features, n_clusters,)
+            cluster_sizes,                       // INOUT (n_clusters,)
+            {select_samples_far_from_centroid_ev}
+        );
+
+    // submit a host task to free temp USM-device allocation
+    q.submit([&](sycl::handler &cgh) {
+        cgh.depends_on(relocate_empty_cluster_ev);
+        auto ctx = q.get_context();
+
+        cgh.host_task([ctx, samples_far_from_center, threshold]() {
+            sycl::free(samples_far_from_center, ctx);
+            sycl::free(threshold, ctx);
+        });
+    });
+
+    return relocate_empty_cluster_ev;
+}
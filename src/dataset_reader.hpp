@@ -0,0 +1,303 @@
+// dataset_reader.hpp
+//
+// Reads samples stored in .npy files, or raw binary files, straight into a
+// USM allocation holding X_t with shape (n_features, n_samples). Files are
+// memory-mapped, and chunks of samples are transposed by host threads into
+// pinned staging buffers. Each chunk is copied to the device in one transfer,
+// and scattered to its columns of X_t by a kernel, both overlapping with
+// transposition of the next chunk.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "quotients_utils.hpp"
+
+struct npy_header_info {
+    std::string descr;          // e.g. "<f4"
+    bool fortran_order;
+    std::vector<size_t> shape;
+    size_t data_offset;         // offset of the array data in the file, in bytes
+};
+
+/* @brief Read-only memory mapping of a whole file */
+class mmap_file {
+public:
+    explicit mmap_file(const std::string &path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("Could not stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+
+        if (size_ > 0) {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd_);
+                throw std::runtime_error("Could not memory-map " + path);
+            }
+            data_ = static_cast<const char *>(addr);
+            // samples are read front to back, once
+            ::madvise(const_cast<char *>(data_), size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    mmap_file(const mmap_file &) = delete;
+    mmap_file &operator=(const mmap_file &) = delete;
+
+    ~mmap_file() {
+        if (data_) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+        ::close(fd_);
+    }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+namespace detail {
+
+inline std::string _npy_dict_value(const std::string &header, const std::string &key) {
+    size_t key_pos = header.find("'" + key + "'");
+    if (key_pos == std::string::npos) {
+        throw std::runtime_error("Key '" + key + "' is missing from .npy header");
+    }
+    size_t colon_pos = header.find(':', key_pos);
+    size_t value_pos = header.find_first_not_of(' ', colon_pos + 1);
+    if (colon_pos == std::string::npos || value_pos == std::string::npos) {
+        throw std::runtime_error("Malformed .npy header");
+    }
+
+    size_t value_end;
+    if (header[value_pos] == '(') {
+        value_end = header.find(')', value_pos) + 1;
+    } else if (header[value_pos] == '\'') {
+        value_end = header.find('\'', value_pos + 1) + 1;
+    } else {
+        value_end = header.find_first_of(",}", value_pos);
+    }
+    if (value_end == std::string::npos || value_end == 0) {
+        throw std::runtime_error("Malformed .npy header");
+    }
+
+    return header.substr(value_pos, value_end - value_pos);
+}
+
+} // namespace detail
+
+/* @brief Parses the header of a .npy file, format versions 1.0, 2.0 and 3.0 */
+inline npy_header_info
+parse_npy_header(const char *buf, size_t buf_size) {
+    static constexpr char magic[] = "\x93NUMPY";
+    constexpr size_t magic_len = 6;
+
+    if (buf_size < 10 || std::memcmp(buf, magic, magic_len) != 0) {
+        throw std::runtime_error("Not a .npy file");
+    }
+
+    std::uint8_t major_version = static_cast<std::uint8_t>(buf[6]);
+    size_t header_len;
+    size_t header_start;
+    if (major_version == 1) {
+        header_len =
+            size_t(static_cast<std::uint8_t>(buf[8])) |
+            (size_t(static_cast<std::uint8_t>(buf[9])) << 8);
+        header_start = 10;
+    } else if (major_version == 2 || major_version == 3) {
+        if (buf_size < 12) {
+            throw std::runtime_error("Truncated .npy header");
+        }
+        header_len = 0;
+        for(size_t i = 0; i < 4; ++i) {
+            header_len |= size_t(static_cast<std::uint8_t>(buf[8 + i])) << (8 * i);
+        }
+        header_start = 12;
+    } else {
+        throw std::runtime_error("Unsupported .npy format version");
+    }
+
+    if (header_start + header_len > buf_size) {
+        throw std::runtime_error("Truncated .npy header");
+    }
+
+    std::string header(buf + header_start, header_len);
+
+    npy_header_info info;
+    info.data_offset = header_start + header_len;
+
+    std::string descr = detail::_npy_dict_value(header, "descr");
+    info.descr = descr.substr(1, descr.size() - 2);
+
+    info.fortran_order = (detail::_npy_dict_value(header, "fortran_order") == "True");
+
+    std::string shape = detail::_npy_dict_value(header, "shape");
+    size_t pos = 1;
+    while (pos < shape.size()) {
+        size_t digit_pos = shape.find_first_of("0123456789", pos);
+        if (digit_pos == std::string::npos) {
+            break;
+        }
+        size_t digit_end = shape.find_first_not_of("0123456789", digit_pos);
+        info.shape.push_back(std::stoull(shape.substr(digit_pos, digit_end - digit_pos)));
+        pos = digit_end;
+    }
+
+    return info;
+}
+
+inline npy_header_info
+read_npy_header(const std::string &path) {
+    mmap_file f(path);
+    return parse_npy_header(f.data(), f.size());
+}
+
+template <typename dataT>
+class read_X_t_scatter_krn;
+
+/* @brief Writes X_t (n_features, n_samples) in USM memory, from samples stored at
+   offset `data_offset` of file `path` as X with shape (n_samples, n_features) in
+   C order, or in Fortran order (i.e. already as X_t) if `fortran_order`.
+
+   Samples are processed in chunks of `chunk_size`, each transposed and converted
+   from srcT to dataT by `n_threads` host threads. Blocks until X_t is populated.
+ */
+template <typename dataT, typename srcT>
+void read_X_t_from_file(
+    sycl::queue q,
+    const std::string &path,
+    size_t data_offset,
+    bool fortran_order,
+    size_t n_samples,
+    size_t n_features,
+    size_t chunk_size,
+    size_t n_threads,
+    dataT *X_t                    // OUT (n_features, n_samples)
+) {
+    mmap_file f(path);
+
+    if (data_offset + n_samples * n_features * sizeof(srcT) > f.size()) {
+        throw std::runtime_error("File " + path + " is too small for the requested shape");
+    }
+
+    if (n_samples == 0 || n_features == 0) {
+        return;
+    }
+
+    const srcT *X = reinterpret_cast<const srcT *>(f.data() + data_offset);
+
+    chunk_size = std::max<size_t>(std::min(chunk_size, n_samples), 1);
+    if (n_threads == 0) {
+        n_threads = std::max<unsigned int>(std::thread::hardware_concurrency(), 1u);
+    }
+
+    const auto &ctx = q.get_context();
+    const auto &dev = q.get_device();
+    dataT *staging[2] = {
+        sycl::malloc_host<dataT>(chunk_size * n_features, ctx),
+        sycl::malloc_host<dataT>(chunk_size * n_features, ctx)
+    };
+    dataT *device_staging[2] = {
+        sycl::malloc_device<dataT>(chunk_size * n_features, dev, ctx),
+        sycl::malloc_device<dataT>(chunk_size * n_features, dev, ctx)
+    };
+    // copies from, and scatters of, staging buffers
+    sycl::event copy_evs[2];
+    sycl::event scatter_evs[2];
+
+    // transposes samples [first_sample_idx, first_sample_idx + n_chunk_samples)
+    // into dst with shape (n_features, n_chunk_samples)
+    auto pack_samples = [=](dataT *dst, size_t first_sample_idx, size_t n_chunk_samples, size_t begin, size_t end) {
+        constexpr size_t tile = 64;
+        for(size_t tile_begin = begin; tile_begin < end; tile_begin += tile) {
+            size_t tile_end = std::min(tile_begin + tile, end);
+            for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+                dataT *dst_row = dst + feature_idx * n_chunk_samples;
+                for(size_t i = tile_begin; i < tile_end; ++i) {
+                    size_t sample_idx = first_sample_idx + i;
+                    size_t src_idx = (fortran_order) ?
+                        feature_idx * n_samples + sample_idx :
+                        sample_idx * n_features + feature_idx;
+                    dst_row[i] = static_cast<dataT>(X[src_idx]);
+                }
+            }
+        }
+    };
+
+    size_t n_chunks = quotient_ceil(n_samples, chunk_size);
+    for(size_t chunk_idx = 0; chunk_idx < n_chunks; ++chunk_idx) {
+        size_t b = chunk_idx % 2;
+        size_t first_sample_idx = chunk_idx * chunk_size;
+        size_t n_chunk_samples = std::min(chunk_size, n_samples - first_sample_idx);
+
+        // the staging buffer is reused once its previous content reached the device
+        copy_evs[b].wait();
+
+        size_t n_chunk_threads = std::min(n_threads, quotient_ceil<size_t>(n_chunk_samples, 64));
+        size_t per_thread = quotient_ceil(n_chunk_samples, n_chunk_threads);
+
+        std::vector<std::thread> workers;
+        workers.reserve(n_chunk_threads);
+        for(size_t t = 0; t < n_chunk_threads; ++t) {
+            size_t begin = t * per_thread;
+            size_t end = std::min(begin + per_thread, n_chunk_samples);
+            if (begin < end) {
+                workers.emplace_back(pack_samples, staging[b], first_sample_idx, n_chunk_samples, begin, end);
+            }
+        }
+        for(auto &w : workers) {
+            w.join();
+        }
+
+        // one transfer of the packed chunk, rather than one per feature,
+        // once the device staging buffer was scattered
+        copy_evs[b] =
+            q.copy<dataT>(staging[b], device_staging[b], n_features * n_chunk_samples, {scatter_evs[b]});
+
+        dataT const *src = device_staging[b];
+        scatter_evs[b] =
+            q.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(copy_evs[b]);
+                cgh.parallel_for<class read_X_t_scatter_krn<dataT>>(
+                    sycl::range<1>(n_features * n_chunk_samples),
+                    [=](sycl::id<1> wid) {
+                        size_t i = wid[0];
+                        size_t feature_idx = i / n_chunk_samples;
+                        size_t chunk_sample_idx = i - feature_idx * n_chunk_samples;
+                        X_t[feature_idx * n_samples + first_sample_idx + chunk_sample_idx] = src[i];
+                    }
+                );
+            });
+    }
+
+    scatter_evs[0].wait();
+    scatter_evs[1].wait();
+
+    sycl::free(staging[0], ctx);
+    sycl::free(staging[1], ctx);
+    sycl::free(device_staging[0], ctx);
+    sycl::free(device_staging[1], ctx);
+}
@@ -137,6 +137,89 @@ void _acummulate_sum_of_ops(
     }
 }
 
+/* Linear index of the coordinate `feature_idx` of sample `sample_idx` in X,
+   stored either as X_t with shape (n_features, n_samples), or, when
+   `X_row_major` is true, as X with shape (n_samples, n_features). */
+template <bool X_row_major>
+inline size_t _X_index(
+    size_t n_samples,
+    size_t n_features,
+    size_t sample_idx,
+    size_t feature_idx
+) {
+    if constexpr (X_row_major) {
+        return sample_idx * n_features + feature_idx;
+    } else {
+        return feature_idx * n_samples + sample_idx;
+    }
+}
+
+/* Loads the tile of row-major X made of the `work_group_size` samples handled
+   by the work group and of `window_n_features` features starting at
+   `first_feature_idx` into `samples_window` of shape
+   (window_n_features, work_group_size + 1).
+
+   Consecutive work items read consecutive features of a sample so that global
+   memory reads are coalesced, while the tile is stored transposed so that
+   subsequent reads of a feature for consecutive samples are contiguous in SLM.
+ */
+template <typename T, typename slmT>
+void _load_window_of_samples_row_major(
+    size_t n_samples,
+    size_t n_features,
+    size_t work_group_size,
+    size_t window_n_features,
+    // =====================================
+    size_t local_work_id,
+    size_t first_sample_idx,
+    size_t first_feature_idx,
+    T const *X,
+    slmT samples_window
+) {
+    constexpr T zero(0);
+
+    size_t tile_size = work_group_size * window_n_features;
+    for(size_t i = local_work_id; i < tile_size; i += work_group_size) {
+        size_t window_sample_idx = i / window_n_features;
+        size_t window_feature_idx = i - window_sample_idx * window_n_features;
+
+        size_t sample_idx = first_sample_idx + window_sample_idx;
+        size_t feature_idx = first_feature_idx + window_feature_idx;
+
+        bool in_bound = (sample_idx < n_samples) && (feature_idx < n_features);
+        T value = (in_bound) ? X[sample_idx * n_features + feature_idx] : zero;
+
+        samples_window[sycl::id<2>(window_feature_idx, window_sample_idx)] = value;
+    }
+}
+
+/* Same as `_acummulate_sum_of_ops`, but sample coordinates are read from the
+   window of samples loaded in SLM by `_load_window_of_samples_row_major`. */
+template <typename T, typename swT, typename cwT, typename resT, bool acummulate_dot_product>
+void _acummulate_sum_of_ops_from_window(
+    size_t window_n_features,
+    size_t window_n_centroids,
+    // ===========================
+    size_t local_work_id,
+    swT samples_window,
+    cwT centroids_window,
+    resT &result
+) {
+    for(size_t window_feature_idx = 0; window_feature_idx < window_n_features; ++window_feature_idx) {
+        T X_value = samples_window[sycl::id<2>(window_feature_idx, local_work_id)];
+
+        for(size_t window_centroid_idx = 0; window_centroid_idx < window_n_centroids; ++window_centroid_idx) {
+            T centroid_value = centroids_window[sycl::id<2>(window_feature_idx, window_centroid_idx)];
+            if constexpr (acummulate_dot_product) {
+                result[window_centroid_idx] += centroid_value * X_value;
+            } else {
+                T diff = centroid_value - X_value;
+                result[window_centroid_idx] += diff * diff;
+            }
+        }
+    }
+}
+
 template <typename T, typename slmT>
 std::pair<size_t, T> _update_closest_centroid(
     size_t window_n_centroids,
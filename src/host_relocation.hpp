@@ -0,0 +1,80 @@
+// host_relocation.hpp
+//
+// Relocation of empty clusters performed on the host, for drivers where samples
+// are not all resident in a single device allocation (streamed from the host,
+// sharded across devices or across processes). Empty clusters very rarely
+// occur, so only the small (n_clusters, n_features + 1) centroid data and the
+// samples actually relocated travel between host and device.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+/* @brief Indices of the `n_selected` samples with the largest squared distance
+   to their nearest centroid, by decreasing distance. Ties are broken by
+   smallest sample index so that the selection is deterministic. */
+template <typename dataT>
+std::vector<size_t>
+select_samples_far_from_centroid_on_host(
+    size_t n_samples,
+    size_t n_selected,
+    dataT const *sq_dist_to_nearest_centroid   // (n_samples, )
+) {
+    n_selected = std::min(n_selected, n_samples);
+
+    std::vector<size_t> idx(n_samples);
+    std::iota(idx.begin(), idx.end(), size_t(0));
+
+    auto farther = [sq_dist_to_nearest_centroid](size_t i, size_t j) {
+        dataT d_i = sq_dist_to_nearest_centroid[i];
+        dataT d_j = sq_dist_to_nearest_centroid[j];
+        return (d_i > d_j) || (d_i == d_j && i < j);
+    };
+
+    std::partial_sort(idx.begin(), idx.begin() + n_selected, idx.end(), farther);
+    idx.resize(n_selected);
+
+    return idx;
+}
+
+/* @brief Moves the i-th selected sample into the i-th empty cluster.
+
+   `centroids_t` holds the (unnormalized) sums of weighted samples of each
+   cluster, as produced by `reduce_centroid_data_kernel`, and `cluster_sizes`
+   the sums of their weights. `get_sample(k, feature_values)` must write the
+   n_features coordinates of the k-th selected sample.
+ */
+template <typename dataT, typename indT, typename GetSampleFnT>
+void relocate_empty_clusters_on_host(
+    size_t n_features,
+    size_t n_clusters,
+    size_t n_empty_clusters,
+    indT const *empty_clusters_list,           // IN (n_empty_clusters, )
+    indT const *selected_samples_assignment,   // IN (n_empty_clusters, )
+    dataT const *selected_samples_weight,      // IN (n_empty_clusters, )
+    GetSampleFnT get_sample,
+    dataT *centroids_t,                        // INOUT (n_features, n_clusters)
+    dataT *cluster_sizes                       // INOUT (n_clusters, )
+) {
+    std::vector<dataT> feature_values(n_features);
+
+    for(size_t k = 0; k < n_empty_clusters; ++k) {
+        size_t relocated_cluster_idx = empty_clusters_list[k];
+        size_t previous_assignment = selected_samples_assignment[k];
+        dataT weight = selected_samples_weight[k];
+
+        get_sample(k, feature_values.data());
+
+        for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+            dataT X_centroid_addend = feature_values[feature_idx] * weight;
+            centroids_t[feature_idx * n_clusters + previous_assignment] -= X_centroid_addend;
+            centroids_t[feature_idx * n_clusters + relocated_cluster_idx] = X_centroid_addend;
+        }
+
+        cluster_sizes[previous_assignment] -= weight;
+        cluster_sizes[relocated_cluster_idx] = weight;
+    }
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "compute_inertia.hpp"
+#include "kmeans_lloyd_driver.hpp"
+#include "scan_kernels.hpp"
+
+template <typename dataT, typename indT>
+class gather_samples_krn;
+
+/* @brief Gathers samples perm[0], ..., perm[n_sub_samples - 1] of X_t and their
+   weights into contiguous sub_X_t (n_features, n_sub_samples) and sub_weight */
+template <typename dataT, typename indT>
+sycl::event
+gather_samples_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_sub_samples,
+    //
+    dataT const *X_t,             // IN  (n_features, n_samples)
+    dataT const *sample_weight,   // IN  (n_samples,)
+    indT const *perm,             // IN  (n_sub_samples,)
+    dataT *sub_X_t,               // OUT (n_features, n_sub_samples)
+    dataT *sub_weight,            // OUT (n_sub_samples,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            cgh.parallel_for<class gather_samples_krn<dataT, indT>>(
+                sycl::range<1>(n_features * n_sub_samples),
+                [=](sycl::id<1> wid) {
+                    size_t i = wid[0];
+                    size_t feature_idx = i / n_sub_samples;
+                    size_t sub_sample_idx = i - feature_idx * n_sub_samples;
+                    size_t sample_idx = perm[sub_sample_idx];
+
+                    sub_X_t[i] = X_t[feature_idx * n_samples + sample_idx];
+                    if (feature_idx == 0) {
+                        sub_weight[sub_sample_idx] = sample_weight[sample_idx];
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+template <typename indT>
+struct bisect_label_is_zero {
+    indT const *labels;
+
+    bool operator()(size_t i) const { return labels[i] == indT(0); }
+};
+
+template <typename indT>
+struct bisect_partition_output {
+    indT const *perm;
+    indT *out_perm;
+
+    void operator()(size_t pos, size_t i) const { out_perm[pos] = perm[i]; }
+};
+
+/* @brief Partitions perm (n_sub_samples,) by 2-means labels into out_perm, samples
+   of cluster 0 first, in order, and those of cluster 1 last, in reverse order.
+   Writes the size of cluster 0 to n_first, that of cluster 1 being
+   n_sub_samples - n_first. */
+template <typename indT>
+sycl::event
+bisect_partition_kernel(
+    sycl::queue q,
+    size_t n_sub_samples,
+    size_t work_group_size,
+    //
+    indT const *perm,              // IN    (n_sub_samples,)
+    indT const *labels,            // IN    (n_sub_samples,) in {0, 1}
+    indT *out_perm,                // OUT   (n_sub_samples,)
+    indT *n_first,                 // OUT   (1,)
+    void *scratch,                 // SCRATCH, nullable (scan_scratch_size<indT> bytes)
+    const std::vector<sycl::event> &depends = {}
+) {
+    return partition_kernel<indT>(
+        q, n_sub_samples, work_group_size,
+        bisect_label_is_zero<indT>{labels},
+        bisect_partition_output<indT>{perm, out_perm},
+        n_first, scratch, depends);
+}
+
+template <typename dataT, typename indT>
+class bisect_split_inertia_krn;
+
+/* @brief Sums per_sample_inertia over samples of either 2-means cluster into
+   cluster_inertia[0] and cluster_inertia[1]. */
+template <typename dataT, typename indT>
+sycl::event
+bisect_split_inertia_kernel(
+    sycl::queue q,
+    size_t n_sub_samples,
+    //
+    indT const *labels,              // IN  (n_sub_samples,) in {0, 1}
+    dataT const *per_sample_inertia, // IN  (n_sub_samples,)
+    dataT *cluster_inertia,          // OUT (2,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            sycl::property_list prop( {sycl::property::reduction::initialize_to_identity{}} );
+            auto firstReduction = sycl::reduction(cluster_inertia, sycl::plus<dataT>(), prop);
+            auto secondReduction = sycl::reduction(cluster_inertia + 1, sycl::plus<dataT>(), prop);
+
+            cgh.parallel_for<class bisect_split_inertia_krn<dataT, indT>>(
+                sycl::range<1>(n_sub_samples),
+                firstReduction, secondReduction,
+                [=](sycl::id<1> idx, auto &first_sum, auto &second_sum) {
+                    dataT inertia = per_sample_inertia[idx];
+                    if (labels[idx] == indT(0)) {
+                        first_sum += inertia;
+                    } else {
+                        second_sum += inertia;
+                    }
+                });
+        });
+
+    return res_ev;
+}
+
+/* @brief Bisecting k-means: starting from a single cluster, repeatedly splits the
+   cluster of largest inertia with a 2-means Lloyd run on its samples only.
+
+   Samples of every cluster occupy a contiguous range of a permutation of sample
+   indices, and are gathered into a contiguous X_t before being split, so that
+   the cost of a level of the hierarchy is that of a pass on data, and the total
+   cost grows as n log k for balanced hierarchies.
+
+   Cluster j, when split, keeps label j for its first half, the second half
+   getting the next unused label. Returns parents of the splits, i.e. the
+   label split at step s gives birth to label s + 1.
+
+   2-means runs are initialized with two distinct samples drawn with `seed`.
+ */
+template <typename dataT, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+std::vector<size_t> driver_bisecting(
+    sycl::queue exec_q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    double centroids_private_copies_max_cache_occupancy,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    // inputs
+    dataT const *X_t,              // (n_features, n_samples)
+    dataT const *sample_weight,    // (n_samples,)
+    size_t max_iter,
+    dataT tol,
+    std::uint64_t seed,
+    // outputs
+    indT *assignment_id,           // (n_samples,)
+    dataT *centroids_t,            // (n_features, n_clusters)
+    dataT &total_inertia,
+    PrintFuncT print_func
+) {
+    if (n_clusters == 0 || n_samples < n_clusters) {
+        throw std::invalid_argument("Bisecting k-means requires 0 < n_clusters <= n_samples");
+    }
+
+    const auto &ctx = exec_q.get_context();
+    const auto &dev = exec_q.get_device();
+
+    indT *perm = sycl::malloc_device<indT>(n_samples, dev, ctx);
+    indT *out_perm = sycl::malloc_device<indT>(n_samples, dev, ctx);
+    dataT *sub_X_t = sycl::malloc_device<dataT>(n_features * n_samples, dev, ctx);
+    dataT *sub_weight = sycl::malloc_device<dataT>(n_samples, dev, ctx);
+    indT *sub_labels = sycl::malloc_device<indT>(n_samples, dev, ctx);
+    dataT *sub_inertia = sycl::malloc_device<dataT>(n_samples, dev, ctx);
+    dataT *split_centroids_t = sycl::malloc_device<dataT>(4 * n_features, dev, ctx);
+    dataT *init_split_centroids_t = split_centroids_t;
+    dataT *res_split_centroids_t = split_centroids_t + 2 * n_features;
+    // size of the first half, and inertia of both halves
+    indT *split_size = sycl::malloc_device<indT>(1, dev, ctx);
+    dataT *split_inertia = sycl::malloc_device<dataT>(2, dev, ctx);
+    size_t partition_scratch_size = scan_scratch_size<indT>(n_samples, work_group_size);
+    char *partition_scratch =
+        (partition_scratch_size > 0) ? sycl::malloc_device<char>(partition_scratch_size, dev, ctx) : nullptr;
+
+    sycl::event iota_ev = exec_q.parallel_for(
+        sycl::range<1>(n_samples), [=](sycl::id<1> i) { perm[i] = static_cast<indT>(i[0]); });
+
+    struct cluster_range {
+        size_t begin;
+        size_t end;
+        double inertia;
+    };
+    std::vector<cluster_range> clusters = {{0, n_samples, 0.0}};
+    std::vector<dataT> host_centroids_t(n_features * n_clusters, dataT(0));
+    std::vector<size_t> split_parents;
+    std::mt19937_64 gen(seed);
+
+    sycl::event perm_ev = iota_ev;
+
+    while (clusters.size() < n_clusters) {
+        // split the cluster with largest inertia, among those which can be split
+        size_t split_idx = clusters.size();
+        for(size_t j = 0; j < clusters.size(); ++j) {
+            if (clusters[j].end - clusters[j].begin < 2) {
+                continue;
+            }
+            if (split_idx == clusters.size() || clusters[j].inertia > clusters[split_idx].inertia) {
+                split_idx = j;
+            }
+        }
+
+        cluster_range c = clusters[split_idx];
+        size_t n_sub_samples = c.end - c.begin;
+
+        sycl::event gather_ev =
+            gather_samples_kernel<dataT, indT>(
+                exec_q, n_samples, n_features, n_sub_samples,
+                X_t, sample_weight, perm + c.begin, sub_X_t, sub_weight,
+                {perm_ev}
+            );
+
+        std::uniform_int_distribution<size_t> first_dist(0, n_sub_samples - 1);
+        std::uniform_int_distribution<size_t> second_dist(0, n_sub_samples - 2);
+        size_t first = first_dist(gen);
+        size_t second = second_dist(gen);
+        second += (second >= first) ? 1 : 0;
+
+        sycl::event init_ev = exec_q.parallel_for(
+            sycl::range<1>(n_features),
+            {gather_ev},
+            [=](sycl::id<1> f) {
+                size_t feature_idx = f[0];
+                init_split_centroids_t[feature_idx * 2] = sub_X_t[feature_idx * n_sub_samples + first];
+                init_split_centroids_t[feature_idx * 2 + 1] = sub_X_t[feature_idx * n_sub_samples + second];
+            });
+        init_ev.wait();
+
+        dataT sub_total_inertia(0);
+        driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, PrintFuncT>(
+            exec_q, n_sub_samples, n_features, 2,
+            centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+            sub_X_t, sub_weight, init_split_centroids_t,
+            max_iter, false, tol,
+            sub_labels, res_split_centroids_t, sub_total_inertia, print_func
+        );
+
+        std::vector<dataT> host_split_centroids_t(n_features * 2);
+        exec_q.copy<dataT>(res_split_centroids_t, host_split_centroids_t.data(), n_features * 2).wait();
+
+        sycl::event inertia_ev =
+            compute_inertia_kernel<dataT, indT>(
+                exec_q, n_sub_samples, n_features, 2, work_group_size,
+                sub_X_t, sub_weight, res_split_centroids_t, sub_labels, sub_inertia
+            );
+
+        sycl::event partition_ev =
+            bisect_partition_kernel<indT>(
+                exec_q, n_sub_samples, work_group_size,
+                perm + c.begin, sub_labels,
+                out_perm + c.begin, split_size, partition_scratch,
+                {perm_ev}
+            );
+
+        sycl::event split_inertia_ev =
+            bisect_split_inertia_kernel<dataT, indT>(
+                exec_q, n_sub_samples,
+                sub_labels, sub_inertia, split_inertia,
+                {inertia_ev}
+            );
+
+        perm_ev = exec_q.copy<indT>(out_perm + c.begin, perm + c.begin, n_sub_samples, {partition_ev});
+
+        indT host_split_size;
+        dataT host_split_inertia[2];
+        sycl::event size_copy_ev = exec_q.copy<indT>(split_size, &host_split_size, 1, {partition_ev});
+        sycl::event inertia_copy_ev = exec_q.copy<dataT>(split_inertia, host_split_inertia, 2, {split_inertia_ev});
+        size_copy_ev.wait();
+        inertia_copy_ev.wait();
+
+        size_t new_label = clusters.size();
+        size_t mid = c.begin + static_cast<size_t>(host_split_size);
+        clusters[split_idx] = {c.begin, mid, static_cast<double>(host_split_inertia[0])};
+        clusters.push_back({mid, c.end, static_cast<double>(host_split_inertia[1])});
+        split_parents.push_back(split_idx);
+
+        for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+            host_centroids_t[feature_idx * n_clusters + split_idx] = host_split_centroids_t[feature_idx * 2];
+            host_centroids_t[feature_idx * n_clusters + new_label] = host_split_centroids_t[feature_idx * 2 + 1];
+        }
+    }
+
+    std::vector<sycl::event> label_evs;
+    sycl::event centroids_copy_ev;
+    if (n_clusters == 1) {
+        // 1-means, i.e. the weighted mean, from any initial centroid
+        exec_q.copy<dataT>(host_centroids_t.data(), init_split_centroids_t, n_features).wait();
+        driver_lloyd<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, PrintFuncT>(
+            exec_q, n_samples, n_features, 1,
+            centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+            X_t, sample_weight, init_split_centroids_t,
+            max_iter, false, tol,
+            assignment_id, centroids_t, total_inertia, print_func
+        );
+    } else {
+        double inertia = 0.0;
+        for(const auto &c : clusters) {
+            inertia += c.inertia;
+        }
+        total_inertia = static_cast<dataT>(inertia);
+
+        centroids_copy_ev = exec_q.copy<dataT>(host_centroids_t.data(), centroids_t, n_features * n_clusters);
+
+        label_evs.reserve(clusters.size());
+        for(size_t j = 0; j < clusters.size(); ++j) {
+            size_t n_cluster_samples = clusters[j].end - clusters[j].begin;
+            if (n_cluster_samples == 0) {
+                continue;
+            }
+            indT const *cluster_perm = perm + clusters[j].begin;
+            indT label = static_cast<indT>(j);
+            label_evs.push_back(exec_q.parallel_for(
+                sycl::range<1>(n_cluster_samples),
+                {perm_ev},
+                [=](sycl::id<1> i) { assignment_id[cluster_perm[i]] = label; }));
+        }
+    }
+
+    centroids_copy_ev.wait();
+    sycl::event::wait(label_evs);
+    perm_ev.wait();
+
+    sycl::free(perm, ctx);
+    sycl::free(out_perm, ctx);
+    sycl::free(sub_X_t, ctx);
+    sycl::free(sub_weight, ctx);
+    sycl::free(sub_labels, ctx);
+    sycl::free(sub_inertia, ctx);
+    sycl::free(split_centroids_t, ctx);
+    sycl::free(split_size, ctx);
+    if (partition_scratch) {
+        sycl::free(partition_scratch, ctx);
+    }
+    sycl::free(split_inertia, ctx);
+
+    return split_parents;
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+
+#include "quotients_utils.hpp"
+#include "lloyd_single_step.hpp"
+#include "compute_inertia.hpp"
+#include "csr_kernels.hpp"
+#include "util_kernels.hpp"
+
+/* @brief Computes lloyd iterations for samples given as CSR matrix
+   (data, indices, indptr) with shape (n_samples, n_features).
+   Returns n_iteration
+
+   Column indices must be in [0, n_features). Besides centroids, the driver
+   allocates n_copies private copies of dense shape (n_features, n_clusters),
+   n_copies being compute_number_of_private_copies, i.e. about
+   max(n_clusters * (n_features + 1) * sizeof(dataT), cache size * occupancy)
+   bytes.
+ */
+template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+size_t driver_lloyd_csr(
+    sycl::queue exec_q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    // all things from self
+    double centroids_private_copies_max_cache_occupancy,
+    size_t work_group_size,
+    // inputs
+    dataT const *data,            // (nnz,)
+    indT const *indices,          // (nnz,)
+    indT const *indptr,           // (n_samples + 1,)
+    dataT const *sample_weight,   // (n_samples,)
+    dataT *init_centroids_t,      // (n_features, n_clusters)
+    size_t max_iter,
+    bool verbose,
+    dataT tol,
+    // outputs
+    indT *assignment_id,
+    dataT *res_centroids_t,
+    dataT &total_inertia,
+    PrintFuncT print_func
+)
+{
+    const auto &alloc_ctx = exec_q.get_context();
+    const auto &alloc_dev = exec_q.get_device();
+
+    // USM temporary allocations, scheduled to be freed when computations complete
+    dataT *centroids_half_l2_norm = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+
+    dataT *cluster_sizes = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+    dataT *centroid_shifts = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+
+    // squared norms of samples do not change across iterations
+    dataT *sample_sq_norms = sycl::malloc_device<dataT>(n_samples, alloc_dev, alloc_ctx);
+
+    // NB: the same buffer is used for those two arrays because it is never needed
+    // to store those simultaneously in memory.
+    dataT *per_sample_inertia = sycl::malloc_device<dataT>(n_samples, alloc_dev, alloc_ctx);
+    dataT *sq_distance_to_nearest_centroid = per_sample_inertia;
+
+    // private copies are dense, of n_clusters * n_features items each, even
+    // though a sample only updates its stored features: with many features,
+    // a single copy exceeds the cache and this is the only one, which then
+    // costs as much memory as centroids themselves
+    size_t n_centroids_private_copies =
+        compute_number_of_private_copies<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+            exec_q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size
+        );
+
+    size_t new_centroids_t_private_copies_size =
+        n_centroids_private_copies * n_features * n_clusters;
+    dataT *new_centroids_t_private_copies = sycl::malloc_device<dataT>(
+        new_centroids_t_private_copies_size, alloc_dev, alloc_ctx);
+
+    size_t cluster_sizes_private_copies_size =
+        n_centroids_private_copies * n_clusters;
+    dataT *cluster_sizes_private_copies = sycl::malloc_device<dataT>(
+        cluster_sizes_private_copies_size, alloc_dev, alloc_ctx);
+
+    indT *empty_clusters_list = sycl::malloc_device<indT>(n_clusters + 1, alloc_dev, alloc_ctx);
+    indT *n_empty_clusters = empty_clusters_list + n_clusters;
+
+    sycl::event sample_sq_norms_ev =
+        csr_row_sq_norms_kernel<dataT, indT>(
+            exec_q, n_samples, work_group_size,
+            //
+            data, indptr, sample_sq_norms
+        );
+
+    size_t n_iterations = 0;
+    dataT centroid_shifts_sum = std::numeric_limits<dataT>::infinity();
+
+    dataT *this_centroids_t = init_centroids_t;
+    dataT *new_centroids_t = res_centroids_t;
+
+    while( (n_iterations < max_iter) && (centroid_shifts_sum > tol) ) {
+
+        sycl::event half_l2_norm_ev = half_l2_norm_kernel<dataT>(
+            exec_q,
+            n_features, n_clusters, work_group_size,
+            //
+            this_centroids_t,
+            centroids_half_l2_norm);
+
+        sycl::event reset_cluster_sizes_private_copies_ev =
+            exec_q.fill<dataT>(
+                cluster_sizes_private_copies,
+                dataT(0),
+                cluster_sizes_private_copies_size
+            );
+
+        sycl::event reset_centroids_private_copies_ev =
+            exec_q.fill<dataT>(
+                new_centroids_t_private_copies,
+                dataT(0),
+                new_centroids_t_private_copies_size
+            );
+
+        sycl::event lloyd_step_ev =
+            csr_lloyd_single_step<
+                dataT, indT, preferred_work_group_size_multiple,
+                centroids_window_width_multiplier
+            >(
+                exec_q,
+                n_samples, n_features, n_clusters,
+                n_centroids_private_copies,
+                work_group_size,
+                //
+                data, indices, indptr,
+                sample_weight,
+                this_centroids_t,
+                centroids_half_l2_norm,
+                assignment_id,                    // OUT
+                new_centroids_t_private_copies,   // OUT
+                cluster_sizes_private_copies,     // OUT
+                {half_l2_norm_ev, reset_centroids_private_copies_ev, reset_cluster_sizes_private_copies_ev}
+            );
+
+        sycl::event reduce_centroid_data_ev =
+            reduce_centroid_data_kernel<dataT, indT>(
+                exec_q,
+                n_centroids_private_copies,
+                n_features,
+                n_clusters,
+                work_group_size,
+                //
+                cluster_sizes_private_copies,
+                new_centroids_t_private_copies,
+                cluster_sizes,
+                new_centroids_t,
+                empty_clusters_list,
+                n_empty_clusters,
+                {lloyd_step_ev}
+            );
+
+        if (verbose) {
+            // labels were computed against this_centroids_t
+            sycl::event compute_inertia_ev =
+                csr_compute_inertia_kernel<dataT, indT>(
+                    exec_q,
+                    n_samples, n_clusters, work_group_size,
+                    //
+                    data, indices, indptr,
+                    sample_sq_norms, sample_weight,
+                    this_centroids_t, centroids_half_l2_norm,
+                    assignment_id,
+                    per_sample_inertia,
+                    {lloyd_step_ev, sample_sq_norms_ev}
+                );
+
+            dataT iteration_total_inertia =
+                reduce_vector_kernel_blocking<dataT>(
+                    exec_q,
+                    n_samples,
+                    per_sample_inertia,
+                    {compute_inertia_ev}
+                );
+
+            std::stringstream ss;
+            ss << "Iteration: " << n_iterations << " "
+               << "Inertia: " << iteration_total_inertia
+               << std::endl;
+
+            print_func(ss);
+        }
+
+        indT host_n_empty_clusters;
+
+        sycl::event n_empty_clusters_copy_ev =
+            exec_q.copy<indT>(n_empty_clusters, &host_n_empty_clusters, 1, {reduce_centroid_data_ev});
+        n_empty_clusters_copy_ev.wait();
+
+        sycl::event relocate_empty_clusters_ev{};
+
+        if (host_n_empty_clusters > 0) {
+            // assignment_id already holds labels with respect to this_centroids_t,
+            // only the (unweighted) squared distances to nearest centroids are needed.
+            sycl::event compute_sq_dist_ev =
+                csr_compute_inertia_kernel<dataT, indT>(
+                    exec_q,
+                    n_samples, n_clusters, work_group_size,
+                    //
+                    data, indices, indptr,
+                    sample_sq_norms, nullptr,
+                    this_centroids_t, centroids_half_l2_norm,
+                    assignment_id,
+                    sq_distance_to_nearest_centroid,
+                    {sample_sq_norms_ev}
+                );
+
+            relocate_empty_clusters_ev =
+                csr_relocate_empty_clusters<dataT, indT>(
+                    exec_q,
+                    n_samples, n_clusters,
+                    work_group_size,
+                    //
+                    host_n_empty_clusters,
+                    data, indices, indptr,           // IN
+                    sample_weight,                   // IN (n_samples)
+                    assignment_id,                   // IN (n_samples, )
+                    empty_clusters_list,             // IN (n_clusters, )
+                    sq_distance_to_nearest_centroid, // IN (n_samples, )
+                    new_centroids_t,                 // INOUT (n_features, n_clusters)
+                    cluster_sizes,                   // INOUT (n_clusters,)
+                    per_sample_inertia,              // INOUT (n_sample, )
+                    {compute_sq_dist_ev}
+                );
+        }
+
+        sycl::event broadcast_division_ev =
+            broadcast_division_kernel<dataT>(
+                exec_q,
+                n_features, n_clusters, work_group_size,
+                //
+                new_centroids_t,
+                cluster_sizes,
+                {relocate_empty_clusters_ev}
+            );
+
+        sycl::event compute_centroid_shifts_ev =
+            compute_centroid_shifts_squared_kernel<dataT>(
+                exec_q,
+                n_features, n_clusters, work_group_size,
+                //
+                this_centroids_t,
+                new_centroids_t,
+                centroid_shifts,
+                {broadcast_division_ev}
+            );
+
+        centroid_shifts_sum = reduce_vector_kernel_blocking<dataT>(
+            exec_q,
+            n_clusters,
+            centroid_shifts,
+            {compute_centroid_shifts_ev}
+        );
+
+        std::swap(this_centroids_t, new_centroids_t);
+
+        ++n_iterations;
+    }
+
+    // Finally, run an assignment kernel to compute the assignments to the best
+    // centroids found, along with the exact inertia.
+    sycl::event final_half_l2_norm_ev =
+        half_l2_norm_kernel<dataT>(
+            exec_q,
+            n_features, n_clusters, work_group_size,
+            //
+            this_centroids_t,
+            centroids_half_l2_norm);
+
+    sycl::event final_assignment_ev =
+        csr_assignment<
+            dataT, indT,
+            preferred_work_group_size_multiple,
+            centroids_window_width_multiplier
+        >(
+            exec_q,
+            n_samples, n_clusters, work_group_size,
+            //
+            data, indices, indptr,
+            this_centroids_t,
+            centroids_half_l2_norm,
+            assignment_id,
+            {final_half_l2_norm_ev}
+        );
+
+    sycl::event final_compute_inertia_ev =
+        csr_compute_inertia_kernel<dataT, indT>(
+            exec_q,
+            n_samples, n_clusters, work_group_size,
+            //
+            data, indices, indptr,
+            sample_sq_norms, sample_weight,
+            this_centroids_t, centroids_half_l2_norm,
+            assignment_id,
+            per_sample_inertia,
+            {final_assignment_ev, sample_sq_norms_ev}
+        );
+
+    sycl::event final_copy_ev;
+    if (this_centroids_t != res_centroids_t) {
+        final_copy_ev = exec_q.copy<dataT>(this_centroids_t, res_centroids_t, n_features * n_clusters);
+    }
+
+    total_inertia =
+        reduce_vector_kernel_blocking<dataT>(
+            exec_q,
+            n_samples,
+            per_sample_inertia,
+            {final_compute_inertia_ev}
+        );
+
+    final_copy_ev.wait();
+
+    sycl::free(centroids_half_l2_norm, alloc_ctx);
+    sycl::free(cluster_sizes, alloc_ctx);
+    sycl::free(centroid_shifts, alloc_ctx);
+    sycl::free(sample_sq_norms, alloc_ctx);
+    sycl::free(per_sample_inertia, alloc_ctx);
+    sycl::free(new_centroids_t_private_copies, alloc_ctx);
+    sycl::free(cluster_sizes_private_copies, alloc_ctx);
+    sycl::free(empty_clusters_list, alloc_ctx);
+
+    return n_iterations;
+}
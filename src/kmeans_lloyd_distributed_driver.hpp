@@ -0,0 +1,82 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "communicator.hpp"
+#include "kmeans_lloyd_sub_devices_driver.hpp"
+
+/* @brief Computes lloyd iterations for samples distributed over the ranks of
+   `comm`, each rank holding its own X_t with shape (n_features, n_local_samples)
+   in host memory, split over its `queues` as in driver_lloyd_sub_devices.
+
+   Only the (n_clusters, n_features + 1) partial sums, and candidates for the
+   relocation of empty clusters, are exchanged between ranks at each
+   iteration. Initial centroids must be the same on all ranks, and so are
+   returned centroids, number of iterations and total inertia. Labels of
+   local samples are written to host_assignment_id. All ranks must call the
+   driver collectively.
+   Returns n_iteration
+ */
+template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+size_t driver_lloyd_distributed(
+    communicator &comm,
+    const std::vector<sycl::queue> &queues,
+    size_t n_local_samples,
+    size_t n_features,
+    size_t n_clusters,
+    // all things from self
+    double centroids_private_copies_max_cache_occupancy,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    // inputs
+    dataT const *host_X_t,              // HOST (n_features, n_local_samples)
+    dataT const *host_sample_weight,    // HOST (n_local_samples,)
+    dataT const *init_centroids_t,      // HOST (n_features, n_clusters)
+    size_t max_iter,
+    bool verbose,
+    dataT tol,
+    // outputs
+    indT *host_assignment_id,           // HOST (n_local_samples,)
+    dataT *res_centroids_t,             // HOST (n_features, n_clusters)
+    dataT &total_inertia,
+    PrintFuncT print_func
+) {
+    // global index of the first local sample, to break ties between relocation
+    // candidates of different ranks consistently
+    std::uint64_t n_local = n_local_samples;
+    std::vector<std::vector<char>> n_samples_per_rank =
+        comm.allgather(reinterpret_cast<const char *>(&n_local), sizeof(n_local));
+
+    size_t global_sample_idx_offset = 0;
+    for(size_t rank = 0; rank < comm.rank(); ++rank) {
+        std::uint64_t n_rank_samples;
+        std::memcpy(&n_rank_samples, n_samples_per_rank[rank].data(), sizeof(n_rank_samples));
+        global_sample_idx_offset += n_rank_samples;
+    }
+
+    auto shards =
+        make_lloyd_shards<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+            queues, n_local_samples, n_features, n_clusters,
+            centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+            host_X_t, host_sample_weight, global_sample_idx_offset
+        );
+
+    // inertia is the same on all ranks, only the first one reports it
+    bool is_root = (comm.rank() == 0);
+    auto root_print_func = [&print_func, is_root](const std::stringstream &ss) {
+        if (is_root) {
+            print_func(ss);
+        }
+    };
+
+    return lloyd_iterations_on_shards<dataT, indT>(
+        shards, n_features, n_clusters, init_centroids_t,
+        max_iter, verbose, tol,
+        host_assignment_id, res_centroids_t, total_inertia, root_print_func,
+        &comm
+    );
+}
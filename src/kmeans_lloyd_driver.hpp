@@ -1,11 +1,15 @@
 #pragma once
 
 #include <CL/sycl.hpp>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cstdint>
 #include <limits>
 #include <sstream>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
 
 #include "quotients_utils.hpp"
 #include "device_functions.hpp"
@@ -14,11 +18,95 @@
 #include "assignment.hpp"
 #include "compute_euclidean_distance.hpp"
 #include "util_kernels.hpp"
+#include "profiling.hpp"
+#include "telemetry.hpp"
+#include "recorded_commands.hpp"
+#include "private_copies_tuning.hpp"
+#include "sort_by_label.hpp"
+
+/* @brief Options of driver_lloyd beyond the problem definition */
+struct lloyd_driver_options {
+    // When non-negative, iterations also stop once at most this fraction of
+    // samples changed label in an iteration, 0 being sklearn's strict
+    // convergence. If tol is 0 as well, centroid shifts are then not computed.
+    double label_change_tol = -1.0;
+
+    // Warm start: number of leading samples whose labels in assignment_id are
+    // those of the model being refitted, init_centroids_t being its centroids.
+    // Only labels of the remaining (e.g. appended) samples are reset, so that
+    // label changes, and convergence, are counted against the previous model.
+    size_t n_labeled_samples = 0;
+
+    // Spherical (cosine) k-means: centroids are kept at unit L2 norm, and
+    // samples are assigned to the centroid of largest dot product, i.e. half
+    // norms of centroids are zeroed. Samples are expected to be normalized,
+    // inertia then sums 2 (1 - cosine similarity) over samples.
+    bool spherical = false;
+
+    // Two sets of private copies of centroids and cluster sizes are used in
+    // turns, so that zeroing the set of the next iteration is submitted as
+    // soon as the current step is, and overlaps its reduction on out-of-order
+    // queues. Private copies then occupy twice their memory. Ignored, with a
+    // single set, when there is no zeroing to overlap, i.e. when private
+    // copies are reset in the reduction, or when all steps are recorded.
+    bool double_buffer_private_copies = false;
+
+    // The commands of a lloyd step, up to the reduction of private copies,
+    // are recorded once as a SYCL command graph and replayed at every
+    // iteration, which saves the host overhead of their submissions. Ignored
+    // when profiling. Zeroing of private copies is then part of the step, not
+    // submitted ahead. Without the SYCL_EXT_ONEAPI_GRAPH extension, or on
+    // devices not supporting graphs, replays submit the commands anew, which
+    // saves nothing: verbose runs print which of the two happens.
+    bool use_command_graph = false;
+
+    // Private copies are zeroed by the reduction reading them, rather than by
+    // fills before every step, which saves a pass over them per iteration.
+    // They are then only filled once, before the first step, and double
+    // buffering has no zeroing left to overlap.
+    bool reset_private_copies_in_reduction = false;
+
+    // The number of private copies and the mapping of sub-groups to copies
+    // are tuned at the first iterations (see private_copies_tuner), rather
+    // than derived from the size of the global memory cache only. Steps are
+    // only recorded once tuning is over.
+    bool adaptive_private_copies = false;
+
+    // How new centroid data is accumulated, sort_by_label trades the atomics
+    // of lloyd_single_step for a sort of samples by label, which pays off
+    // with much imbalanced clusters. Ignored when adaptive_private_copies is
+    // true, the tuner then tries sort_by_label when clusters are imbalanced.
+    centroid_update_strategy update_strategy = centroid_update_strategy::private_copies;
+};
 
 /* @brief Computes lloyd iterations
    Returns n_iteration
+
+   Private copies of new centroids and cluster sizes are accumulated in accT,
+   which may be wider than dataT (mixed-precision mode).
+
+   When X_row_major is true, X_t is instead expected to be X with shape
+   (n_samples, n_features), which spares the caller a transposed copy.
+
+   When `profiler` is given, every command is recorded in it, with the
+   iteration it belongs to. exec_q must then have profiling enabled.
+
+   `iteration_callback` is called with lloyd_iteration_metrics at the end of
+   every iteration, unless it is a no_iteration_callback.
+
+   Every command is submitted with the events of the commands it depends on,
+   so that exec_q may be out-of-order, independent commands (e.g. zeroing of
+   private copies and computation of half norms of centroids) then overlap.
+
+   Throws std::invalid_argument if options.update_strategy is sort_by_label
+   and n_samples does not fit in std::uint32_t.
+
+   Labels are reset at entry, except the first options.n_labeled_samples
+   ones, kept for a warm start. The final assignment pass is skipped when the
+   last iteration changed no label and relocated no cluster, only inertia is
+   then computed.
  */
-template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT, typename accT = dataT, bool X_row_major = false, typename IterationCallbackT = no_iteration_callback>
 size_t driver_lloyd(
     sycl::queue exec_q,
     size_t n_samples,
@@ -29,7 +117,7 @@ size_t driver_lloyd(
     size_t centroids_window_height,
     size_t work_group_size,
     // inputs
-    dataT const *X_t,
+    dataT const *X_t,                   // (n_features, n_samples) or (n_samples, n_features) if X_row_major
     dataT const *sample_weight,
     dataT *init_centroids_t,
     size_t max_iter,
@@ -39,9 +127,19 @@ size_t driver_lloyd(
     indT *assignment_id,
     dataT *res_centroids_t,
     dataT &total_inertia,
-    PrintFuncT print_func
+    PrintFuncT print_func,
+    kernel_profiler *profiler = nullptr,
+    IterationCallbackT iteration_callback = IterationCallbackT{},
+    lloyd_driver_options options = lloyd_driver_options{}
 )
 {
+    // sorted indices of samples are std::uint32_t
+    bool can_sort_by_label = (n_samples <= std::numeric_limits<std::uint32_t>::max());
+    if (!options.adaptive_private_copies &&
+        options.update_strategy == centroid_update_strategy::sort_by_label && !can_sort_by_label) {
+        throw std::invalid_argument("Too many samples to sort them by label");
+    }
+
     const auto &alloc_ctx = exec_q.get_context();
     const auto &alloc_dev = exec_q.get_device();
   
@@ -57,58 +155,190 @@ size_t driver_lloyd(
     dataT *sq_distance_to_nearest_centroid = per_sample_inertia;
 
     size_t n_centroids_private_copies = 
-        compute_number_of_private_copies<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+        compute_number_of_private_copies<accT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
             exec_q, n_samples, n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size
         );
+    size_t private_copies_block_size = preferred_work_group_size_multiple;
+    centroid_update_strategy update_strategy = options.update_strategy;
+
+    // buffers are sized for the largest count the tuner may choose, copies
+    // beyond the count in use are left zeroed
+    std::unique_ptr<private_copies_tuner> tuner;
+    size_t n_allocated_private_copies = n_centroids_private_copies;
+    if (options.adaptive_private_copies) {
+        tuner = std::make_unique<private_copies_tuner>(
+            exec_q.get_device(), n_samples, n_features, n_clusters, sizeof(accT),
+            preferred_work_group_size_multiple, work_group_size, n_centroids_private_copies,
+            can_sort_by_label);
+        n_allocated_private_copies = tuner->max_n_copies();
+        n_centroids_private_copies = tuner->current().n_copies;
+    }
+
+    // Steps recorded once per parity of iterations, since centroids buffers
+    // are swapped at every iteration. Commands of profiled runs are submitted
+    // one by one so that each of them is recorded.
+    bool use_command_graph = options.use_command_graph && !profiler;
+
+    // zeroing of the next set of private copies only overlaps steps that are
+    // submitted one by one, and that do not reset copies themselves
+    bool double_buffers =
+        options.double_buffer_private_copies && !options.reset_private_copies_in_reduction &&
+        (!use_command_graph || options.adaptive_private_copies);
+    size_t n_private_copies_buffers = (double_buffers) ? 2 : 1;
 
     size_t new_centroids_t_private_copies_size =
-        n_centroids_private_copies * n_features * n_clusters; 
-    dataT *new_centroids_t_private_copies = sycl::malloc_device<dataT>( 
-        new_centroids_t_private_copies_size, alloc_dev, alloc_ctx);
+        n_allocated_private_copies * n_features * n_clusters; 
+    accT *new_centroids_t_private_copies_buffers = sycl::malloc_device<accT>(
+        n_private_copies_buffers * new_centroids_t_private_copies_size, alloc_dev, alloc_ctx);
 
     size_t cluster_sizes_private_copies_size = 
-        n_centroids_private_copies * n_clusters;
-    dataT *cluster_sizes_private_copies = sycl::malloc_device<dataT>(
-        cluster_sizes_private_copies_size, alloc_dev, alloc_ctx);
+        n_allocated_private_copies * n_clusters;
+    accT *cluster_sizes_private_copies_buffers = sycl::malloc_device<accT>(
+        n_private_copies_buffers * cluster_sizes_private_copies_size, alloc_dev, alloc_ctx);
 
-    indT *empty_clusters_list = sycl::malloc_device<indT>(n_clusters + 1, alloc_dev, alloc_ctx);
+    // counters follow the list, so that they are copied to host together
+    indT *empty_clusters_list = sycl::malloc_device<indT>(n_clusters + 2, alloc_dev, alloc_ctx);
     indT *n_empty_clusters = empty_clusters_list + n_clusters;
+    indT *n_changed_labels = empty_clusters_list + n_clusters + 1;
+    indT *host_counters = sycl::malloc_host<indT>(2, alloc_ctx);
+
+    // buffers of the sort_by_label strategy, allocated once it is first used:
+    // sorted indices, scratch of the sort and labels of carries of the
+    // segmented reduction, which then writes in the first private copy
+    size_t segment_chunk_size = segmented_centroid_sums_chunk_size(n_samples);
+    size_t n_segment_carries = 2 * quotient_ceil(n_samples, segment_chunk_size);
+    size_t sort_scratch_size = sort_samples_by_label_scratch_size<indT>(n_samples, work_group_size);
+    std::uint32_t *sorted_sample_idx = nullptr;
+    char *sort_scratch = nullptr;
+    std::uint32_t *segment_carry_labels = nullptr;
+    accT *segment_carry_sums = nullptr;
+
+    using host_clock = std::chrono::steady_clock;
+    bool with_telemetry = iteration_callback_enabled(iteration_callback);
+
+    bool check_label_changes = (options.label_change_tol >= 0.0);
+    bool compute_centroid_shifts = !(check_label_changes && tol == dataT(0));
+    size_t max_n_changed_labels =
+        static_cast<size_t>(options.label_change_tol * static_cast<double>(n_samples));
+
+    // label changes are always counted, so that no sample is counted as
+    // unchanged at the first iteration, labels are reset to a sentinel
+    size_t n_labeled_samples = std::min(options.n_labeled_samples, n_samples);
+    sycl::event reset_assignment_ev;
+    if (n_labeled_samples < n_samples) {
+        reset_assignment_ev = exec_q.fill<indT>(
+            assignment_id + n_labeled_samples, static_cast<indT>(-1), n_samples - n_labeled_samples);
+    }
+
+    // whether labels computed by the last lloyd step are those of the final
+    // centroids: true when no label changed and no cluster was relocated,
+    // since the final centroids are then the previous ones. Initial centroids
+    // of a warm start need not be the means of the initial labels.
+    bool labels_are_final = false;
 
     size_t n_iterations = 0;
     dataT centroid_shifts_sum = std::numeric_limits<dataT>::infinity();
+    bool labels_converged = false;
+
+    // completion of the update of centroids of the previous iteration
+    sycl::event centroids_update_ev;
+
+    // last command reading new_centroids_t, as centroids of the previous
+    // iteration, before it is overwritten
+    sycl::event centroid_shifts_ev;
+
+    // per buffer of private copies, the last step reducing it, and the
+    // zeroing submitted ahead of the step using it
+    std::vector<sycl::event> private_copies_reduce_evs(n_private_copies_buffers);
+    std::vector<sycl::event> private_copies_reset_evs;
 
     dataT *this_centroids_t = init_centroids_t;
     dataT *new_centroids_t = res_centroids_t;
 
-    while( (n_iterations < max_iter) && (centroid_shifts_sum > tol) ) {
-
-        // populate centroids_half_norm
-        sycl::event half_l2_norm_ev = half_l2_norm_kernel<dataT>(
-            exec_q,
-            n_features, n_clusters, work_group_size,
-            //
-            this_centroids_t, 
-            centroids_half_l2_norm);
+    auto profile = [&](const char *name, sycl::event ev, kernel_cost cost) {
+        if (profiler) {
+            profiler->record(name, n_iterations, ev, cost);
+        }
+    };
+
+    // half norms of centroids, zeroed in spherical mode, where maximizing the
+    // dot product is what ranks centroids
+    auto compute_half_l2_norm = [&](dataT const *centroids_t, const std::vector<sycl::event> &depends) {
+        sycl::event ev;
+        if (options.spherical) {
+            ev = exec_q.fill<dataT>(centroids_half_l2_norm, dataT(0), n_clusters, depends);
+            profile("fill", ev, lloyd_kernel_costs::fill<dataT>(n_clusters));
+        } else {
+            ev = half_l2_norm_kernel<dataT>(
+                exec_q,
+                n_features, n_clusters, work_group_size,
+                //
+                centroids_t, 
+                centroids_half_l2_norm,
+                depends);
+            profile("half_l2_norm", ev, lloyd_kernel_costs::half_l2_norm<dataT>(n_features, n_clusters));
+        }
+        return ev;
+    };
 
-        // zero out cluster_sizes_private_copies
+    // zero out cluster_sizes_private_copies and new_centroids_t_private_copies
+    // of a buffer
+    auto reset_private_copies = [&](size_t buffer_idx, const std::vector<sycl::event> &depends) {
         sycl::event reset_cluster_sizes_private_copies_ev =
-            exec_q.fill<dataT>(
-                cluster_sizes_private_copies, 
-                dataT(0), 
-                cluster_sizes_private_copies_size
+            exec_q.fill<accT>(
+                cluster_sizes_private_copies_buffers + buffer_idx * cluster_sizes_private_copies_size,
+                accT(0),
+                cluster_sizes_private_copies_size,
+                depends
             );
+        profile("reset_cluster_sizes_private_copies", reset_cluster_sizes_private_copies_ev,
+                lloyd_kernel_costs::fill<accT>(cluster_sizes_private_copies_size));
 
-        // zero out new_centroids_t_private_copies
         sycl::event reset_centroids_private_copies_ev = 
-            exec_q.fill<dataT>(
-                new_centroids_t_private_copies,
-                dataT(0),
-                new_centroids_t_private_copies_size
+            exec_q.fill<accT>(
+                new_centroids_t_private_copies_buffers + buffer_idx * new_centroids_t_private_copies_size,
+                accT(0),
+                new_centroids_t_private_copies_size,
+                depends
             );
+        profile("reset_centroids_private_copies", reset_centroids_private_copies_ev,
+                lloyd_kernel_costs::fill<accT>(new_centroids_t_private_copies_size));
+
+        return std::vector<sycl::event>{reset_cluster_sizes_private_copies_ev, reset_centroids_private_copies_ev};
+    };
+
+    // Submits a lloyd step with centroids step_centroids_t, up to the reduction
+    // of private copies of buffer `buffer_idx` in step_new_centroids_t and the
+    // copy of counters to the host. Private copies are zeroed first, unless
+    // `reset_evs`, events of their zeroing done ahead, are given.
+    // Returns the event of the copy of counters.
+    auto submit_lloyd_step = [&](
+        dataT const *step_centroids_t,
+        dataT *step_new_centroids_t,
+        size_t buffer_idx,
+        std::vector<sycl::event> reset_evs,
+        const std::vector<sycl::event> &depends
+    ) {
+        accT *new_centroids_t_private_copies =
+            new_centroids_t_private_copies_buffers + buffer_idx * new_centroids_t_private_copies_size;
+        accT *cluster_sizes_private_copies =
+            cluster_sizes_private_copies_buffers + buffer_idx * cluster_sizes_private_copies_size;
 
-        // n_empty_clusters[0] = np.int32(0)
+        // populate centroids_half_norm
+        sycl::event half_l2_norm_ev = compute_half_l2_norm(step_centroids_t, depends);
+
+        if (reset_evs.empty() && !options.reset_private_copies_in_reduction) {
+            reset_evs = reset_private_copies(buffer_idx, depends);
+        }
+
+        // n_empty_clusters[0] = np.int32(0), along with n_changed_labels
         sycl::event set_n_empty_clusters_ev = 
-            exec_q.fill<indT>(n_empty_clusters, indT(0), 1);
+            exec_q.fill<indT>(n_empty_clusters, indT(0), 2, depends);
+        profile("reset_n_empty_clusters", set_n_empty_clusters_ev, lloyd_kernel_costs::fill<indT>(2));
+
+        std::vector<sycl::event> lloyd_step_depends(reset_evs);
+        lloyd_step_depends.push_back(half_l2_norm_ev);
+        lloyd_step_depends.push_back(set_n_empty_clusters_ev);
 
         /*
             fused_lloyd_fixed_window_single_step_kernel(
@@ -121,10 +351,13 @@ size_t driver_lloyd(
                 cluster_sizes_private_copies,
             )
         */
+        // with sort_by_label, samples are only assigned by the step
+        bool sorts_by_label = (update_strategy == centroid_update_strategy::sort_by_label);
+
         sycl::event lloyd_step_ev = 
             lloyd_single_step<
-                dataT, indT, preferred_work_group_size_multiple, 
-                centroids_window_width_multiplier
+                dataT, indT, preferred_work_group_size_multiple,
+                centroids_window_width_multiplier, accT, X_row_major
             >(
                 exec_q, 
                 n_samples, n_features, n_clusters,
@@ -134,13 +367,47 @@ size_t driver_lloyd(
                 // 
                 X_t, 
                 sample_weight,
-                this_centroids_t,
+                step_centroids_t,
                 centroids_half_l2_norm,
                 assignment_id,                    // OUT
-                new_centroids_t_private_copies,   // OUT
-                cluster_sizes_private_copies,     // OUT
-                {half_l2_norm_ev, reset_centroids_private_copies_ev, reset_cluster_sizes_private_copies_ev}
+                (sorts_by_label) ? nullptr : new_centroids_t_private_copies,   // OUT
+                (sorts_by_label) ? nullptr : cluster_sizes_private_copies,     // OUT
+                lloyd_step_depends,
+                n_changed_labels,
+                private_copies_block_size
             );
+        profile("lloyd_single_step", lloyd_step_ev,
+                lloyd_kernel_costs::lloyd_single_step<dataT, indT, accT>(n_samples, n_features, n_clusters));
+
+        sycl::event accumulate_ev = lloyd_step_ev;
+        size_t n_reduced_private_copies = n_centroids_private_copies;
+        if (sorts_by_label) {
+            sycl::event first_sort_ev;
+            sycl::event sort_ev = sort_samples_by_label<indT>(
+                exec_q, n_samples, n_clusters, work_group_size,
+                assignment_id, sorted_sample_idx, sort_scratch,
+                {lloyd_step_ev}, &first_sort_ev);
+            if (profiler) {
+                profiler->record_span("sort_samples_by_label", n_iterations, first_sort_ev, sort_ev,
+                                      lloyd_kernel_costs::sort_samples_by_label(n_samples, n_clusters));
+            }
+
+            sycl::event first_sums_ev;
+            accumulate_ev = segmented_centroid_sums_kernel<dataT, indT, accT, X_row_major>(
+                exec_q, n_samples, n_features, n_clusters, segment_chunk_size,
+                X_t, sample_weight, assignment_id, sorted_sample_idx,
+                new_centroids_t_private_copies,   // INOUT
+                cluster_sizes_private_copies,     // INOUT
+                segment_carry_labels, segment_carry_sums,
+                {sort_ev}, &first_sums_ev);
+            if (profiler) {
+                profiler->record_span("segmented_centroid_sums", n_iterations, first_sums_ev, accumulate_ev,
+                                      lloyd_kernel_costs::segmented_centroid_sums<dataT, indT, accT>(
+                                          n_samples, n_features, n_clusters));
+            }
+
+            n_reduced_private_copies = 1;
+        }
 
         /* 
         reduce_centroid_data_kernel(
@@ -152,10 +419,11 @@ size_t driver_lloyd(
                 n_empty_clusters,
             )
         */
+        sycl::event first_reduce_ev;
         sycl::event reduce_centroid_data_ev = 
-            reduce_centroid_data_kernel<dataT, indT>(
+            reduce_centroid_data_kernel<dataT, indT, accT>(
                 exec_q, 
-                n_centroids_private_copies,
+                n_reduced_private_copies,
                 n_features, 
                 n_clusters,
                 work_group_size,
@@ -163,13 +431,113 @@ size_t driver_lloyd(
                 cluster_sizes_private_copies,    // OUT  (n_copies, n_clusters)
                 new_centroids_t_private_copies,  // OUT  (n_copies, n_features, n_clusters)
                 cluster_sizes,         // OUT  (n_clusters)
-                new_centroids_t,       // OUT  (n_features, n_clusters,)
+                step_new_centroids_t,  // OUT  (n_features, n_clusters,)
                 empty_clusters_list,   // OUT  (n_clusters,)
                 n_empty_clusters,      // OUT  (1,)
-                {lloyd_step_ev}
+                {accumulate_ev},
+                options.reset_private_copies_in_reduction,
+                &first_reduce_ev
             );
+        if (profiler) {
+            profiler->record_span("reduce_centroid_data", n_iterations, first_reduce_ev, reduce_centroid_data_ev,
+                                  lloyd_kernel_costs::reduce_centroid_data<dataT, accT>(
+                                      n_reduced_private_copies, n_features, n_clusters,
+                                      options.reset_private_copies_in_reduction));
+        }
+
+        return exec_q.copy<indT>(n_empty_clusters, host_counters, 2, {reduce_centroid_data_ev});
+    };
+
+    std::unique_ptr<recorded_commands> recorded_steps[2];
+
+    if (options.reset_private_copies_in_reduction) {
+        // the only zeroing, the first step using each buffer waits for it
+        for(size_t buffer_idx = 0; buffer_idx < n_private_copies_buffers; ++buffer_idx) {
+            private_copies_reset_evs = reset_private_copies(buffer_idx, {});
+            private_copies_reduce_evs[buffer_idx] = exec_q.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(private_copies_reset_evs);
+                cgh.single_task([]() {});
+            });
+        }
+        private_copies_reset_evs.clear();
+    }
+
+    if (options.spherical) {
+        // initial centroids are overwritten by their normalization
+        centroids_update_ev = l2_normalize_kernel<dataT>(
+            exec_q, n_features, n_clusters, work_group_size, init_centroids_t);
+        profile("l2_normalize", centroids_update_ev, lloyd_kernel_costs::l2_normalize<dataT>(n_features, n_clusters));
+    }
+
+    while( (n_iterations < max_iter) && (centroid_shifts_sum > tol) && !labels_converged ) {
+
+        size_t buffer_idx = n_iterations % n_private_copies_buffers;
+
+        if (tuner) {
+            n_centroids_private_copies = tuner->current().n_copies;
+            private_copies_block_size = tuner->block_size();
+            update_strategy = tuner->current().strategy;
+        }
+
+        // allocated ahead of the timing of the step, as the tuner compares steps
+        if (update_strategy == centroid_update_strategy::sort_by_label && !sorted_sample_idx) {
+            sorted_sample_idx = sycl::malloc_device<std::uint32_t>(n_samples + n_segment_carries, alloc_dev, alloc_ctx);
+            segment_carry_labels = sorted_sample_idx + n_samples;
+            sort_scratch = sycl::malloc_device<char>(sort_scratch_size, alloc_dev, alloc_ctx);
+            segment_carry_sums = sycl::malloc_device<accT>(n_segment_carries * (n_features + 1), alloc_dev, alloc_ctx);
+        }
+
+        auto iteration_start = host_clock::now();
+        double inertia_ns = 0.0;
+        bool use_recorded_steps = use_command_graph && (!tuner || tuner->settled());
+
+        // the step overwrites new_centroids_t, read by the centroid shifts of
+        // the previous iteration, and private copies, read by their last reduction
+        std::vector<sycl::event> step_depends = {
+            centroids_update_ev, centroid_shifts_ev, reset_assignment_ev, private_copies_reduce_evs[buffer_idx]
+        };
+
+        sycl::event step_ev;
+        if (use_recorded_steps) {
+            std::unique_ptr<recorded_commands> &recorded_step = recorded_steps[n_iterations % 2];
+            if (!recorded_step) {
+                dataT const *step_centroids_t = this_centroids_t;
+                dataT *step_new_centroids_t = new_centroids_t;
+                recorded_step = std::make_unique<recorded_commands>(
+                    exec_q,
+                    [=, &submit_lloyd_step](const std::vector<sycl::event> &depends) {
+                        return submit_lloyd_step(step_centroids_t, step_new_centroids_t, buffer_idx, {}, depends);
+                    });
+
+                if (verbose && !recorded_steps[(n_iterations + 1) % 2]) {
+                    std::stringstream ss;
+                    ss << "Lloyd step replays: "
+                       << (recorded_step->is_graph() ? "command graph" : "submissions, no graph support")
+                       << std::endl;
+                    print_func(ss);
+                }
+            }
+            // a zeroing submitted ahead by the last step that was not recorded
+            // writes to the private copies of this one
+            step_depends.insert(step_depends.end(), private_copies_reset_evs.begin(), private_copies_reset_evs.end());
+            private_copies_reset_evs.clear();
+            step_ev = recorded_step->replay(step_depends);
+        } else {
+            step_ev = submit_lloyd_step(
+                this_centroids_t, new_centroids_t, buffer_idx, std::move(private_copies_reset_evs), step_depends);
+            private_copies_reset_evs.clear();
+        }
+        private_copies_reduce_evs[buffer_idx] = step_ev;
+
+        if (double_buffers && !use_recorded_steps) {
+            // zeroing the other buffer, for the next iteration, overlaps this reduction
+            size_t next_buffer_idx = (buffer_idx + 1) % n_private_copies_buffers;
+            private_copies_reset_evs = reset_private_copies(next_buffer_idx, {private_copies_reduce_evs[next_buffer_idx]});
+        }
 
         if (verbose) {
+            auto inertia_start = host_clock::now();
+
             // auto compute_inertia_ev = compute_inertia_kernel<dataT>(exec_q, 
             // X_t, sample_weight, new_centroids_t, assignment_idx, per_sample_inertia,
             // {reduce_centroid_data_ev});
@@ -177,7 +545,7 @@ size_t driver_lloyd(
             // auto interia_reduce_ev = reduce_inertia_kernel<dataT>(
             //     exec_q, per_sample_inertia, {compute_inertial_ev});
             sycl::event compute_inertia_ev = 
-                compute_inertia_kernel<dataT>(
+                compute_inertia_kernel<dataT, indT, X_row_major>(
                     exec_q,
                     n_samples, n_features, n_clusters, work_group_size,
                     //
@@ -185,16 +553,21 @@ size_t driver_lloyd(
                     new_centroids_t,
                     assignment_id,
                     per_sample_inertia,
-                    {reduce_centroid_data_ev}
+                    {step_ev}
                 );
+            profile("compute_inertia", compute_inertia_ev,
+                    lloyd_kernel_costs::compute_inertia<dataT, indT>(n_samples, n_features));
 
+            sycl::event reduce_inertia_ev;
             dataT iteration_total_inertia =
                 reduce_vector_kernel_blocking<dataT>(
                     exec_q,
                     n_samples,
                     per_sample_inertia,
-                    {compute_inertia_ev} 
+                    {compute_inertia_ev},
+                    &reduce_inertia_ev
                 );
+            profile("reduce_inertia", reduce_inertia_ev, lloyd_kernel_costs::reduce_vector<dataT>(n_samples));
 
             std::stringstream ss;
             ss << "Iteration: " << n_iterations << " "
@@ -202,13 +575,44 @@ size_t driver_lloyd(
                << std::endl;
 
             print_func(ss);
+
+            inertia_ns = std::chrono::duration<double, std::nano>(host_clock::now() - inertia_start).count();
         }
 
-        indT host_n_empty_clusters;
+        step_ev.wait();
+
+        indT host_n_empty_clusters = host_counters[0];
+        size_t host_n_changed_labels = static_cast<size_t>(host_counters[1]);
+        auto lloyd_step_end = host_clock::now();
 
-        sycl::event n_empty_clusters_copy_ev = 
-            exec_q.copy<indT>(n_empty_clusters, &host_n_empty_clusters, 1, {reduce_centroid_data_ev});
-        n_empty_clusters_copy_ev.wait();
+        if (tuner && !tuner->settled()) {
+            double step_ns =
+                std::chrono::duration<double, std::nano>(lloyd_step_end - iteration_start).count() - inertia_ns;
+
+            std::vector<dataT> host_cluster_sizes;
+            if (tuner->needs_cluster_sizes()) {
+                host_cluster_sizes.resize(n_clusters);
+                exec_q.copy<dataT>(cluster_sizes, host_cluster_sizes.data(), n_clusters).wait();
+            }
+            tuner->record_step(step_ns, host_cluster_sizes);
+
+            if (verbose && tuner->settled()) {
+                std::stringstream ss;
+                if (tuner->current().strategy == centroid_update_strategy::sort_by_label) {
+                    ss << "Centroid update: sort_by_label" << std::endl;
+                } else {
+                    ss << "Private copies: " << tuner->current().n_copies << " "
+                       << "Mapping: " << private_copies_mapping_name(tuner->current().mapping)
+                       << std::endl;
+                }
+
+                print_func(ss);
+            }
+        }
+
+        // centroids are still updated from the labels of this iteration
+        labels_converged = check_label_changes && (host_n_changed_labels <= max_n_changed_labels);
+        labels_are_final = (n_iterations > 0) && (host_n_changed_labels == 0) && (host_n_empty_clusters == 0);
 
         // n_empty_clusters_ = int(n_empty_clusters[0])
 
@@ -236,8 +640,8 @@ size_t driver_lloyd(
                 assignment_ev =
                     assignment<
                         dataT, indT,
-                        preferred_work_group_size_multiple, 
-                        centroids_window_width_multiplier
+                        preferred_work_group_size_multiple,
+                        centroids_window_width_multiplier, X_row_major
                     >(
                         exec_q,
                         n_samples, n_features, n_clusters, 
@@ -245,7 +649,8 @@ size_t driver_lloyd(
                         //
                         X_t, this_centroids_t, 
                         centroids_half_l2_norm, 
-                        assignment_id
+                        assignment_id,
+                        {step_ev}
                     );
             }
 
@@ -265,7 +670,7 @@ size_t driver_lloyd(
                 )
                 */
                 compute_inertia_ev = 
-                    compute_uniform_weight_inertia_kernel<dataT>(
+                    compute_uniform_weight_inertia_kernel<dataT, indT, X_row_major>(
                         exec_q,
                         n_samples, n_features, n_clusters, work_group_size,
                         // 
@@ -293,13 +698,13 @@ size_t driver_lloyd(
                 )
             */
             relocate_empty_clusters_ev = 
-                relocate_empty_clusters<dataT, indT>(
+                relocate_empty_clusters<dataT, indT, X_row_major>(
                     exec_q,
                     n_samples, n_features, n_clusters,
                     work_group_size,
                     //
                     host_n_empty_clusters,
-                    X_t,                             // IN (n_features, n_samples)
+                    X_t,                             // IN (n_features, n_samples) or (n_samples, n_features)
                     sample_weight,                   // IN (n_samples)
                     assignment_id,                   // IN (n_samples, )
                     empty_clusters_list,             // IN (n_clusters, )
@@ -307,45 +712,96 @@ size_t driver_lloyd(
                     new_centroids_t,                 // INOUT (n_features, n_clusters)
                     cluster_sizes,                   // INOUT (n_clusters,)
                     per_sample_inertia,              // INOUT (n_sample, )
-                    {assignment_ev, compute_inertia_ev}
+                    {step_ev, assignment_ev, compute_inertia_ev}
                 );
+
+            if (profiler) {
+                // assignment_ev is a no-op event when verbose, labels are then up to date
+                sycl::event first_ev = (!verbose) ? assignment_ev : compute_inertia_ev;
+                profiler->record_span(
+                    "relocate_empty_clusters", n_iterations, first_ev, relocate_empty_clusters_ev,
+                    lloyd_kernel_costs::relocate_empty_clusters<dataT, indT>(n_samples, n_features, n_clusters, !verbose));
+            }
         }
 
         // compute new_centroids_t /= cluster_sizes
         // broadcast_division_kernel(n_feature, n_clusters, new_centroids_t, cluster_sizes)
+        // or, in spherical mode, scale sums to unit norm
 
-        sycl::event broadcast_division_ev =
-            broadcast_division_kernel<dataT>(
-                exec_q,
-                n_features, n_clusters, work_group_size,
-                // 
-                new_centroids_t, 
-                cluster_sizes,
-                {relocate_empty_clusters_ev}
-            );
+        sycl::event broadcast_division_ev;
+        if (options.spherical) {
+            broadcast_division_ev =
+                l2_normalize_kernel<dataT>(
+                    exec_q,
+                    n_features, n_clusters, work_group_size,
+                    //
+                    new_centroids_t,
+                    {step_ev, relocate_empty_clusters_ev}
+                );
+            profile("l2_normalize", broadcast_division_ev,
+                    lloyd_kernel_costs::l2_normalize<dataT>(n_features, n_clusters));
+        } else {
+            broadcast_division_ev =
+                broadcast_division_kernel<dataT>(
+                    exec_q,
+                    n_features, n_clusters, work_group_size,
+                    // 
+                    new_centroids_t, 
+                    cluster_sizes,
+                    {step_ev, relocate_empty_clusters_ev}
+                );
+            profile("broadcast_division", broadcast_division_ev,
+                    lloyd_kernel_costs::broadcast_division<dataT>(n_features, n_clusters));
+        }
 
-        // centroid_shifts = np.square(new_centroids_t - centroids_t).sum(axis=0)
-        // compute_centroid_shifts_kernel(
-        //     centroids_t, new_centroids_t, centroid_shifts
-        // )
-        sycl::event compute_centroid_shifts_ev = 
-            compute_centroid_shifts_squared_kernel<dataT>(
+        centroids_update_ev = broadcast_division_ev;
+
+        if (compute_centroid_shifts) {
+            // centroid_shifts = np.square(new_centroids_t - centroids_t).sum(axis=0)
+            // compute_centroid_shifts_kernel(
+            //     centroids_t, new_centroids_t, centroid_shifts
+            // )
+            centroid_shifts_ev = 
+                compute_centroid_shifts_squared_kernel<dataT>(
+                    exec_q,
+                    n_features, n_clusters, work_group_size,
+                    //
+                    this_centroids_t,     // IN
+                    new_centroids_t, // IN
+                    centroid_shifts, // OUT 
+                    {broadcast_division_ev}
+                );
+            profile("compute_centroid_shifts", centroid_shifts_ev,
+                    lloyd_kernel_costs::centroid_shifts<dataT>(n_features, n_clusters));
+
+            // centroid_shifts_sum, *_ = reduce_centroid_shifts_kernel(centroid_shifts)
+            sycl::event reduce_centroid_shifts_ev;
+            centroid_shifts_sum = reduce_vector_kernel_blocking<dataT>(
                 exec_q,
-                n_features, n_clusters, work_group_size,
-                //
-                this_centroids_t,     // IN
-                new_centroids_t, // IN
-                centroid_shifts, // OUT 
-                {broadcast_division_ev}
+                n_clusters,
+                centroid_shifts,
+                {centroid_shifts_ev},
+                &reduce_centroid_shifts_ev
             );
+            profile("reduce_centroid_shifts", reduce_centroid_shifts_ev, lloyd_kernel_costs::reduce_vector<dataT>(n_clusters));
+        }
 
-        // centroid_shifts_sum, *_ = reduce_centroid_shifts_kernel(centroid_shifts)
-        centroid_shifts_sum = reduce_vector_kernel_blocking<dataT>(
-            exec_q,
-            n_clusters,
-            centroid_shifts,
-            {compute_centroid_shifts_ev}
-        );
+        if (with_telemetry) {
+            lloyd_iteration_metrics metrics;
+            metrics.iteration = n_iterations;
+            // NaN when centroid shifts are not computed
+            metrics.centroid_shifts_sum = (compute_centroid_shifts) ?
+                static_cast<double>(centroid_shifts_sum) : std::numeric_limits<double>::quiet_NaN();
+            metrics.n_empty_clusters = static_cast<size_t>(host_n_empty_clusters);
+            metrics.n_changed_labels = host_n_changed_labels;
+            metrics.lloyd_step_ns =
+                std::chrono::duration<double, std::nano>(lloyd_step_end - iteration_start).count() - inertia_ns;
+            metrics.inertia_ns = inertia_ns;
+            metrics.update_ns =
+                std::chrono::duration<double, std::nano>(host_clock::now() - lloyd_step_end).count();
+
+            iteration_callback(metrics);
+        }
 
         // centroids_t, new_centroids_t = (new_centroids_t, centroids_t)
         std::swap(this_centroids_t, new_centroids_t);
@@ -355,42 +811,43 @@ size_t driver_lloyd(
 
     // # Finally, run an assignment kernel to compute the assignments to the best
     // # centroids found, along with the exact inertia.
+    // The assignment pass is skipped when labels of the last step are final.
     // half_l2_norm_kernel(centroids_t, centroids_half_l2_norm)
 
-    sycl::event final_half_l2_norm_ev = 
-        half_l2_norm_kernel<dataT>(
-            exec_q,
-            n_features, n_clusters, work_group_size,
-            //
-            this_centroids_t, 
-            centroids_half_l2_norm);
+    sycl::event final_assignment_ev = centroids_update_ev;
 
-    // assignment_fixed_window_kernel(
-    //     X_t, centroids_t, centroids_half_l2_norm, assignments_idx
-    // )
+    if (!labels_are_final) {
+        sycl::event final_half_l2_norm_ev = compute_half_l2_norm(this_centroids_t, {centroids_update_ev});
 
-    sycl::event final_assignment_ev =
-        assignment<
-            dataT, indT,
-            preferred_work_group_size_multiple, 
-            centroids_window_width_multiplier
-        >(
-            exec_q,
-            n_samples, n_features, n_clusters, 
-            centroids_window_height, work_group_size,
-            //
-            X_t, this_centroids_t, 
-            centroids_half_l2_norm, 
-            assignment_id,
-            {final_half_l2_norm_ev}
-        );
+        // assignment_fixed_window_kernel(
+        //     X_t, centroids_t, centroids_half_l2_norm, assignments_idx
+        // )
+
+        final_assignment_ev =
+            assignment<
+                dataT, indT,
+                preferred_work_group_size_multiple,
+                centroids_window_width_multiplier, X_row_major
+            >(
+                exec_q,
+                n_samples, n_features, n_clusters, 
+                centroids_window_height, work_group_size,
+                //
+                X_t, this_centroids_t, 
+                centroids_half_l2_norm, 
+                assignment_id,
+                {final_half_l2_norm_ev}
+            );
+        profile("assignment", final_assignment_ev,
+                lloyd_kernel_costs::assignment<dataT, indT>(n_samples, n_features, n_clusters));
+    }
 
 
     // compute_inertia_kernel(
     //     X_t, sample_weight, centroids_t, assignments_idx, per_sample_inertia
     // )
     sycl::event final_compute_inertia_ev = 
-        compute_inertia_kernel<dataT>(
+        compute_inertia_kernel<dataT, indT, X_row_major>(
             exec_q,
             n_samples, n_features, n_clusters, work_group_size,
             //
@@ -400,32 +857,45 @@ size_t driver_lloyd(
             per_sample_inertia,
             {final_assignment_ev}
         );
+    profile("compute_inertia", final_compute_inertia_ev,
+            lloyd_kernel_costs::compute_inertia<dataT, indT>(n_samples, n_features));
 
     sycl::event final_copy_ev;
     if (this_centroids_t != res_centroids_t) {
-        final_copy_ev = exec_q.copy<dataT>(this_centroids_t, res_centroids_t, n_features * n_clusters);
+        final_copy_ev = exec_q.copy<dataT>(this_centroids_t, res_centroids_t, n_features * n_clusters, {centroids_update_ev});
     }
 
     // inertia = dpt.asnumpy(reduce_inertia_kernel(per_sample_inertia))
     // inertia = inertia[0]
 
+    sycl::event final_reduce_inertia_ev;
     total_inertia =
         reduce_vector_kernel_blocking<dataT>(
             exec_q,
             n_samples,
             per_sample_inertia,
-            {final_compute_inertia_ev} 
+            {final_compute_inertia_ev},
+            &final_reduce_inertia_ev
         );
+    profile("reduce_inertia", final_reduce_inertia_ev, lloyd_kernel_costs::reduce_vector<dataT>(n_samples));
 
     final_copy_ev.wait();
+    // zeroing submitted ahead for an iteration which did not happen
+    sycl::event::wait(private_copies_reset_evs);
 
     sycl::free(centroids_half_l2_norm, alloc_ctx);
     sycl::free(cluster_sizes, alloc_ctx);
     sycl::free(centroid_shifts, alloc_ctx);
     sycl::free(per_sample_inertia, alloc_ctx);
-    sycl::free(new_centroids_t_private_copies, alloc_ctx);
-    sycl::free(cluster_sizes_private_copies, alloc_ctx);
+    sycl::free(new_centroids_t_private_copies_buffers, alloc_ctx);
+    sycl::free(cluster_sizes_private_copies_buffers, alloc_ctx);
     sycl::free(empty_clusters_list, alloc_ctx);
+    sycl::free(host_counters, alloc_ctx);
+    if (sorted_sample_idx) {
+        sycl::free(sorted_sample_idx, alloc_ctx);
+        sycl::free(sort_scratch, alloc_ctx);
+        sycl::free(segment_carry_sums, alloc_ctx);
+    }
 
     return n_iterations;
 }
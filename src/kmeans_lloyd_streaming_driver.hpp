@@ -0,0 +1,494 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "lloyd_single_step.hpp"
+#include "compute_inertia.hpp"
+#include "assignment.hpp"
+#include "util_kernels.hpp"
+#include "host_relocation.hpp"
+
+/* @brief Streams a host-resident X_t with shape (n_features, n_samples) to the
+   device in chunks of at most `chunk_size` samples.
+
+   Two pinned staging buffers and two device buffers are used, so that packing
+   and copying chunk i + 1 overlaps with kernels processing chunk i. Each chunk
+   is laid out on the device as a (n_features, n_chunk_samples) X_t, so that
+   kernels are oblivious to streaming.
+
+   The host pointer may point into a memory-mapped file, pages are only touched
+   while packing the chunk being staged.
+ */
+template <typename dataT>
+class host_chunk_streamer {
+public:
+    host_chunk_streamer(
+        sycl::queue q,
+        size_t n_samples,
+        size_t n_features,
+        size_t chunk_size,
+        dataT const *host_X_t
+    ) : q_(q),
+        n_samples_(n_samples),
+        n_features_(n_features),
+        chunk_size_(std::min(chunk_size, n_samples)),
+        host_X_t_(host_X_t)
+    {
+        const auto &ctx = q_.get_context();
+        const auto &dev = q_.get_device();
+
+        for(size_t b = 0; b < 2; ++b) {
+            staging_[b] = sycl::malloc_host<dataT>(n_features_ * chunk_size_, ctx);
+            device_chunk_[b] = sycl::malloc_device<dataT>(n_features_ * chunk_size_, dev, ctx);
+        }
+    }
+
+    host_chunk_streamer(const host_chunk_streamer &) = delete;
+    host_chunk_streamer &operator=(const host_chunk_streamer &) = delete;
+
+    ~host_chunk_streamer() {
+        const auto &ctx = q_.get_context();
+
+        for(size_t b = 0; b < 2; ++b) {
+            consume_ev_[b].wait();
+            copy_ev_[b].wait();
+            sycl::free(staging_[b], ctx);
+            sycl::free(device_chunk_[b], ctx);
+        }
+    }
+
+    size_t chunk_size() const { return chunk_size_; }
+
+    size_t n_chunks() const { return quotient_ceil<size_t>(n_samples_, chunk_size_); }
+
+    /* @brief Calls `submit_fn(first_sample_idx, n_chunk_samples, X_t_chunk, depends)`
+       for every chunk, in order. `submit_fn` must return the event of the last
+       command reading `X_t_chunk`. Returns the events of the last consumers of
+       both device buffers.
+     */
+    template <typename SubmitFnT>
+    std::vector<sycl::event>
+    for_each_chunk(SubmitFnT submit_fn, const std::vector<sycl::event> &depends = {}) {
+        size_t n = n_chunks();
+
+        stage_(0);
+
+        for(size_t chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+            size_t b = chunk_idx % 2;
+            size_t first_sample_idx = chunk_idx * chunk_size_;
+            size_t n_chunk_samples = std::min(chunk_size_, n_samples_ - first_sample_idx);
+
+            std::vector<sycl::event> chunk_depends(depends);
+            chunk_depends.push_back(copy_ev_[b]);
+
+            consume_ev_[b] = submit_fn(first_sample_idx, n_chunk_samples, device_chunk_[b], chunk_depends);
+
+            // pack and send the next chunk while the device works on this one
+            if (chunk_idx + 1 < n) {
+                stage_(chunk_idx + 1);
+            }
+        }
+
+        return {consume_ev_[0], consume_ev_[1]};
+    }
+
+private:
+    void stage_(size_t chunk_idx) {
+        size_t b = chunk_idx % 2;
+        size_t first_sample_idx = chunk_idx * chunk_size_;
+        size_t n_chunk_samples = std::min(chunk_size_, n_samples_ - first_sample_idx);
+
+        // staging buffer is reused once its previous content reached the device
+        copy_ev_[b].wait();
+
+        dataT *dst = staging_[b];
+        for(size_t feature_idx = 0; feature_idx < n_features_; ++feature_idx) {
+            std::memcpy(
+                dst + feature_idx * n_chunk_samples,
+                host_X_t_ + feature_idx * n_samples_ + first_sample_idx,
+                n_chunk_samples * sizeof(dataT)
+            );
+        }
+
+        // device buffer is reused once kernels processing the previous chunk completed
+        copy_ev_[b] = q_.memcpy(
+            device_chunk_[b], staging_[b],
+            n_features_ * n_chunk_samples * sizeof(dataT),
+            consume_ev_[b]
+        );
+    }
+
+    sycl::queue q_;
+    size_t n_samples_;
+    size_t n_features_;
+    size_t chunk_size_;
+    dataT const *host_X_t_;
+
+    dataT *staging_[2];
+    dataT *device_chunk_[2];
+    sycl::event copy_ev_[2];
+    sycl::event consume_ev_[2];
+};
+
+/* @brief Computes lloyd iterations for X_t with shape (n_features, n_samples)
+   residing in host memory (possibly a memory-mapped file), streamed to the
+   device in chunks of `chunk_size` samples at each pass on data.
+   Returns n_iteration
+
+   This is exact Lloyd: private copies of centroids and cluster sizes are
+   accumulated across all chunks before being reduced, only the resident
+   footprint of X on the device is bounded. Sample weights, labels and
+   per-sample inertia are kept on the device.
+ */
+template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+size_t driver_lloyd_streaming(
+    sycl::queue exec_q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    // all things from self
+    double centroids_private_copies_max_cache_occupancy,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    size_t chunk_size,
+    // inputs
+    dataT const *host_X_t,              // HOST (n_features, n_samples)
+    dataT const *sample_weight,         // (n_samples,)
+    dataT *init_centroids_t,            // (n_features, n_clusters)
+    size_t max_iter,
+    bool verbose,
+    dataT tol,
+    // outputs
+    indT *assignment_id,
+    dataT *res_centroids_t,
+    dataT &total_inertia,
+    PrintFuncT print_func
+)
+{
+    const auto &alloc_ctx = exec_q.get_context();
+    const auto &alloc_dev = exec_q.get_device();
+
+    host_chunk_streamer<dataT> streamer(exec_q, n_samples, n_features, chunk_size, host_X_t);
+
+    // USM temporary allocations, scheduled to be freed when computations complete
+    dataT *centroids_half_l2_norm = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+
+    dataT *cluster_sizes = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+    dataT *centroid_shifts = sycl::malloc_device<dataT>(n_clusters, alloc_dev, alloc_ctx);
+
+    // NB: the same buffer is used for those two arrays because it is never needed
+    // to store those simultaneously in memory.
+    dataT *per_sample_inertia = sycl::malloc_device<dataT>(n_samples, alloc_dev, alloc_ctx);
+    dataT *sq_distance_to_nearest_centroid = per_sample_inertia;
+
+    // private copies are sized for a chunk, they are shared by all chunks
+    size_t n_centroids_private_copies =
+        compute_number_of_private_copies<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+            exec_q, streamer.chunk_size(), n_features, n_clusters, centroids_private_copies_max_cache_occupancy, work_group_size
+        );
+
+    size_t new_centroids_t_private_copies_size =
+        n_centroids_private_copies * n_features * n_clusters;
+    dataT *new_centroids_t_private_copies = sycl::malloc_device<dataT>(
+        new_centroids_t_private_copies_size, alloc_dev, alloc_ctx);
+
+    size_t cluster_sizes_private_copies_size =
+        n_centroids_private_copies * n_clusters;
+    dataT *cluster_sizes_private_copies = sycl::malloc_device<dataT>(
+        cluster_sizes_private_copies_size, alloc_dev, alloc_ctx);
+
+    indT *empty_clusters_list = sycl::malloc_device<indT>(n_clusters + 1, alloc_dev, alloc_ctx);
+    indT *n_empty_clusters = empty_clusters_list + n_clusters;
+
+    // per-sample inertia w.r.t. the current labels, chunk by chunk
+    auto stream_inertia = [&](dataT const *centroids_t, bool use_sample_weight, std::vector<sycl::event> depends) {
+        return streamer.for_each_chunk(
+            [&](size_t first_sample_idx, size_t n_chunk_samples, dataT const *X_t_chunk, const std::vector<sycl::event> &chunk_depends) {
+                if (use_sample_weight) {
+                    return compute_inertia_kernel<dataT, indT>(
+                        exec_q,
+                        n_chunk_samples, n_features, n_clusters, work_group_size,
+                        //
+                        X_t_chunk, sample_weight + first_sample_idx,
+                        centroids_t,
+                        assignment_id + first_sample_idx,
+                        per_sample_inertia + first_sample_idx,
+                        chunk_depends
+                    );
+                }
+                return compute_uniform_weight_inertia_kernel<dataT, indT>(
+                    exec_q,
+                    n_chunk_samples, n_features, n_clusters, work_group_size,
+                    //
+                    X_t_chunk,
+                    centroids_t,
+                    assignment_id + first_sample_idx,
+                    sq_distance_to_nearest_centroid + first_sample_idx,
+                    chunk_depends
+                );
+            },
+            depends
+        );
+    };
+
+    size_t n_iterations = 0;
+    dataT centroid_shifts_sum = std::numeric_limits<dataT>::infinity();
+
+    dataT *this_centroids_t = init_centroids_t;
+    dataT *new_centroids_t = res_centroids_t;
+
+    std::vector<dataT> host_centroids_t;
+    std::vector<dataT> host_cluster_sizes;
+
+    while( (n_iterations < max_iter) && (centroid_shifts_sum > tol) ) {
+
+        sycl::event half_l2_norm_ev = half_l2_norm_kernel<dataT>(
+            exec_q,
+            n_features, n_clusters, work_group_size,
+            //
+            this_centroids_t,
+            centroids_half_l2_norm);
+
+        sycl::event reset_cluster_sizes_private_copies_ev =
+            exec_q.fill<dataT>(
+                cluster_sizes_private_copies,
+                dataT(0),
+                cluster_sizes_private_copies_size
+            );
+
+        sycl::event reset_centroids_private_copies_ev =
+            exec_q.fill<dataT>(
+                new_centroids_t_private_copies,
+                dataT(0),
+                new_centroids_t_private_copies_size
+            );
+
+        // all chunks accumulate into the same private copies
+        std::vector<sycl::event> lloyd_step_evs = streamer.for_each_chunk(
+            [&](size_t first_sample_idx, size_t n_chunk_samples, dataT const *X_t_chunk, const std::vector<sycl::event> &chunk_depends) {
+                return lloyd_single_step<
+                    dataT, indT, preferred_work_group_size_multiple,
+                    centroids_window_width_multiplier
+                >(
+                    exec_q,
+                    n_chunk_samples, n_features, n_clusters,
+                    centroids_window_height,
+                    n_centroids_private_copies,
+                    work_group_size,
+                    //
+                    X_t_chunk,
+                    sample_weight + first_sample_idx,
+                    this_centroids_t,
+                    centroids_half_l2_norm,
+                    assignment_id + first_sample_idx,   // OUT
+                    new_centroids_t_private_copies,     // OUT
+                    cluster_sizes_private_copies,       // OUT
+                    chunk_depends
+                );
+            },
+            {half_l2_norm_ev, reset_centroids_private_copies_ev, reset_cluster_sizes_private_copies_ev}
+        );
+
+        sycl::event reduce_centroid_data_ev =
+            reduce_centroid_data_kernel<dataT, indT>(
+                exec_q,
+                n_centroids_private_copies,
+                n_features,
+                n_clusters,
+                work_group_size,
+                //
+                cluster_sizes_private_copies,
+                new_centroids_t_private_copies,
+                cluster_sizes,
+                new_centroids_t,
+                empty_clusters_list,
+                n_empty_clusters,
+                lloyd_step_evs
+            );
+
+        if (verbose) {
+            // labels were computed against this_centroids_t
+            std::vector<sycl::event> compute_inertia_evs =
+                stream_inertia(this_centroids_t, true, lloyd_step_evs);
+
+            dataT iteration_total_inertia =
+                reduce_vector_kernel_blocking<dataT>(
+                    exec_q,
+                    n_samples,
+                    per_sample_inertia,
+                    compute_inertia_evs
+                );
+
+            std::stringstream ss;
+            ss << "Iteration: " << n_iterations << " "
+               << "Inertia: " << iteration_total_inertia
+               << std::endl;
+
+            print_func(ss);
+        }
+
+        indT host_n_empty_clusters;
+
+        sycl::event n_empty_clusters_copy_ev =
+            exec_q.copy<indT>(n_empty_clusters, &host_n_empty_clusters, 1, {reduce_centroid_data_ev});
+        n_empty_clusters_copy_ev.wait();
+
+        if (host_n_empty_clusters > 0) {
+            // assignment_id already holds labels with respect to this_centroids_t,
+            // only the (unweighted) squared distances to nearest centroids are needed.
+            std::vector<sycl::event> compute_sq_dist_evs =
+                stream_inertia(this_centroids_t, false, lloyd_step_evs);
+
+            size_t n_empty = host_n_empty_clusters;
+
+            std::vector<dataT> host_sq_dist(n_samples);
+            std::vector<indT> host_empty_clusters_list(n_empty);
+            host_centroids_t.resize(n_features * n_clusters);
+            host_cluster_sizes.resize(n_clusters);
+
+            exec_q.copy<dataT>(sq_distance_to_nearest_centroid, host_sq_dist.data(), n_samples, compute_sq_dist_evs).wait();
+
+            std::vector<size_t> selected =
+                select_samples_far_from_centroid_on_host<dataT>(n_samples, n_empty, host_sq_dist.data());
+            n_empty = selected.size();
+
+            std::vector<indT> host_selected_assignment(n_empty);
+            std::vector<dataT> host_selected_weight(n_empty);
+
+            std::vector<sycl::event> copy_evs;
+            copy_evs.push_back(exec_q.copy<indT>(empty_clusters_list, host_empty_clusters_list.data(), n_empty));
+            copy_evs.push_back(exec_q.copy<dataT>(new_centroids_t, host_centroids_t.data(), n_features * n_clusters));
+            copy_evs.push_back(exec_q.copy<dataT>(cluster_sizes, host_cluster_sizes.data(), n_clusters));
+            for(size_t k = 0; k < n_empty; ++k) {
+                copy_evs.push_back(exec_q.copy<indT>(assignment_id + selected[k], host_selected_assignment.data() + k, 1));
+                copy_evs.push_back(exec_q.copy<dataT>(sample_weight + selected[k], host_selected_weight.data() + k, 1));
+            }
+            sycl::event::wait(copy_evs);
+
+            relocate_empty_clusters_on_host<dataT, indT>(
+                n_features, n_clusters, n_empty,
+                host_empty_clusters_list.data(),
+                host_selected_assignment.data(),
+                host_selected_weight.data(),
+                [&](size_t k, dataT *feature_values) {
+                    for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+                        feature_values[feature_idx] = host_X_t[feature_idx * n_samples + selected[k]];
+                    }
+                },
+                host_centroids_t.data(),
+                host_cluster_sizes.data()
+            );
+
+            sycl::event::wait({
+                exec_q.copy<dataT>(host_centroids_t.data(), new_centroids_t, n_features * n_clusters),
+                exec_q.copy<dataT>(host_cluster_sizes.data(), cluster_sizes, n_clusters)
+            });
+        }
+
+        sycl::event broadcast_division_ev =
+            broadcast_division_kernel<dataT>(
+                exec_q,
+                n_features, n_clusters, work_group_size,
+                //
+                new_centroids_t,
+                cluster_sizes,
+                {reduce_centroid_data_ev}
+            );
+
+        sycl::event compute_centroid_shifts_ev =
+            compute_centroid_shifts_squared_kernel<dataT>(
+                exec_q,
+                n_features, n_clusters, work_group_size,
+                //
+                this_centroids_t,
+                new_centroids_t,
+                centroid_shifts,
+                {broadcast_division_ev}
+            );
+
+        centroid_shifts_sum = reduce_vector_kernel_blocking<dataT>(
+            exec_q,
+            n_clusters,
+            centroid_shifts,
+            {compute_centroid_shifts_ev}
+        );
+
+        std::swap(this_centroids_t, new_centroids_t);
+
+        ++n_iterations;
+    }
+
+    // Finally, run an assignment kernel to compute the assignments to the best
+    // centroids found, along with the exact inertia, in a last pass on data.
+    sycl::event final_half_l2_norm_ev =
+        half_l2_norm_kernel<dataT>(
+            exec_q,
+            n_features, n_clusters, work_group_size,
+            //
+            this_centroids_t,
+            centroids_half_l2_norm);
+
+    std::vector<sycl::event> final_compute_inertia_evs = streamer.for_each_chunk(
+        [&](size_t first_sample_idx, size_t n_chunk_samples, dataT const *X_t_chunk, const std::vector<sycl::event> &chunk_depends) {
+            sycl::event assignment_ev =
+                assignment<
+                    dataT, indT,
+                    preferred_work_group_size_multiple,
+                    centroids_window_width_multiplier
+                >(
+                    exec_q,
+                    n_chunk_samples, n_features, n_clusters,
+                    centroids_window_height, work_group_size,
+                    //
+                    X_t_chunk, this_centroids_t,
+                    centroids_half_l2_norm,
+                    assignment_id + first_sample_idx,
+                    chunk_depends
+                );
+
+            return compute_inertia_kernel<dataT, indT>(
+                exec_q,
+                n_chunk_samples, n_features, n_clusters, work_group_size,
+                //
+                X_t_chunk, sample_weight + first_sample_idx,
+                this_centroids_t,
+                assignment_id + first_sample_idx,
+                per_sample_inertia + first_sample_idx,
+                {assignment_ev}
+            );
+        },
+        {final_half_l2_norm_ev}
+    );
+
+    sycl::event final_copy_ev;
+    if (this_centroids_t != res_centroids_t) {
+        final_copy_ev = exec_q.copy<dataT>(this_centroids_t, res_centroids_t, n_features * n_clusters);
+    }
+
+    total_inertia =
+        reduce_vector_kernel_blocking<dataT>(
+            exec_q,
+            n_samples,
+            per_sample_inertia,
+            final_compute_inertia_evs
+        );
+
+    final_copy_ev.wait();
+
+    sycl::free(centroids_half_l2_norm, alloc_ctx);
+    sycl::free(cluster_sizes, alloc_ctx);
+    sycl::free(centroid_shifts, alloc_ctx);
+    sycl::free(per_sample_inertia, alloc_ctx);
+    sycl::free(new_centroids_t_private_copies, alloc_ctx);
+    sycl::free(cluster_sizes_private_copies, alloc_ctx);
+    sycl::free(empty_clusters_list, alloc_ctx);
+
+    return n_iterations;
+}
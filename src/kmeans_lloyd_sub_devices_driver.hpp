@@ -0,0 +1,288 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "lloyd_shard.hpp"
+#include "communicator.hpp"
+
+/* @brief Queues on sub-devices of `dev` partitioned by NUMA affinity domain,
+   sharing one context. Falls back to a single queue on `dev` when the device
+   can not be partitioned so. */
+inline std::vector<sycl::queue>
+make_numa_sub_device_queues(const sycl::device &dev) {
+    std::vector<sycl::device> sub_devices;
+
+    try {
+        auto domains = dev.get_info<sycl::info::device::partition_affinity_domains>();
+        bool supports_numa =
+            std::find(domains.begin(), domains.end(), sycl::info::partition_affinity_domain::numa) != domains.end();
+        if (supports_numa) {
+            sub_devices =
+                dev.create_sub_devices<sycl::info::partition_property::partition_by_affinity_domain>(
+                    sycl::info::partition_affinity_domain::numa);
+        }
+    } catch (const sycl::exception &) {
+        sub_devices.clear();
+    }
+
+    if (sub_devices.size() < 2) {
+        return {sycl::queue(dev)};
+    }
+
+    sycl::context ctx(sub_devices);
+
+    std::vector<sycl::queue> queues;
+    queues.reserve(sub_devices.size());
+    for(const auto &sub_dev : sub_devices) {
+        queues.emplace_back(ctx, sub_dev);
+    }
+
+    return queues;
+}
+
+/* @brief One shard per queue of balanced contiguous ranges of the samples of
+   host X_t (n_features, n_samples), the first of which has index
+   `global_sample_idx_offset` among samples of all processes. */
+template <typename dataT, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+std::vector<std::unique_ptr<lloyd_shard<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>>>
+make_lloyd_shards(
+    const std::vector<sycl::queue> &queues,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    double centroids_private_copies_max_cache_occupancy,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    dataT const *host_X_t,              // HOST (n_features, n_samples)
+    dataT const *host_sample_weight,    // HOST (n_samples,)
+    size_t global_sample_idx_offset = 0
+) {
+    using shard_t = lloyd_shard<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>;
+
+    size_t n_shards = queues.size();
+    std::vector<std::unique_ptr<shard_t>> shards;
+    shards.reserve(n_shards);
+
+    for(size_t shard_idx = 0; shard_idx < n_shards; ++shard_idx) {
+        size_t first_sample_idx = (n_samples * shard_idx) / n_shards;
+        size_t last_sample_idx = (n_samples * (shard_idx + 1)) / n_shards;
+
+        shards.push_back(std::make_unique<shard_t>(
+            queues[shard_idx],
+            first_sample_idx, last_sample_idx - first_sample_idx,
+            n_features, n_clusters,
+            centroids_private_copies_max_cache_occupancy,
+            centroids_window_height, work_group_size,
+            host_X_t, n_samples, host_sample_weight,
+            global_sample_idx_offset
+        ));
+    }
+
+    return shards;
+}
+
+/* @brief Lloyd iterations over samples spread over `shards`, whose partial sums
+   are combined on the host. Centroids, cluster sizes, relocation of empty
+   clusters and centroid shifts are computed on the host, they are only
+   (n_clusters, n_features + 1) values. Labels of the shard starting at sample
+   i are written to host_assignment_id + i - first_sample_idx of the first shard.
+
+   With a communicator, shards are the local part of a distributed fit: partial
+   sums, inertia and relocation candidates are further combined over ranks,
+   every rank holding the same centroids at every iteration.
+   Returns n_iteration
+ */
+template <typename dataT, typename indT, typename ShardT, typename PrintFuncT>
+size_t lloyd_iterations_on_shards(
+    std::vector<std::unique_ptr<ShardT>> &shards,
+    size_t n_features,
+    size_t n_clusters,
+    dataT const *init_centroids_t,      // HOST (n_features, n_clusters)
+    size_t max_iter,
+    bool verbose,
+    dataT tol,
+    // outputs
+    indT *host_assignment_id,           // HOST (n_samples of all shards,)
+    dataT *res_centroids_t,             // HOST (n_features, n_clusters)
+    dataT &total_inertia,
+    PrintFuncT print_func,
+    communicator *comm = nullptr
+) {
+    size_t n_shards = shards.size();
+    size_t centroids_size = n_features * n_clusters;
+
+    std::vector<dataT> this_centroids_t(init_centroids_t, init_centroids_t + centroids_size);
+    std::vector<dataT> new_centroids_t(centroids_size);
+    std::vector<dataT> cluster_sizes(n_clusters);
+
+    std::vector<std::vector<dataT>> shard_sums_t(n_shards, std::vector<dataT>(centroids_size));
+    std::vector<std::vector<dataT>> shard_cluster_sizes(n_shards, std::vector<dataT>(n_clusters));
+
+    auto set_centroids = [&](const std::vector<dataT> &centroids_t) {
+        std::vector<sycl::event> set_centroids_evs;
+        for(auto &shard : shards) {
+            set_centroids_evs.push_back(shard->set_centroids(centroids_t.data()));
+        }
+        sycl::event::wait(set_centroids_evs);
+    };
+
+    size_t n_iterations = 0;
+    dataT centroid_shifts_sum = std::numeric_limits<dataT>::infinity();
+
+    while( (n_iterations < max_iter) && (centroid_shifts_sum > tol) ) {
+        set_centroids(this_centroids_t);
+
+        // all shards work concurrently, each on its own device
+        std::vector<sycl::event> accumulate_evs;
+        for(size_t shard_idx = 0; shard_idx < n_shards; ++shard_idx) {
+            accumulate_evs.push_back(
+                shards[shard_idx]->accumulate(shard_sums_t[shard_idx].data(), shard_cluster_sizes[shard_idx].data()));
+        }
+        sycl::event::wait(accumulate_evs);
+
+        std::fill(new_centroids_t.begin(), new_centroids_t.end(), dataT(0));
+        std::fill(cluster_sizes.begin(), cluster_sizes.end(), dataT(0));
+        for(size_t shard_idx = 0; shard_idx < n_shards; ++shard_idx) {
+            for(size_t i = 0; i < centroids_size; ++i) {
+                new_centroids_t[i] += shard_sums_t[shard_idx][i];
+            }
+            for(size_t cluster_idx = 0; cluster_idx < n_clusters; ++cluster_idx) {
+                cluster_sizes[cluster_idx] += shard_cluster_sizes[shard_idx][cluster_idx];
+            }
+        }
+
+        if (comm) {
+            comm->allreduce_sum<dataT>(new_centroids_t.data(), centroids_size);
+            comm->allreduce_sum<dataT>(cluster_sizes.data(), n_clusters);
+        }
+
+        if (verbose) {
+            dataT iteration_total_inertia = dataT(0);
+            for(auto &shard : shards) {
+                iteration_total_inertia += shard->inertia();
+            }
+            if (comm) {
+                iteration_total_inertia = comm->allreduce_sum<dataT>(iteration_total_inertia);
+            }
+
+            std::stringstream ss;
+            ss << "Iteration: " << n_iterations << " "
+               << "Inertia: " << iteration_total_inertia
+               << std::endl;
+
+            print_func(ss);
+        }
+
+        std::vector<std::int64_t> empty_clusters_list;
+        for(size_t cluster_idx = 0; cluster_idx < n_clusters; ++cluster_idx) {
+            if (cluster_sizes[cluster_idx] == dataT(0)) {
+                empty_clusters_list.push_back(static_cast<std::int64_t>(cluster_idx));
+            }
+        }
+
+        if (!empty_clusters_list.empty()) {
+            // the farthest samples overall are among the farthest samples of each shard
+            relocation_candidates<dataT> candidates;
+            for(auto &shard : shards) {
+                candidates.append(shard->far_samples(empty_clusters_list.size()));
+            }
+
+            if (comm) {
+                std::vector<char> local_bytes = candidates.farthest(empty_clusters_list.size()).to_bytes();
+                std::vector<std::vector<char>> gathered = comm->allgather(local_bytes.data(), local_bytes.size());
+
+                candidates = relocation_candidates<dataT>();
+                for(const auto &bytes : gathered) {
+                    candidates.append(relocation_candidates<dataT>::from_bytes(bytes, n_features));
+                }
+            }
+
+            relocate_empty_clusters_from_candidates<dataT>(
+                n_features, n_clusters, empty_clusters_list, candidates,
+                new_centroids_t.data(), cluster_sizes.data()
+            );
+        }
+
+        centroid_shifts_sum = dataT(0);
+        for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+            for(size_t cluster_idx = 0; cluster_idx < n_clusters; ++cluster_idx) {
+                size_t offset = feature_idx * n_clusters + cluster_idx;
+                new_centroids_t[offset] /= cluster_sizes[cluster_idx];
+
+                dataT shift = new_centroids_t[offset] - this_centroids_t[offset];
+                centroid_shifts_sum += shift * shift;
+            }
+        }
+
+        std::swap(this_centroids_t, new_centroids_t);
+
+        ++n_iterations;
+    }
+
+    // Finally, assign samples to the best centroids found, along with the exact
+    // inertia, in a last pass on data.
+    set_centroids(this_centroids_t);
+
+    size_t first_sample_idx = (n_shards > 0) ? shards[0]->first_sample_idx() : 0;
+    total_inertia = dataT(0);
+    for(auto &shard : shards) {
+        total_inertia += shard->final_assignment(host_assignment_id + shard->first_sample_idx() - first_sample_idx);
+    }
+    if (comm) {
+        total_inertia = comm->allreduce_sum<dataT>(total_inertia);
+    }
+
+    std::copy(this_centroids_t.begin(), this_centroids_t.end(), res_centroids_t);
+
+    return n_iterations;
+}
+
+/* @brief Computes lloyd iterations for X_t with shape (n_features, n_samples)
+   residing in host memory, with samples split in balanced contiguous ranges
+   over `queues`, typically sub-devices of one device partitioned by NUMA
+   domain (see make_numa_sub_device_queues). Each shard of X_t is copied once,
+   by its own queue, so that it is resident in memory local to its sub-device.
+   Returns n_iteration
+ */
+template <typename dataT, typename indT = std::uint32_t, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename PrintFuncT>
+size_t driver_lloyd_sub_devices(
+    const std::vector<sycl::queue> &queues,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    // all things from self
+    double centroids_private_copies_max_cache_occupancy,
+    size_t centroids_window_height,
+    size_t work_group_size,
+    // inputs
+    dataT const *host_X_t,              // HOST (n_features, n_samples)
+    dataT const *host_sample_weight,    // HOST (n_samples,)
+    dataT const *init_centroids_t,      // HOST (n_features, n_clusters)
+    size_t max_iter,
+    bool verbose,
+    dataT tol,
+    // outputs
+    indT *host_assignment_id,           // HOST (n_samples,)
+    dataT *res_centroids_t,             // HOST (n_features, n_clusters)
+    dataT &total_inertia,
+    PrintFuncT print_func
+) {
+    auto shards =
+        make_lloyd_shards<dataT, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+            queues, n_samples, n_features, n_clusters,
+            centroids_private_copies_max_cache_occupancy, centroids_window_height, work_group_size,
+            host_X_t, host_sample_weight
+        );
+
+    return lloyd_iterations_on_shards<dataT, indT>(
+        shards, n_features, n_clusters, init_centroids_t,
+        max_iter, verbose, tol,
+        host_assignment_id, res_centroids_t, total_inertia, print_func
+    );
+}
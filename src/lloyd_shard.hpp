@@ -0,0 +1,511 @@
+// lloyd_shard.hpp
+//
+// A contiguous range of samples resident on one device (or sub-device), with
+// the buffers needed to run the fused Lloyd step on it. Drivers spreading
+// samples over several devices, or several processes, own one shard per
+// device and combine the (n_clusters, n_features + 1) partial sums shards
+// bring back to the host.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "lloyd_single_step.hpp"
+#include "compute_inertia.hpp"
+#include "assignment.hpp"
+#include "util_kernels.hpp"
+#include "host_relocation.hpp"
+
+/* @brief Samples proposed by shards to be moved into empty clusters, with all
+   the data relocation needs, so that no shard needs to access samples of
+   another. Flat arrays, so that they can be exchanged as raw bytes. */
+template <typename dataT>
+struct relocation_candidates {
+    std::vector<dataT> sq_dist;              // squared distance to nearest centroid
+    std::vector<std::uint64_t> sample_idx;   // global index of the sample
+    std::vector<std::int64_t> assignment;    // label of the sample
+    std::vector<dataT> weight;
+    std::vector<dataT> features;             // (n_candidates, n_features)
+
+    size_t size() const { return sq_dist.size(); }
+
+    void append(const relocation_candidates &other) {
+        sq_dist.insert(sq_dist.end(), other.sq_dist.begin(), other.sq_dist.end());
+        sample_idx.insert(sample_idx.end(), other.sample_idx.begin(), other.sample_idx.end());
+        assignment.insert(assignment.end(), other.assignment.begin(), other.assignment.end());
+        weight.insert(weight.end(), other.weight.begin(), other.weight.end());
+        features.insert(features.end(), other.features.begin(), other.features.end());
+    }
+
+    /* @brief The `n` candidates farthest from their centroid, by decreasing
+       distance, ties being broken by smallest global index as in the single
+       device driver. */
+    relocation_candidates farthest(size_t n) const {
+        std::vector<size_t> order(size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+            return (sq_dist[i] > sq_dist[j]) || (sq_dist[i] == sq_dist[j] && sample_idx[i] < sample_idx[j]);
+        });
+        order.resize(std::min(n, order.size()));
+
+        size_t n_features = (size() > 0) ? features.size() / size() : 0;
+
+        relocation_candidates res;
+        for(size_t i : order) {
+            res.sq_dist.push_back(sq_dist[i]);
+            res.sample_idx.push_back(sample_idx[i]);
+            res.assignment.push_back(assignment[i]);
+            res.weight.push_back(weight[i]);
+            res.features.insert(
+                res.features.end(),
+                features.begin() + i * n_features,
+                features.begin() + (i + 1) * n_features);
+        }
+
+        return res;
+    }
+
+    std::vector<char> to_bytes() const {
+        std::uint64_t n = size();
+        std::vector<char> bytes;
+        auto put = [&bytes](const void *src, size_t n_bytes) {
+            const char *p = static_cast<const char *>(src);
+            bytes.insert(bytes.end(), p, p + n_bytes);
+        };
+
+        put(&n, sizeof(n));
+        put(sq_dist.data(), sq_dist.size() * sizeof(dataT));
+        put(sample_idx.data(), sample_idx.size() * sizeof(std::uint64_t));
+        put(assignment.data(), assignment.size() * sizeof(std::int64_t));
+        put(weight.data(), weight.size() * sizeof(dataT));
+        put(features.data(), features.size() * sizeof(dataT));
+
+        return bytes;
+    }
+
+    static relocation_candidates from_bytes(const std::vector<char> &bytes, size_t n_features) {
+        const char *p = bytes.data();
+        auto get = [&p](void *dst, size_t n_bytes) {
+            std::memcpy(dst, p, n_bytes);
+            p += n_bytes;
+        };
+
+        std::uint64_t n;
+        get(&n, sizeof(n));
+
+        relocation_candidates res;
+        res.sq_dist.resize(n);
+        res.sample_idx.resize(n);
+        res.assignment.resize(n);
+        res.weight.resize(n);
+        res.features.resize(n * n_features);
+
+        get(res.sq_dist.data(), n * sizeof(dataT));
+        get(res.sample_idx.data(), n * sizeof(std::uint64_t));
+        get(res.assignment.data(), n * sizeof(std::int64_t));
+        get(res.weight.data(), n * sizeof(dataT));
+        get(res.features.data(), n * n_features * sizeof(dataT));
+
+        return res;
+    }
+};
+
+/* @brief Relocates empty clusters of the combined partial sums, choosing among
+   candidates of all shards the samples farthest from their centroid. */
+template <typename dataT>
+void relocate_empty_clusters_from_candidates(
+    size_t n_features,
+    size_t n_clusters,
+    const std::vector<std::int64_t> &empty_clusters_list,
+    const relocation_candidates<dataT> &candidates,
+    dataT *centroids_t,       // INOUT (n_features, n_clusters), sums of weighted samples
+    dataT *cluster_sizes      // INOUT (n_clusters,)
+) {
+    relocation_candidates<dataT> selected = candidates.farthest(empty_clusters_list.size());
+
+    relocate_empty_clusters_on_host<dataT, std::int64_t>(
+        n_features, n_clusters, selected.size(),
+        empty_clusters_list.data(),
+        selected.assignment.data(),
+        selected.weight.data(),
+        [&](size_t k, dataT *feature_values) {
+            const dataT *src = selected.features.data() + k * n_features;
+            std::copy(src, src + n_features, feature_values);
+        },
+        centroids_t,
+        cluster_sizes
+    );
+}
+
+template <typename dataT, typename indT>
+class gather_relocation_candidates_krn;
+
+/* @brief Gathers features (n_selected, n_features), weights and labels of
+   samples selected_idx[0], ..., selected_idx[n_selected - 1] of X_t, in the
+   layout of relocation_candidates. */
+template <typename dataT, typename indT>
+sycl::event
+gather_relocation_candidates_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_selected,
+    //
+    dataT const *X_t,             // IN  (n_features, n_samples)
+    dataT const *sample_weight,   // IN  (n_samples,)
+    indT const *assignment_id,    // IN  (n_samples,)
+    indT const *selected_idx,     // IN  (n_selected,)
+    dataT *features,              // OUT (n_selected, n_features)
+    dataT *weight,                // OUT (n_selected,)
+    indT *assignment,             // OUT (n_selected,)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            cgh.parallel_for<class gather_relocation_candidates_krn<dataT, indT>>(
+                sycl::range<1>(n_selected * n_features),
+                [=](sycl::id<1> wid) {
+                    size_t i = wid[0];
+                    size_t k = i / n_features;
+                    size_t feature_idx = i - k * n_features;
+                    size_t sample_idx = selected_idx[k];
+
+                    features[i] = X_t[feature_idx * n_samples + sample_idx];
+                    if (feature_idx == 0) {
+                        weight[k] = sample_weight[sample_idx];
+                        assignment[k] = assignment_id[sample_idx];
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+/* @brief Samples [first_sample_idx, first_sample_idx + n_samples) of a host X_t
+   with `host_n_samples` columns, copied to the device of `q` at construction,
+   after which the host arrays are no longer read.
+   Memory is allocated and first touched by the device of `q`, which keeps
+   it local to that device (e.g. NUMA node of a sub-device). Sample indices
+   reported to other shards are offset by `global_sample_idx_offset`, the index
+   of the first sample of the host X_t among samples of all processes. */
+template <typename dataT, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+class lloyd_shard {
+public:
+    lloyd_shard(
+        sycl::queue q,
+        size_t first_sample_idx,
+        size_t n_samples,
+        size_t n_features,
+        size_t n_clusters,
+        double centroids_private_copies_max_cache_occupancy,
+        size_t centroids_window_height,
+        size_t work_group_size,
+        dataT const *host_X_t,              // HOST (n_features, host_n_samples)
+        size_t host_n_samples,
+        dataT const *host_sample_weight,    // HOST (host_n_samples,)
+        size_t global_sample_idx_offset = 0
+    ) : q_(q),
+        first_sample_idx_(first_sample_idx),
+        global_sample_idx_offset_(global_sample_idx_offset),
+        n_samples_(n_samples),
+        n_features_(n_features),
+        n_clusters_(n_clusters),
+        centroids_window_height_(centroids_window_height),
+        work_group_size_(work_group_size)
+    {
+        const auto &ctx = q_.get_context();
+        const auto &dev = q_.get_device();
+
+        // shards hold fewer samples but whole centroids, the count is at
+        // least one copy even when a copy exceeds the cache
+        n_centroids_private_copies_ =
+            compute_number_of_private_copies<dataT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+                q_, std::max<size_t>(n_samples_, 1), n_features_, n_clusters_,
+                centroids_private_copies_max_cache_occupancy, work_group_size_
+            );
+
+        size_t centroids_size = n_features_ * n_clusters_;
+        size_t n = std::max<size_t>(n_samples_, 1);
+
+        X_t_ = sycl::malloc_device<dataT>(n_features_ * n, dev, ctx);
+        sample_weight_ = sycl::malloc_device<dataT>(n, dev, ctx);
+        assignment_id_ = sycl::malloc_device<indT>(n, dev, ctx);
+        per_sample_inertia_ = sycl::malloc_device<dataT>(n, dev, ctx);
+        centroids_t_ = sycl::malloc_device<dataT>(centroids_size, dev, ctx);
+        centroids_half_l2_norm_ = sycl::malloc_device<dataT>(n_clusters_, dev, ctx);
+        sums_t_ = sycl::malloc_device<dataT>(centroids_size, dev, ctx);
+        cluster_sizes_ = sycl::malloc_device<dataT>(n_clusters_, dev, ctx);
+        new_centroids_t_private_copies_ = sycl::malloc_device<dataT>(n_centroids_private_copies_ * centroids_size, dev, ctx);
+        cluster_sizes_private_copies_ = sycl::malloc_device<dataT>(n_centroids_private_copies_ * n_clusters_, dev, ctx);
+        empty_clusters_list_ = sycl::malloc_device<indT>(n_clusters_ + 1, dev, ctx);
+
+        std::vector<sycl::event> copy_evs;
+        copy_evs.reserve(n_features_ + 1);
+        if (n_samples_ > 0) {
+            for(size_t feature_idx = 0; feature_idx < n_features_; ++feature_idx) {
+                copy_evs.push_back(q_.copy<dataT>(
+                    host_X_t + feature_idx * host_n_samples + first_sample_idx_,
+                    X_t_ + feature_idx * n_samples_,
+                    n_samples_));
+            }
+            copy_evs.push_back(q_.copy<dataT>(host_sample_weight + first_sample_idx_, sample_weight_, n_samples_));
+        }
+        sycl::event::wait(copy_evs);
+    }
+
+    lloyd_shard(const lloyd_shard &) = delete;
+    lloyd_shard &operator=(const lloyd_shard &) = delete;
+
+    ~lloyd_shard() {
+        const auto &ctx = q_.get_context();
+        q_.wait();
+
+        sycl::free(X_t_, ctx);
+        sycl::free(sample_weight_, ctx);
+        sycl::free(assignment_id_, ctx);
+        sycl::free(per_sample_inertia_, ctx);
+        sycl::free(centroids_t_, ctx);
+        sycl::free(centroids_half_l2_norm_, ctx);
+        sycl::free(sums_t_, ctx);
+        sycl::free(cluster_sizes_, ctx);
+        sycl::free(new_centroids_t_private_copies_, ctx);
+        sycl::free(cluster_sizes_private_copies_, ctx);
+        sycl::free(empty_clusters_list_, ctx);
+    }
+
+    size_t first_sample_idx() const { return first_sample_idx_; }
+    size_t n_samples() const { return n_samples_; }
+
+    /* @brief Replaces centroids of the shard with host_centroids_t (n_features, n_clusters) */
+    sycl::event set_centroids(dataT const *host_centroids_t) {
+        centroids_ev_ = q_.copy<dataT>(host_centroids_t, centroids_t_, n_features_ * n_clusters_);
+        return centroids_ev_;
+    }
+
+    /* @brief Assigns samples of the shard to centroids, and writes the sums of
+       their weighted coordinates and weights per cluster to host arrays
+       host_sums_t (n_features, n_clusters) and host_cluster_sizes (n_clusters,) */
+    sycl::event accumulate(dataT *host_sums_t, dataT *host_cluster_sizes) {
+        size_t centroids_size = n_features_ * n_clusters_;
+
+        if (n_samples_ == 0) {
+            std::fill(host_sums_t, host_sums_t + centroids_size, dataT(0));
+            std::fill(host_cluster_sizes, host_cluster_sizes + n_clusters_, dataT(0));
+            return centroids_ev_;
+        }
+
+        sycl::event half_l2_norm_ev =
+            half_l2_norm_kernel<dataT>(
+                q_, n_features_, n_clusters_, work_group_size_,
+                centroids_t_, centroids_half_l2_norm_, {centroids_ev_});
+
+        sycl::event reset_cluster_sizes_private_copies_ev =
+            q_.fill<dataT>(cluster_sizes_private_copies_, dataT(0), n_centroids_private_copies_ * n_clusters_);
+        sycl::event reset_centroids_private_copies_ev =
+            q_.fill<dataT>(new_centroids_t_private_copies_, dataT(0), n_centroids_private_copies_ * centroids_size);
+
+        lloyd_step_ev_ =
+            lloyd_single_step<
+                dataT, indT,
+                preferred_work_group_size_multiple,
+                centroids_window_width_multiplier
+            >(
+                q_,
+                n_samples_, n_features_, n_clusters_,
+                centroids_window_height_, n_centroids_private_copies_, work_group_size_,
+                //
+                X_t_, sample_weight_,
+                centroids_t_, centroids_half_l2_norm_,
+                assignment_id_,
+                new_centroids_t_private_copies_,
+                cluster_sizes_private_copies_,
+                {half_l2_norm_ev, reset_cluster_sizes_private_copies_ev, reset_centroids_private_copies_ev}
+            );
+
+        sycl::event reduce_centroid_data_ev =
+            reduce_centroid_data_kernel<dataT, indT>(
+                q_,
+                n_centroids_private_copies_, n_features_, n_clusters_, work_group_size_,
+                //
+                cluster_sizes_private_copies_,
+                new_centroids_t_private_copies_,
+                cluster_sizes_,
+                sums_t_,
+                empty_clusters_list_,
+                empty_clusters_list_ + n_clusters_,
+                {lloyd_step_ev_}
+            );
+
+        sycl::event sums_copy_ev = q_.copy<dataT>(sums_t_, host_sums_t, centroids_size, {reduce_centroid_data_ev});
+        sycl::event sizes_copy_ev = q_.copy<dataT>(cluster_sizes_, host_cluster_sizes, n_clusters_, {reduce_centroid_data_ev});
+
+        return q_.submit([&](sycl::handler &cgh) {
+            cgh.depends_on({sums_copy_ev, sizes_copy_ev});
+            cgh.single_task([]() {});
+        });
+    }
+
+    /* @brief Weighted inertia of samples with respect to the centroids and labels
+       of the last call to accumulate. Blocking. */
+    dataT inertia() {
+        if (n_samples_ == 0) {
+            return dataT(0);
+        }
+
+        sycl::event compute_inertia_ev =
+            compute_inertia_kernel<dataT, indT>(
+                q_,
+                n_samples_, n_features_, n_clusters_, work_group_size_,
+                X_t_, sample_weight_, centroids_t_, assignment_id_, per_sample_inertia_,
+                {lloyd_step_ev_}
+            );
+
+        return reduce_vector_kernel_blocking<dataT>(q_, n_samples_, per_sample_inertia_, {compute_inertia_ev});
+    }
+
+    /* @brief The `n_candidates` samples of the shard farthest from their centroid,
+       with respect to the last call to accumulate. Blocking. */
+    relocation_candidates<dataT> far_samples(size_t n_candidates) {
+        relocation_candidates<dataT> candidates;
+        if (n_samples_ == 0) {
+            return candidates;
+        }
+
+        sycl::event sq_dist_ev =
+            compute_uniform_weight_inertia_kernel<dataT, indT>(
+                q_,
+                n_samples_, n_features_, n_clusters_, work_group_size_,
+                X_t_, centroids_t_, assignment_id_, per_sample_inertia_,
+                {lloyd_step_ev_}
+            );
+
+        std::vector<dataT> host_sq_dist(n_samples_);
+        q_.copy<dataT>(per_sample_inertia_, host_sq_dist.data(), n_samples_, {sq_dist_ev}).wait();
+
+        std::vector<size_t> selected =
+            select_samples_far_from_centroid_on_host<dataT>(n_samples_, n_candidates, host_sq_dist.data());
+        size_t n_selected = selected.size();
+
+        if (n_selected == 0) {
+            return candidates;
+        }
+
+        // a single gather from the device copies of the shard, host arrays
+        // are only read at construction
+        const auto &ctx = q_.get_context();
+        const auto &dev = q_.get_device();
+        std::vector<indT> host_selected_idx(selected.begin(), selected.end());
+        indT *selected_idx = sycl::malloc_device<indT>(2 * n_selected, dev, ctx);
+        indT *gathered_assignment = selected_idx + n_selected;
+        dataT *gathered_features = sycl::malloc_device<dataT>(n_selected * (n_features_ + 1), dev, ctx);
+        dataT *gathered_weight = gathered_features + n_selected * n_features_;
+
+        sycl::event idx_copy_ev = q_.copy<indT>(host_selected_idx.data(), selected_idx, n_selected);
+        sycl::event gather_ev =
+            gather_relocation_candidates_kernel<dataT, indT>(
+                q_, n_samples_, n_features_, n_selected,
+                X_t_, sample_weight_, assignment_id_, selected_idx,
+                gathered_features, gathered_weight, gathered_assignment,
+                {idx_copy_ev, lloyd_step_ev_}
+            );
+
+        std::vector<indT> host_assignment(n_selected);
+        std::vector<dataT> host_gathered(n_selected * (n_features_ + 1));
+        sycl::event assignment_copy_ev =
+            q_.copy<indT>(gathered_assignment, host_assignment.data(), n_selected, {gather_ev});
+        sycl::event features_copy_ev =
+            q_.copy<dataT>(gathered_features, host_gathered.data(), host_gathered.size(), {gather_ev});
+        assignment_copy_ev.wait();
+        features_copy_ev.wait();
+
+        sycl::free(selected_idx, ctx);
+        sycl::free(gathered_features, ctx);
+
+        candidates.features.assign(host_gathered.begin(), host_gathered.begin() + n_selected * n_features_);
+        candidates.weight.assign(host_gathered.begin() + n_selected * n_features_, host_gathered.end());
+        for(size_t k = 0; k < n_selected; ++k) {
+            candidates.sq_dist.push_back(host_sq_dist[selected[k]]);
+            candidates.sample_idx.push_back(global_sample_idx_offset_ + first_sample_idx_ + selected[k]);
+            candidates.assignment.push_back(static_cast<std::int64_t>(host_assignment[k]));
+        }
+
+        return candidates;
+    }
+
+    /* @brief Assigns samples of the shard to its centroids, writing labels to
+       host_assignment_id (n_samples,). Returns their weighted inertia. Blocking. */
+    dataT final_assignment(indT *host_assignment_id) {
+        if (n_samples_ == 0) {
+            return dataT(0);
+        }
+
+        sycl::event half_l2_norm_ev =
+            half_l2_norm_kernel<dataT>(
+                q_, n_features_, n_clusters_, work_group_size_,
+                centroids_t_, centroids_half_l2_norm_, {centroids_ev_});
+
+        sycl::event assignment_ev =
+            assignment<
+                dataT, indT,
+                preferred_work_group_size_multiple,
+                centroids_window_width_multiplier
+            >(
+                q_,
+                n_samples_, n_features_, n_clusters_,
+                centroids_window_height_, work_group_size_,
+                //
+                X_t_, centroids_t_, centroids_half_l2_norm_,
+                assignment_id_,
+                {half_l2_norm_ev}
+            );
+
+        sycl::event compute_inertia_ev =
+            compute_inertia_kernel<dataT, indT>(
+                q_,
+                n_samples_, n_features_, n_clusters_, work_group_size_,
+                X_t_, sample_weight_, centroids_t_, assignment_id_, per_sample_inertia_,
+                {assignment_ev}
+            );
+
+        sycl::event labels_copy_ev = q_.copy<indT>(assignment_id_, host_assignment_id, n_samples_, {assignment_ev});
+
+        dataT shard_inertia = reduce_vector_kernel_blocking<dataT>(q_, n_samples_, per_sample_inertia_, {compute_inertia_ev});
+        labels_copy_ev.wait();
+
+        return shard_inertia;
+    }
+
+private:
+    sycl::queue q_;
+    size_t first_sample_idx_;
+    size_t global_sample_idx_offset_;
+    size_t n_samples_;
+    size_t n_features_;
+    size_t n_clusters_;
+    size_t centroids_window_height_;
+    size_t work_group_size_;
+    size_t n_centroids_private_copies_;
+
+    dataT *X_t_;
+    dataT *sample_weight_;
+    indT *assignment_id_;
+    dataT *per_sample_inertia_;
+    dataT *centroids_t_;
+    dataT *centroids_half_l2_norm_;
+    dataT *sums_t_;
+    dataT *cluster_sizes_;
+    dataT *new_centroids_t_private_copies_;
+    dataT *cluster_sizes_private_copies_;
+    indT *empty_clusters_list_;
+
+    sycl::event centroids_ev_;
+    sycl::event lloyd_step_ev_;
+};
@@ -5,10 +5,15 @@
 #include <vector>
 
 #include "quotients_utils.hpp"
+#include "device_functions.hpp"
 
-template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename accT, bool X_row_major>
 class lloyd_single_step_krn;
 
+/* @brief Number of private copies of centroids and cluster sizes that fit in
+   the given fraction of the global memory cache, at most one per sub-group.
+   It is at least 1, even when a single copy exceeds the cache, e.g. for many
+   features and clusters. */
 template <typename T, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
 size_t compute_number_of_private_copies(
     sycl::queue q,
@@ -31,10 +36,29 @@ size_t compute_number_of_private_copies(
 
     n_centroids_private_copies = std::min(n_subgroups, n_centroids_private_copies);
 
-    return n_centroids_private_copies;
+    // lloyd_single_step maps samples to copies modulo their number
+    return std::max<size_t>(1, n_centroids_private_copies);
 }
 
-template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier>
+/* @brief Fused assignment and accumulation of new centroid data.
+
+   Coordinates of samples and the assignment arithmetic use type T, while the
+   private copies of centroids and cluster sizes are accumulated in type accT.
+   Using accT = double with T = float keeps the assignment as fast as in single
+   precision, but avoids the loss of precision of single precision atomic
+   accumulation when clusters hold many samples.
+
+   When `X_row_major` is true, X_t is instead expected to be X with shape
+   (n_samples, n_features), see `assignment`.
+
+   Consecutive blocks of `private_copies_block_size` samples accumulate in
+   private copies taken in turns, by default one block per sub-group. Blocks
+   of a work-group size send all updates of a work-group to the same copy.
+
+   When new_centroids_t_private_copies is null, samples are only assigned,
+   centroid data being then accumulated otherwise (see sort_by_label.hpp).
+ */
+template <typename T, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename accT = T, bool X_row_major = false>
 sycl::event
 lloyd_single_step(
     sycl::queue q,
@@ -45,14 +69,16 @@ lloyd_single_step(
     size_t n_centroids_private_copies,
     size_t work_group_size,
     // ===================
-    const T *X_t,                      // IN READ-ONLY  (n_features, n_samples)
+    const T *X_t,                      // IN READ-ONLY  (n_features, n_samples) or (n_samples, n_features) if X_row_major
     const T *sample_weights,           // IN READ_ONLY  (n_samples, )   ????
     const T *current_centroids_t,      // IN            (n_features, n_clusters)
     const T *centroids_half_l2_norm,   // IN            (n_clusters, )
     indT *assignments_idx,             // OUT           (n_samples, )
-    T *new_centroids_t_private_copies, // OUT           (n_private_copies, n_features, n_clusters)
-    T *cluster_sizes_private_copies,   // OUT           (n_private_copies, n_clusters)  # noqa
-    const std::vector<sycl::event> &depends = {}
+    accT *new_centroids_t_private_copies, // OUT        (n_private_copies, n_features, n_clusters)
+    accT *cluster_sizes_private_copies,   // OUT        (n_private_copies, n_clusters)  # noqa
+    const std::vector<sycl::event> &depends = {},
+    indT *n_changed_labels = nullptr,     // INOUT, optional (1,) incremented by the number of samples whose label changes
+    size_t private_copies_block_size = preferred_work_group_size_multiple
 )
 {
     constexpr size_t window_n_centroids = (
@@ -72,8 +98,6 @@ lloyd_single_step(
             auto G = sycl::range<1>(global_size);
             auto L = sycl::range<1>(work_group_size);
 
-            sycl::stream out(1024, 256, cgh);
-
             // allocate SLM
             using slm_cwT = sycl::accessor<T, 2, sycl::access::mode::read_write, sycl::access::target::local>;
             slm_cwT centroids_window(sycl::range<2>(centroids_window_height, (window_n_centroids + 1)), cgh);
@@ -81,11 +105,18 @@ lloyd_single_step(
             using slm_l2hnT = sycl::accessor<T, 1, sycl::access::mode::read_write, sycl::access::target::local>;
             slm_l2hnT window_of_centroids_half_l2_norms(sycl::range<1>(window_n_centroids), cgh);
 
-            cgh.parallel_for<class lloyd_single_step_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier>>(
+            // only used when X is row-major
+            using slm_swT = sycl::accessor<T, 2, sycl::access::mode::read_write, sycl::access::target::local>;
+            slm_swT samples_window(
+                (X_row_major) ? sycl::range<2>(centroids_window_height, (work_group_size + 1)) : sycl::range<2>(1, 1),
+                cgh);
+
+            cgh.parallel_for<class lloyd_single_step_krn<T, indT, preferred_work_group_size_multiple, centroids_window_width_multiplier, accT, X_row_major>>(
                 sycl::nd_range<1>(G, L),
                 [=](sycl::nd_item<1> it) {
                     size_t sample_idx = it.get_global_id(0);
                     size_t local_work_id = it.get_local_id(0);
+                    size_t first_sample_idx = sample_idx - local_work_id;
 
                     std::array<T, window_n_centroids> dot_products;
 
@@ -115,7 +146,7 @@ lloyd_single_step(
 
                         size_t first_feature_idx = 0;
 
-                        for(size_t i1 = 0; i1 < n_windows_for_centroid; ++i1) {
+                        for(size_t i1 = 0; i1 < n_windows_for_feature; ++i1) {
                             _load_window_of_centroids_and_features(
                                 n_clusters,
                                 n_features,
@@ -131,21 +162,48 @@ lloyd_single_step(
                                 centroids_window
                             );
 
+                            if constexpr (X_row_major) {
+                                _load_window_of_samples_row_major<T>(
+                                    n_samples,
+                                    n_features,
+                                    work_group_size,
+                                    centroids_window_height,
+                                    // =====
+                                    local_work_id,
+                                    first_sample_idx,
+                                    first_feature_idx,
+                                    X_t,
+                                    samples_window
+                                );
+                            }
+
                             it.barrier(sycl::access::fence_space::local_space);
 
                             constexpr bool acummulate_dot_product = true;
-                            _acummulate_sum_of_ops<T, decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
-                                n_samples,
-                                n_features,
-                                centroids_window_height,
-                                window_n_centroids,
-                                // ==============
-                                sample_idx,
-                                first_feature_idx,
-                                X_t,
-                                centroids_window,
-                                dot_products
-                            );
+                            if constexpr (X_row_major) {
+                                _acummulate_sum_of_ops_from_window<T, decltype(samples_window), decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
+                                    centroids_window_height,
+                                    window_n_centroids,
+                                    // ==============
+                                    local_work_id,
+                                    samples_window,
+                                    centroids_window,
+                                    dot_products
+                                );
+                            } else {
+                                _acummulate_sum_of_ops<T, decltype(centroids_window), decltype(dot_products), acummulate_dot_product>(
+                                    n_samples,
+                                    n_features,
+                                    centroids_window_height,
+                                    window_n_centroids,
+                                    // ==============
+                                    sample_idx,
+                                    first_feature_idx,
+                                    X_t,
+                                    centroids_window,
+                                    dot_products
+                                );
+                            }
 
                             it.barrier(sycl::access::fence_space::local_space);
 
@@ -166,20 +224,43 @@ lloyd_single_step(
 
                         min_idx = closest.first;
                         min_sample_pseudo_inertia = closest.second;
+
+                        first_centroid_idx += window_n_centroids;
+                    }
+
+                    if (n_changed_labels) {
+                        // one atomic per work-group, all its work-items take this branch
+                        bool label_changed =
+                            (sample_idx < n_samples) && (assignments_idx[sample_idx] != static_cast<indT>(min_idx));
+                        indT n_changed_in_group =
+                            sycl::reduce_over_group(it.get_group(), indT(label_changed), sycl::plus<indT>());
+
+                        if (local_work_id == 0 && n_changed_in_group > 0) {
+                            auto atomic_n_changed =
+                            sycl::atomic_ref<
+                                indT,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(*n_changed_labels);
+
+                            atomic_n_changed += n_changed_in_group;
+                        }
                     }
 
                     if (sample_idx < n_samples) {
                         assignments_idx[sample_idx] = min_idx;
+                    }
 
-                        T weight = sample_weights[sample_idx];
+                    if ((sample_idx < n_samples) && new_centroids_t_private_copies) {
+                        accT weight = static_cast<accT>(sample_weights[sample_idx]);
 
                         size_t privatization_idx = (
-                            sample_idx / preferred_work_group_size_multiple
+                            sample_idx / private_copies_block_size
                         ) % n_centroids_private_copies;
 
                         auto atomic_cluser_size =
                         sycl::atomic_ref<
-                            T,
+                            accT,
                             sycl::memory_order::relaxed,
                             sycl::memory_scope::device,
                             sycl::access::address_space::global_space>(
@@ -193,14 +274,15 @@ lloyd_single_step(
                         for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx ) {
                             auto atomic_coord =
                             sycl::atomic_ref<
-                                T,
+                                accT,
                                 sycl::memory_order::relaxed,
                                 sycl::memory_scope::device,
                                 sycl::access::address_space::global_space>(
                                     new_centroids_t_private_copies[_offset + feature_idx * n_clusters]
                                 );
 
-                            atomic_coord += X_t[feature_idx * n_samples + sample_idx ] * weight;
+                            atomic_coord += static_cast<accT>(
+                                X_t[_X_index<X_row_major>(n_samples, n_features, sample_idx, feature_idx)]) * weight;
                         }
                     }
                 }
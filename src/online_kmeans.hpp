@@ -0,0 +1,282 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "lloyd_single_step.hpp"
+#include "util_kernels.hpp"
+
+template <typename dataT, typename accT>
+class decayed_centroids_update_krn;
+
+/* @brief Folds sums and sizes of clusters of a chunk into running ones, after
+   decaying the running ones by `decay`, and updates centroids to their ratio.
+   Sums of the chunk are in accT, as accumulated, so that accT = double keeps
+   them in double precision until they are folded.
+
+   centroids of clusters which have never been assigned a sample are kept.
+ */
+template <typename dataT, typename accT = dataT>
+sycl::event
+decayed_centroids_update_kernel(
+    sycl::queue q,
+    size_t n_features,
+    size_t n_clusters,
+    size_t work_group_size,
+    accT decay,
+    //
+    accT const *chunk_centroids_t,    // IN     (n_features, n_clusters)  sums over the chunk
+    accT const *chunk_cluster_sizes,  // IN     (n_clusters,)
+    accT *sums_t,                     // INOUT  (n_features, n_clusters)
+    accT *cluster_weights,            // INOUT  (n_clusters,)
+    dataT *centroids_t,               // INOUT  (n_features, n_clusters)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            size_t global_size = quotient_ceil(n_clusters, work_group_size) * work_group_size;
+            cgh.parallel_for<class decayed_centroids_update_krn<dataT, accT>>(
+                sycl::nd_range<1>(global_size, work_group_size),
+                [=](sycl::nd_item<1> it) {
+                    size_t cluster_idx = it.get_global_linear_id();
+                    if (cluster_idx < n_clusters) {
+                        accT weight = decay * cluster_weights[cluster_idx] + chunk_cluster_sizes[cluster_idx];
+                        cluster_weights[cluster_idx] = weight;
+
+                        for(size_t feature_idx = 0; feature_idx < n_features; ++feature_idx) {
+                            size_t offset = feature_idx * n_clusters + cluster_idx;
+                            accT sum = decay * sums_t[offset] + chunk_centroids_t[offset];
+                            sums_t[offset] = sum;
+                            if (weight > accT(0)) {
+                                centroids_t[offset] = static_cast<dataT>(sum / weight);
+                            }
+                        }
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+/* @brief State of online k-means over an append-only stream of samples.
+
+   Running sums of samples and of weights of clusters live on the device. Each
+   call to partial_fit assigns a chunk of samples to the current centroids,
+   accumulating their sums with the fused kernel of Lloyd iterations, then
+   folds them in the running sums, decayed by a factor `decay` in (0, 1], and
+   updates centroids. With decay 1, centroids are the means of all samples
+   assigned to them so far.
+
+   partial_fit only submits commands, it never synchronizes with the host, so
+   that chunks can be fed back to back. Empty clusters are not relocated.
+ */
+template <typename dataT, typename indT, size_t preferred_work_group_size_multiple, size_t centroids_window_width_multiplier, typename accT = dataT>
+class online_kmeans_state {
+public:
+    using data_type = dataT;
+    using acc_type = accT;
+
+    online_kmeans_state(
+        sycl::queue q,
+        size_t n_features,
+        size_t n_clusters,
+        size_t max_chunk_size,
+        double centroids_private_copies_max_cache_occupancy,
+        size_t centroids_window_height,
+        size_t work_group_size,
+        accT decay,
+        dataT const *init_centroids_t,       // IN (n_features, n_clusters)
+        const std::vector<sycl::event> &depends = {}
+    ) : q_(q),
+        n_features_(n_features),
+        n_clusters_(n_clusters),
+        max_chunk_size_(max_chunk_size),
+        centroids_window_height_(centroids_window_height),
+        work_group_size_(work_group_size),
+        decay_(decay)
+    {
+        const auto &ctx = q_.get_context();
+        const auto &dev = q_.get_device();
+
+        n_centroids_private_copies_ =
+            compute_number_of_private_copies<accT, preferred_work_group_size_multiple, centroids_window_width_multiplier>(
+                q_, max_chunk_size_, n_features_, n_clusters_, centroids_private_copies_max_cache_occupancy, work_group_size_
+            );
+
+        size_t centroids_size = n_features_ * n_clusters_;
+
+        centroids_t_ = sycl::malloc_device<dataT>(centroids_size, dev, ctx);
+        centroids_half_l2_norm_ = sycl::malloc_device<dataT>(n_clusters_, dev, ctx);
+        sums_t_ = sycl::malloc_device<accT>(centroids_size, dev, ctx);
+        cluster_weights_ = sycl::malloc_device<accT>(n_clusters_, dev, ctx);
+        chunk_centroids_t_ = sycl::malloc_device<accT>(centroids_size, dev, ctx);
+        chunk_cluster_sizes_ = sycl::malloc_device<accT>(n_clusters_, dev, ctx);
+        new_centroids_t_private_copies_ = sycl::malloc_device<accT>(n_centroids_private_copies_ * centroids_size, dev, ctx);
+        cluster_sizes_private_copies_ = sycl::malloc_device<accT>(n_centroids_private_copies_ * n_clusters_, dev, ctx);
+        // the counter of empty clusters follows the list, unused here
+        empty_clusters_list_ = sycl::malloc_device<indT>(n_clusters_ + 1, dev, ctx);
+        assignment_id_ = sycl::malloc_device<indT>(max_chunk_size_, dev, ctx);
+
+        std::vector<sycl::event> init_evs = {
+            q_.copy<dataT>(init_centroids_t, centroids_t_, centroids_size, depends),
+            q_.fill<accT>(sums_t_, accT(0), centroids_size),
+            q_.fill<accT>(cluster_weights_, accT(0), n_clusters_)
+        };
+        last_ev_ = q_.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(init_evs);
+            cgh.single_task([]() {});
+        });
+    }
+
+    online_kmeans_state(const online_kmeans_state &) = delete;
+    online_kmeans_state &operator=(const online_kmeans_state &) = delete;
+
+    ~online_kmeans_state() {
+        const auto &ctx = q_.get_context();
+        last_ev_.wait();
+
+        sycl::free(centroids_t_, ctx);
+        sycl::free(centroids_half_l2_norm_, ctx);
+        sycl::free(sums_t_, ctx);
+        sycl::free(cluster_weights_, ctx);
+        sycl::free(chunk_centroids_t_, ctx);
+        sycl::free(chunk_cluster_sizes_, ctx);
+        sycl::free(new_centroids_t_private_copies_, ctx);
+        sycl::free(cluster_sizes_private_copies_, ctx);
+        sycl::free(empty_clusters_list_, ctx);
+        sycl::free(assignment_id_, ctx);
+    }
+
+    /* @brief Updates the state with samples X_chunk_t (n_features, n_chunk_samples)
+       of weights `sample_weight`. Labels of samples with respect to centroids
+       before the update are written to `assignment_id` if not null.
+       Returns the event of the update of centroids.
+     */
+    sycl::event partial_fit(
+        size_t n_chunk_samples,
+        dataT const *X_chunk_t,           // IN  (n_features, n_chunk_samples)
+        dataT const *sample_weight,       // IN  (n_chunk_samples,)
+        indT *assignment_id = nullptr,    // OUT (n_chunk_samples,), optional
+        const std::vector<sycl::event> &depends = {}
+    ) {
+        if (n_chunk_samples > max_chunk_size_) {
+            throw std::invalid_argument("Chunk of samples exceeds the maximal chunk size of the state");
+        }
+
+        size_t centroids_size = n_features_ * n_clusters_;
+
+        std::vector<sycl::event> step_depends(depends);
+        step_depends.push_back(last_ev_);
+
+        sycl::event half_l2_norm_ev =
+            half_l2_norm_kernel<dataT>(
+                q_, n_features_, n_clusters_, work_group_size_,
+                centroids_t_, centroids_half_l2_norm_, {last_ev_});
+
+        step_depends.push_back(half_l2_norm_ev);
+        step_depends.push_back(
+            q_.fill<accT>(cluster_sizes_private_copies_, accT(0), n_centroids_private_copies_ * n_clusters_, {last_ev_}));
+        step_depends.push_back(
+            q_.fill<accT>(new_centroids_t_private_copies_, accT(0), n_centroids_private_copies_ * centroids_size, {last_ev_}));
+
+        sycl::event lloyd_step_ev =
+            lloyd_single_step<
+                dataT, indT,
+                preferred_work_group_size_multiple,
+                centroids_window_width_multiplier, accT
+            >(
+                q_,
+                n_chunk_samples, n_features_, n_clusters_,
+                centroids_window_height_, n_centroids_private_copies_, work_group_size_,
+                //
+                X_chunk_t, sample_weight,
+                centroids_t_, centroids_half_l2_norm_,
+                (assignment_id) ? assignment_id : assignment_id_,
+                new_centroids_t_private_copies_,
+                cluster_sizes_private_copies_,
+                step_depends
+            );
+
+        // sums of the chunk are reduced in accT, not rounded to dataT
+        sycl::event reduce_centroid_data_ev =
+            reduce_centroid_data_kernel<accT, indT, accT>(
+                q_,
+                n_centroids_private_copies_, n_features_, n_clusters_, work_group_size_,
+                //
+                cluster_sizes_private_copies_,
+                new_centroids_t_private_copies_,
+                chunk_cluster_sizes_,
+                chunk_centroids_t_,
+                empty_clusters_list_,
+                empty_clusters_list_ + n_clusters_,
+                {lloyd_step_ev}
+            );
+
+        last_ev_ =
+            decayed_centroids_update_kernel<dataT, accT>(
+                q_,
+                n_features_, n_clusters_, work_group_size_, decay_,
+                //
+                chunk_centroids_t_, chunk_cluster_sizes_,
+                sums_t_, cluster_weights_, centroids_t_,
+                {reduce_centroid_data_ev}
+            );
+
+        n_seen_samples_ += n_chunk_samples;
+
+        return last_ev_;
+    }
+
+    /* @brief Copies current centroids into `out_centroids_t` (n_features, n_clusters) */
+    sycl::event copy_centroids_t(dataT *out_centroids_t, const std::vector<sycl::event> &depends = {}) {
+        std::vector<sycl::event> copy_depends(depends);
+        copy_depends.push_back(last_ev_);
+        return q_.copy<dataT>(centroids_t_, out_centroids_t, n_features_ * n_clusters_, copy_depends);
+    }
+
+    /* @brief Copies decayed sums of weights of samples assigned to each cluster */
+    sycl::event copy_cluster_weights(accT *out_cluster_weights, const std::vector<sycl::event> &depends = {}) {
+        std::vector<sycl::event> copy_depends(depends);
+        copy_depends.push_back(last_ev_);
+        return q_.copy<accT>(cluster_weights_, out_cluster_weights, n_clusters_, copy_depends);
+    }
+
+    size_t n_features() const { return n_features_; }
+    size_t n_clusters() const { return n_clusters_; }
+    size_t max_chunk_size() const { return max_chunk_size_; }
+    size_t n_seen_samples() const { return n_seen_samples_; }
+    sycl::queue queue() const { return q_; }
+
+    /* @brief Event of the last command updating the state */
+    sycl::event last_event() const { return last_ev_; }
+
+private:
+    sycl::queue q_;
+    size_t n_features_;
+    size_t n_clusters_;
+    size_t max_chunk_size_;
+    size_t centroids_window_height_;
+    size_t work_group_size_;
+    size_t n_centroids_private_copies_;
+    accT decay_;
+    size_t n_seen_samples_ = 0;
+
+    dataT *centroids_t_;
+    dataT *centroids_half_l2_norm_;
+    accT *sums_t_;
+    accT *cluster_weights_;
+    accT *chunk_centroids_t_;
+    accT *chunk_cluster_sizes_;
+    accT *new_centroids_t_private_copies_;
+    accT *cluster_sizes_private_copies_;
+    indT *empty_clusters_list_;
+    indT *assignment_id_;
+
+    // last command updating the state
+    sycl::event last_ev_;
+};
@@ -0,0 +1,206 @@
+// performance_model.hpp
+//
+// Roofline model of the main kernels: analytic counts of floating point
+// operations and of bytes loaded from global memory, as functions of the problem
+// shape and of the window parameters, and a small microbenchmark measuring the
+// attainable bandwidth (STREAM triad) and throughput (chains of FMAs) of the device.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "quotients_utils.hpp"
+#include "profiling.hpp"
+
+struct kernel_model {
+    double n_flops;
+    // bytes that must move between global memory and the device at least once
+    double compulsory_bytes;
+    // bytes requested by global loads and stores as coded, which caches may absorb
+    double global_access_bytes;
+
+    kernel_cost cost() const { return {compulsory_bytes, n_flops}; }
+
+    double arithmetic_intensity() const { return n_flops / compulsory_bytes; }
+};
+
+struct device_peaks {
+    double gb_per_s;
+    double gflop_per_s;
+};
+
+/* @brief Lowest time in nanoseconds in which the device could run the kernel */
+inline double attainable_ns(const kernel_model &m, const device_peaks &peaks) {
+    return std::max(m.compulsory_bytes / peaks.gb_per_s, m.n_flops / peaks.gflop_per_s);
+}
+
+/* @brief Attainable throughput in GFLOP/s, i.e. min(peak, intensity * bandwidth) */
+inline double attainable_gflop_per_s(const kernel_model &m, const device_peaks &peaks) {
+    return std::min(peaks.gflop_per_s, m.arithmetic_intensity() * peaks.gb_per_s);
+}
+
+namespace lloyd_kernel_models {
+
+/* Samples are streamed once per window of centroids, every work-group loads all
+   centroids through windows of height `centroids_window_height` into SLM. */
+template <typename dataT, typename indT>
+kernel_model assignment(
+    size_t n_samples, size_t n_features, size_t n_clusters,
+    size_t centroids_window_height, size_t work_group_size, size_t window_n_centroids
+) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    double n_work_groups = quotient_ceil(n_samples, work_group_size);
+    double n_windows_for_centroid = quotient_ceil(n_clusters, window_n_centroids);
+    double padded_F = double(quotient_ceil(n_features, centroids_window_height) * centroids_window_height);
+
+    double flops = 2.0 * N * F * K + 2.0 * N * K;
+    double compulsory = sizeof(dataT) * (N * F + F * K + K) + sizeof(indT) * N;
+    double accessed =
+        sizeof(dataT) * (N * F * n_windows_for_centroid                                  // samples
+                         + n_work_groups * (padded_F * n_windows_for_centroid * window_n_centroids  // centroids
+                                            + n_windows_for_centroid * window_n_centroids))  // half norms
+        + sizeof(indT) * N;
+
+    return {flops, compulsory, accessed};
+}
+
+/* As assignment, plus weights and atomic updates of private copies of centroids */
+template <typename dataT, typename indT, typename accT = dataT>
+kernel_model lloyd_single_step(
+    size_t n_samples, size_t n_features, size_t n_clusters,
+    size_t centroids_window_height, size_t work_group_size, size_t window_n_centroids,
+    size_t n_centroids_private_copies
+) {
+    kernel_model m = assignment<dataT, indT>(
+        n_samples, n_features, n_clusters, centroids_window_height, work_group_size, window_n_centroids);
+
+    double N = n_samples, F = n_features, K = n_clusters;
+    double private_copies = sizeof(accT) * double(n_centroids_private_copies) * (F + 1) * K;
+    // each sample re-reads its features and performs F + 1 atomic read-modify-writes
+    double updates = sizeof(dataT) * N * (F + 1) + 2.0 * sizeof(accT) * N * (F + 1);
+
+    m.n_flops += 2.0 * N * F;
+    m.compulsory_bytes += sizeof(dataT) * N + std::min(private_copies, 2.0 * sizeof(accT) * N * (F + 1));
+    m.global_access_bytes += updates;
+
+    return m;
+}
+
+/* Every work-item loads its sample once per window of centroids, and writes K distances */
+template <typename dataT>
+kernel_model compute_distances(
+    size_t n_samples, size_t n_features, size_t n_clusters,
+    size_t centroids_window_height, size_t work_group_size, size_t window_n_centroids
+) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    double n_work_groups = quotient_ceil(n_samples, work_group_size);
+    double n_windows_for_centroid = quotient_ceil(n_clusters, window_n_centroids);
+    double padded_F = double(quotient_ceil(n_features, centroids_window_height) * centroids_window_height);
+
+    double flops = 3.0 * N * F * K;
+    double compulsory = sizeof(dataT) * (N * F + F * K + N * K);
+    double accessed =
+        sizeof(dataT) * (N * F * n_windows_for_centroid
+                         + n_work_groups * padded_F * n_windows_for_centroid * window_n_centroids
+                         + N * K);
+
+    return {flops, compulsory, accessed};
+}
+
+/* Every work-item gathers the coordinates of its assigned centroid */
+template <typename dataT, typename indT>
+kernel_model compute_inertia(size_t n_samples, size_t n_features, size_t n_clusters) {
+    double N = n_samples, F = n_features, K = n_clusters;
+
+    double flops = 3.0 * N * F + N;
+    double compulsory = sizeof(dataT) * (N * F + 2.0 * N + F * K) + sizeof(indT) * N;
+    double accessed = sizeof(dataT) * (2.0 * N * F + 2.0 * N) + sizeof(indT) * N;
+
+    return {flops, compulsory, accessed};
+}
+
+} // namespace lloyd_kernel_models
+
+template <typename T> class stream_triad_krn;
+template <typename T> class fma_chain_krn;
+
+/* @brief Measures attainable bandwidth with a STREAM triad over vectors of n
+   elements, and attainable throughput with independent chains of FMAs.
+   Best of `repetitions` runs, queue `q` must have profiling enabled. */
+template <typename T>
+device_peaks measure_device_peaks(sycl::queue q, size_t n = size_t(1) << 25, size_t repetitions = 10) {
+    auto duration_ns = [](const sycl::event &ev) {
+        return static_cast<double>(
+            ev.get_profiling_info<sycl::info::event_profiling::command_end>() -
+            ev.get_profiling_info<sycl::info::event_profiling::command_start>());
+    };
+
+    size_t max_alloc = q.get_device().get_info<sycl::info::device::max_mem_alloc_size>();
+    n = std::min(n, max_alloc / sizeof(T) / 2);
+
+    T *a = sycl::malloc_device<T>(n, q);
+    T *b = sycl::malloc_device<T>(n, q);
+    T *c = sycl::malloc_device<T>(n, q);
+    q.fill<T>(b, T(1), n).wait();
+    q.fill<T>(c, T(2), n).wait();
+
+    double best_triad_ns = std::numeric_limits<double>::infinity();
+    for(size_t rep = 0; rep < repetitions; ++rep) {
+        sycl::event ev = q.parallel_for<class stream_triad_krn<T>>(
+            sycl::range<1>(n),
+            [=](sycl::id<1> i) {
+                a[i] = b[i] + T(3) * c[i];
+            });
+        ev.wait();
+        best_triad_ns = std::min(best_triad_ns, duration_ns(ev));
+    }
+
+    constexpr size_t n_chains = 8;
+    constexpr size_t chain_length = 1024;
+    size_t max_wgs = q.get_device().get_info<sycl::info::device::max_work_group_size>();
+    size_t n_compute_units = q.get_device().get_info<sycl::info::device::max_compute_units>();
+    size_t wgs = std::min<size_t>(max_wgs, 256);
+    size_t global_size = n_compute_units * 16 * wgs;
+
+    double best_fma_ns = std::numeric_limits<double>::infinity();
+    for(size_t rep = 0; rep < repetitions; ++rep) {
+        sycl::event ev = q.parallel_for<class fma_chain_krn<T>>(
+            sycl::nd_range<1>(global_size, wgs),
+            [=](sycl::nd_item<1> it) {
+                size_t i = it.get_global_id(0);
+                T acc[n_chains];
+                for(size_t k = 0; k < n_chains; ++k) {
+                    acc[k] = T(i + k) * T(1e-7);
+                }
+                const T x = T(0.999);
+                const T y = T(1e-3);
+                for(size_t j = 0; j < chain_length; ++j) {
+                    for(size_t k = 0; k < n_chains; ++k) {
+                        acc[k] = sycl::fma(acc[k], x, y);
+                    }
+                }
+                T sum(0);
+                for(size_t k = 0; k < n_chains; ++k) {
+                    sum += acc[k];
+                }
+                // keeps the computation alive
+                if (i < n) {
+                    a[i] = sum;
+                }
+            });
+        ev.wait();
+        best_fma_ns = std::min(best_fma_ns, duration_ns(ev));
+    }
+
+    sycl::free(a, q);
+    sycl::free(b, q);
+    sycl::free(c, q);
+
+    double triad_bytes = 3.0 * sizeof(T) * n;
+    double fma_flops = 2.0 * n_chains * chain_length * global_size;
+
+    return {triad_bytes / best_triad_ns, fma_flops / best_fma_ns};
+}
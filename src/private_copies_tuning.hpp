@@ -0,0 +1,231 @@
+// private_copies_tuning.hpp
+//
+// Choice of the number of private copies of centroids and cluster sizes that
+// lloyd_single_step accumulates into, and of the mapping of samples to copies.
+// compute_number_of_private_copies sizes copies to fit in the global memory
+// cache, which ignores contention: on CPU devices, atomics of concurrent
+// threads contend on cache lines of the clusters they update, and the more
+// so as a few clusters hold most samples. The tuner below instead estimates
+// contention from the cluster sizes of the first iteration, derives a few
+// candidate configurations, times two Lloyd steps with each of them over the
+// next iterations and keeps the fastest, by the faster of its two steps, so
+// that the compilation of kernels and allocations a candidate is the first to
+// need do not count against it. Lloyd steps cost about the same at every
+// iteration, so that tuning needs no extra pass on data. When clusters
+// are much imbalanced, sorting samples by label instead of using atomics (see
+// sort_by_label.hpp) is a candidate too.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "quotients_utils.hpp"
+
+enum class private_copies_mapping {
+    // each sub-group accumulates in the next copy, in turns
+    sub_group,
+    // all sub-groups of a work-group accumulate in the same copy
+    work_group
+};
+
+inline const char *private_copies_mapping_name(private_copies_mapping mapping) {
+    return (mapping == private_copies_mapping::sub_group) ? "sub_group" : "work_group";
+}
+
+enum class centroid_update_strategy {
+    // atomic accumulation in private copies by lloyd_single_step
+    private_copies,
+    // sort of samples by label and segmented reduction, in a single copy
+    sort_by_label
+};
+
+struct private_copies_config {
+    size_t n_copies;
+    private_copies_mapping mapping;
+    centroid_update_strategy strategy = centroid_update_strategy::private_copies;
+
+    bool operator==(const private_copies_config &other) const {
+        return n_copies == other.n_copies && mapping == other.mapping && strategy == other.strategy;
+    }
+};
+
+// ratio of n_clusters to the effective number of clusters from which sorting
+// samples by label is a candidate
+constexpr double sort_by_label_min_imbalance = 4.0;
+
+// Lloyd steps timed per candidate, the first one warms it up
+constexpr size_t private_copies_tuning_steps_per_candidate = 2;
+
+/* @brief private_copies_block_size of lloyd_single_step for `mapping` */
+inline size_t private_copies_block_size(
+    private_copies_mapping mapping,
+    size_t sub_group_size,
+    size_t work_group_size
+) {
+    return (mapping == private_copies_mapping::sub_group) ? sub_group_size : work_group_size;
+}
+
+/* @brief Effective number of clusters of the given sizes, the inverse of the
+   probability that two samples drawn by weight belong to the same cluster.
+   It is n_clusters for balanced clusters, and 1 when one cluster holds all
+   samples. */
+template <typename T>
+double effective_number_of_clusters(const std::vector<T> &cluster_sizes) {
+    double total = 0.0;
+    double sum_of_squares = 0.0;
+    for(T size : cluster_sizes) {
+        double s = static_cast<double>(size);
+        total += s;
+        sum_of_squares += s * s;
+    }
+
+    if (sum_of_squares == 0.0) {
+        return static_cast<double>(std::max<size_t>(cluster_sizes.size(), 1));
+    }
+    return (total * total) / sum_of_squares;
+}
+
+class private_copies_tuner {
+public:
+    /* @brief `n_cache_copies` is the count of compute_number_of_private_copies,
+       which is the first configuration used, with the sub_group mapping.
+       `allow_sort_by_label` is false when sort_by_label can not be used. */
+    private_copies_tuner(
+        const sycl::device &dev,
+        size_t n_samples,
+        size_t n_features,
+        size_t n_clusters,
+        size_t bytes_per_copy_item,
+        size_t sub_group_size,
+        size_t work_group_size,
+        size_t n_cache_copies,
+        bool allow_sort_by_label = true
+    ) : n_clusters_(n_clusters), sub_group_size_(sub_group_size), work_group_size_(work_group_size),
+        allow_sort_by_label_(allow_sort_by_label)
+    {
+        size_t global_size = quotient_ceil(n_samples, work_group_size) * work_group_size;
+        n_sub_groups_ = std::max<size_t>(global_size / sub_group_size, 1);
+        n_work_groups_ = std::max<size_t>(global_size / work_group_size, 1);
+
+        // work-items of a work-group run in sequence on a CPU thread
+        size_t n_compute_units = dev.get_info<sycl::info::device::max_compute_units>();
+        n_concurrent_updaters_ = std::max<size_t>(n_compute_units, 1);
+        if (!dev.is_cpu()) {
+            n_concurrent_updaters_ *= std::max<size_t>(work_group_size / sub_group_size, 1);
+        }
+
+        // more copies than concurrent updaters can not lower contention, and
+        // all copies fit in a sixteenth of the device memory
+        size_t bytes_per_copy = bytes_per_copy_item * n_clusters * (n_features + 1);
+        size_t global_mem_size = dev.get_info<sycl::info::device::global_mem_size>();
+        size_t max_n_copies_in_memory = std::max<size_t>(global_mem_size / (16 * bytes_per_copy), 1);
+
+        n_cache_copies_ = std::max<size_t>(n_cache_copies, 1);
+        max_n_copies_ = std::min(
+            n_sub_groups_,
+            std::max(n_cache_copies_, std::min(n_concurrent_updaters_, max_n_copies_in_memory)));
+        n_cache_copies_ = std::min(n_cache_copies_, max_n_copies_);
+
+        candidates_.push_back({n_cache_copies_, private_copies_mapping::sub_group});
+    }
+
+    /* @brief Number of copies private copies buffers must be sized for */
+    size_t max_n_copies() const { return max_n_copies_; }
+
+    /* @brief Configuration of the next Lloyd step */
+    private_copies_config current() const {
+        return settled() ? best_ : candidates_[n_timed_steps_ / private_copies_tuning_steps_per_candidate];
+    }
+
+    size_t block_size() const {
+        return private_copies_block_size(current().mapping, sub_group_size_, work_group_size_);
+    }
+
+    /* @brief Whether the configuration no longer changes */
+    bool settled() const { return settled_; }
+
+    /* @brief Whether record_step expects cluster sizes with the timing */
+    bool needs_cluster_sizes() const { return !has_contention_candidates_; }
+
+    /* @brief Records the duration of a Lloyd step run with current(). The
+       first step only gives cluster sizes, from which the other candidates
+       follow, its timing includes the compilation of kernels. Each candidate
+       then runs private_copies_tuning_steps_per_candidate steps. */
+    template <typename T = double>
+    void record_step(double step_ns, const std::vector<T> &cluster_sizes = {}) {
+        if (settled_) {
+            return;
+        }
+
+        if (!has_contention_candidates_) {
+            add_contention_candidates(effective_number_of_clusters(cluster_sizes));
+            has_contention_candidates_ = true;
+            return;
+        }
+        size_t candidate_idx = n_timed_steps_ / private_copies_tuning_steps_per_candidate;
+        if (n_timed_steps_ % private_copies_tuning_steps_per_candidate == 0) {
+            timings_ns_.push_back(step_ns);
+        } else {
+            timings_ns_[candidate_idx] = std::min(timings_ns_[candidate_idx], step_ns);
+        }
+        ++n_timed_steps_;
+
+        if (n_timed_steps_ == private_copies_tuning_steps_per_candidate * candidates_.size()) {
+            size_t best_idx = std::min_element(timings_ns_.begin(), timings_ns_.end()) - timings_ns_.begin();
+            best_ = candidates_[best_idx];
+            settled_ = true;
+        }
+    }
+
+private:
+    size_t n_clusters_;
+    size_t sub_group_size_;
+    size_t work_group_size_;
+    bool allow_sort_by_label_;
+    size_t n_sub_groups_;
+    size_t n_work_groups_;
+    size_t n_concurrent_updaters_;
+    size_t n_cache_copies_;
+    size_t max_n_copies_;
+
+    std::vector<private_copies_config> candidates_;
+    // fastest step of each candidate timed so far
+    std::vector<double> timings_ns_;
+    size_t n_timed_steps_ = 0;
+    private_copies_config best_{1, private_copies_mapping::sub_group};
+    bool has_contention_candidates_ = false;
+    bool settled_ = false;
+
+    void add_candidate(size_t n_copies, private_copies_mapping mapping) {
+        // copies beyond the number of blocks of samples are never written to
+        size_t n_blocks = (mapping == private_copies_mapping::sub_group) ? n_sub_groups_ : n_work_groups_;
+        n_copies = std::max<size_t>(std::min({n_copies, n_blocks, max_n_copies_}), 1);
+
+        private_copies_config config{n_copies, mapping};
+        if (std::find(candidates_.begin(), candidates_.end(), config) == candidates_.end()) {
+            candidates_.push_back(config);
+        }
+    }
+
+    /* Concurrent updaters spread over n_copies copies, and those of a copy
+       over n_effective_clusters clusters, so that about one updater at a time
+       contends for a cluster with n_concurrent_updaters / n_effective_clusters
+       copies. Fewer copies are cheaper to reduce, more ones lower contention. */
+    void add_contention_candidates(double n_effective_clusters) {
+        size_t n_contention_copies = static_cast<size_t>(
+            std::ceil(static_cast<double>(n_concurrent_updaters_) / std::max(n_effective_clusters, 1.0)));
+
+        for(auto mapping : {private_copies_mapping::work_group, private_copies_mapping::sub_group}) {
+            add_candidate(n_contention_copies, mapping);
+            add_candidate(n_cache_copies_, mapping);
+        }
+
+        if (allow_sort_by_label_ &&
+            static_cast<double>(n_clusters_) >= sort_by_label_min_imbalance * n_effective_clusters) {
+            candidates_.push_back({1, private_copies_mapping::sub_group, centroid_update_strategy::sort_by_label});
+        }
+    }
+};
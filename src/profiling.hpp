@@ -0,0 +1,192 @@
+// profiling.hpp
+//
+// Collection of device timings of commands submitted by drivers, when the
+// execution queue has been created with sycl::property::queue::enable_profiling.
+// Each record carries the number of bytes moved from/to global memory and of
+// floating point operations performed by the command, as counted by the
+// analytic model below, from which achieved bandwidth and throughput derive.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct kernel_cost {
+    double n_bytes;
+    double n_flops;
+};
+
+struct kernel_profile_record {
+    std::string name;
+    size_t iteration;
+    std::uint64_t start_ns;
+    std::uint64_t end_ns;
+    double n_bytes;
+    double n_flops;
+
+    double duration_ns() const { return static_cast<double>(end_ns - start_ns); }
+
+    // bytes per nanosecond are gigabytes per second
+    double gb_per_s() const { return (end_ns > start_ns) ? n_bytes / duration_ns() : 0.0; }
+    double gflop_per_s() const { return (end_ns > start_ns) ? n_flops / duration_ns() : 0.0; }
+};
+
+class kernel_profiler {
+public:
+    void record(const std::string &name, size_t iteration, sycl::event ev, kernel_cost cost) {
+        record_span(name, iteration, ev, ev, cost);
+    }
+
+    /* @brief Records a sequence of dependent commands as a single entry,
+       starting with `first_ev` and ending with `last_ev` */
+    void record_span(const std::string &name, size_t iteration, sycl::event first_ev, sycl::event last_ev, kernel_cost cost) {
+        pending_.push_back({name, iteration, std::move(first_ev), std::move(last_ev), cost});
+    }
+
+    /* @brief Waits for all recorded commands and returns their timings, in order
+       of recording. Recorded entries are cleared. */
+    std::vector<kernel_profile_record> collect() {
+        std::vector<kernel_profile_record> records;
+        records.reserve(pending_.size());
+
+        for(auto &p : pending_) {
+            p.last_ev.wait();
+            std::uint64_t start_ns =
+                p.first_ev.template get_profiling_info<sycl::info::event_profiling::command_start>();
+            std::uint64_t end_ns =
+                p.last_ev.template get_profiling_info<sycl::info::event_profiling::command_end>();
+
+            records.push_back({p.name, p.iteration, start_ns, end_ns, p.cost.n_bytes, p.cost.n_flops});
+        }
+        pending_.clear();
+
+        return records;
+    }
+
+private:
+    struct pending_record {
+        std::string name;
+        size_t iteration;
+        sycl::event first_ev;
+        sycl::event last_ev;
+        kernel_cost cost;
+    };
+
+    std::vector<pending_record> pending_;
+};
+
+/* Minimal global memory traffic and floating point operations of kernels
+   of Lloyd iterations, assuming centroids are served from cache/SLM. */
+namespace lloyd_kernel_costs {
+
+template <typename T>
+kernel_cost fill(size_t n) {
+    return {double(sizeof(T)) * n, 0.0};
+}
+
+template <typename dataT>
+kernel_cost half_l2_norm(size_t n_features, size_t n_clusters) {
+    double FK = double(n_features) * n_clusters;
+    return {sizeof(dataT) * (FK + n_clusters), 2.0 * FK};
+}
+
+template <typename dataT, typename indT, typename accT = dataT>
+kernel_cost lloyd_single_step(size_t n_samples, size_t n_features, size_t n_clusters) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    return {
+        // samples, weights, labels, atomic updates of private copies
+        sizeof(dataT) * (N * F + N) + sizeof(indT) * N + sizeof(accT) * N * (F + 1),
+        // dot products, pseudo-inertia, weighted accumulation
+        2.0 * N * F * K + 2.0 * N * K + 2.0 * N * F
+    };
+}
+
+template <typename dataT, typename accT = dataT>
+kernel_cost reduce_centroid_data(size_t n_copies, size_t n_features, size_t n_clusters, bool reset_private_copies = false) {
+    double cells = (double(n_features) + 1) * n_clusters;
+    double private_copies_passes = (reset_private_copies) ? 2.0 : 1.0;
+    // cluster sizes are read twice more by the compaction of empty clusters
+    return {private_copies_passes * sizeof(accT) * n_copies * cells + sizeof(dataT) * (cells + 2.0 * n_clusters),
+            double(n_copies) * cells};
+}
+
+/* A read of labels counting digits of all passes, then passes over 8 bits of
+   labels, each reading and writing keys and indices. */
+inline kernel_cost sort_samples_by_label(size_t n_samples, size_t n_clusters) {
+    double n_passes = 1.0;
+    while (std::pow(256.0, n_passes) < double(n_clusters)) {
+        n_passes += 1.0;
+    }
+    return {4.0 * n_samples + n_passes * 4.0 * 4.0 * n_samples, 0.0};
+}
+
+template <typename dataT, typename indT, typename accT = dataT>
+kernel_cost segmented_centroid_sums(size_t n_samples, size_t n_features, size_t n_clusters) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    return {
+        // samples, weights, sorted indices and their labels, sums
+        sizeof(dataT) * (N * F + N) + (4.0 + sizeof(indT)) * N + sizeof(accT) * 2.0 * K * (F + 1),
+        2.0 * N * F + N
+    };
+}
+
+template <typename dataT>
+kernel_cost broadcast_division(size_t n_features, size_t n_clusters) {
+    double FK = double(n_features) * n_clusters;
+    return {sizeof(dataT) * (2.0 * FK + n_clusters), FK};
+}
+
+template <typename dataT>
+kernel_cost l2_normalize(size_t n_features, size_t n_clusters) {
+    double FK = double(n_features) * n_clusters;
+    return {sizeof(dataT) * 3.0 * FK, 3.0 * FK};
+}
+
+template <typename dataT>
+kernel_cost centroid_shifts(size_t n_features, size_t n_clusters) {
+    double FK = double(n_features) * n_clusters;
+    return {sizeof(dataT) * (2.0 * FK + n_clusters), 3.0 * FK};
+}
+
+template <typename dataT>
+kernel_cost reduce_vector(size_t n) {
+    return {double(sizeof(dataT)) * n, double(n)};
+}
+
+template <typename dataT, typename indT>
+kernel_cost assignment(size_t n_samples, size_t n_features, size_t n_clusters) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    return {sizeof(dataT) * N * F + sizeof(indT) * N, 2.0 * N * F * K + 2.0 * N * K};
+}
+
+template <typename dataT>
+kernel_cost compute_distances(size_t n_samples, size_t n_features, size_t n_clusters) {
+    double N = n_samples, F = n_features, K = n_clusters;
+    return {sizeof(dataT) * (N * F + N * K), 3.0 * N * F * K};
+}
+
+template <typename dataT, typename indT>
+kernel_cost compute_inertia(size_t n_samples, size_t n_features) {
+    double N = n_samples, F = n_features;
+    return {sizeof(dataT) * (N * F + 2.0 * N) + sizeof(indT) * N, 3.0 * N * F + N};
+}
+
+/* Relocation is dominated by the passes on data computing distances to nearest
+   centroids and selecting farthest samples. */
+template <typename dataT, typename indT>
+kernel_cost relocate_empty_clusters(size_t n_samples, size_t n_features, size_t n_clusters, bool with_assignment) {
+    kernel_cost inertia = compute_inertia<dataT, indT>(n_samples, n_features);
+    kernel_cost cost = {inertia.n_bytes + 2.0 * sizeof(dataT) * n_samples, inertia.n_flops};
+    if (with_assignment) {
+        kernel_cost a = assignment<dataT, indT>(n_samples, n_features, n_clusters);
+        cost.n_bytes += a.n_bytes;
+        cost.n_flops += a.n_flops;
+    }
+    return cost;
+}
+
+} // namespace lloyd_kernel_costs
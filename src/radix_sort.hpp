@@ -0,0 +1,475 @@
+// radix_sort.hpp
+//
+// Stable LSD radix sort of keys, optionally carrying values along, on the
+// device. Keys are floating point or integer numbers, mapped to unsigned
+// integers of the same width that compare the same way, and sorted 8 bits
+// per pass. Each pass is a single kernel, after the counts of digits of all
+// passes have been computed upfront (onesweep): work-groups sort tiles of
+// keys locally, and find the offsets of digits of their tile among previous
+// tiles with a decoupled look-back, i.e. from the counts or prefixes that
+// previous tiles publish, without a separate pass nor grid-wide barrier.
+//
+// Callers provide scratch memory of radix_sort_scratch_size bytes, so that
+// sorts within iterations allocate nothing.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "quotients_utils.hpp"
+
+/* Mapping of keys to unsigned integers of the same order */
+template <typename KeyT>
+struct radix_key_traits;
+
+template <>
+struct radix_key_traits<float> {
+    using bits_t = std::uint32_t;
+    static constexpr bits_t sign_bit = bits_t(1) << 31;
+
+    // positive numbers are moved above negative ones, whose order is reversed
+    static bits_t to_bits(float key) {
+        bits_t b = sycl::bit_cast<bits_t>(key);
+        return (b & sign_bit) ? bits_t(~b) : bits_t(b | sign_bit);
+    }
+    static float from_bits(bits_t b) {
+        return sycl::bit_cast<float>((b & sign_bit) ? bits_t(b & ~sign_bit) : bits_t(~b));
+    }
+};
+
+template <>
+struct radix_key_traits<double> {
+    using bits_t = std::uint64_t;
+    static constexpr bits_t sign_bit = bits_t(1) << 63;
+
+    static bits_t to_bits(double key) {
+        bits_t b = sycl::bit_cast<bits_t>(key);
+        return (b & sign_bit) ? bits_t(~b) : bits_t(b | sign_bit);
+    }
+    static double from_bits(bits_t b) {
+        return sycl::bit_cast<double>((b & sign_bit) ? bits_t(b & ~sign_bit) : bits_t(~b));
+    }
+};
+
+template <typename UIntT>
+struct _radix_unsigned_key_traits {
+    using bits_t = UIntT;
+    static bits_t to_bits(UIntT key) { return key; }
+    static UIntT from_bits(bits_t b) { return b; }
+};
+
+template <> struct radix_key_traits<std::uint32_t> : _radix_unsigned_key_traits<std::uint32_t> {};
+template <> struct radix_key_traits<std::uint64_t> : _radix_unsigned_key_traits<std::uint64_t> {};
+
+template <typename IntT, typename UIntT>
+struct _radix_signed_key_traits {
+    using bits_t = UIntT;
+    static constexpr bits_t sign_bit = bits_t(1) << (8 * sizeof(bits_t) - 1);
+
+    static bits_t to_bits(IntT key) { return sycl::bit_cast<bits_t>(key) ^ sign_bit; }
+    static IntT from_bits(bits_t b) { return sycl::bit_cast<IntT>(bits_t(b ^ sign_bit)); }
+};
+
+template <> struct radix_key_traits<std::int32_t> : _radix_signed_key_traits<std::int32_t, std::uint32_t> {};
+template <> struct radix_key_traits<std::int64_t> : _radix_signed_key_traits<std::int64_t, std::uint64_t> {};
+
+constexpr unsigned radix_sort_digit_bits = 8;
+constexpr size_t radix_sort_radix = size_t(1) << radix_sort_digit_bits;
+constexpr size_t radix_sort_keys_per_work_item = 4;
+
+// tile statuses published for the look-back: a count of keys of a digit,
+// flagged as either the count of the tile alone, or the inclusive prefix
+// over all tiles up to it
+constexpr std::uint64_t radix_sort_aggregate_flag = std::uint64_t(1) << 62;
+constexpr std::uint64_t radix_sort_prefix_flag = std::uint64_t(1) << 63;
+constexpr std::uint64_t radix_sort_count_mask = radix_sort_aggregate_flag - 1;
+
+template <typename KeyT, typename ValueT>
+struct _radix_sort_scratch_layout {
+    using bits_t = typename radix_key_traits<KeyT>::bits_t;
+
+    size_t n_tiles;
+    size_t n_passes;
+    // offsets in bytes, all multiples of 8
+    size_t key_bits_offset[2];
+    size_t values_offset;
+    // zeroed at every sort, contiguous
+    size_t statuses_offset;
+    size_t digit_offsets_offset;
+    size_t tile_counters_offset;
+    size_t size;
+
+    _radix_sort_scratch_layout(size_t n_keys, size_t work_group_size, unsigned n_sorted_bits) {
+        auto aligned = [](size_t n_bytes) { return quotient_ceil<size_t>(n_bytes, 8) * 8; };
+
+        n_tiles = std::max<size_t>(quotient_ceil(n_keys, work_group_size * radix_sort_keys_per_work_item), 1);
+        n_passes = std::max<size_t>(quotient_ceil<size_t>(n_sorted_bits, radix_sort_digit_bits), 1);
+
+        key_bits_offset[0] = 0;
+        key_bits_offset[1] = aligned(n_keys * sizeof(bits_t));
+        values_offset = key_bits_offset[1] + aligned(n_keys * sizeof(bits_t));
+        statuses_offset = values_offset + aligned(n_keys * sizeof(ValueT));
+        digit_offsets_offset = statuses_offset + n_passes * n_tiles * radix_sort_radix * sizeof(std::uint64_t);
+        tile_counters_offset = digit_offsets_offset + aligned(n_passes * radix_sort_radix * sizeof(std::uint32_t));
+        size = tile_counters_offset + aligned(n_passes * sizeof(std::uint32_t));
+    }
+};
+
+/* @brief Number of bytes of the scratch of radix_sort_pairs */
+template <typename KeyT, typename ValueT = std::uint32_t>
+size_t radix_sort_scratch_size(size_t n_keys, size_t work_group_size) {
+    constexpr unsigned n_key_bits = 8 * sizeof(typename radix_key_traits<KeyT>::bits_t);
+    return _radix_sort_scratch_layout<KeyT, ValueT>(n_keys, work_group_size, n_key_bits).size;
+}
+
+template <typename KeyT, typename ValueT>
+class radix_sort_digit_counts_krn;
+
+template <typename KeyT, typename ValueT>
+class radix_sort_digit_offsets_krn;
+
+template <typename KeyT, typename ValueT>
+class radix_sort_onesweep_krn;
+
+/* @brief Sorts keys_in (n_keys,) into keys_out, and values_in along into
+   values_out. The sort is stable, in ascending order, or in descending order
+   when `descending` is true, ties then keeping their order too.
+
+   When values_in is null, values are the indices of keys, i.e. values_out is
+   the permutation sorting keys_in. keys_out, or values_out for a sort of
+   keys only, may be null when not needed. n_keys must fit in std::uint32_t.
+
+   Only the `n_sorted_bits` lowest bits of keys, as mapped by
+   radix_key_traits, are sorted, e.g. 8 bits for keys known to be in
+   [0, 256). `scratch` holds radix_sort_scratch_size bytes, aligned for
+   std::uint64_t, as USM allocations are. When given, `first_ev` is set to
+   the event of the first command submitted.
+
+   Work-groups spin on the statuses of tiles of smaller index, which are
+   handed out in order of start of work-groups, so that they are running or
+   done.
+ */
+template <typename KeyT, typename ValueT = std::uint32_t>
+sycl::event
+radix_sort_pairs(
+    sycl::queue q,
+    size_t n_keys,
+    size_t work_group_size,
+    //
+    KeyT const *keys_in,      // IN            (n_keys,)
+    ValueT const *values_in,  // IN, nullable  (n_keys,)
+    KeyT *keys_out,           // OUT, nullable (n_keys,)
+    ValueT *values_out,       // OUT, nullable (n_keys,)
+    void *scratch,            // SCRATCH       (radix_sort_scratch_size bytes)
+    bool descending = false,
+    const std::vector<sycl::event> &depends = {},
+    unsigned n_sorted_bits = 8 * sizeof(typename radix_key_traits<KeyT>::bits_t),
+    sycl::event *first_ev = nullptr
+) {
+    using traits = radix_key_traits<KeyT>;
+    using bits_t = typename traits::bits_t;
+
+    _radix_sort_scratch_layout<KeyT, ValueT> layout(n_keys, work_group_size, n_sorted_bits);
+    char *scratch_bytes = static_cast<char *>(scratch);
+    bits_t *key_bits[2] = {
+        reinterpret_cast<bits_t *>(scratch_bytes + layout.key_bits_offset[0]),
+        reinterpret_cast<bits_t *>(scratch_bytes + layout.key_bits_offset[1])
+    };
+    ValueT *values_tmp = reinterpret_cast<ValueT *>(scratch_bytes + layout.values_offset);
+    std::uint64_t *statuses = reinterpret_cast<std::uint64_t *>(scratch_bytes + layout.statuses_offset);
+    std::uint32_t *digit_offsets = reinterpret_cast<std::uint32_t *>(scratch_bytes + layout.digit_offsets_offset);
+    std::uint32_t *tile_counters = reinterpret_cast<std::uint32_t *>(scratch_bytes + layout.tile_counters_offset);
+
+    size_t n_tiles = layout.n_tiles;
+    size_t n_passes = layout.n_passes;
+    size_t tile_size = work_group_size * radix_sort_keys_per_work_item;
+
+    // sorted bits, with padding keys of all bits set sorting last
+    auto key_bits_of = [=](KeyT key) {
+        bits_t b = traits::to_bits(key);
+        return (descending) ? bits_t(~b) : b;
+    };
+    auto key_of = [=](bits_t b) {
+        return traits::from_bits((descending) ? bits_t(~b) : b);
+    };
+    auto digit_of = [=](bits_t b, size_t pass) {
+        unsigned shift = pass * radix_sort_digit_bits;
+        unsigned n_digit_bits = sycl::min(radix_sort_digit_bits, n_sorted_bits - shift);
+        return static_cast<size_t>((b >> shift) & ((bits_t(1) << n_digit_bits) - 1));
+    };
+
+    sycl::event reset_ev = q.memset(
+        statuses, 0, layout.size - layout.statuses_offset, depends);
+    if (first_ev) {
+        *first_ev = reset_ev;
+    }
+
+    if (n_keys == 0) {
+        return reset_ev;
+    }
+
+    // counts of digits of all passes, in a single read of keys
+    sycl::event counts_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(reset_ev);
+
+            using slm_countsT = sycl::accessor<std::uint32_t, 1, sycl::access::mode::read_write, sycl::access::target::local>;
+            slm_countsT counts(sycl::range<1>(n_passes * radix_sort_radix), cgh);
+
+            cgh.parallel_for<class radix_sort_digit_counts_krn<KeyT, ValueT>>(
+                sycl::nd_range<1>({n_tiles * work_group_size}, {work_group_size}),
+                [=](sycl::nd_item<1> it) {
+                    size_t local_id = it.get_local_id(0);
+                    size_t tile_first = it.get_group(0) * tile_size;
+
+                    for(size_t k = local_id; k < n_passes * radix_sort_radix; k += work_group_size) {
+                        counts[k] = 0;
+                    }
+                    it.barrier(sycl::access::fence_space::local_space);
+
+                    for(size_t r = 0; r < radix_sort_keys_per_work_item; ++r) {
+                        size_t i = tile_first + r * work_group_size + local_id;
+                        if (i < n_keys) {
+                            bits_t b = key_bits_of(keys_in[i]);
+                            for(size_t pass = 0; pass < n_passes; ++pass) {
+                                sycl::atomic_ref<
+                                    std::uint32_t,
+                                    sycl::memory_order::relaxed,
+                                    sycl::memory_scope::work_group,
+                                    sycl::access::address_space::local_space>(
+                                        counts[pass * radix_sort_radix + digit_of(b, pass)]) += 1;
+                            }
+                        }
+                    }
+                    it.barrier(sycl::access::fence_space::local_space);
+
+                    for(size_t k = local_id; k < n_passes * radix_sort_radix; k += work_group_size) {
+                        if (counts[k] > 0) {
+                            sycl::atomic_ref<
+                                std::uint32_t,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(digit_offsets[k]) += counts[k];
+                        }
+                    }
+                }
+            );
+        });
+
+    // exclusive scan of counts of digits of each pass, a work-group per pass
+    sycl::event offsets_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(counts_ev);
+
+            cgh.parallel_for<class radix_sort_digit_offsets_krn<KeyT, ValueT>>(
+                sycl::nd_range<1>({n_passes * work_group_size}, {work_group_size}),
+                [=](sycl::nd_item<1> it) {
+                    auto group = it.get_group();
+                    size_t local_id = it.get_local_id(0);
+                    std::uint32_t *pass_offsets = digit_offsets + it.get_group(0) * radix_sort_radix;
+
+                    std::uint32_t carry = 0;
+                    for(size_t first = 0; first < radix_sort_radix; first += work_group_size) {
+                        size_t digit = first + local_id;
+                        std::uint32_t count = (digit < radix_sort_radix) ? pass_offsets[digit] : 0;
+
+                        std::uint32_t offset = sycl::exclusive_scan_over_group(group, count, sycl::plus<std::uint32_t>());
+                        std::uint32_t block_count = sycl::reduce_over_group(group, count, sycl::plus<std::uint32_t>());
+
+                        if (digit < radix_sort_radix) {
+                            pass_offsets[digit] = carry + offset;
+                        }
+                        carry += block_count;
+                    }
+                }
+            );
+        });
+
+    sycl::event pass_ev = offsets_ev;
+
+    for(size_t pass = 0; pass < n_passes; ++pass) {
+        bool first_pass = (pass == 0);
+        bool last_pass = (pass == n_passes - 1);
+        unsigned shift = pass * radix_sort_digit_bits;
+        unsigned n_digit_bits = std::min<unsigned>(radix_sort_digit_bits, n_sorted_bits - shift);
+
+        bits_t const *bits_in = key_bits[(pass + 1) % 2];
+        bits_t *bits_out = key_bits[pass % 2];
+        // the last pass writes to values_out
+        ValueT const *pass_values_in = (first_pass) ? values_in : ((n_passes - pass) % 2 == 0) ? values_out : values_tmp;
+        ValueT *pass_values_out = ((n_passes - 1 - pass) % 2 == 0) ? values_out : values_tmp;
+        bool with_values = (values_out != nullptr);
+
+        std::uint64_t *pass_statuses = statuses + pass * n_tiles * radix_sort_radix;
+        std::uint32_t const *pass_digit_offsets = digit_offsets + pass * radix_sort_radix;
+        std::uint32_t *tile_counter = tile_counters + pass;
+
+        pass_ev =
+            q.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(pass_ev);
+
+                using slm_bitsT = sycl::accessor<bits_t, 1, sycl::access::mode::read_write, sycl::access::target::local>;
+                using slm_u32T = sycl::accessor<std::uint32_t, 1, sycl::access::mode::read_write, sycl::access::target::local>;
+                slm_bitsT tile_bits(sycl::range<1>(tile_size), cgh);
+                // position of keys in the tile before the local sort
+                slm_u32T tile_positions(sycl::range<1>(tile_size), cgh);
+                slm_u32T digit_counts(sycl::range<1>(radix_sort_radix), cgh);
+                slm_u32T digit_starts(sycl::range<1>(radix_sort_radix), cgh);
+                slm_u32T digit_prefixes(sycl::range<1>(radix_sort_radix), cgh);
+                slm_u32T tile_idx_slm(sycl::range<1>(1), cgh);
+
+                cgh.parallel_for<class radix_sort_onesweep_krn<KeyT, ValueT>>(
+                    sycl::nd_range<1>({n_tiles * work_group_size}, {work_group_size}),
+                    [=](sycl::nd_item<1> it) {
+                        auto group = it.get_group();
+                        size_t local_id = it.get_local_id(0);
+
+                        if (local_id == 0) {
+                            tile_idx_slm[0] = sycl::atomic_ref<
+                                std::uint32_t,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(*tile_counter).fetch_add(1);
+                        }
+                        for(size_t digit = local_id; digit < radix_sort_radix; digit += work_group_size) {
+                            digit_counts[digit] = 0;
+                        }
+                        it.barrier(sycl::access::fence_space::local_space);
+
+                        size_t tile_idx = tile_idx_slm[0];
+                        size_t tile_first = tile_idx * tile_size;
+                        size_t n_tile_keys = sycl::min(tile_size, n_keys - tile_first);
+
+                        for(size_t r = 0; r < radix_sort_keys_per_work_item; ++r) {
+                            size_t j = r * work_group_size + local_id;
+                            bits_t b = ~bits_t(0);
+                            if (j < n_tile_keys) {
+                                b = (first_pass) ? key_bits_of(keys_in[tile_first + j]) : bits_in[tile_first + j];
+                                sycl::atomic_ref<
+                                    std::uint32_t,
+                                    sycl::memory_order::relaxed,
+                                    sycl::memory_scope::work_group,
+                                    sycl::access::address_space::local_space>(digit_counts[digit_of(b, pass)]) += 1;
+                            }
+                            tile_bits[j] = b;
+                            tile_positions[j] = j;
+                        }
+                        it.barrier(sycl::access::fence_space::local_space);
+
+                        // publish counts of the tile, then add those of previous
+                        // tiles until one publishes its inclusive prefix
+                        for(size_t digit = local_id; digit < radix_sort_radix; digit += work_group_size) {
+                            std::uint64_t count = digit_counts[digit];
+                            auto status = sycl::atomic_ref<
+                                std::uint64_t,
+                                sycl::memory_order::relaxed,
+                                sycl::memory_scope::device,
+                                sycl::access::address_space::global_space>(pass_statuses[tile_idx * radix_sort_radix + digit]);
+
+                            std::uint64_t prefix = 0;
+                            if (tile_idx > 0) {
+                                status.store(radix_sort_aggregate_flag | count);
+
+                                for(size_t look_back_idx = tile_idx; look_back_idx > 0; --look_back_idx) {
+                                    auto previous_status = sycl::atomic_ref<
+                                        std::uint64_t,
+                                        sycl::memory_order::relaxed,
+                                        sycl::memory_scope::device,
+                                        sycl::access::address_space::global_space>(
+                                            pass_statuses[(look_back_idx - 1) * radix_sort_radix + digit]);
+
+                                    std::uint64_t s = previous_status.load();
+                                    while ((s & (radix_sort_aggregate_flag | radix_sort_prefix_flag)) == 0) {
+                                        s = previous_status.load();
+                                    }
+
+                                    prefix += s & radix_sort_count_mask;
+                                    if (s & radix_sort_prefix_flag) {
+                                        break;
+                                    }
+                                }
+                            }
+                            status.store(radix_sort_prefix_flag | (prefix + count));
+                            digit_prefixes[digit] = static_cast<std::uint32_t>(prefix);
+                        }
+
+                        // stable local sort of the tile by the digit, one bit at a time
+                        for(unsigned bit = 0; bit < n_digit_bits; ++bit) {
+                            bits_t bits[radix_sort_keys_per_work_item];
+                            std::uint32_t positions[radix_sort_keys_per_work_item];
+                            std::uint32_t n_zeros_before[radix_sort_keys_per_work_item];
+                            std::uint32_t n_zeros = 0;
+
+                            for(size_t r = 0; r < radix_sort_keys_per_work_item; ++r) {
+                                size_t j = r * work_group_size + local_id;
+                                bits[r] = tile_bits[j];
+                                positions[r] = tile_positions[j];
+
+                                std::uint32_t is_zero = ((bits[r] >> (shift + bit)) & 1) == 0;
+                                n_zeros_before[r] = n_zeros +
+                                    sycl::exclusive_scan_over_group(group, is_zero, sycl::plus<std::uint32_t>());
+                                n_zeros += sycl::reduce_over_group(group, is_zero, sycl::plus<std::uint32_t>());
+                            }
+                            it.barrier(sycl::access::fence_space::local_space);
+
+                            for(size_t r = 0; r < radix_sort_keys_per_work_item; ++r) {
+                                size_t j = r * work_group_size + local_id;
+                                bool is_zero = ((bits[r] >> (shift + bit)) & 1) == 0;
+                                size_t sorted_j = (is_zero) ? n_zeros_before[r] : n_zeros + (j - n_zeros_before[r]);
+                                tile_bits[sorted_j] = bits[r];
+                                tile_positions[sorted_j] = positions[r];
+                            }
+                            it.barrier(sycl::access::fence_space::local_space);
+                        }
+
+                        // first position of each digit in the sorted tile
+                        std::uint32_t carry = 0;
+                        for(size_t first = 0; first < radix_sort_radix; first += work_group_size) {
+                            size_t digit = first + local_id;
+                            std::uint32_t count = (digit < radix_sort_radix) ? digit_counts[digit] : 0;
+
+                            std::uint32_t start = sycl::exclusive_scan_over_group(group, count, sycl::plus<std::uint32_t>());
+                            std::uint32_t block_count = sycl::reduce_over_group(group, count, sycl::plus<std::uint32_t>());
+
+                            if (digit < radix_sort_radix) {
+                                digit_starts[digit] = carry + start;
+                            }
+                            carry += block_count;
+                        }
+                        it.barrier(sycl::access::fence_space::local_space);
+
+                        // keys of a digit are contiguous in the tile and in the output
+                        for(size_t r = 0; r < radix_sort_keys_per_work_item; ++r) {
+                            size_t j = r * work_group_size + local_id;
+                            if (j >= n_tile_keys) {
+                                continue;
+                            }
+
+                            bits_t b = tile_bits[j];
+                            size_t digit = digit_of(b, pass);
+                            size_t out_idx = pass_digit_offsets[digit] + digit_prefixes[digit] + (j - digit_starts[digit]);
+
+                            if (last_pass) {
+                                if (keys_out) {
+                                    keys_out[out_idx] = key_of(b);
+                                }
+                            } else {
+                                bits_out[out_idx] = b;
+                            }
+
+                            if (with_values) {
+                                size_t in_idx = tile_first + tile_positions[j];
+                                pass_values_out[out_idx] = (pass_values_in) ?
+                                    pass_values_in[in_idx] : static_cast<ValueT>(in_idx);
+                            }
+                        }
+                    }
+                );
+            });
+    }
+
+    return pass_ev;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/* @brief A sequence of commands, submitted by a function to a queue, recorded
+   once and replayed as a whole.
+
+   With the SYCL_EXT_ONEAPI_GRAPH extension, commands are captured in an
+   executable command graph, so that a replay is a single submission. When
+   the extension is unavailable, or the device does not support graphs, the
+   submitting function is kept and called again at each replay.
+
+   The submitting function is called once with no dependencies when recording,
+   its commands may only depend on each other. Pointers it uses are captured
+   as they are at recording, replays do not see later changes of them.
+ */
+class recorded_commands {
+public:
+    using submit_fn_t = std::function<sycl::event(const std::vector<sycl::event> &)>;
+
+    recorded_commands(sycl::queue q, submit_fn_t submit_fn)
+        : q_(q), submit_fn_(std::move(submit_fn))
+    {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+        namespace sycl_exp = sycl::ext::oneapi::experimental;
+
+        try {
+            sycl_exp::command_graph<sycl_exp::graph_state::modifiable> graph(q_.get_context(), q_.get_device());
+
+            graph.begin_recording(q_);
+            try {
+                submit_fn_({});
+            } catch (...) {
+                graph.end_recording(q_);
+                throw;
+            }
+            graph.end_recording(q_);
+
+            exec_graph_ = std::make_unique<sycl_exp::command_graph<sycl_exp::graph_state::executable>>(graph.finalize());
+        } catch (const sycl::exception &) {
+            // the device does not support graphs, commands are submitted anew
+            exec_graph_.reset();
+        }
+#endif
+    }
+
+    /* @brief Submits the recorded commands after `depends`, returns an event
+       of the completion of all of them */
+    sycl::event replay(const std::vector<sycl::event> &depends = {}) {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+        if (exec_graph_) {
+            return q_.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(depends);
+                cgh.ext_oneapi_graph(*exec_graph_);
+            });
+        }
+#endif
+        return submit_fn_(depends);
+    }
+
+    /* @brief Whether replays are submissions of a command graph */
+    bool is_graph() const {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+        return static_cast<bool>(exec_graph_);
+#else
+        return false;
+#endif
+    }
+
+private:
+    sycl::queue q_;
+    submit_fn_t submit_fn_;
+
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+    std::unique_ptr<
+        sycl::ext::oneapi::experimental::command_graph<sycl::ext::oneapi::experimental::graph_state::executable>
+    > exec_graph_;
+#endif
+};
@@ -0,0 +1,351 @@
+// scan_kernels.hpp
+//
+// Prefix sums (scans), stream compaction and partitions on the device. Items are split
+// in tiles of work_group_size * scan_items_per_work_item items: sums of tiles
+// are computed first, a single work-group scans them into offsets of tiles,
+// and work-groups then scan their tile from its offset. Each item is loaded
+// twice and stored once, whatever the number of tiles, and no atomics are
+// used, so that results do not depend on the scheduling of work-items and
+// selected items come out in order.
+//
+// Callers provide scratch memory of scan_scratch_size bytes. Without it, a
+// single work-group scans all tiles in turn, which suits short inputs, e.g.
+// of one item per cluster.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "quotients_utils.hpp"
+
+constexpr size_t scan_items_per_work_item = 4;
+
+inline size_t _scan_n_tiles(size_t n_items, size_t work_group_size) {
+    return std::max<size_t>(quotient_ceil(n_items, work_group_size * scan_items_per_work_item), 1);
+}
+
+/* @brief Number of bytes of the scratch of a scan, or stream compaction, of
+   n_items with sums of type T. It is 0 when items fit in a single tile. */
+template <typename T>
+size_t scan_scratch_size(size_t n_items, size_t work_group_size) {
+    size_t n_tiles = _scan_n_tiles(n_items, work_group_size);
+    return (n_tiles > 1) ? n_tiles * sizeof(T) : 0;
+}
+
+template <typename T, typename LoadT, typename StoreT>
+class scan_tile_sums_krn;
+
+template <typename T, typename LoadT, typename StoreT>
+class scan_tile_offsets_krn;
+
+template <typename T, typename LoadT, typename StoreT>
+class scan_tiles_krn;
+
+/* @brief Scan of load(i) over i in [0, n_items): store(i, prefix, value) is
+   called with the sum `prefix` of load(j) over j < i, and value = load(i).
+   The sum over all items is written to `total` when it is not null.
+
+   LoadT and StoreT name kernels, they are functors declared at namespace
+   scope. When given, `first_ev` is set to the event of the first kernel
+   submitted.
+ */
+template <typename T, typename LoadT, typename StoreT>
+sycl::event
+_scan_tiles(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    LoadT load,
+    StoreT store,
+    T *total,                   // OUT, nullable (1,)
+    void *scratch,              // SCRATCH, nullable (scan_scratch_size bytes)
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    size_t tile_size = work_group_size * scan_items_per_work_item;
+    size_t n_tiles = _scan_n_tiles(n_items, work_group_size);
+
+    // offsets of tiles, or null when a single work-group scans tiles in turn
+    T *tile_offsets = (n_tiles > 1) ? static_cast<T *>(scratch) : nullptr;
+    std::vector<sycl::event> tiles_depends = depends;
+
+    if (tile_offsets) {
+        sycl::event sums_ev =
+            q.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(depends);
+
+                cgh.parallel_for<class scan_tile_sums_krn<T, LoadT, StoreT>>(
+                    sycl::nd_range<1>({n_tiles * work_group_size}, {work_group_size}),
+                    [=](sycl::nd_item<1> it) {
+                        size_t local_id = it.get_local_id(0);
+                        size_t tile_first = it.get_group(0) * tile_size;
+
+                        T sum(0);
+                        for(size_t r = 0; r < scan_items_per_work_item; ++r) {
+                            size_t i = tile_first + r * work_group_size + local_id;
+                            if (i < n_items) {
+                                sum += load(i);
+                            }
+                        }
+
+                        T tile_sum = sycl::reduce_over_group(it.get_group(), sum, sycl::plus<T>());
+                        if (local_id == 0) {
+                            tile_offsets[it.get_group(0)] = tile_sum;
+                        }
+                    }
+                );
+            });
+        if (first_ev) {
+            *first_ev = sums_ev;
+        }
+
+        sycl::event offsets_ev =
+            q.submit([&](sycl::handler &cgh) {
+                cgh.depends_on(sums_ev);
+
+                cgh.parallel_for<class scan_tile_offsets_krn<T, LoadT, StoreT>>(
+                    sycl::nd_range<1>({work_group_size}, {work_group_size}),
+                    [=](sycl::nd_item<1> it) {
+                        auto group = it.get_group();
+                        size_t local_id = it.get_local_id(0);
+
+                        T carry(0);
+                        for(size_t first = 0; first < n_tiles; first += work_group_size) {
+                            size_t tile_idx = first + local_id;
+                            T tile_sum = (tile_idx < n_tiles) ? tile_offsets[tile_idx] : T(0);
+
+                            T offset = sycl::exclusive_scan_over_group(group, tile_sum, sycl::plus<T>());
+                            T block_sum = sycl::reduce_over_group(group, tile_sum, sycl::plus<T>());
+
+                            if (tile_idx < n_tiles) {
+                                tile_offsets[tile_idx] = carry + offset;
+                            }
+                            carry += block_sum;
+                        }
+
+                        if (total && local_id == 0) {
+                            *total = carry;
+                        }
+                    }
+                );
+            });
+        tiles_depends = {offsets_ev};
+    }
+
+    size_t n_work_groups = (tile_offsets) ? n_tiles : 1;
+
+    sycl::event tiles_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(tiles_depends);
+
+            cgh.parallel_for<class scan_tiles_krn<T, LoadT, StoreT>>(
+                sycl::nd_range<1>({n_work_groups * work_group_size}, {work_group_size}),
+                [=](sycl::nd_item<1> it) {
+                    auto group = it.get_group();
+                    size_t local_id = it.get_local_id(0);
+
+                    size_t first_tile = (tile_offsets) ? it.get_group(0) : 0;
+                    size_t last_tile = (tile_offsets) ? first_tile + 1 : n_tiles;
+                    T carry = (tile_offsets) ? tile_offsets[first_tile] : T(0);
+
+                    for(size_t tile_idx = first_tile; tile_idx < last_tile; ++tile_idx) {
+                        for(size_t r = 0; r < scan_items_per_work_item; ++r) {
+                            size_t i = tile_idx * tile_size + r * work_group_size + local_id;
+                            T value = (i < n_items) ? load(i) : T(0);
+
+                            T prefix = carry + sycl::exclusive_scan_over_group(group, value, sycl::plus<T>());
+                            carry += sycl::reduce_over_group(group, value, sycl::plus<T>());
+
+                            if (i < n_items) {
+                                store(i, prefix, value);
+                            }
+                        }
+                    }
+
+                    if (!tile_offsets && total && local_id == 0) {
+                        *total = carry;
+                    }
+                }
+            );
+        });
+    if (first_ev && !tile_offsets) {
+        *first_ev = tiles_ev;
+    }
+
+    return tiles_ev;
+}
+
+template <typename T>
+struct _scan_load_array {
+    T const *in;
+
+    T operator()(size_t i) const { return in[i]; }
+};
+
+template <typename T, bool inclusive>
+struct _scan_store_array {
+    T *out;
+
+    void operator()(size_t i, T prefix, T value) const { out[i] = (inclusive) ? prefix + value : prefix; }
+};
+
+/* @brief out[i] = in[0] + ... + in[i - 1], and total = in[0] + ... +
+   in[n_items - 1] when total is not null. `out` may be `in`. */
+template <typename T>
+sycl::event
+exclusive_scan_kernel(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    //
+    T const *in,      // IN              (n_items,)
+    T *out,           // OUT             (n_items,)
+    T *total,         // OUT, nullable   (1,)
+    void *scratch,    // SCRATCH, nullable (scan_scratch_size bytes)
+    const std::vector<sycl::event> &depends = {}
+) {
+    return _scan_tiles<T>(
+        q, n_items, work_group_size,
+        _scan_load_array<T>{in}, _scan_store_array<T, false>{out},
+        total, scratch, depends);
+}
+
+/* @brief out[i] = in[0] + ... + in[i], and total = in[0] + ... +
+   in[n_items - 1] when total is not null. `out` may be `in`. */
+template <typename T>
+sycl::event
+inclusive_scan_kernel(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    //
+    T const *in,      // IN              (n_items,)
+    T *out,           // OUT             (n_items,)
+    T *total,         // OUT, nullable   (1,)
+    void *scratch,    // SCRATCH, nullable (scan_scratch_size bytes)
+    const std::vector<sycl::event> &depends = {}
+) {
+    return _scan_tiles<T>(
+        q, n_items, work_group_size,
+        _scan_load_array<T>{in}, _scan_store_array<T, true>{out},
+        total, scratch, depends);
+}
+
+template <typename indT, typename PredicateT>
+struct _compaction_load {
+    PredicateT predicate;
+
+    indT operator()(size_t i) const { return (predicate(i)) ? indT(1) : indT(0); }
+};
+
+template <typename indT, typename WriterT>
+struct _compaction_store {
+    WriterT write;
+
+    void operator()(size_t i, indT rank, indT selected) const {
+        if (selected) {
+            write(rank, i);
+        }
+    }
+};
+
+/* @brief Stream compaction of [0, n_items): write(rank, i) is called for
+   each i such that predicate(i) is true, with rank the number of such
+   indices before i, and their number is written to n_selected.
+
+   PredicateT and WriterT name kernels, they are functors declared at
+   namespace scope. When given, `first_ev` is set to the event of the first
+   kernel submitted.
+ */
+template <typename indT, typename PredicateT, typename WriterT>
+sycl::event
+stream_compaction_kernel(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    //
+    PredicateT predicate,
+    WriterT write,
+    indT *n_selected,  // OUT   (1,)
+    void *scratch,     // SCRATCH, nullable (scan_scratch_size<indT> bytes)
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    return _scan_tiles<indT>(
+        q, n_items, work_group_size,
+        _compaction_load<indT, PredicateT>{predicate}, _compaction_store<indT, WriterT>{write},
+        n_selected, scratch, depends, first_ev);
+}
+
+template <typename indT>
+struct compaction_output {
+    indT *selected_idx;
+
+    void operator()(indT rank, size_t i) const { selected_idx[rank] = static_cast<indT>(i); }
+};
+
+/* @brief Writes indices i in [0, n_items) such that predicate(i) is true to
+   selected_idx, in increasing order, and their number to n_selected. */
+template <typename indT, typename PredicateT>
+sycl::event
+compact_indices_kernel(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    //
+    PredicateT predicate,
+    indT *selected_idx,  // OUT   (n_items,)
+    indT *n_selected,    // OUT   (1,)
+    void *scratch,       // SCRATCH, nullable (scan_scratch_size<indT> bytes)
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    return stream_compaction_kernel<indT>(
+        q, n_items, work_group_size,
+        predicate, compaction_output<indT>{selected_idx},
+        n_selected, scratch, depends, first_ev);
+}
+
+template <typename indT, typename WriterT>
+struct _partition_store {
+    WriterT write;
+    size_t n_items;
+
+    void operator()(size_t i, indT rank, indT selected) const {
+        if (selected) {
+            write(static_cast<size_t>(rank), i);
+        } else {
+            write(n_items - 1 - (i - static_cast<size_t>(rank)), i);
+        }
+    }
+};
+
+/* @brief Partition of [0, n_items): write(pos, i) is called for every i, with
+   indices such that predicate(i) is true at positions [0, n_selected) in
+   increasing order, and the others at positions [n_selected, n_items) in
+   decreasing order. Their number is written to n_selected.
+
+   PredicateT and WriterT name kernels, they are functors declared at
+   namespace scope.
+ */
+template <typename indT, typename PredicateT, typename WriterT>
+sycl::event
+partition_kernel(
+    sycl::queue q,
+    size_t n_items,
+    size_t work_group_size,
+    //
+    PredicateT predicate,
+    WriterT write,
+    indT *n_selected,  // OUT   (1,)
+    void *scratch,     // SCRATCH, nullable (scan_scratch_size<indT> bytes)
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    return _scan_tiles<indT>(
+        q, n_items, work_group_size,
+        _compaction_load<indT, PredicateT>{predicate}, _partition_store<indT, WriterT>{write, n_items},
+        n_selected, scratch, depends, first_ev);
+}
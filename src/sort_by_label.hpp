@@ -0,0 +1,211 @@
+// sort_by_label.hpp
+//
+// Contention-free alternative to the atomic accumulation of new centroid data
+// in lloyd_single_step: indices of samples are sorted by label (see
+// radix_sort.hpp), so that the samples of each cluster are contiguous, and
+// sums of clusters are then computed by a segmented reduction. No two work-items ever update the same
+// value, and results do not depend on the scheduling of work-items, which
+// pays off when a few clusters hold most samples and their atomics contend.
+
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "quotients_utils.hpp"
+#include "device_functions.hpp"
+#include "radix_sort.hpp"
+
+// label of no run, in carries of segmented_centroid_sums_kernel
+constexpr std::uint32_t no_label = std::numeric_limits<std::uint32_t>::max();
+
+/* @brief Number of bytes of the scratch of sort_samples_by_label */
+template <typename indT>
+size_t sort_samples_by_label_scratch_size(size_t n_samples, size_t work_group_size) {
+    return radix_sort_scratch_size<indT, std::uint32_t>(n_samples, work_group_size);
+}
+
+/* @brief Indices of samples sorted by label, samples of a same cluster in
+   increasing order, with a radix sort over the bits of labels in
+   [0, n_clusters) only. n_samples must fit in std::uint32_t. `scratch` holds
+   sort_samples_by_label_scratch_size(n_samples, work_group_size) bytes.
+   When given, `first_ev` is set to the event of the first command submitted.
+ */
+template <typename indT>
+sycl::event
+sort_samples_by_label(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_clusters,
+    size_t work_group_size,
+    //
+    indT const *assignment_idx,        // IN   (n_samples,)
+    std::uint32_t *sorted_sample_idx,  // OUT  (n_samples,)
+    void *scratch,                     // SCRATCH
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    unsigned n_label_bits = 1;
+    while ((n_label_bits < 32) && ((size_t(1) << n_label_bits) < n_clusters)) {
+        ++n_label_bits;
+    }
+
+    // values are indices of samples, sorted labels themselves are not needed
+    return radix_sort_pairs<indT, std::uint32_t>(
+        q, n_samples, work_group_size,
+        assignment_idx, nullptr, nullptr, sorted_sample_idx, scratch,
+        false, depends, n_label_bits, first_ev);
+}
+
+/* @brief Length of the ranges of sorted samples reduced by each work-item of
+   segmented_centroid_sums_kernel, which balances the length of a range with
+   the number of carries that are summed sequentially, two per range. */
+inline size_t segmented_centroid_sums_chunk_size(size_t n_samples) {
+    return std::max<size_t>(64, static_cast<size_t>(std::sqrt(2.0 * static_cast<double>(n_samples))));
+}
+
+template <typename dataT, typename indT, typename accT, bool X_row_major>
+class segmented_centroid_sums_krn;
+
+template <typename dataT, typename indT, typename accT, bool X_row_major>
+class sum_segment_carries_krn;
+
+/* @brief Adds weighted sums of samples, and of their weights, of each cluster
+   to centroids_t_sums and cluster_sizes_sums, given indices of samples sorted
+   by label (see sort_samples_by_label). Sums are accumulated in accT.
+
+   Sorted samples are split in ranges of `chunk_size`, a work-item sums a
+   feature over a range. A run of samples of a cluster that does not extend to
+   a neighbouring range holds all samples of its cluster, its sum is added in
+   place. The (at most two) runs of a range that do are carried, and sums of
+   carries are added in order of ranges by a second kernel.
+
+   When X_row_major is true, X_t is instead expected to be X with shape
+   (n_samples, n_features). When given, `first_ev` is set to the event of the
+   first kernel submitted.
+ */
+template <typename dataT, typename indT, typename accT = dataT, bool X_row_major = false>
+sycl::event
+segmented_centroid_sums_kernel(
+    sycl::queue q,
+    size_t n_samples,
+    size_t n_features,
+    size_t n_clusters,
+    size_t chunk_size,
+    //
+    dataT const *X_t,                       // IN    (n_features, n_samples) or (n_samples, n_features)
+    dataT const *sample_weight,             // IN    (n_samples,)
+    indT const *assignment_idx,             // IN    (n_samples,)
+    std::uint32_t const *sorted_sample_idx, // IN    (n_samples,)
+    accT *centroids_t_sums,                 // INOUT (n_features, n_clusters)
+    accT *cluster_sizes_sums,               // INOUT (n_clusters,)
+    std::uint32_t *carry_labels,            // SCRATCH (n_chunks, 2)
+    accT *carry_sums,                       // SCRATCH (n_chunks, 2, n_features + 1)
+    const std::vector<sycl::event> &depends = {},
+    sycl::event *first_ev = nullptr
+) {
+    size_t n_chunks = quotient_ceil(n_samples, chunk_size);
+    // the last sum of a range is the one of weights, i.e. of cluster sizes
+    size_t n_sums = n_features + 1;
+
+    auto sum_ptr = [=](size_t sum_idx, std::uint32_t label) {
+        return (sum_idx < n_features) ?
+            centroids_t_sums + sum_idx * n_clusters + label : cluster_sizes_sums + label;
+    };
+
+    sycl::event sums_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+
+            cgh.parallel_for<class segmented_centroid_sums_krn<dataT, indT, accT, X_row_major>>(
+                sycl::range<1>(n_chunks * n_sums),
+                [=](sycl::id<1> wid) {
+                    size_t chunk_idx = wid[0] / n_sums;
+                    size_t sum_idx = wid[0] % n_sums;
+
+                    size_t first = chunk_idx * chunk_size;
+                    size_t last = sycl::min(first + chunk_size, n_samples);
+
+                    auto label_at = [&](size_t pos) {
+                        return static_cast<std::uint32_t>(assignment_idx[sorted_sample_idx[pos]]);
+                    };
+
+                    auto value_at = [&](size_t pos) {
+                        size_t sample_idx = sorted_sample_idx[pos];
+                        accT weight = static_cast<accT>(sample_weight[sample_idx]);
+                        if (sum_idx == n_features) {
+                            return weight;
+                        }
+                        return static_cast<accT>(
+                            X_t[_X_index<X_row_major>(n_samples, n_features, sample_idx, sum_idx)]) * weight;
+                    };
+
+                    std::uint32_t previous_label = (first > 0) ? label_at(first - 1) : no_label;
+                    std::uint32_t next_label = (last < n_samples) ? label_at(last) : no_label;
+
+                    if (sum_idx == 0) {
+                        carry_labels[2 * chunk_idx] = no_label;
+                        carry_labels[2 * chunk_idx + 1] = no_label;
+                    }
+
+                    std::uint32_t run_label = label_at(first);
+                    size_t run_first = first;
+                    accT run_sum(0);
+
+                    auto end_run = [&](size_t run_last) {
+                        bool carried_from_previous = (run_first == first) && (run_label == previous_label);
+                        bool carried_to_next = (run_last == last) && (run_label == next_label);
+
+                        if (carried_from_previous || carried_to_next) {
+                            size_t carry_idx = 2 * chunk_idx + ((carried_from_previous) ? 0 : 1);
+                            carry_sums[carry_idx * n_sums + sum_idx] = run_sum;
+                            if (sum_idx == 0) {
+                                carry_labels[carry_idx] = run_label;
+                            }
+                        } else {
+                            *sum_ptr(sum_idx, run_label) += run_sum;
+                        }
+                    };
+
+                    for(size_t pos = first; pos < last; ++pos) {
+                        std::uint32_t label = label_at(pos);
+                        if (label != run_label) {
+                            end_run(pos);
+                            run_label = label;
+                            run_first = pos;
+                            run_sum = accT(0);
+                        }
+                        run_sum += value_at(pos);
+                    }
+                    end_run(last);
+                }
+            );
+        });
+    if (first_ev) {
+        *first_ev = sums_ev;
+    }
+
+    sycl::event carries_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(sums_ev);
+
+            cgh.parallel_for<class sum_segment_carries_krn<dataT, indT, accT, X_row_major>>(
+                sycl::range<1>(n_sums),
+                [=](sycl::id<1> wid) {
+                    size_t sum_idx = wid[0];
+                    for(size_t carry_idx = 0; carry_idx < 2 * n_chunks; ++carry_idx) {
+                        std::uint32_t label = carry_labels[carry_idx];
+                        if (label != no_label) {
+                            *sum_ptr(sum_idx, label) += carry_sums[carry_idx * n_sums + sum_idx];
+                        }
+                    }
+                }
+            );
+        });
+
+    return carries_ev;
+}
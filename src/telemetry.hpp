@@ -0,0 +1,39 @@
+// telemetry.hpp
+//
+// Metrics reported by drivers to an optional callback at the end of every
+// Lloyd iteration. They only rely on values the driver brings to the host
+// anyway, so reporting them adds no device synchronization.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+struct lloyd_iteration_metrics {
+    size_t iteration;
+    double centroid_shifts_sum;
+    size_t n_empty_clusters;
+    // number of samples whose label differs from the one held by assignment_id
+    // before the iteration
+    size_t n_changed_labels;
+
+    // host wall-clock timings of the phases of the iteration, in nanoseconds,
+    // delimited by synchronizations the driver performs regardless
+    double lloyd_step_ns;      // until cluster sizes and empty clusters are known
+    double inertia_ns;         // inertia reported to print_func, 0 unless verbose
+    double update_ns;          // relocation, division and centroid shifts
+};
+
+/* @brief Default callback, disables collection of metrics */
+struct no_iteration_callback {
+    void operator()(const lloyd_iteration_metrics &) const {}
+};
+
+template <typename IterationCallbackT>
+bool iteration_callback_enabled(const IterationCallbackT &) { return true; }
+
+inline bool iteration_callback_enabled(const no_iteration_callback &) { return false; }
+
+inline bool iteration_callback_enabled(const std::function<void(const lloyd_iteration_metrics &)> &cb) {
+    return static_cast<bool>(cb);
+}
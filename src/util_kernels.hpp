@@ -1,10 +1,13 @@
 #pragma once
 
 #include <CL/sycl.hpp>
+#include <algorithm>
 #include <vector>
 #include <cstdint>
 #include "quotients_utils.hpp"
-#include "iterative_merge_sort.hpp"
+#include "device_functions.hpp"
+#include "radix_sort.hpp"
+#include "scan_kernels.hpp"
 
 template <typename T>
 sycl::event
@@ -81,10 +84,71 @@ half_l2_norm_kernel(
     return res_ev;
 }
 
-template<typename dataT, typename indT>
+template <typename T>
+class l2_normalize_krn;
+
+/* @brief Scales columns of centroids_t to unit L2 norm, zero columns are left as is */
+template <typename T>
+sycl::event
+l2_normalize_kernel(
+    sycl::queue q,
+    size_t n_features,
+    size_t n_clusters,
+    size_t work_group_size,
+    //
+    T *centroids_t,              // IN & OUT  (n_features, n_clusters)
+    const std::vector<sycl::event> &depends = {}
+) {
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(depends);
+            size_t global_size = quotient_ceil(n_clusters, work_group_size) * work_group_size;
+            cgh.parallel_for<class l2_normalize_krn<T>>(
+                sycl::nd_range<1>(global_size, work_group_size),
+                [=](sycl::nd_item<1> it) {
+                    auto col_idx = it.get_global_linear_id();
+                    if (col_idx < n_clusters) {
+                        T l2_norm(0);
+                        for(size_t row_idx=0; row_idx < n_features; ++row_idx) {
+                            T item = centroids_t[n_clusters * row_idx + col_idx];
+                            l2_norm += item * item;
+                        }
+
+                        if (l2_norm > T(0)) {
+                            T inv_norm = sycl::rsqrt(l2_norm);
+                            for(size_t row_idx=0; row_idx < n_features; ++row_idx) {
+                                centroids_t[n_clusters * row_idx + col_idx] *= inv_norm;
+                            }
+                        }
+                    }
+                }
+            );
+        });
+
+    return res_ev;
+}
+
+template<typename dataT, typename indT, typename accT>
 class reduce_centroid_data_krn;
 
-template<typename dataT, typename indT>
+template <typename dataT>
+struct _is_empty_cluster {
+    dataT const *cluster_sizes;
+
+    bool operator()(size_t cluster_idx) const { return cluster_sizes[cluster_idx] == dataT(0); }
+};
+
+/* @brief Sums private copies of centroids and cluster sizes, and lists empty
+   clusters in increasing order.
+
+   Private copies may be accumulated in a wider type accT, in which case the
+   sums are computed in accT and only down-cast to dataT when written out.
+
+   When `reset_private_copies` is true, private copies are zeroed once read,
+   ready for the next accumulation, which spares a fill of them. When given,
+   `first_ev` is set to the event of the first kernel submitted.
+ */
+template<typename dataT, typename indT, typename accT = dataT>
 sycl::event
 reduce_centroid_data_kernel(
     sycl::queue q,
@@ -93,13 +157,15 @@ reduce_centroid_data_kernel(
     size_t n_clusters,
     size_t work_group_size,
     //
-    dataT const *cluster_sizes_private_copies, // IN  (n_copies, n_clusters)
-    dataT const *centroids_t_private_copies,   // IN  (n_copies, n_features, n_clusters)
+    accT *cluster_sizes_private_copies, // IN, zeroed if reset_private_copies  (n_copies, n_clusters)
+    accT *centroids_t_private_copies,   // IN, zeroed if reset_private_copies  (n_copies, n_features, n_clusters)
     dataT *cluster_sizes,         // OUT  (n_clusters)
     dataT *centroids_t,           // OUT  (n_features, n_clusters,)
     indT *empty_clusters_list,    // OUT  (n_clusters,)
     indT *n_empty_clusters,       // OUT  (1,)
-    const std::vector<sycl::event> &depends = {}
+    const std::vector<sycl::event> &depends = {},
+    bool reset_private_copies = false,
+    sycl::event *first_ev = nullptr
 ) {
 
     sycl::event res_ev =
@@ -111,7 +177,7 @@ reduce_centroid_data_kernel(
             size_t n_work_items_for_clusters = n_work_groups_for_clusters * work_group_size;
             size_t gws = n_work_items_for_clusters * n_features;
 
-            cgh.parallel_for<class reduce_centroid_data_krn<dataT, indT>>(
+            cgh.parallel_for<class reduce_centroid_data_krn<dataT, indT, accT>>(
                 sycl::nd_range<1>({gws}, {work_group_size}),
                 [=](sycl::nd_item<1> it) {
                     size_t group_idx = it.get_group(0);
@@ -123,41 +189,45 @@ reduce_centroid_data_kernel(
 
                     if (cluster_idx < n_clusters) {
                         {
-                            dataT sum_(0);
+                            accT sum_(0);
                             size_t offset = feature_idx * n_clusters +
                                     cluster_idx;
                             size_t step = n_features * n_clusters;
                             for(size_t copy_idx = 0; copy_idx < n_centroids_private_copies; ++copy_idx) {
                                 sum_ += centroids_t_private_copies[copy_idx * step + offset];
+                                if (reset_private_copies) {
+                                    centroids_t_private_copies[copy_idx * step + offset] = accT(0);
+                                }
                             }
-                            centroids_t[offset] = sum_;
+                            centroids_t[offset] = static_cast<dataT>(sum_);
                         }
 
                         if (feature_idx == 0) {
-                            dataT sum_(0);
+                            accT sum_(0);
                             for(size_t copy_idx = 0; copy_idx < n_centroids_private_copies; ++copy_idx) {
                                 sum_ += cluster_sizes_private_copies[copy_idx * n_clusters + cluster_idx];
+                                if (reset_private_copies) {
+                                    cluster_sizes_private_copies[copy_idx * n_clusters + cluster_idx] = accT(0);
+                                }
                             }
-                            cluster_sizes[cluster_idx] = sum_;
-
-                            // FIXME: this is race condition
-                            if (sum_ == 0) {
-                                sycl::atomic_ref<
-                                    indT,
-                                    sycl::memory_order::relaxed,
-                                    sycl::memory_scope::device,
-                                    sycl::access::address_space::global_space> v(
-                                        n_empty_clusters[0]);
-                                indT i = v.fetch_add(indT(1));
-                                empty_clusters_list[i] = cluster_idx;
-                            }
+                            cluster_sizes[cluster_idx] = static_cast<dataT>(sum_);
                         }
                     }
                 }
             );
         });
+    if (first_ev) {
+        *first_ev = res_ev;
+    }
 
-    return res_ev;
+    // a single work-group scans the few cluster sizes, no scratch is needed
+    sycl::event empty_clusters_ev =
+        compact_indices_kernel<indT>(
+            q, n_clusters, work_group_size,
+            _is_empty_cluster<dataT>{cluster_sizes},
+            empty_clusters_list, n_empty_clusters, nullptr, {res_ev});
+
+    return empty_clusters_ev;
 }
 
 template <typename dataT>
@@ -187,26 +257,79 @@ compute_threshold_kernel(
             });
         return res_ev;
     } else {
+        size_t work_group_size = std::min<size_t>(
+            256, q.get_device().get_info<sycl::info::device::max_work_group_size>());
+
         dataT *temp_output = sycl::malloc_device<dataT>(n_samples, q);
+        char *sort_scratch = sycl::malloc_device<char>(
+            radix_sort_scratch_size<dataT>(n_samples, work_group_size), q);
 
+        // n_empty_clusters-th largest value, in descending order
         sycl::event sort_ev =
-            iterative_merge_sort(q, data, temp_output, n_samples, depends);
+            radix_sort_pairs<dataT, std::uint32_t>(
+                q, n_samples, work_group_size,
+                data, nullptr, temp_output, nullptr, sort_scratch,
+                true, depends);
 
-        sycl::event copy_ev = q.copy<dataT>(temp_output + n_samples - n_empty_clusters, threshold, 1, {sort_ev});
+        sycl::event copy_ev = q.copy<dataT>(temp_output + n_empty_clusters - 1, threshold, 1, {sort_ev});
 
-        // asynchronously free temporary
+        // asynchronously free temporaries
         q.submit([&](sycl::handler &cgh) {
             cgh.depends_on(copy_ev);
             auto ctx = q.get_context();
-            cgh.host_task([ctx, temp_output] { sycl::free(temp_output, ctx); });
+            cgh.host_task([ctx, temp_output, sort_scratch] {
+                sycl::free(temp_output, ctx);
+                sycl::free(sort_scratch, ctx);
+            });
         });
 
         return copy_ev;
     }
 }
 
+template <typename dataT, bool greater>
+struct _compares_to_threshold {
+    dataT const *distance_to_centroid;
+    dataT const *threshold;
+
+    bool operator()(size_t sample_idx) const {
+        return (greater) ?
+            (distance_to_centroid[sample_idx] > threshold[0]) : (distance_to_centroid[sample_idx] == threshold[0]);
+    }
+};
+
+// indices of samples equal to threshold are written from the end, as long as
+// fewer than n_empty_clusters samples are selected
+template <typename indT>
+struct _select_from_end {
+    indT *selected_samples_idx;
+    indT const *n_selected_gt_threshold;
+    size_t n_samples;
+    size_t n_empty_clusters;
+
+    void operator()(indT rank, size_t sample_idx) const {
+        if (static_cast<size_t>(rank + n_selected_gt_threshold[0]) < n_empty_clusters) {
+            selected_samples_idx[n_samples - 1 - rank] = static_cast<indT>(sample_idx);
+        }
+    }
+};
+
 template <typename dataT, typename indT>
-class select_samples_far_from_cetrnoids_krn;
+class clip_n_selected_eq_threshold_krn;
+
+/* @brief Number of bytes of the scratch of select_samples_far_from_centroid_kernel */
+template <typename indT>
+size_t select_samples_far_from_centroid_scratch_size(size_t n_samples, size_t work_group_size) {
+    return scan_scratch_size<indT>(n_samples, work_group_size);
+}
+
+/* @brief Position in selected_samples_idx of select_samples_far_from_centroid_kernel
+   of the relocated_idx-th selected sample. */
+template <typename indT>
+inline size_t selected_sample_position(size_t relocated_idx, indT n_selected_gt_threshold, size_t n_samples) {
+    size_t n_gt = static_cast<size_t>(n_selected_gt_threshold);
+    return (relocated_idx < n_gt) ? (n_gt - 1 - relocated_idx) : (n_samples - 1 - (relocated_idx - n_gt));
+}
 
 template <typename dataT, typename indT>
 sycl::event
@@ -221,6 +344,7 @@ select_samples_far_from_centroid_kernel(
     indT *selected_samples_idx,        // OUT (n_samples,)
     indT *n_selected_gt_threshold,     // OUT (1,)
     indT *n_selected_eq_threshold,     // OUT (1,)
+    void *scratch,                     // SCRATCH (select_samples_far_from_centroid_scratch_size bytes)
     const std::vector<sycl::event> &depends = {}
 ) {
     /*
@@ -232,63 +356,36 @@ select_samples_far_from_centroid_kernel(
     threshold, and at least n_selected values that are greater or equal than
     threshold.
 
-    Because the exact number of values strictly equal to the threshold is not known
-    and that the goal is to select the top n_selected greater items above threshold,
-    we write indices of values strictly greater than threshold at the beginning of
-    the selected_samples_idx, and indices of values equal to threshold at the end
-    of the selected_samples_idx array.
+    Indices of values strictly greater than threshold are written at the
+    beginning of selected_samples_idx, in increasing order, and the first
+    indices of values equal to threshold that complete the selection at the
+    end of selected_samples_idx, in increasing order from the last item
+    backwards. Both are stream compactions, n_selected_eq_threshold is one more
+    than the number of indices written at the end.
     */
 
-    sycl::event res_ev =
-        q.submit([&](sycl::handler &cgh) {
-            cgh.depends_on(depends);
+    sycl::event gt_ev =
+        compact_indices_kernel<indT>(
+            q, n_samples, work_group_size,
+            _compares_to_threshold<dataT, true>{distance_to_centroid, threshold},
+            selected_samples_idx, n_selected_gt_threshold, scratch, depends);
 
-            cgh.parallel_for<class select_samples_far_from_cetrnoids_krn<dataT, indT>>(
-                {n_samples},
-                [=](sycl::id<1> wid) {
-                    size_t sample_idx = wid[0];
-                    if (sample_idx >= n_samples)
-                        return;
+    sycl::event eq_ev =
+        stream_compaction_kernel<indT>(
+            q, n_samples, work_group_size,
+            _compares_to_threshold<dataT, false>{distance_to_centroid, threshold},
+            _select_from_end<indT>{selected_samples_idx, n_selected_gt_threshold, n_samples, n_empty_clusters},
+            n_selected_eq_threshold, scratch, {gt_ev});
 
-                    indT n_selected_gt_threshold_ = n_selected_gt_threshold[0];
-                    indT n_selected_eq_threshold_ = n_selected_eq_threshold[0];
-                    indT max_n_selected_gt_threshold = n_empty_clusters - 1;
-                    indT min_n_selected_eq_threshold = 2;
-                    indT max_n_selected_eq_threshold = n_empty_clusters + 1;
-
-                    if ((n_selected_gt_threshold_ == max_n_selected_gt_threshold) && (n_selected_eq_threshold_ >= min_n_selected_eq_threshold))
-                        return;
-
-                    dataT threshold_ = threshold[0];
-                    dataT distance_to_centroid_ = distance_to_centroid[sample_idx];
-
-                    if (distance_to_centroid_ < threshold_) {
-                        return;
-                    } else if(distance_to_centroid_ > threshold_) {
-                        auto atomic_n_selected_gt_threshold =
-                        sycl::atomic_ref<
-                            indT,
-                            sycl::memory_order::relaxed,
-                            sycl::memory_scope::device,
-                            sycl::access::address_space::global_space>(n_selected_gt_threshold[0]);
-                        indT selected_idx = atomic_n_selected_gt_threshold.fetch_add(1);
-                        selected_samples_idx[selected_idx] = sample_idx;
-
-                        return;
-                    } else {
-                        if (n_selected_eq_threshold_ >= max_n_selected_eq_threshold)
-                            return;
-
-                        auto atomic_n_selected_eq_threshold =
-                        sycl::atomic_ref<
-                            indT,
-                            sycl::memory_order::relaxed,
-                            sycl::memory_scope::device,
-                            sycl::access::address_space::global_space>(n_selected_eq_threshold[0]);
+    sycl::event res_ev =
+        q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(eq_ev);
 
-                        indT selected_idx = n_samples - atomic_n_selected_eq_threshold.fetch_add(1);
-                        selected_samples_idx[selected_idx] = sample_idx;
-                    }
+            cgh.parallel_for<class clip_n_selected_eq_threshold_krn<dataT, indT>>(
+                sycl::range<1>(1),
+                [=](sycl::id<1>) {
+                    indT n_missing = static_cast<indT>(n_empty_clusters) - n_selected_gt_threshold[0];
+                    n_selected_eq_threshold[0] = sycl::min(n_selected_eq_threshold[0], sycl::max(n_missing, indT(0))) + 1;
                 }
             );
         });
@@ -296,10 +393,10 @@ select_samples_far_from_centroid_kernel(
     return res_ev;
 }
 
-template <typename dataT, typename indT>
+template <typename dataT, typename indT, bool X_row_major>
 class relocate_empty_clusters_krn;
 
-template <typename dataT, typename indT>
+template <typename dataT, typename indT, bool X_row_major = false>
 sycl::event
 relocate_empty_clusters_kernel(
     sycl::queue q,
@@ -310,7 +407,7 @@ relocate_empty_clusters_kernel(
     indT const *n_selected_gt_threshold,   // USM pointer
     size_t work_group_size,
     //
-    dataT const *X_t,                  // IN, READ ONLY (n_features, n_samples,)
+    dataT const *X_t,                  // IN, READ ONLY (n_features, n_samples,) or (n_samples, n_features) if X_row_major
     dataT const *sample_weight,        // IN, READ ONLY (n_samples,)
     indT const *assignment_id,            // IN  (n_samples,)
     indT const *samples_far_from_center,  // IN  (n_samples, )
@@ -337,7 +434,7 @@ relocate_empty_clusters_kernel(
             // before q.submit call.
             sycl::stream out(16, 8, cgh);
 
-            cgh.parallel_for<class relocate_empty_clusters_krn<dataT, indT>>(
+            cgh.parallel_for<class relocate_empty_clusters_krn<dataT, indT, X_row_major>>(
                 sycl::nd_range<1>({global_size}, {work_group_size}),
                 [=](sycl::nd_item<1> wit) {
                     size_t group_idx = wit.get_group(0);
@@ -351,11 +448,11 @@ relocate_empty_clusters_kernel(
                     indT relocated_cluster_idx = empty_clusters_list[relocated_idx];
                     indT n_selected_gt_threshold_ = n_selected_gt_threshold[0];
 
-		            size_t index = (n_selected_gt_threshold_ == 0) ? (n_samples - 1) : (n_selected_gt_threshold_ - 1 - relocated_idx);
+                    size_t index = selected_sample_position(relocated_idx, n_selected_gt_threshold_, n_samples);
                     indT new_location_X_idx = samples_far_from_center[index];
                     indT new_location_previous_assignment = assignment_id[new_location_X_idx];
 
-                    dataT new_centroid_value = X_t[feature_idx * n_samples + new_location_X_idx];
+                    dataT new_centroid_value = X_t[_X_index<X_row_major>(n_samples, n_features, new_location_X_idx, feature_idx)];
                     dataT new_location_weight = sample_weight[new_location_X_idx];
                     dataT X_centroid_addend = new_centroid_value * new_location_weight;
 
@@ -387,7 +484,7 @@ relocate_empty_clusters_kernel(
     return res_ev;
 }
 
-template <typename dataT, typename indT>
+template <typename dataT, typename indT, bool X_row_major = false>
 sycl::event
 relocate_empty_clusters(
     sycl::queue q,
@@ -397,7 +494,7 @@ relocate_empty_clusters(
     size_t work_group_size,
     //
     size_t n_empty_clusters,
-    dataT const *X_t,                          // IN (n_features, n_samples)
+    dataT const *X_t,                          // IN (n_features, n_samples) or (n_samples, n_features) if X_row_major
     dataT const *sample_weight,                // IN (n_samples, )
     indT const *assignment_id,                 // IN (n_samples, )
     indT const *empty_clusters_list,           // IN (n_clusters, )
@@ -415,14 +512,15 @@ relocate_empty_clusters(
     sycl::event compute_threshold_ev =
         compute_threshold_kernel(q, n_samples, sq_dist_to_nearest_centroid, n_empty_clusters, threshold, depends);
 
-    indT *samples_far_from_center = sycl::malloc_device<indT>(n_samples + 2, q);
+    // scratch of the selection, in multiples of indT, follows the counters
+    size_t n_select_scratch = quotient_ceil<size_t>(
+        select_samples_far_from_centroid_scratch_size<indT>(n_samples, work_group_size), sizeof(indT));
+    indT *samples_far_from_center = sycl::malloc_device<indT>(n_samples + 2 + n_select_scratch, q);
     indT *n_selected = samples_far_from_center + n_samples;
 
     indT *n_selected_gt_threshold = n_selected;
     indT *n_selected_eq_threshold = n_selected + 1;
-
-    indT zero_one[2] = {0, 1};
-    sycl::event n_selected_pop_ev = q.copy<indT>(&zero_one[0], n_selected, 2);
+    indT *select_scratch = n_selected + 2;
 
     sycl::event select_samples_far_from_centroid_ev =
         select_samples_far_from_centroid_kernel<dataT, indT>(
@@ -434,11 +532,12 @@ relocate_empty_clusters(
             samples_far_from_center,     // OUT (n_samples,)
             n_selected_gt_threshold,     // OUT (1,)
             n_selected_eq_threshold,     // OUT (1,)
-            {compute_threshold_ev, n_selected_pop_ev}
+            select_scratch,              // SCRATCH
+            {compute_threshold_ev}
         );
 
     sycl::event relocate_empty_cluster_ev =
-        relocate_empty_clusters_kernel<dataT, indT>(
+        relocate_empty_clusters_kernel<dataT, indT, X_row_major>(
             q,
             n_samples,
             n_features,
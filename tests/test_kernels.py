@@ -122,6 +122,44 @@ def test_reduce_centroids_data_empty():
         dpt.asnumpy(out_cluster_sizes), dpt.asnumpy(cluster_sizes_private_copies).sum(axis=0))
 
 
+def test_reduce_centroids_data_empty_clusters_in_order():
+    n_copies = 2
+    n_features = 3
+    # clusters span several tiles of the compaction of empty clusters
+    n_clusters = 5000
+
+    dataT = np.dtype('f4')
+    indT = np.dtype('i4')
+
+    sizes_np = np.random.randint(1, 5, size=(n_copies, n_clusters)).astype(dataT)
+    empty_clusters = np.sort(np.random.choice(n_clusters, size=700, replace=False))
+    sizes_np[:, empty_clusters] = 0
+    cluster_sizes_private_copies = dpt.asarray(sizes_np, dtype=dataT)
+    centroids_t_private_copies = dpt.zeros((n_copies, n_features, n_clusters), dtype=dataT)
+
+    out_cluster_sizes = dpt.empty(n_clusters, dtype=dataT)
+    out_centroids_t = dpt.empty((n_features, n_clusters,), dtype=dataT)
+    out_empty_clusters_list = dpt.full((n_clusters,), -1, dtype=indT)
+    out_n_empty_clusters = dpt.zeros((1,), dtype=indT)
+
+    q = cluster_sizes_private_copies.sycl_queue
+    ht, _, = kdp.reduce_centroids_data(
+        cluster_sizes_private_copies,
+        centroids_t_private_copies,
+        out_cluster_sizes,
+        out_centroids_t,
+        out_empty_clusters_list,
+        out_n_empty_clusters,
+        work_group_size=128,
+        sycl_queue=q
+    )
+    ht.wait()
+
+    n_empty = int(out_n_empty_clusters)
+    assert n_empty == empty_clusters.shape[0]
+    assert np.array_equal(dpt.asnumpy(out_empty_clusters_list)[:n_empty], empty_clusters)
+
+
 def test_compute_threshold():
     dataT = dpt.float32
     n = 10**5
@@ -142,6 +180,29 @@ def test_compute_threshold():
     assert float(threshold) == float(np.partition(Xnp, kth = n - 2)[n-2])
 
 
+@pytest.mark.parametrize("dataT", [dpt.float32, dpt.float64])
+@pytest.mark.parametrize("descending", [False, True])
+def test_radix_sort(dataT, descending):
+    n = 10**5 + 17
+    indT = dpt.int32
+    # ties, and negative numbers, but no zero of either sign
+    Xnp = (np.random.randint(-500, 500, size=n) + 0.5).astype(dataT)
+    Xnp[:100] = np.random.randn(100)
+
+    keys = dpt.asarray(Xnp, dtype=dataT)
+    sorted_keys = dpt.empty(n, dtype=dataT)
+    sorted_idx = dpt.empty(n, dtype=indT)
+
+    q = keys.sycl_queue
+    ht, _ = kdp.radix_sort(
+        keys, sorted_keys, sorted_idx, 256, sycl_queue=q, descending=descending)
+    ht.wait()
+
+    expected_idx = np.argsort(-Xnp if descending else Xnp, kind="stable")
+    assert np.array_equal(dpt.asnumpy(sorted_idx), expected_idx)
+    assert np.array_equal(dpt.asnumpy(sorted_keys), Xnp[expected_idx])
+
+
 def test_select_samples_far_from_centroid_kernel():
     dataT = dpt.float32
     indT = dpt.int32
@@ -178,6 +239,48 @@ def test_select_samples_far_from_centroid_kernel():
     assert np.all(Xnp[dpt.asnumpy(selected_samples_idx[1-int(n_selected_eq_threshold):])] == float(threshold))
 
 
+def test_select_samples_far_from_centroid_kernel_ties_in_order():
+    dataT = dpt.float32
+    indT = dpt.int32
+    n = 10**5
+    n_empty_clusters = 5
+    # a single value above the threshold, and many ties with it
+    Xnp = np.random.randint(0, 50, size=n).astype(dataT)
+    Xnp[1234] = 100
+
+    distance_to_centroid = dpt.asarray(Xnp, dtype=dataT)
+    threshold = dpt.empty(tuple(), dtype=dataT)
+
+    selected_samples_idx = dpt.full(n, -1, dtype=indT)
+    n_selected_gt_threshold = dpt.zeros(tuple(), dtype=indT)
+    n_selected_eq_threshold = dpt.ones(tuple(), dtype=indT)
+
+    q = threshold.sycl_queue
+    ht_ev, c_ev = kdp.compute_threshold(
+        distance_to_centroid, n_empty_clusters, threshold, sycl_queue=q)
+
+    ht_ev2, _ = kdp.select_samples_far_from_centroid(
+        n_empty_clusters, distance_to_centroid, threshold,
+        selected_samples_idx, n_selected_gt_threshold, n_selected_eq_threshold,
+        work_group_size=256,
+        sycl_queue=q,
+        depends=[c_ev]
+    )
+
+    ht_ev2.wait()
+    ht_ev.wait()
+
+    assert float(threshold) == 49
+    assert int(n_selected_gt_threshold) == 1
+    assert int(n_selected_eq_threshold) == n_empty_clusters
+    selected_np = dpt.asnumpy(selected_samples_idx)
+    assert selected_np[0] == 1234
+    # first ties in increasing order, from the end backwards
+    expected_ties = np.flatnonzero(Xnp == 49)[:n_empty_clusters - 1]
+    assert np.array_equal(selected_np[::-1][:n_empty_clusters - 1], expected_ties)
+    assert np.all(selected_np[1:-(n_empty_clusters - 1)] == -1)
+
+
 def test_relocate_empty_clusters():
     dataT = np.float32
     indT = np.int32
@@ -457,6 +560,44 @@ def test_lloyd_single_step():
     )
 
 
+# corners of the cube [-1, 1]^3, centers of the clouds of _corner_clouds
+_corners = np.array([
+    [1,1,1], [1,1,-1], [1,-1,1], [-1,1,1], [1,-1,-1], [-1,1,-1], [-1,-1,1], [-1,-1,-1]
+])
+
+
+def _corner_clouds_np(cloud_size, dataT, noise=0.1, on_sphere=False):
+    """Clouds of cloud_size samples around each corner of the cube, one after
+    the other, projected on the unit sphere when on_sphere is true."""
+    rs = np.random.default_rng(seed=12345)
+    Xnp = np.concatenate([
+        rs.normal(0, noise, size=(cloud_size,3)).astype(dataT) + p for p in _corners.astype(dataT)
+    ], axis=0)
+    if on_sphere:
+        Xnp /= np.linalg.norm(Xnp, axis=1, keepdims=True)
+    return Xnp
+
+
+def _corner_clouds(cloud_size, dataT, q=None, **kwargs):
+    """Returns samples of _corner_clouds_np, their transpose X_t on q, and the
+    corners as initial centroids on the queue of X_t."""
+    Xnp = _corner_clouds_np(cloud_size, dataT, **kwargs)
+    X_t = dpt.asarray(np.ascontiguousarray(Xnp.T), dtype=dataT, sycl_queue=q)
+    init_centroids_t = dpt.asarray(
+        np.ascontiguousarray(_corners.T), dtype=dataT, sycl_queue=X_t.sycl_queue)
+    return Xnp, X_t, init_centroids_t
+
+
+def _lloyd_driver_outputs(init_centroids_t, n_samples, indT):
+    """Unit sample weights, and arrays of labels and centroids for results of
+    a driver, on the queue of init_centroids_t."""
+    q = init_centroids_t.sycl_queue
+    sample_weight = dpt.ones(n_samples, dtype=init_centroids_t.dtype, sycl_queue=q)
+    assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+    res_centroids_t = dpt.empty_like(init_centroids_t)
+    return sample_weight, assignment_ids, res_centroids_t
+
+
 def test_kmeans_lloyd_driver():
     # kmeans_lloyd_driver(
     #    X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t, 
@@ -469,28 +610,14 @@ def test_kmeans_lloyd_driver():
 
     cloud_size = 32
 
-    ps = np.array([
-        [1,1,1], [1,1,-1], [1,-1,1], [-1,1,1], [1,-1,-1], [-1,1,-1], [-1,-1,1], [-1,-1,-1]
-    ], dtype=dataT)
-    rs = np.random.default_rng(seed=12345)
-    Xnp = np.concatenate([
-        rs.normal(0, 0.1, size=(cloud_size,3)).astype(dataT) + p for p in ps
-    ], axis=0)
-    Xnp_t = np.ascontiguousarray(Xnp.T)
-    Cnt = np.ascontiguousarray(ps.T)
-
-    Xt = dpt.asarray(Xnp_t, dtype=dataT)
+    _, Xt, init_centroids_t = _corner_clouds(cloud_size, dataT)
     n_features, n_samples = Xt.shape
     assert n_features == 3
 
-    n_clusters = ps.shape[0]
     assert Xt.flags.c_contiguous
-    init_centroids_t = dpt.asarray(Cnt, dtype=dataT)
     assert init_centroids_t.flags.c_contiguous
 
-    res_centroids_t = dpt.empty_like(init_centroids_t)
-    sample_weight = dpt.ones(n_samples, dtype=dataT)
-    assignment_ids = dpt.empty(n_samples, dtype=indT)
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
 
     q = Xt.sycl_queue
 
@@ -513,3 +640,928 @@ def test_kmeans_lloyd_driver():
 
     assert n_iters_ < max_iters
     assert n_iters_ == 2
+
+
+def test_kmeans_lloyd_driver_accumulate_in_double():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    q = dpctl.SyclQueue()
+    if not q.sycl_device.has_aspect_fp64:
+        pytest.skip("Device does not support double precision")
+
+    cloud_size = 32
+
+    Xnp, Xt, init_centroids_t = _corner_clouds(cloud_size, dataT, q)
+    n_features, n_samples = Xt.shape
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+        Xt, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7,
+        q, accumulate_in_double=True
+    )
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    expected_centroids_t = np.reshape(Xnp.T, (n_features, 8, cloud_size)).astype(np.float64).mean(axis=-1)
+    assert np.allclose(
+        dpt.asnumpy(res_centroids_t), expected_centroids_t, rtol=np.finfo(dataT).resolution
+    )
+
+
+def test_kmeans_lloyd_driver_row_major():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp, _, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    q = init_centroids_t.sycl_queue
+    X = dpt.asarray(Xnp, dtype=dataT, sycl_queue=q)
+    n_samples, n_features = X.shape
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+        X, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7,
+        q, X_row_major=True
+    )
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+    assert n_iters_ == 2
+
+    expected_inertia = np.sum(np.square(Xnp - np.repeat(dpt.asnumpy(res_centroids_t).T, cloud_size, axis=0)))
+    assert np.allclose(float(total_inertia), expected_inertia, rtol=1e-4)
+
+
+def _dense_to_csr(Xnp, indT):
+    mask = Xnp != 0
+    data = Xnp[mask]
+    indices = np.nonzero(mask)[1].astype(indT)
+    indptr = np.concatenate([[0], np.cumsum(mask.sum(axis=1))]).astype(indT)
+    return data, indices, indptr
+
+
+def test_kmeans_lloyd_driver_csr():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+    n_features = 16
+
+    rs = np.random.default_rng(seed=12345)
+    ps = np.zeros((4, n_features), dtype=dataT)
+    for i in range(4):
+        ps[i, 4 * i : 4 * (i + 1)] = 1
+    Xnp = np.concatenate([
+        p * rs.uniform(0.9, 1.1, size=(cloud_size, n_features)).astype(dataT) for p in ps
+    ], axis=0)
+    n_samples = Xnp.shape[0]
+
+    data_np, indices_np, indptr_np = _dense_to_csr(Xnp, np.int32)
+    q = dpctl.SyclQueue()
+    data = dpt.asarray(data_np, dtype=dataT, sycl_queue=q)
+    indices = dpt.asarray(indices_np, dtype=indT, sycl_queue=q)
+    indptr = dpt.asarray(indptr_np, dtype=indT, sycl_queue=q)
+
+    init_centroids_t = dpt.asarray(np.ascontiguousarray(ps.T), dtype=dataT, sycl_queue=q)
+    res_centroids_t = dpt.empty_like(init_centroids_t)
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+    assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver_csr(
+        data, indices, indptr, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 128, 0.7,
+        q
+    )
+
+    expected_ids = np.repeat(np.arange(4, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    expected_centroids = np.reshape(Xnp, (4, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, expected_centroids, rtol=1e-5)
+
+    expected_inertia = np.sum(np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)))
+    assert np.allclose(float(total_inertia), expected_inertia, rtol=1e-3)
+
+
+def test_kmeans_lloyd_driver_csr_single_copy_exceeding_cache():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    n_features = 20000
+    n_clusters = 64
+    cloud_size = 16
+    occupancy = 1e-3
+
+    q = dpctl.SyclQueue()
+    # a copy of n_clusters * (n_features + 1) items does not fit in the
+    # fraction of the cache, the count of copies is clamped to 1, not 0
+    probe = dpt.empty(1, dtype=dataT, sycl_queue=q)
+    cache_size = q.sycl_device.global_mem_cache_size
+    assert cache_size * occupancy < n_clusters * (n_features + 1) * 4
+    n_copies = kdp.compute_number_of_private_copies(
+        probe, n_clusters * cloud_size, n_features, n_clusters, occupancy, 128)
+    assert n_copies == 1
+
+    # each cluster is a cloud on its own few features
+    rs = np.random.default_rng(seed=0)
+    ps = np.zeros((n_clusters, n_features), dtype=dataT)
+    for i in range(n_clusters):
+        ps[i, 3 * i : 3 * (i + 1)] = 1
+    Xnp = np.concatenate([
+        p * rs.uniform(0.9, 1.1, size=(cloud_size, n_features)).astype(dataT) for p in ps
+    ], axis=0)
+    n_samples = Xnp.shape[0]
+
+    data_np, indices_np, indptr_np = _dense_to_csr(Xnp, np.int32)
+    data = dpt.asarray(data_np, dtype=dataT, sycl_queue=q)
+    indices = dpt.asarray(indices_np, dtype=indT, sycl_queue=q)
+    indptr = dpt.asarray(indptr_np, dtype=indT, sycl_queue=q)
+
+    init_centroids_t = dpt.asarray(np.ascontiguousarray(ps.T), dtype=dataT, sycl_queue=q)
+    res_centroids_t = dpt.empty_like(init_centroids_t)
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+    assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+
+    kdp.kmeans_lloyd_driver_csr(
+        data, indices, indptr, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 10, 128, occupancy,
+        q
+    )
+
+    expected_ids = np.repeat(np.arange(n_clusters, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    expected_centroids = np.reshape(Xnp, (n_clusters, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, expected_centroids, rtol=1e-5)
+
+    # column indices out of [0, n_features) are rejected
+    bad_indices = dpt.asarray(
+        np.where(indices_np == indices_np.max(), n_features, indices_np).astype(np.int32), dtype=indT, sycl_queue=q)
+    with pytest.raises(ValueError):
+        kdp.kmeans_lloyd_driver_csr(
+            data, bad_indices, indptr, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 10, 128, occupancy,
+            q
+        )
+
+
+def test_kmeans_lloyd_driver_streaming(tmp_path):
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp = _corner_clouds_np(cloud_size, dataT)
+    n_samples, n_features = Xnp.shape
+
+    # X_t is read from a memory-mapped file, in chunks not dividing n_samples
+    X_t_mm = np.memmap(tmp_path / "X_t.raw", dtype=dataT, mode="w+", shape=(n_features, n_samples))
+    X_t_mm[...] = Xnp.T
+    X_t_mm.flush()
+
+    q = dpctl.SyclQueue()
+    init_centroids_t = dpt.asarray(np.ascontiguousarray(_corners.T), dtype=dataT, sycl_queue=q)
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver_streaming(
+        X_t_mm, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7, 50,
+        q
+    )
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+    assert n_iters_ == 2
+
+    expected_centroids = np.reshape(Xnp, (8, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, expected_centroids, rtol=1e-4, atol=1e-6)
+
+    expected_inertia = np.sum(np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)))
+    assert np.allclose(float(total_inertia), expected_inertia, rtol=1e-4)
+
+
+@pytest.mark.parametrize("fortran_order", [False, True])
+def test_load_X_t(tmp_path, fortran_order):
+    rs = np.random.default_rng(seed=12345)
+    Xnp = rs.normal(size=(1000, 7)).astype(np.float32)
+    if fortran_order:
+        Xnp = np.asfortranarray(Xnp)
+
+    npy_path = tmp_path / "X.npy"
+    np.save(npy_path, Xnp)
+
+    descr, is_fortran, shape, offset = kdp.npy_header(str(npy_path))
+    assert np.dtype(descr) == np.float32
+    assert is_fortran == fortran_order
+    assert shape == Xnp.shape
+
+    X_t = kdp.load_X_t(npy_path, chunk_size=300, n_threads=3)
+    assert X_t.dtype == dpt.float32
+    assert np.array_equal(dpt.asnumpy(X_t), Xnp.T)
+
+    raw_path = tmp_path / "X.raw"
+    np.ascontiguousarray(Xnp).tofile(raw_path)
+    X_t = kdp.load_X_t(raw_path, dtype=dpt.float64, shape=Xnp.shape, raw_dtype=np.float32, chunk_size=256)
+    assert X_t.dtype == dpt.float64
+    assert np.array_equal(dpt.asnumpy(X_t), Xnp.T.astype(np.float64))
+
+
+def test_kmeans_lloyd_driver_profile():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    records = []
+    n_iters_, _ = kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7,
+        q, profile=records
+    )
+
+    names = {r["name"] for r in records}
+    assert {"half_l2_norm", "lloyd_single_step", "reduce_centroid_data", "broadcast_division",
+            "compute_centroid_shifts", "reduce_centroid_shifts", "compute_inertia"} <= names
+    assert sum(r["name"] == "lloyd_single_step" for r in records) == n_iters_
+    assert all(r["end_ns"] >= r["start_ns"] for r in records)
+    assert all(r["gb_per_s"] >= 0 and r["gflop_per_s"] >= 0 for r in records)
+
+
+def test_kmeans_lloyd_driver_callback():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    _, X_t, _ = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+
+    # start from shuffled centroids, with every label wrong
+    init_centroids_t = dpt.asarray(np.ascontiguousarray(_corners[::-1].T), dtype=dataT, sycl_queue=q)
+    sample_weight, _, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+    assignment_ids = dpt.asarray(np.repeat(np.arange(8, dtype=np.int32), cloud_size), dtype=indT, sycl_queue=q)
+
+    metrics = []
+    n_iters_, _ = kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7,
+        q, callback=metrics.append
+    )
+
+    assert len(metrics) == n_iters_
+    assert [m["iteration"] for m in metrics] == list(range(n_iters_))
+    assert metrics[0]["n_changed_labels"] == n_samples
+    assert metrics[-1]["n_changed_labels"] == 0
+    assert all(m["n_empty_clusters"] == 0 for m in metrics)
+    assert metrics[-1]["centroid_shifts_sum"] <= 1e-6
+    assert all(m["lloyd_step_ns"] > 0 and m["inertia_ns"] == 0 for m in metrics)
+
+
+def test_kmeans_lloyd_driver_label_change_tol():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight, _, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+    # labels matching the initial centroids must not be taken for converged ones
+    assignment_ids = dpt.asarray(np.repeat(np.arange(8, dtype=np.int32), cloud_size), dtype=indT, sycl_queue=q)
+
+    metrics = []
+    # strict convergence only, centroid shifts are not computed with tol=0
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        0.0, False, 255, 8, 128, 0.7,
+        q, callback=metrics.append, label_change_tol=0.0
+    )
+
+    assert n_iters_ == 2
+    assert metrics[0]["n_changed_labels"] == n_samples
+    assert metrics[1]["n_changed_labels"] == 0
+    assert all(np.isnan(m["centroid_shifts_sum"]) for m in metrics)
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    expected_centroids = np.reshape(Xnp, (8, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, expected_centroids, rtol=1e-4, atol=1e-6)
+
+
+def test_kmeans_lloyd_driver_skips_final_assignment():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    records = []
+    # the second iteration changes no label, its labels are those of the result
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        0.0, False, 255, 8, 128, 0.7,
+        q, profile=records, label_change_tol=0.0
+    )
+
+    assert n_iters_ == 2
+    names = [r["name"] for r in records]
+    assert "assignment" not in names
+    assert names.count("compute_inertia") == 1
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    expected_centroids = np.reshape(Xnp, (8, cloud_size, n_features)).mean(axis=1)
+    expected_inertia = np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)).sum()
+    assert np.allclose(total_inertia, expected_inertia, rtol=1e-4)
+
+
+def test_kmeans_lloyd_refit():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight, labels, centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    # one new sample close to each cloud
+    rs = np.random.default_rng(seed=54321)
+    X_new = _corners.astype(dataT) + rs.normal(0, 0.1, size=_corners.shape).astype(dataT)
+
+    kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, labels, centroids_t,
+        0.0, False, 255, 8, 128, 0.7,
+        q, label_change_tol=0.0
+    )
+
+    X2np = np.concatenate([Xnp, X_new], axis=0)
+    X2_t = dpt.asarray(np.ascontiguousarray(X2np.T), dtype=dataT, sycl_queue=q)
+    sample_weight2 = dpt.ones(X2np.shape[0], dtype=dataT, sycl_queue=q)
+
+    metrics = []
+    n_iters_, total_inertia, assignment_id, res_centroids_t = kdp.kmeans_lloyd_refit(
+        X2_t, sample_weight2, centroids_t, labels, callback=metrics.append
+    )
+
+    # previous labels are kept, only appended samples change label
+    assert metrics[0]["n_changed_labels"] == len(_corners)
+    assert n_iters_ == 2
+
+    expected_ids = np.concatenate([np.repeat(np.arange(8, dtype=indT), cloud_size), np.arange(8, dtype=indT)])
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_id))
+    assert np.array_equal(dpt.asnumpy(labels), expected_ids[:n_samples])
+
+    expected_centroids = np.stack([X2np[expected_ids == k].mean(axis=0) for k in range(8)])
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, expected_centroids, rtol=1e-4, atol=1e-6)
+
+
+def test_online_kmeans_partial_fit():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+    chunk_size = 50
+
+    Xnp, _, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    rs = np.random.default_rng(seed=12345)
+    Xnp = Xnp[rs.permutation(Xnp.shape[0])]
+    n_samples, n_features = Xnp.shape
+    q = init_centroids_t.sycl_queue
+    ps = _corners.astype(dataT)
+
+    state = kdp.OnlineKMeans(init_centroids_t, chunk_size)
+
+    labels = []
+    for start in range(0, n_samples, chunk_size):
+        X_chunk = Xnp[start:start + chunk_size]
+        X_chunk_t = dpt.asarray(np.ascontiguousarray(X_chunk.T), dtype=dataT, sycl_queue=q)
+        sample_weight = dpt.ones(X_chunk.shape[0], dtype=dataT, sycl_queue=q)
+        assignment_id = dpt.empty(X_chunk.shape[0], dtype=indT, sycl_queue=q)
+        ht, _ = state.partial_fit(X_chunk_t, sample_weight, assignment_id)
+        ht.wait()
+        labels.append(dpt.asnumpy(assignment_id))
+
+    assert state.n_seen_samples == n_samples
+
+    labels = np.concatenate(labels)
+    expected_labels = np.argmin(np.square(Xnp[:, np.newaxis, :] - ps[np.newaxis, :, :]).sum(axis=-1), axis=1)
+    assert np.array_equal(labels, expected_labels)
+
+    centroids_t = dpt.empty_like(init_centroids_t)
+    cluster_weights = dpt.empty(ps.shape[0], dtype=dataT, sycl_queue=q)
+    ht1, _ = state.copy_centroids_t(centroids_t)
+    ht2, _ = state.copy_cluster_weights(cluster_weights)
+    ht1.wait()
+    ht2.wait()
+
+    # with no decay, centroids are the means of all samples assigned so far
+    expected_centroids = np.stack([Xnp[expected_labels == k].mean(axis=0) for k in range(ps.shape[0])])
+    assert np.allclose(dpt.asnumpy(centroids_t).T, expected_centroids, rtol=1e-4, atol=1e-6)
+    assert np.array_equal(dpt.asnumpy(cluster_weights), np.full(ps.shape[0], cloud_size, dtype=dataT))
+
+
+def test_online_kmeans_accumulate_in_double():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    q = dpctl.SyclQueue()
+    if not q.sycl_device.has_aspect_fp64:
+        pytest.skip("Device does not support double precision")
+
+    n_chunks = 4
+    chunk_size = 200
+    n_features = 2
+
+    rs = np.random.default_rng(seed=0)
+    init_centroids_t = dpt.zeros((n_features, 1), dtype=dataT, sycl_queue=q)
+    state = kdp.OnlineKMeans(init_centroids_t, chunk_size, accumulate_in_double=True)
+
+    # a sum of single precision weights of 0.1 is exact in double precision,
+    # but not once rounded to single precision
+    weight = np.float32(0.1)
+    for _ in range(n_chunks):
+        X_chunk_t = dpt.asarray(rs.normal(size=(n_features, chunk_size)).astype(dataT), sycl_queue=q)
+        sample_weight = dpt.full(chunk_size, weight, dtype=dataT, sycl_queue=q)
+        ht, _ = state.partial_fit(X_chunk_t, sample_weight)
+        ht.wait()
+
+    cluster_weights = dpt.empty(1, dtype=dpt.float64, sycl_queue=q)
+    ht, _ = state.copy_cluster_weights(cluster_weights)
+    ht.wait()
+
+    assert float(cluster_weights[0]) == n_chunks * chunk_size * float(weight)
+
+
+def test_build_coreset():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 1024
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    ps = _corners.astype(dataT)
+
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+    # rough centroids, slightly off
+    rough_centroids_t = dpt.asarray(np.ascontiguousarray((0.8 * ps).T), dtype=dataT, sycl_queue=q)
+
+    coreset_size = 400
+    coreset_X_t, coreset_weight = kdp.build_coreset(
+        X_t, sample_weight, rough_centroids_t, coreset_size, 42, 8, 128, q
+    )
+
+    n_coreset_samples = coreset_X_t.shape[1]
+    assert coreset_X_t.shape[0] == n_features
+    assert coreset_weight.shape == (n_coreset_samples,)
+    assert abs(n_coreset_samples - coreset_size) < 4 * np.sqrt(coreset_size)
+
+    # same seed, same coreset
+    coreset_X_t2, _ = kdp.build_coreset(
+        X_t, sample_weight, rough_centroids_t, coreset_size, 42, 8, 128, q
+    )
+    assert coreset_X_t2.shape == coreset_X_t.shape
+
+    weights = dpt.asnumpy(coreset_weight)
+    assert np.all(weights >= 1)
+    assert np.isclose(weights.sum(), n_samples, rtol=0.2)
+
+    # coreset samples are samples of X
+    X_coreset = dpt.asnumpy(coreset_X_t).T
+    assert np.all(np.isin(X_coreset[:, 0], Xnp[:, 0]))
+
+    res_centroids_t = dpt.empty_like(init_centroids_t)
+    assignment_ids = dpt.empty(n_coreset_samples, dtype=indT, sycl_queue=q)
+    kdp.kmeans_lloyd_driver(
+        coreset_X_t, coreset_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7, q
+    )
+    assert np.allclose(dpt.asnumpy(res_centroids_t).T, ps, atol=0.05)
+
+
+def test_kmeans_bisecting_driver():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 64
+
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT)
+    n_features, n_samples = X_t.shape
+    n_clusters = init_centroids_t.shape[1]
+    # initial centroids are not used, only the shape of the result
+    sample_weight, assignment_ids, centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+    q = X_t.sycl_queue
+
+    total_inertia, split_parents = kdp.kmeans_bisecting_driver(
+        X_t, sample_weight, assignment_ids, centroids_t,
+        1e-6, 100, 0, 8, 128, 0.7, q
+    )
+
+    assert split_parents.shape == (n_clusters - 1,)
+    assert all(split_parents[s] <= s for s in range(n_clusters - 1))
+
+    # every cloud is a cluster
+    labels = dpt.asnumpy(assignment_ids).reshape(n_clusters, cloud_size)
+    assert np.all(labels == labels[:, :1])
+    assert np.array_equal(np.sort(labels[:, 0]), np.arange(n_clusters))
+
+    centroids = dpt.asnumpy(centroids_t).T[labels[:, 0]]
+    expected_centroids = np.reshape(Xnp, (n_clusters, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(centroids, expected_centroids, rtol=1e-4, atol=1e-5)
+
+    expected_inertia = np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)).sum()
+    assert np.allclose(total_inertia, expected_inertia, rtol=1e-3)
+
+
+def test_kmeans_lloyd_driver_spherical():
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    cloud_size = 32
+
+    # directions of clusters are the corners, samples lie on the unit sphere,
+    # and initial centroids, the corners, are not of unit norm: only their
+    # directions matter
+    Xnp, X_t, init_centroids_t = _corner_clouds(cloud_size, dataT, noise=0.05 * np.sqrt(3), on_sphere=True)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight, assignment_ids, res_centroids_t = _lloyd_driver_outputs(init_centroids_t, n_samples, indT)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, 0.7,
+        q, spherical=True
+    )
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, dpt.asnumpy(assignment_ids))
+
+    sums = np.reshape(Xnp, (8, cloud_size, n_features)).sum(axis=1)
+    expected_centroids = sums / np.linalg.norm(sums, axis=1, keepdims=True)
+    centroids = dpt.asnumpy(res_centroids_t).T
+    assert np.allclose(np.linalg.norm(centroids, axis=1), 1, rtol=1e-5)
+    assert np.allclose(centroids, expected_centroids, rtol=1e-4, atol=1e-5)
+
+    cos = np.sum(Xnp * np.repeat(expected_centroids, cloud_size, axis=0), axis=1)
+    assert np.allclose(total_inertia, np.sum(2 * (1 - cos)), rtol=1e-3)
+
+
+# with the smaller occupancy, a single private copy exceeds the fraction of
+# the cache, and shards must still use one
+@pytest.mark.parametrize("occupancy", [0.7, 1e-7])
+def test_kmeans_lloyd_driver_sub_devices(occupancy):
+    dataT = np.float32
+    indT = np.int32
+
+    cloud_size = 32
+
+    Xnp = _corner_clouds_np(cloud_size, dataT)
+    n_samples, n_features = Xnp.shape
+
+    q = dpctl.SyclQueue()
+    assert kdp.numa_sub_devices_count(q) >= 1
+    if occupancy < 0.7:
+        n_clusters = _corners.shape[0]
+        assert q.sycl_device.global_mem_cache_size * occupancy < n_clusters * (n_features + 1) * 4
+
+    X_t = np.ascontiguousarray(Xnp.T)
+    sample_weight = np.ones(n_samples, dtype=dataT)
+    init_centroids_t = np.ascontiguousarray(_corners.T, dtype=dataT)
+    res_centroids_t = np.empty_like(init_centroids_t)
+    assignment_ids = np.empty(n_samples, dtype=indT)
+
+    n_iters_, total_inertia = kdp.kmeans_lloyd_driver_sub_devices(
+        X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+        1e-6, False, 255, 8, 128, occupancy,
+        q
+    )
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, assignment_ids)
+    assert n_iters_ == 2
+
+    expected_centroids = np.reshape(Xnp, (8, cloud_size, n_features)).mean(axis=1)
+    assert np.allclose(res_centroids_t.T, expected_centroids, rtol=1e-4, atol=1e-6)
+
+    expected_inertia = np.sum(np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)))
+    assert np.allclose(float(total_inertia), expected_inertia, rtol=1e-4)
+
+
+@pytest.mark.parametrize("transport", ["in_process", "tcp"])
+def test_kmeans_lloyd_driver_distributed(transport):
+    import socket
+    import threading
+
+    dataT = np.float32
+    indT = np.int32
+
+    cloud_size = 32
+    n_ranks = 3
+
+    Xnp = _corner_clouds_np(cloud_size, dataT)
+    n_samples, n_features = Xnp.shape
+    init_centroids_t = np.ascontiguousarray(_corners.T, dtype=dataT)
+
+    # uneven split of samples between ranks
+    bounds = [0, 50, 170, n_samples]
+
+    if transport == "in_process":
+        comms = kdp.make_in_process_communicators(n_ranks)
+        make_comm = lambda rank: comms[rank]
+    else:
+        with socket.socket() as s:
+            s.bind(("127.0.0.1", 0))
+            port = s.getsockname()[1]
+        make_comm = lambda rank: kdp.TcpCommunicator(rank, n_ranks, "127.0.0.1", port)
+
+    results = [None] * n_ranks
+    errors = []
+
+    def run_rank(rank):
+        try:
+            comm = make_comm(rank)
+            assert comm.rank == rank and comm.size == n_ranks
+
+            X_t = np.ascontiguousarray(Xnp[bounds[rank]:bounds[rank + 1]].T)
+            n_local_samples = X_t.shape[1]
+            res_centroids_t = np.empty_like(init_centroids_t)
+            assignment_ids = np.empty(n_local_samples, dtype=indT)
+
+            n_iters_, total_inertia = kdp.kmeans_lloyd_driver_distributed(
+                comm, X_t, np.ones(n_local_samples, dtype=dataT), init_centroids_t,
+                assignment_ids, res_centroids_t,
+                1e-6, False, 255, 8, 128, 0.7,
+                dpctl.SyclQueue()
+            )
+            results[rank] = (n_iters_, float(total_inertia), assignment_ids, res_centroids_t)
+        except Exception as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=run_rank, args=(rank,)) for rank in range(n_ranks)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    assert not errors, errors
+
+    expected_ids = np.repeat(np.arange(8, dtype=indT), cloud_size)
+    assert np.array_equal(expected_ids, np.concatenate([r[2] for r in results]))
+
+    expected_centroids = np.reshape(Xnp, (8, cloud_size, n_features)).mean(axis=1)
+    expected_inertia = np.sum(np.square(Xnp - np.repeat(expected_centroids, cloud_size, axis=0)))
+    for n_iters_, total_inertia, _, res_centroids_t in results:
+        assert n_iters_ == 2
+        assert np.allclose(res_centroids_t.T, expected_centroids, rtol=1e-4, atol=1e-6)
+        assert np.allclose(total_inertia, expected_inertia, rtol=1e-4)
+        # all ranks hold bitwise identical centroids
+        assert np.array_equal(res_centroids_t, results[0][3])
+
+
+@pytest.mark.parametrize("queue_property", ["in_order", "out_of_order"])
+def test_kmeans_lloyd_driver_double_buffer_private_copies(queue_property):
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    rs = np.random.default_rng(seed=12345)
+    Xnp = rs.normal(size=(1000, 4)).astype(dataT)
+    # last initial centroid is far from all samples, and its cluster gets relocated
+    Cnp = np.concatenate([Xnp[:4], np.full((1, 4), 100, dtype=dataT)], axis=0)
+
+    q = dpctl.SyclQueue(property=queue_property)
+    X_t = dpt.asarray(np.ascontiguousarray(Xnp.T), dtype=dataT, sycl_queue=q)
+    n_features, n_samples = X_t.shape
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+
+    results = []
+    for double_buffer in [False, True]:
+        init_centroids_t = dpt.asarray(np.ascontiguousarray(Cnp.T), dtype=dataT, sycl_queue=q)
+        res_centroids_t = dpt.empty_like(init_centroids_t)
+        assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+
+        n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 100, 8, 128, 0.7,
+            q, double_buffer_private_copies=double_buffer,
+            # fills of private copies are what double buffering overlaps
+            reset_private_copies_in_reduction=False
+        )
+        results.append((n_iters_, float(total_inertia), dpt.asnumpy(assignment_ids), dpt.asnumpy(res_centroids_t)))
+
+    (n_iters_a, inertia_a, ids_a, centroids_a), (n_iters_b, inertia_b, ids_b, centroids_b) = results
+    assert n_iters_a == n_iters_b
+    assert np.array_equal(ids_a, ids_b)
+    assert np.allclose(centroids_a, centroids_b, rtol=1e-5, atol=1e-6)
+    assert np.isclose(inertia_a, inertia_b, rtol=1e-5)
+    assert np.unique(ids_b).size == 5
+
+
+@pytest.mark.parametrize("spherical", [False, True])
+def test_kmeans_lloyd_driver_command_graph(spherical):
+    dataT = dpt.float32
+    indT = dpt.int32
+
+    rs = np.random.default_rng(seed=12345)
+    Xnp = rs.normal(size=(1000, 4)).astype(dataT)
+    if spherical:
+        Xnp /= np.linalg.norm(Xnp, axis=1, keepdims=True)
+    Cnp = Xnp[:6]
+
+    X_t = dpt.asarray(np.ascontiguousarray(Xnp.T), dtype=dataT)
+    n_features, n_samples = X_t.shape
+    q = X_t.sycl_queue
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+
+    results = []
+    for use_command_graph in [False, True]:
+        init_centroids_t = dpt.asarray(np.ascontiguousarray(Cnp.T), dtype=dataT, sycl_queue=q)
+        res_centroids_t = dpt.empty_like(init_centroids_t)
+        assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+
+        n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 100, 8, 128, 0.7,
+            q, spherical=spherical, use_command_graph=use_command_graph,
+            reset_private_copies_in_reduction=False
+        )
+        results.append((n_iters_, float(total_inertia), dpt.asnumpy(assignment_ids), dpt.asnumpy(res_centroids_t)))
+
+    (n_iters_a, inertia_a, ids_a, centroids_a), (n_iters_b, inertia_b, ids_b, centroids_b) = results
+    # replays alternate between two recorded steps, more than 2 iterations exercise both
+    assert n_iters_a > 2
+    assert n_iters_a == n_iters_b
+    assert np.array_equal(ids_a, ids_b)
+    assert np.allclose(centroids_a, centroids_b, rtol=1e-5, atol=1e-6)
+    assert np.isclose(inertia_a, inertia_b, rtol=1e-5)
+
+
+def test_reduce_centroids_data_reset_private_copies():
+    n_copies = 3
+    n_features = 2
+    n_clusters = 4
+
+    dataT = np.dtype('f4')
+    indT = np.dtype('i4')
+
+    sizes_np = np.array([[2, 1, 3, 1], [1, 2, 3, 1], [0, 1, 0, 1]], dtype=dataT)
+    cluster_sizes_private_copies = dpt.asarray(sizes_np, dtype=dataT)
+    Xnp = np.random.randn(n_copies, n_features, n_clusters).astype(dataT)
+    centroids_t_private_copies = dpt.asarray(Xnp, dtype=dataT)
+
+    out_cluster_sizes = dpt.empty(n_clusters, dtype=dataT)
+    out_centroids_t = dpt.empty((n_features, n_clusters,), dtype=dataT)
+    out_empty_clusters_list = dpt.empty((n_clusters,), dtype=indT)
+    out_n_empty_clusters = dpt.zeros((1,), dtype=indT)
+
+    q = cluster_sizes_private_copies.sycl_queue
+    ht, _, = kdp.reduce_centroids_data(
+        cluster_sizes_private_copies, centroids_t_private_copies,
+        out_cluster_sizes, out_centroids_t, out_empty_clusters_list, out_n_empty_clusters,
+        work_group_size=256, sycl_queue=q, reset_private_copies=True
+    )
+    ht.wait()
+
+    assert np.allclose(
+        dpt.asnumpy(out_centroids_t), Xnp.sum(axis=0), rtol = np.finfo(dataT).resolution)
+    assert np.allclose(dpt.asnumpy(out_cluster_sizes), sizes_np.sum(axis=0))
+    # private copies are ready for the next accumulation
+    assert not np.any(dpt.asnumpy(cluster_sizes_private_copies))
+    assert not np.any(dpt.asnumpy(centroids_t_private_copies))
+
+    # and the driver gives the same results either way
+    rs = np.random.default_rng(seed=12345)
+    Xs = rs.normal(size=(1000, 4)).astype(dataT)
+    X_t = dpt.asarray(np.ascontiguousarray(Xs.T), dtype=dataT, sycl_queue=q)
+    sample_weight = dpt.ones(Xs.shape[0], dtype=dataT, sycl_queue=q)
+
+    results = []
+    for reset_in_reduction in [False, True]:
+        init_centroids_t = dpt.asarray(np.ascontiguousarray(Xs[:5].T), dtype=dataT, sycl_queue=q)
+        res_centroids_t = dpt.empty_like(init_centroids_t)
+        assignment_ids = dpt.empty(Xs.shape[0], dtype=indT, sycl_queue=q)
+        n_iters_, _ = kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 100, 8, 128, 0.7,
+            q, reset_private_copies_in_reduction=reset_in_reduction
+        )
+        results.append((n_iters_, dpt.asnumpy(assignment_ids), dpt.asnumpy(res_centroids_t)))
+
+    assert results[0][0] == results[1][0]
+    assert np.array_equal(results[0][1], results[1][1])
+    assert np.allclose(results[0][2], results[1][2], rtol=1e-5, atol=1e-6)
+
+
+@pytest.mark.parametrize("queue_property", ["in_order", "out_of_order"])
+@pytest.mark.parametrize("double_buffer", [False, True])
+@pytest.mark.parametrize("use_command_graph", [False, True])
+def test_kmeans_lloyd_driver_adaptive_private_copies(use_command_graph, double_buffer, queue_property):
+    dataT = np.dtype('f4')
+    indT = np.dtype('i4')
+    n_clusters = 6
+
+    # skewed cluster sizes, most samples are in the first cluster
+    rs = np.random.default_rng(seed=2023)
+    sizes = [3000, 200, 200, 200, 200, 200]
+    Xs = np.concatenate([
+        rs.normal(loc=2 * cluster_idx, size=(size, 3)) for cluster_idx, size in enumerate(sizes)
+    ]).astype(dataT)
+    n_samples = Xs.shape[0]
+    init_idx = np.cumsum([0] + sizes[:-1])
+
+    q = dpctl.SyclQueue(property=queue_property)
+    X_t = dpt.asarray(np.ascontiguousarray(Xs.T), dtype=dataT, sycl_queue=q)
+    sample_weight = dpt.ones(n_samples, dtype=dataT, sycl_queue=q)
+
+    results = []
+    for adaptive_private_copies in [False, True]:
+        init_centroids_t = dpt.asarray(np.ascontiguousarray(Xs[init_idx].T), dtype=dataT, sycl_queue=q)
+        res_centroids_t = dpt.empty_like(init_centroids_t)
+        assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+        n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            0, False, 100, 8, 128, 0.7,
+            q, label_change_tol=0.0,
+            use_command_graph=use_command_graph, adaptive_private_copies=adaptive_private_copies,
+            # with recorded steps, the first replayed step follows a zeroing
+            # submitted ahead by the last tuning step
+            double_buffer_private_copies=double_buffer
+        )
+        results.append((n_iters_, float(total_inertia), dpt.asnumpy(assignment_ids), dpt.asnumpy(res_centroids_t)))
+
+    (n_iters_a, inertia_a, ids_a, _), (n_iters_b, inertia_b, ids_b, _) = results
+    # overlapping clusters take many iterations to converge, during which
+    # tuning runs. Atomics accumulate in a different order with other
+    # configurations, so that labels of samples at boundaries of clusters may
+    # differ, but not the quality of the clustering.
+    assert n_iters_a > 5 and n_iters_b > 5
+    assert np.unique(ids_b).size == n_clusters
+    assert np.isclose(inertia_a, inertia_b, rtol=1e-3)
+
+
+@pytest.mark.parametrize("X_row_major", [False, True])
+def test_kmeans_lloyd_driver_sort_by_label(X_row_major):
+    dataT = np.dtype('f4')
+    indT = np.dtype('i4')
+    # more than 256 clusters, labels of 9 bits are sorted over two passes of
+    # 8 bits digits
+    n_clusters = 300
+
+    # a cluster holds most samples
+    rs = np.random.default_rng(seed=7)
+    sizes = [4000] + [50] * (n_clusters - 1)
+    Xs = np.concatenate([
+        rs.normal(loc=3 * cluster_idx, size=(size, 3)) for cluster_idx, size in enumerate(sizes)
+    ]).astype(dataT)
+    n_samples = Xs.shape[0]
+    init_idx = np.cumsum([0] + sizes[:-1])
+
+    X = np.ascontiguousarray(Xs) if X_row_major else np.ascontiguousarray(Xs.T)
+    X_t = dpt.asarray(X, dtype=dataT)
+    q = X_t.sycl_queue
+    sample_weight = dpt.asarray(rs.uniform(0.5, 2.0, size=n_samples).astype(dataT), sycl_queue=q)
+
+    results = []
+    for update_strategy in ["private_copies", "sort_by_label"]:
+        init_centroids_t = dpt.asarray(np.ascontiguousarray(Xs[init_idx].T), dtype=dataT, sycl_queue=q)
+        res_centroids_t = dpt.empty_like(init_centroids_t)
+        assignment_ids = dpt.empty(n_samples, dtype=indT, sycl_queue=q)
+        n_iters_, total_inertia = kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 100, 8, 128, 0.7,
+            q, X_row_major=X_row_major, update_strategy=update_strategy
+        )
+        results.append((n_iters_, float(total_inertia), dpt.asnumpy(assignment_ids), dpt.asnumpy(res_centroids_t)))
+
+    (n_iters_a, inertia_a, ids_a, centroids_a), (n_iters_b, inertia_b, ids_b, centroids_b) = results
+    assert n_iters_a == n_iters_b
+    assert np.array_equal(ids_a, ids_b)
+    assert np.allclose(centroids_a, centroids_b, rtol=1e-5, atol=1e-5)
+    assert np.isclose(inertia_a, inertia_b, rtol=1e-5)
+
+    with pytest.raises(ValueError):
+        kdp.kmeans_lloyd_driver(
+            X_t, sample_weight, init_centroids_t, assignment_ids, res_centroids_t,
+            1e-6, False, 100, 8, 128, 0.7,
+            q, X_row_major=X_row_major, update_strategy="unknown"
+        )